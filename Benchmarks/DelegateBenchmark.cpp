@@ -0,0 +1,94 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include "Delegate.h"
+#include "HookContainer.h"
+
+namespace
+{
+	std::atomic<size_t> g_allocationCount { 0 };
+}
+
+void* operator new(size_t size)
+{
+	g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* result = std::malloc(size != 0 ? size : 1))
+		return result;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+namespace
+{
+	using Handle = void*;
+
+	// Same shape as a WriteFile monitor.
+	class Owner
+	{
+	public:
+		unsigned long long m_bytes { 0 };
+
+		void WriteFileMonitorHook(Handle, const void*, unsigned long nNumberOfBytesToWrite, unsigned long*, void*, int)
+		{
+			m_bytes += nNumberOfBytesToWrite;
+		}
+	};
+
+	using FunctionMonitor = std::function<void(Handle, const void*, unsigned long, unsigned long*, void*, int)>;
+	using DelegateMonitor = TestHooks::Delegate<void(Handle, const void*, unsigned long, unsigned long*, void*, int)>;
+
+	constexpr int CallCount { 10000000 };
+
+	template<typename Monitor>
+	void Measure(const char* name, Monitor monitor)
+	{
+		TestHooks::HookContainer<Monitor> container;
+
+		size_t allocationsBefore = g_allocationCount.load();
+		TestHooks::FilterCookie cookie = container.AddFilter(monitor);
+		size_t registerAllocations = g_allocationCount.load() - allocationsBefore;
+
+		allocationsBefore = g_allocationCount.load();
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < CallCount; ++i)
+		{
+			unsigned long written = 0;
+			container.ForEachVoidFilter([&](Monitor& monitor) { monitor(nullptr, nullptr, i & 0xff, &written, nullptr, 1); });
+		}
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+		size_t callAllocations = g_allocationCount.load() - allocationsBefore;
+
+		container.RemoveFilter(cookie);
+
+		std::printf("%-40s %12zu %12zu %12.2f\n", name, registerAllocations, callAllocations, elapsed.count() / CallCount);
+	}
+}
+
+int main()
+{
+	Owner owner;
+
+	std::printf("%-40s %12s %12s %12s\n", "monitor", "allocs/add", "allocs/call", "ns/call");
+
+	size_t allocationsBefore = g_allocationCount.load();
+	FunctionMonitor boundFunction = std::bind(&Owner::WriteFileMonitorHook, &owner, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6);
+	std::printf("%-40s %12zu\n", "std::function(std::bind) construction", g_allocationCount.load() - allocationsBefore);
+
+	Measure("std::function(std::bind)", boundFunction);
+	Measure("Delegate::FromMember", DelegateMonitor::FromMember<&Owner::WriteFileMonitorHook>(&owner));
+	Measure("Delegate(lambda capturing this)", DelegateMonitor([ownerPointer = &owner](auto&&... args) { ownerPointer->WriteFileMonitorHook(args...); }));
+
+	return owner.m_bytes == 0;
+}
@@ -0,0 +1,97 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <x86intrin.h>
+#include "MinHook/include/MinHook.h"
+
+// Cycles per call of a hooked function whose detour is within reach of a
+// rel32 jump from the target, which the patch jumps to directly, and of one
+// mapped far away, which is reached through the relay function's indirect
+// jump.
+asm(".text\n"
+	".p2align 4\n"
+	// mov eax, 1; ret
+	".globl BenchmarkTarget\n"
+	"BenchmarkTarget:\n"
+	"	movl $1, %eax\n"
+	"	ret\n");
+
+extern "C" int BenchmarkTarget();
+
+namespace
+{
+	constexpr int CallCount { 20000000 };
+	constexpr int RunCount { 5 };
+
+	int (*volatile g_target)() = &BenchmarkTarget;
+	volatile int g_sink;
+
+	__attribute__((noinline)) int NearDetour()
+	{
+		return 10;
+	}
+
+	// Fewest cycles per call over a few runs, to leave out interruptions.
+	double MeasureCyclesPerCall()
+	{
+		double best = 0;
+		for (int run = 0; run < RunCount; ++run)
+		{
+			int (*target)() = g_target;
+			int sum = 0;
+			uint64_t begin = __rdtsc();
+			for (int i = 0; i < CallCount; ++i)
+				sum += target();
+			uint64_t cycles = __rdtsc() - begin;
+			g_sink = sum;
+
+			double perCall = static_cast<double>(cycles) / CallCount;
+			if (run == 0 || perCall < best)
+				best = perCall;
+		}
+		return best;
+	}
+
+	double MeasureHooked(LPVOID detour)
+	{
+		MH_CreateHook(reinterpret_cast<LPVOID>(&BenchmarkTarget), detour, nullptr);
+		MH_EnableHook(reinterpret_cast<LPVOID>(&BenchmarkTarget));
+		double cycles = MeasureCyclesPerCall();
+		MH_RemoveHook(reinterpret_cast<LPVOID>(&BenchmarkTarget));
+		return cycles;
+	}
+
+	// mov eax, 10; ret, more than 2 GB away from the target.
+	void* MapFarDetour()
+	{
+		static const unsigned char code[] { 0xB8, 0x0A, 0x00, 0x00, 0x00, 0xC3 };
+		uintptr_t hint = (reinterpret_cast<uintptr_t>(&BenchmarkTarget) + 0x400000000) & ~uintptr_t(0xFFFF);
+		void* detour = mmap(reinterpret_cast<void*>(hint), 0x1000, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (detour != MAP_FAILED)
+			std::memcpy(detour, code, sizeof(code));
+		return detour;
+	}
+}
+
+int main()
+{
+	void* farDetour = MapFarDetour();
+	if (farDetour == MAP_FAILED)
+		return 1;
+
+	MH_Initialize();
+	double unhooked = MeasureCyclesPerCall();
+	double direct = MeasureHooked(reinterpret_cast<LPVOID>(&NearDetour));
+	double relay = MeasureHooked(farDetour);
+	MH_Uninitialize();
+
+	std::printf("%-24s %12s\n", "call", "cycles");
+	std::printf("%-24s %12.2f\n", "unhooked", unhooked);
+	std::printf("%-24s %12.2f\n", "hooked, direct jump", direct);
+	std::printf("%-24s %12.2f\n", "hooked, through relay", relay);
+	std::printf("%-24s %12.2f\n", "saved per call", relay - direct);
+
+	munmap(farDetour, 0x1000);
+	return 0;
+}
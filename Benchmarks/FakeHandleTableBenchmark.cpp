@@ -0,0 +1,133 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FakeHandleTable.h"
+
+namespace
+{
+	struct FakeRegistryKey
+	{
+		int m_value { 0 };
+	};
+
+	// What SerialPortHook used before FakeHandleTable: a counter for new
+	// handles and a map of live ones, behind one mutex.
+	class LockedHandleMap
+	{
+	private:
+		TestHooks::HandleKey m_nextHandle { 0x01000000 };
+		std::map<TestHooks::HandleKey, std::unique_ptr<FakeRegistryKey>> m_handles;
+		std::mutex m_mutex;
+	public:
+		TestHooks::HandleKey Allocate(std::unique_ptr<FakeRegistryKey> payload)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			TestHooks::HandleKey result = m_nextHandle++;
+			m_handles.emplace(result, std::move(payload));
+
+			return result;
+		}
+
+		FakeRegistryKey* Lookup(TestHooks::HandleKey handle)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			auto iterator = m_handles.find(handle);
+			return iterator != std::end(m_handles) ? iterator->second.get() : nullptr;
+		}
+
+		bool Release(TestHooks::HandleKey handle)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_handles.erase(handle) != 0;
+		}
+	};
+
+	class TableAdapter
+	{
+	private:
+		TestHooks::FakeHandleTable m_table;
+	public:
+		TestHooks::HandleKey Allocate(std::unique_ptr<FakeRegistryKey> payload)
+		{
+			return m_table.Allocate(std::move(payload));
+		}
+
+		FakeRegistryKey* Lookup(TestHooks::HandleKey handle)
+		{
+			TestHooks::EpochDomain::ReadGuard guard(TestHooks::EpochDomain::Instance());
+			return m_table.Lookup<FakeRegistryKey>(handle);
+		}
+
+		bool Release(TestHooks::HandleKey handle)
+		{
+			return m_table.Release(handle);
+		}
+	};
+
+	// Every handle is opened, queried LookupsPerHandle times and closed, the
+	// way a test enumerates a device: SetupDiOpenDevRegKey, RegGetValueW..., RegCloseKey.
+	constexpr int LookupsPerHandle { 8 };
+	constexpr auto RunTime { std::chrono::milliseconds(250) };
+
+	template<typename Table>
+	double MeasureOperationsPerSecond(Table& table, unsigned int threadCount)
+	{
+		std::atomic<bool> start { false };
+		std::atomic<bool> stop { false };
+		std::atomic<unsigned long long> totalOperations { 0 };
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 0; i < threadCount; ++i)
+		{
+			threads.emplace_back([&] {
+				while (!start.load(std::memory_order_acquire))
+					std::this_thread::yield();
+
+				unsigned long long operations = 0;
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					TestHooks::HandleKey handle = table.Allocate(std::make_unique<FakeRegistryKey>());
+					for (int lookup = 0; lookup < LookupsPerHandle; ++lookup)
+						table.Lookup(handle)->m_value++;
+					table.Release(handle);
+					operations += LookupsPerHandle + 2;
+				}
+				totalOperations += operations;
+			});
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		start.store(true, std::memory_order_release);
+		std::this_thread::sleep_for(RunTime);
+		stop.store(true);
+
+		for (std::thread& thread : threads)
+			thread.join();
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+		return totalOperations.load() / elapsed.count();
+	}
+}
+
+int main()
+{
+	LockedHandleMap lockedMap;
+	TableAdapter table;
+
+	std::printf("%8s %20s %20s %10s\n", "threads", "locked map ops/s", "handle table ops/s", "speedup");
+	for (unsigned int threadCount = 1; threadCount <= 16; threadCount *= 2)
+	{
+		double locked = MeasureOperationsPerSecond(lockedMap, threadCount);
+		double sharded = MeasureOperationsPerSecond(table, threadCount);
+		std::printf("%8u %20.0f %20.0f %9.2fx\n", threadCount, locked, sharded, sharded / locked);
+	}
+
+	return 0;
+}
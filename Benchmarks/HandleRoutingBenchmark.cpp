@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "Delegate.h"
+#include "HandleRouter.h"
+#include "HookContainer.h"
+
+namespace
+{
+	using Handle = void*;
+	using Filter = TestHooks::Delegate<bool(Handle handle, int& result)>;
+
+	constexpr int CallCount { 2000000 };
+
+	// What a handle owning filter looks like without routing: every filter
+	// runs for every handle and rejects the ones it did not mint.
+	struct OwnedHandle
+	{
+		Handle m_handle;
+
+		bool CloseHandleFilterHook(Handle handle, int& result)
+		{
+			if (handle != m_handle)
+				return false;
+			result = 1;
+			return true;
+		}
+	};
+
+	Handle MakeHandle(size_t index)
+	{
+		return reinterpret_cast<Handle>(0x01000000 + index * 4);
+	}
+
+	template<typename Dispatch>
+	double MeasureNanosecondsPerCall(Dispatch dispatch)
+	{
+		Handle unrelated = reinterpret_cast<Handle>(0x7ff00040);
+		int hits = 0;
+
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < CallCount; ++i)
+			hits += dispatch(unrelated) ? 1 : 0;
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+
+		return hits == 0 ? elapsed.count() / CallCount : -1.0;
+	}
+}
+
+int main()
+{
+	std::printf("%10s %24s %24s\n", "filters", "filter list ns/call", "handle router ns/call");
+	for (size_t filterCount : { 1, 10, 100, 500, 1000 })
+	{
+		std::vector<OwnedHandle> owners(filterCount);
+		TestHooks::HookContainer<Filter> container;
+		TestHooks::HandleRouter<Filter> router;
+		std::vector<TestHooks::FilterCookie> containerCookies;
+		std::vector<TestHooks::FilterCookie> routerCookies;
+
+		for (size_t i = 0; i < filterCount; ++i)
+		{
+			owners[i].m_handle = MakeHandle(i);
+			Filter filter = Filter::FromMember<&OwnedHandle::CloseHandleFilterHook>(&owners[i]);
+			containerCookies.push_back(container.AddFilter(filter));
+			routerCookies.push_back(router.Claim(TestHooks::ToHandleKey(owners[i].m_handle), TestHooks::ToHandleKey(owners[i].m_handle), filter));
+		}
+
+		double listed = MeasureNanosecondsPerCall([&](Handle handle) {
+				int result;
+				return container.ForEachFilterReturningBoolean([&](Filter& filter) { return filter(handle, result); });
+			});
+		double routed = MeasureNanosecondsPerCall([&](Handle handle) {
+				int result;
+				return router.DispatchToOwner(TestHooks::ToHandleKey(handle), [&](Filter& filter) { return filter(handle, result); });
+			});
+		std::printf("%10zu %24.1f %24.1f\n", filterCount, listed, routed);
+
+		for (TestHooks::FilterCookie cookie : containerCookies)
+			container.RemoveFilter(cookie);
+		for (TestHooks::FilterCookie cookie : routerCookies)
+			router.Release(cookie);
+	}
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "HookContainer.h"
+
+namespace
+{
+	using Filter = std::function<bool(int handle, int& result)>;
+
+	// The dispatch strategy HookContainer used before snapshots: one recursive
+	// mutex per container, held while the filter map is walked.
+	class LockedHookContainer
+	{
+	private:
+		TestHooks::FilterCookie m_nextFilterCookie { 1 };
+		std::map<TestHooks::FilterCookie, Filter> m_filters;
+		std::recursive_mutex m_mutex;
+	public:
+		TestHooks::FilterCookie AddFilter(Filter newFilter)
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+			TestHooks::FilterCookie result = m_nextFilterCookie++;
+			m_filters.insert(std::make_pair(result, newFilter));
+
+			return result;
+		}
+
+		void RemoveFilter(TestHooks::FilterCookie cookie)
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_mutex);
+			m_filters.erase(cookie);
+		}
+
+		template<typename Callback>
+		bool ForEachFilterReturningBoolean(Callback doFilter)
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+			return std::any_of(std::begin(m_filters), std::end(m_filters), [&](auto& filterPair) {
+					return doFilter(filterPair.second);
+				});
+		}
+	};
+
+	constexpr int FilterCount { 4 };
+	constexpr auto RunTime { std::chrono::milliseconds(250) };
+
+	template<typename Container>
+	double MeasureCallsPerSecond(Container& container, unsigned int threadCount)
+	{
+		std::atomic<bool> start { false };
+		std::atomic<bool> stop { false };
+		std::atomic<unsigned long long> totalCalls { 0 };
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 0; i < threadCount; ++i)
+		{
+			threads.emplace_back([&, i] {
+				while (!start.load(std::memory_order_acquire))
+					std::this_thread::yield();
+
+				unsigned long long calls = 0;
+				int handle = static_cast<int>(i);
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					int result;
+					container.ForEachFilterReturningBoolean([&](Filter& filter) { return filter(handle, result); });
+					++calls;
+				}
+				totalCalls += calls;
+			});
+		}
+
+		// One writer keeps publishing so the readers also pay for reclamation.
+		std::thread writer([&] {
+			while (!start.load(std::memory_order_acquire))
+				std::this_thread::yield();
+
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				TestHooks::FilterCookie cookie = container.AddFilter([](int, int&) { return false; });
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				container.RemoveFilter(cookie);
+			}
+		});
+
+		auto begin = std::chrono::steady_clock::now();
+		start.store(true, std::memory_order_release);
+		std::this_thread::sleep_for(RunTime);
+		stop.store(true);
+
+		for (std::thread& thread : threads)
+			thread.join();
+		writer.join();
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+		return totalCalls.load() / elapsed.count();
+	}
+
+	template<typename Container>
+	void AddFilters(Container& container, std::vector<TestHooks::FilterCookie>& cookies)
+	{
+		for (int i = 0; i < FilterCount; ++i)
+			cookies.push_back(container.AddFilter([i](int handle, int& result) {
+					if (handle != -1 - i)
+						return false;
+					result = i;
+					return true;
+				}));
+	}
+}
+
+int main()
+{
+	TestHooks::HookContainer<Filter> snapshotContainer;
+	LockedHookContainer lockedContainer;
+
+	std::vector<TestHooks::FilterCookie> snapshotCookies;
+	std::vector<TestHooks::FilterCookie> lockedCookies;
+	AddFilters(snapshotContainer, snapshotCookies);
+	AddFilters(lockedContainer, lockedCookies);
+
+	std::printf("%8s %20s %20s %10s\n", "threads", "locked calls/s", "snapshot calls/s", "speedup");
+	for (unsigned int threadCount = 1; threadCount <= 64; threadCount *= 2)
+	{
+		double locked = MeasureCallsPerSecond(lockedContainer, threadCount);
+		double snapshot = MeasureCallsPerSecond(snapshotContainer, threadCount);
+		std::printf("%8u %20.0f %20.0f %9.2fx\n", threadCount, locked, snapshot, snapshot / locked);
+	}
+
+	for (TestHooks::FilterCookie cookie : snapshotCookies)
+		snapshotContainer.RemoveFilter(cookie);
+	for (TestHooks::FilterCookie cookie : lockedCookies)
+		lockedContainer.RemoveFilter(cookie);
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "MinHook/include/MinHook.h"
+
+namespace
+{
+	constexpr int ToggleCount { 1000 };
+
+	// Read, write and execute memory for the target.
+	unsigned char* AllocateCode(size_t size)
+	{
+#ifdef _WIN32
+		return static_cast<unsigned char*>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+#else
+		void* code = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return code != MAP_FAILED ? static_cast<unsigned char*>(code) : nullptr;
+#endif
+	}
+
+	void FreeCode(void* code, size_t size)
+	{
+#ifdef _WIN32
+		(void)size;
+		VirtualFree(code, 0, MEM_RELEASE);
+#else
+		munmap(code, size);
+#endif
+	}
+
+	int Detour()
+	{
+		return 2;
+	}
+
+	// mov eax, 1; ret. One instruction covers the whole jump, so the hook
+	// can be patched atomically.
+	LPVOID CreateTarget()
+	{
+		unsigned char* target = AllocateCode(16);
+		const unsigned char code[] = { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3 };
+		std::memcpy(target, code, sizeof(code));
+		return target;
+	}
+
+	double MeasureMicrosecondsPerToggle(LPVOID target)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < ToggleCount; ++i)
+		{
+			MH_EnableHook(target);
+			MH_DisableHook(target);
+		}
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - begin;
+
+		return elapsed.count() / ToggleCount;
+	}
+}
+
+int main()
+{
+	MH_Initialize();
+
+	LPVOID target = CreateTarget();
+	MH_CreateHook(target, reinterpret_cast<LPVOID>(&Detour), nullptr);
+
+	std::printf("%-10s %16s %16s\n", "threads", "freeze us", "atomic us");
+	for (size_t threadCount : { 0, 8, 64, 256 })
+	{
+		// Threads that keep calling the target while it is patched.
+		std::atomic<bool> stop { false };
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < threadCount; ++i)
+		{
+			threads.emplace_back([&stop, target]()
+			{
+				auto function = reinterpret_cast<int (*)()>(target);
+				while (!stop)
+				{
+					function();
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+		}
+
+		MH_SetAtomicPatching(FALSE);
+		double frozen = MeasureMicrosecondsPerToggle(target);
+		MH_SetAtomicPatching(TRUE);
+		double atomic = MeasureMicrosecondsPerToggle(target);
+
+		stop = true;
+		for (std::thread& thread : threads)
+			thread.join();
+
+		std::printf("%-10zu %16.1f %16.1f\n", threadCount, frozen, atomic);
+	}
+
+	MH_RemoveHook(target);
+	FreeCode(target, 16);
+	MH_Uninitialize();
+
+	return 0;
+}
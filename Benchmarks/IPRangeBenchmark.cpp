@@ -0,0 +1,100 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "MinHook/src/iprange.h"
+
+// The work MinHook's Freeze() does per suspended thread to find out whether
+// its IP has to move, while every other thread of the process is stopped:
+// checking each hook's instruction boundaries, or one search of the sorted
+// patched-range table that is built before the threads are suspended.
+namespace
+{
+	constexpr size_t ThreadCount { 256 };
+
+	struct Hook
+	{
+		uintptr_t m_target;
+		uint8_t m_oldIPs[8];
+		unsigned m_nIP;
+	};
+
+	uintptr_t FindNewIP(const Hook& hook, uintptr_t ip)
+	{
+		for (unsigned i = 0; i < hook.m_nIP; ++i)
+		{
+			if (ip == hook.m_target + hook.m_oldIPs[i])
+				return hook.m_target + 0x1000;
+		}
+		return 0;
+	}
+
+	template<typename Fixup>
+	double MeasureMicrosecondsFrozen(const std::vector<uintptr_t>& threadIPs, Fixup fixup)
+	{
+		uintptr_t moved = 0;
+		auto begin = std::chrono::steady_clock::now();
+		for (uintptr_t ip : threadIPs)
+			moved += fixup(ip);
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - begin;
+
+		if (moved == 1)
+			std::printf(" ");
+		return elapsed.count();
+	}
+}
+
+int main()
+{
+	std::mt19937 random(1);
+
+	std::printf("%zu suspended threads, time spent finding IPs to move\n", ThreadCount);
+	std::printf("%-10s %16s %16s %16s\n", "hooks", "scan us", "table us", "table build us");
+	for (size_t hookCount : { 10, 100, 1000, 10000 })
+	{
+		std::vector<Hook> hooks(hookCount);
+		for (size_t i = 0; i < hookCount; ++i)
+		{
+			hooks[i].m_target = 0x400000 + i * 64 + random() % 32;
+			hooks[i].m_nIP = 3;
+			hooks[i].m_oldIPs[0] = 0;
+			hooks[i].m_oldIPs[1] = 1;
+			hooks[i].m_oldIPs[2] = 4;
+		}
+
+		// Most threads are waiting somewhere in system code; a few are in a prologue.
+		std::vector<uintptr_t> threadIPs;
+		for (size_t i = 0; i < ThreadCount; ++i)
+			threadIPs.push_back(i % 16 == 0 ? hooks[random() % hookCount].m_target + 1 : 0x7ff000000000 + random());
+
+		double scan = MeasureMicrosecondsFrozen(threadIPs, [&](uintptr_t ip)
+		{
+			uintptr_t moved = 0;
+			for (const Hook& hook : hooks)
+			{
+				uintptr_t newIP = FindNewIP(hook, ip);
+				if (newIP != 0)
+					moved = newIP;
+			}
+			return moved;
+		});
+
+		auto begin = std::chrono::steady_clock::now();
+		std::vector<IP_RANGE> ranges;
+		for (size_t i = 0; i < hookCount; ++i)
+			ranges.push_back({ hooks[i].m_target, hooks[i].m_target + hooks[i].m_oldIPs[hooks[i].m_nIP - 1] + 1, static_cast<unsigned>(i) });
+		SortIPRanges(ranges.data(), static_cast<unsigned>(ranges.size()));
+		std::chrono::duration<double, std::micro> build = std::chrono::steady_clock::now() - begin;
+
+		double table = MeasureMicrosecondsFrozen(threadIPs, [&](uintptr_t ip) -> uintptr_t
+		{
+			const IP_RANGE* range = FindIPRange(ranges.data(), static_cast<unsigned>(ranges.size()), ip);
+			return range != nullptr ? FindNewIP(hooks[range->tag], ip) : 0;
+		});
+
+		std::printf("%-10zu %16.1f %16.1f %16.1f\n", hookCount, scan, table, build.count());
+	}
+
+	return 0;
+}
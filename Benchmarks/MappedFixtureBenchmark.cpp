@@ -0,0 +1,146 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "VirtualFileSystem.h"
+
+namespace
+{
+	using TestHooks::FileDisposition;
+	using TestHooks::HandleKey;
+	using TestHooks::VirtualFileSystem;
+
+	constexpr size_t FixtureFileSize { 16 * 1024 * 1024 };
+
+	struct Sample
+	{
+		double m_startupMilliseconds;
+		double m_readMilliseconds;
+		long m_residentKilobytes;
+		long m_anonymousKilobytes;
+	};
+
+	long StatusKilobytes(const char* field)
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			if (line.compare(0, std::strlen(field), field) == 0)
+				return std::strtol(line.c_str() + std::strlen(field), nullptr, 10);
+		}
+		return -1;
+	}
+
+	void CreateFixtures(const std::filesystem::path& directory, size_t fileCount)
+	{
+		std::filesystem::create_directories(directory);
+		std::vector<char> block(1024 * 1024);
+		for (size_t i = 0; i < fileCount; ++i)
+		{
+			std::ofstream file(directory / ("capture" + std::to_string(i) + ".bin"), std::ios::binary);
+			for (size_t done = 0; done < FixtureFileSize; done += block.size())
+			{
+				std::memset(block.data(), static_cast<int>(i + done), block.size());
+				file.write(block.data(), block.size());
+			}
+		}
+	}
+
+	// What a test does without a mount: read every fixture into the file system up front.
+	void LoadEagerly(VirtualFileSystem& fileSystem, const std::filesystem::path& directory)
+	{
+		fileSystem.AddRoot(L"C:\\Fixtures");
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+		{
+			std::ifstream file(entry.path(), std::ios::binary);
+			std::vector<char> contents(static_cast<size_t>(entry.file_size()));
+			file.read(contents.data(), contents.size());
+			fileSystem.AddFile(L"C:\\Fixtures\\" + entry.path().filename().wstring(), contents.data(), contents.size());
+		}
+	}
+
+	// A typical test only reads part of its fixtures: here the first tenth of each file.
+	void ReadFixtures(VirtualFileSystem& fileSystem, size_t fileCount)
+	{
+		std::vector<unsigned char> buffer(64 * 1024);
+		for (size_t i = 0; i < fileCount; ++i)
+		{
+			HandleKey handle;
+			fileSystem.Open(L"C:\\Fixtures\\capture" + std::to_wstring(i) + L".bin", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle);
+			for (size_t done = 0; done < FixtureFileSize / 10; done += buffer.size())
+			{
+				size_t bytesRead;
+				VirtualFileSystem::Read(handle, buffer.data(), buffer.size(), bytesRead);
+			}
+			VirtualFileSystem::Close(handle);
+		}
+	}
+
+	// Runs in a fresh process so that each strategy starts from the same resident set.
+	template<typename Startup>
+	Sample MeasureInChild(Startup startup, size_t fileCount)
+	{
+		int pipeEnds[2];
+		if (pipe(pipeEnds) != 0)
+			std::exit(1);
+
+		pid_t child = fork();
+		if (child == 0)
+		{
+			VirtualFileSystem fileSystem;
+			Sample sample;
+
+			auto begin = std::chrono::steady_clock::now();
+			startup(fileSystem);
+			std::chrono::duration<double, std::milli> startupTime = std::chrono::steady_clock::now() - begin;
+
+			begin = std::chrono::steady_clock::now();
+			ReadFixtures(fileSystem, fileCount);
+			std::chrono::duration<double, std::milli> readTime = std::chrono::steady_clock::now() - begin;
+
+			sample.m_startupMilliseconds = startupTime.count();
+			sample.m_readMilliseconds = readTime.count();
+			sample.m_residentKilobytes = StatusKilobytes("VmRSS:");
+			sample.m_anonymousKilobytes = StatusKilobytes("RssAnon:");
+			ssize_t written = write(pipeEnds[1], &sample, sizeof(sample));
+			_exit(written == sizeof(sample) ? 0 : 1);
+		}
+
+		Sample sample {};
+		if (read(pipeEnds[0], &sample, sizeof(sample)) != sizeof(sample))
+			std::exit(1);
+		waitpid(child, nullptr, 0);
+		close(pipeEnds[0]);
+		close(pipeEnds[1]);
+		return sample;
+	}
+
+	void Print(const char* name, const Sample& sample)
+	{
+		std::printf("%-12s %14.1f %14.1f %14ld %14ld\n", name, sample.m_startupMilliseconds, sample.m_readMilliseconds,
+			sample.m_residentKilobytes / 1024, sample.m_anonymousKilobytes / 1024);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t fileCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "TestHooksFixtureBenchmark";
+	std::filesystem::remove_all(directory);
+	CreateFixtures(directory, fileCount);
+
+	std::printf("%zu fixtures of %zu MB\n", fileCount, FixtureFileSize / (1024 * 1024));
+	std::printf("%-12s %14s %14s %14s %14s\n", "fixtures", "startup ms", "read ms", "RSS MB", "anonymous MB");
+	Print("eager", MeasureInChild([&](VirtualFileSystem& fileSystem) { LoadEagerly(fileSystem, directory); }, fileCount));
+	Print("mapped", MeasureInChild([&](VirtualFileSystem& fileSystem) { fileSystem.MountDirectory(L"C:\\Fixtures", directory); }, fileCount));
+
+	std::filesystem::remove_all(directory);
+	return 0;
+}
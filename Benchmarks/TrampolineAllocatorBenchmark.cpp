@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <sys/mman.h>
+#include "MinHook/src/platform/compat.h"
+#include "MinHook/src/buffer.h"
+
+// MinHook's trampoline slot allocator with 10,000 hooks in many modules,
+// each module far enough from most others that their trampolines cannot
+// share blocks.
+namespace
+{
+	constexpr size_t ModuleCount { 40 };
+	constexpr size_t ModuleSize { 2 * 1024 * 1024 };
+	constexpr uintptr_t ModuleSpacing { 256 * 1024 * 1024 };
+	constexpr size_t TrampolineCount { 10000 };
+
+	template<typename Operation>
+	double MeasureNanosecondsPerTrampoline(size_t count, Operation operation)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; ++i)
+			operation(i);
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+
+		return elapsed.count() / count;
+	}
+
+	// Reserves address space where the modules would be loaded.
+	std::vector<uintptr_t> MapModules()
+	{
+		std::vector<uintptr_t> modules;
+		uintptr_t address = 0x200000000000;
+		for (size_t i = 0; i < ModuleCount; ++i, address += ModuleSpacing)
+		{
+			void* module = mmap(reinterpret_cast<void*>(address), ModuleSize, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (module != MAP_FAILED)
+				modules.push_back(reinterpret_cast<uintptr_t>(module));
+		}
+		return modules;
+	}
+}
+
+int main()
+{
+	std::mt19937 random(3);
+	std::vector<uintptr_t> modules = MapModules();
+
+	std::vector<LPVOID> origins;
+	for (size_t i = 0; i < TrampolineCount; ++i)
+		origins.push_back(reinterpret_cast<LPVOID>(modules[i % modules.size()] + random() % ModuleSize));
+
+	InitializeBuffer();
+
+	std::vector<LPVOID> buffers(TrampolineCount);
+	double allocate = MeasureNanosecondsPerTrampoline(TrampolineCount, [&](size_t i) { buffers[i] = AllocateBuffer(origins[i], MEMORY_SLOT_SIZE); });
+
+	// Unhooking and rehooking a random half, as when reconfiguring: the
+	// freed slots are scattered over the blocks of every module.
+	std::vector<size_t> half(TrampolineCount);
+	for (size_t i = 0; i < TrampolineCount; ++i)
+		half[i] = i;
+	std::shuffle(half.begin(), half.end(), random);
+	half.resize(TrampolineCount / 2);
+
+	double reconfigure = MeasureNanosecondsPerTrampoline(half.size(), [&](size_t i)
+	{
+		FreeBuffer(buffers[half[i]]);
+		buffers[half[i]] = AllocateBuffer(origins[half[i]], MEMORY_SLOT_SIZE);
+	});
+
+	std::shuffle(buffers.begin(), buffers.end(), random);
+	double free = MeasureNanosecondsPerTrampoline(TrampolineCount, [&](size_t i) { FreeBuffer(buffers[i]); });
+
+	UninitializeBuffer();
+
+	std::printf("%zu trampolines in %zu modules\n", TrampolineCount, modules.size());
+	std::printf("%-24s %12s\n", "operation", "ns");
+	std::printf("%-24s %12.1f\n", "allocate", allocate);
+	std::printf("%-24s %12.1f\n", "free + allocate", reconfigure);
+	std::printf("%-24s %12.1f\n", "free", free);
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "MinHook/src/platform/compat.h"
+#include "MinHook/src/trampoline.h"
+
+// How many trampolines BuildTrampoline() makes per second from copies of
+// typical x64 prologues, with no memory to allocate or protect.
+namespace
+{
+	constexpr int BuildCount { 2000000 };
+
+	struct Prologue
+	{
+		const char* name;
+		std::vector<uint8_t> code;
+	};
+
+	const std::vector<Prologue> Prologues
+	{
+		// push rbp; mov rbp, rsp; sub rsp, 0x20
+		{ "frame setup", { 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20 } },
+		// mov rax, [rip + 0x1000]; test rax, rax; je +0x10
+		{ "RIP relative, jcc", { 0x48, 0x8B, 0x05, 0x00, 0x10, 0x00, 0x00, 0x48, 0x85, 0xC0, 0x74, 0x10 } },
+		// sub rsp, 0x28; call +0x100; add rsp, 0x28
+		{ "call", { 0x48, 0x83, 0xEC, 0x28, 0xE8, 0x00, 0x01, 0x00, 0x00, 0x48, 0x83, 0xC4, 0x28 } },
+		// jmp [rip + 0x2000], as in an import thunk
+		{ "import thunk", { 0xFF, 0x25, 0x00, 0x20, 0x00, 0x00, 0xCC, 0xCC } }
+	};
+
+	double MeasureBuildsPerSecond(const Prologue& prologue)
+	{
+		uint8_t output[64];
+		uint8_t oldIPs[TRAMPOLINE_MAX_IPS];
+		uint8_t newIPs[TRAMPOLINE_MAX_IPS];
+		TRAMPOLINE_BUILD build {};
+		build.pCode = prologue.code.data();
+		build.codeSize = static_cast<UINT>(prologue.code.size());
+		build.codeAddress = 0x7F0000001000;
+		build.detourAddress = 0x7F0000300000;
+		build.pOutput = output;
+		build.outputSize = sizeof(output);
+		build.pOldIPs = oldIPs;
+		build.pNewIPs = newIPs;
+		build.maxIP = TRAMPOLINE_MAX_IPS;
+
+		int built = 0;
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < BuildCount; ++i)
+		{
+			build.trampolineAddress = 0x7F0000200000 + (i & 0xFF) * sizeof(output);
+			built += BuildTrampoline(&build) ? 1 : 0;
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+		return built / elapsed.count();
+	}
+}
+
+int main()
+{
+	std::printf("%-24s %16s\n", "prologue", "trampolines/s");
+	for (const Prologue& prologue : Prologues)
+		std::printf("%-24s %16.0f\n", prologue.name, MeasureBuildsPerSecond(prologue));
+
+	return 0;
+}
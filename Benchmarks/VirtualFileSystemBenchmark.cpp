@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "VirtualFileSystem.h"
+
+namespace
+{
+	using TestHooks::FileDisposition;
+	using TestHooks::FileStatus;
+	using TestHooks::HandleKey;
+	using TestHooks::VirtualFileSystem;
+
+	constexpr size_t FileSize { 64 * 1024 * 1024 };
+
+	template<typename Body>
+	double MeasureMegabytesPerSecond(Body body)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		body();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+		return FileSize / (1024.0 * 1024.0) / elapsed.count();
+	}
+
+	// The real file system, through the C runtime, as the I/O of an unhooked test would be.
+	void MeasureRealFile(size_t blockSize, double& write, double& read)
+	{
+		std::vector<unsigned char> block(blockSize, 0x5a);
+		std::FILE* file = std::tmpfile();
+
+		write = MeasureMegabytesPerSecond([&] {
+				for (size_t done = 0; done < FileSize; done += blockSize)
+					std::fwrite(block.data(), 1, blockSize, file);
+				std::fflush(file);
+			});
+		std::rewind(file);
+		read = MeasureMegabytesPerSecond([&] {
+				while (std::fread(block.data(), 1, blockSize, file) == blockSize)
+				{
+				}
+			});
+
+		std::fclose(file);
+	}
+
+	void MeasureVirtualFile(size_t blockSize, double& write, double& read)
+	{
+		std::vector<unsigned char> block(blockSize, 0x5a);
+		VirtualFileSystem fileSystem;
+		fileSystem.AddRoot(L"C:\\Benchmark");
+
+		HandleKey handle;
+		fileSystem.Open(L"C:\\Benchmark\\data.bin", TestHooks::FileAccessWrite, FileDisposition::CreateAlways, handle);
+		write = MeasureMegabytesPerSecond([&] {
+				size_t bytesWritten;
+				for (size_t done = 0; done < FileSize; done += blockSize)
+					VirtualFileSystem::Write(handle, block.data(), blockSize, bytesWritten);
+			});
+		VirtualFileSystem::Close(handle);
+
+		fileSystem.Open(L"C:\\Benchmark\\data.bin", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle);
+		read = MeasureMegabytesPerSecond([&] {
+				size_t bytesRead;
+				while (VirtualFileSystem::Read(handle, block.data(), blockSize, bytesRead) == FileStatus::Success && bytesRead != 0)
+				{
+				}
+			});
+		VirtualFileSystem::Close(handle);
+	}
+}
+
+int main()
+{
+	std::printf("%10s %16s %16s %16s %16s\n", "block", "real write MB/s", "real read MB/s", "vfs write MB/s", "vfs read MB/s");
+	for (size_t blockSize : { 512, 4096, 65536, 1048576 })
+	{
+		double realWrite, realRead, virtualWrite, virtualRead;
+		MeasureRealFile(blockSize, realWrite, realRead);
+		MeasureVirtualFile(blockSize, virtualWrite, virtualRead);
+		std::printf("%10zu %16.0f %16.0f %16.0f %16.0f\n", blockSize, realWrite, realRead, virtualWrite, virtualRead);
+	}
+
+	return 0;
+}
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Delegate.h"
+
+namespace TestHooks
+{
+	// What a producer does when its ring has no room for another event.
+	enum class Backpressure
+	{
+		Drop,		// Discard the event and count it.
+		Block,		// Wait for the consumer to make room.
+		Sample		// Once the ring is half full keep one event in SampleInterval, drop the rest.
+	};
+
+	struct AsyncMonitorStatistics
+	{
+		uint64_t				m_published { 0 };
+		uint64_t				m_consumed { 0 };
+		uint64_t				m_dropped { 0 };
+		uint64_t				m_sampledOut { 0 };
+	};
+
+	// Single producer, single consumer ring of fixed, power of two capacity.
+	template<typename Event>
+	class SpscRing
+	{
+	private:
+		std::unique_ptr<Event[]>		m_events;
+		size_t							m_mask;
+		alignas(64) std::atomic<size_t>	m_writeIndex { 0 };
+		alignas(64) std::atomic<size_t>	m_readIndex { 0 };
+	public:
+		explicit SpscRing(size_t capacity)
+			: m_events(new Event[capacity]),
+			  m_mask(capacity - 1)
+		{
+			assert((capacity & m_mask) == 0);
+		}
+
+		size_t Capacity() const
+		{
+			return m_mask + 1;
+		}
+
+		size_t Size() const
+		{
+			return m_writeIndex.load(std::memory_order_acquire) - m_readIndex.load(std::memory_order_acquire);
+		}
+
+		size_t WriteIndex() const
+		{
+			return m_writeIndex.load(std::memory_order_acquire);
+		}
+
+		size_t ReadIndex() const
+		{
+			return m_readIndex.load(std::memory_order_acquire);
+		}
+
+		bool TryPush(const Event& event)
+		{
+			size_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+			if (writeIndex - m_readIndex.load(std::memory_order_acquire) > m_mask)
+				return false;
+
+			m_events[writeIndex & m_mask] = event;
+			m_writeIndex.store(writeIndex + 1, std::memory_order_release);
+			return true;
+		}
+
+		template<typename Handler>
+		size_t PopBatch(size_t maximum, Handler handler)
+		{
+			size_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+			size_t available = m_writeIndex.load(std::memory_order_acquire) - readIndex;
+			size_t count = available < maximum ? available : maximum;
+
+			for (size_t i = 0; i < count; ++i)
+				handler(m_events[(readIndex + i) & m_mask]);
+
+			m_readIndex.store(readIndex + count, std::memory_order_release);
+			return count;
+		}
+	};
+
+	// Moves monitor calls off the hooked thread. Every producing thread gets
+	// its own SpscRing, so publishing is a copy and a release store; one
+	// background thread drains all rings in batches and hands each event to
+	// the consumer. Rings of exited threads are drained and then reused.
+	// Rings are owned by the pipeline; a thread only keeps a weak reference
+	// to its ring and the id of the pipeline it belongs to, so a pipeline may
+	// be destroyed while threads that published to it are still running, as
+	// long as none of them is inside Publish. Hooks of different APIs may
+	// share an Event type, so a thread keeps one ring per pipeline it
+	// publishes to.
+	template<typename Event>
+	class AsyncMonitorPipeline
+	{
+	public:
+		using Consumer = Delegate<void(Event& event)>;
+
+	private:
+		static constexpr size_t BatchSize { 64 };
+
+		struct Ring
+		{
+			SpscRing<Event>				m_ring;
+			std::atomic<bool>			m_owned { true };
+			std::atomic<uint64_t>		m_dropped { 0 };
+			std::atomic<uint64_t>		m_sampledOut { 0 };
+			uint64_t					m_sampleCounter { 0 };
+
+			explicit Ring(size_t capacity)
+				: m_ring(capacity)
+			{
+			}
+		};
+
+		// m_ring is only used while the pipeline with m_pipelineId is running
+		// Publish, which keeps the ring alive; anything else goes through m_weakRing.
+		struct ThreadRing
+		{
+			uint64_t					m_pipelineId { 0 };
+			Ring*						m_ring { nullptr };
+			std::weak_ptr<Ring>			m_weakRing;
+
+			ThreadRing() = default;
+
+			ThreadRing(ThreadRing&& other) noexcept
+				: m_pipelineId(std::exchange(other.m_pipelineId, 0)),
+				  m_ring(std::exchange(other.m_ring, nullptr)),
+				  m_weakRing(std::move(other.m_weakRing))
+			{
+			}
+
+			ThreadRing& operator=(ThreadRing&& other) noexcept
+			{
+				if (this != &other)
+				{
+					Disown();
+					m_pipelineId = std::exchange(other.m_pipelineId, 0);
+					m_ring = std::exchange(other.m_ring, nullptr);
+					m_weakRing = std::move(other.m_weakRing);
+				}
+				return *this;
+			}
+
+			void Disown()
+			{
+				if (std::shared_ptr<Ring> ring = m_weakRing.lock())
+					ring->m_owned.store(false, std::memory_order_release);
+				m_pipelineId = 0;
+				m_ring = nullptr;
+				m_weakRing.reset();
+			}
+
+			~ThreadRing()
+			{
+				Disown();
+			}
+		};
+
+		static inline std::atomic<uint64_t>	m_nextId { 1 };
+
+		uint64_t						m_id;
+		Consumer						m_consumer;
+		Backpressure					m_backpressure;
+		size_t							m_ringCapacity;
+		unsigned int					m_sampleInterval;
+
+		std::mutex						m_ringsMutex;
+		std::vector<std::shared_ptr<Ring>>	m_rings;
+		std::atomic<size_t>				m_ringCount { 0 };
+
+		std::atomic<uint64_t>			m_consumed { 0 };
+		std::atomic<uint64_t>			m_consumerDropped { 0 };
+		std::atomic<bool>				m_stopping { false };
+		std::mutex						m_wakeMutex;
+		std::condition_variable			m_wake;
+		std::atomic<std::thread::id>	m_consumerThreadId;
+		std::thread						m_consumerThread;
+
+		// Shared by every pipeline of this Event type, so keyed by pipeline id.
+		static std::vector<ThreadRing>& CurrentThreadRings()
+		{
+			static thread_local std::vector<ThreadRing> threadRings;
+			return threadRings;
+		}
+
+		std::shared_ptr<Ring> RegisterThread()
+		{
+			std::lock_guard<std::mutex> lock(m_ringsMutex);
+
+			for (std::shared_ptr<Ring>& ring : m_rings)
+			{
+				bool owned = false;
+				if (ring->m_ring.Size() == 0 && ring->m_owned.compare_exchange_strong(owned, true))
+					return ring;
+			}
+
+			m_rings.push_back(std::make_shared<Ring>(m_ringCapacity));
+			m_ringCount.store(m_rings.size(), std::memory_order_release);
+			return m_rings.back();
+		}
+
+		Ring* RingForCurrentThread()
+		{
+			std::vector<ThreadRing>& threadRings = CurrentThreadRings();
+			for (ThreadRing& threadRing : threadRings)
+			{
+				if (threadRing.m_pipelineId == m_id)
+					return threadRing.m_ring;
+			}
+
+			// Ids are never reused, so entries of destroyed pipelines can only be dropped.
+			std::erase_if(threadRings, [](const ThreadRing& threadRing) { return threadRing.m_weakRing.expired(); });
+
+			std::shared_ptr<Ring> ring = RegisterThread();
+			ThreadRing& threadRing = threadRings.emplace_back();
+			threadRing.m_pipelineId = m_id;
+			threadRing.m_ring = ring.get();
+			threadRing.m_weakRing = ring;
+			return threadRing.m_ring;
+		}
+
+		size_t DrainOnce()
+		{
+			// Rings are only ever appended, and only while m_ringsMutex is held.
+			size_t ringCount = m_ringCount.load(std::memory_order_acquire);
+			size_t consumed = 0;
+			for (size_t i = 0; i < ringCount; ++i)
+			{
+				Ring* ring;
+				{
+					std::lock_guard<std::mutex> lock(m_ringsMutex);
+					ring = m_rings[i].get();
+				}
+				consumed += ring->m_ring.PopBatch(BatchSize, [&](Event& event) { m_consumer(event); });
+			}
+			m_consumed.fetch_add(consumed, std::memory_order_release);
+			return consumed;
+		}
+
+		void ConsumerLoop()
+		{
+			m_consumerThreadId.store(std::this_thread::get_id(), std::memory_order_release);
+			while (!m_stopping.load(std::memory_order_acquire))
+			{
+				if (DrainOnce() == 0)
+				{
+					std::unique_lock<std::mutex> lock(m_wakeMutex);
+					m_wake.wait_for(lock, std::chrono::milliseconds(1));
+				}
+			}
+			while (DrainOnce() != 0)
+			{
+			}
+		}
+
+	public:
+		AsyncMonitorPipeline(Consumer consumer, Backpressure backpressure = Backpressure::Drop, size_t ringCapacity = 4096, unsigned int sampleInterval = 16)
+			: m_id(m_nextId.fetch_add(1, std::memory_order_relaxed)),
+			  m_consumer(consumer),
+			  m_backpressure(backpressure),
+			  m_ringCapacity(ringCapacity),
+			  m_sampleInterval(sampleInterval != 0 ? sampleInterval : 1)
+		{
+			m_consumerThread = std::thread([this] { ConsumerLoop(); });
+		}
+
+		~AsyncMonitorPipeline()
+		{
+			m_stopping.store(true, std::memory_order_release);
+			m_wake.notify_one();
+			m_consumerThread.join();
+		}
+
+		AsyncMonitorPipeline(const AsyncMonitorPipeline&) = delete;
+		AsyncMonitorPipeline& operator=(const AsyncMonitorPipeline&) = delete;
+
+		// Returns false if the event was dropped or sampled out.
+		bool Publish(const Event& event)
+		{
+			// A monitor that calls a hooked API would otherwise feed (or, when blocking, wait on) itself.
+			if (std::this_thread::get_id() == m_consumerThreadId.load(std::memory_order_acquire))
+			{
+				m_consumerDropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			Ring* ring = RingForCurrentThread();
+
+			if (m_backpressure == Backpressure::Sample && ring->m_ring.Size() * 2 >= ring->m_ring.Capacity()
+				&& (ring->m_sampleCounter++ % m_sampleInterval) != 0)
+			{
+				ring->m_sampledOut.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			while (!ring->m_ring.TryPush(event))
+			{
+				if (m_backpressure != Backpressure::Block)
+				{
+					ring->m_dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				m_wake.notify_one();
+				std::this_thread::yield();
+			}
+			return true;
+		}
+
+		// Waits until every event published before the call has been consumed.
+		// On the consumer thread (from inside a monitor) that would wait on
+		// itself, so there it returns false at once.
+		bool Flush()
+		{
+			if (std::this_thread::get_id() == m_consumerThreadId.load(std::memory_order_acquire))
+				return false;
+
+			std::vector<std::pair<Ring*, size_t>> targets;
+			{
+				std::lock_guard<std::mutex> lock(m_ringsMutex);
+				for (std::shared_ptr<Ring>& ring : m_rings)
+					targets.emplace_back(ring.get(), ring->m_ring.WriteIndex());
+			}
+
+			for (auto& target : targets)
+			{
+				while (target.first->m_ring.ReadIndex() < target.second)
+				{
+					m_wake.notify_one();
+					std::this_thread::yield();
+				}
+			}
+			return true;
+		}
+
+		AsyncMonitorStatistics Statistics()
+		{
+			AsyncMonitorStatistics result;
+
+			std::lock_guard<std::mutex> lock(m_ringsMutex);
+			result.m_dropped = m_consumerDropped.load(std::memory_order_relaxed);
+			for (std::shared_ptr<Ring>& ring : m_rings)
+			{
+				result.m_published += ring->m_ring.WriteIndex();
+				result.m_dropped += ring->m_dropped.load(std::memory_order_relaxed);
+				result.m_sampledOut += ring->m_sampledOut.load(std::memory_order_relaxed);
+			}
+			result.m_consumed = m_consumed.load(std::memory_order_acquire);
+
+			return result;
+		}
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace TestHooks
+{
+	// A non-allocating replacement for std::function used to store filters
+	// and monitors. It holds either an object pointer bound to a member
+	// function, or a small trivially copyable callable (a stateless lambda,
+	// a lambda capturing a pointer or two, a function pointer) in place.
+	// A call is one indirect call through the generated stub. An empty
+	// Delegate does nothing when called and returns a value initialized Result.
+	template<typename Signature>
+	class Delegate;
+
+	template<typename Result, typename... Args>
+	class Delegate<Result(Args...)>
+	{
+	private:
+		static constexpr size_t StorageSize { 2 * sizeof(void*) };
+
+		using Stub = Result(*)(const void* storage, Args... args);
+
+		alignas(void*) unsigned char m_storage[StorageSize];
+		Stub m_stub;
+
+		template<typename Callable>
+		static Result InvokeCallable(const void* storage, Args... args)
+		{
+			return (*static_cast<const Callable*>(storage))(std::forward<Args>(args)...);
+		}
+
+		template<auto Member, typename Owner>
+		static Result InvokeMember(const void* storage, Args... args)
+		{
+			Owner* owner = *static_cast<Owner* const*>(storage);
+			return (owner->*Member)(std::forward<Args>(args)...);
+		}
+
+	public:
+		// Whether a Callable fits in place; anything else does not convert to
+		// a Delegate (capture a pointer to the state instead).
+		template<typename Callable>
+		static constexpr bool IsStorable { sizeof(Callable) <= StorageSize && alignof(Callable) <= alignof(void*)
+			&& std::is_trivially_copyable_v<Callable> && std::is_trivially_destructible_v<Callable> };
+
+		Delegate()
+			: m_storage {},
+			  m_stub(nullptr)
+		{
+		}
+
+		template<typename Callable, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Callable>, Delegate> && IsStorable<Callable>>>
+		Delegate(Callable callable)
+			: m_storage {},
+			  m_stub(&InvokeCallable<Callable>)
+		{
+			new (m_storage) Callable(callable);
+		}
+
+		template<auto Member, typename Owner>
+		static Delegate FromMember(Owner* owner)
+		{
+			Delegate result;
+			new (result.m_storage) Owner*(owner);
+			result.m_stub = &InvokeMember<Member, Owner>;
+
+			return result;
+		}
+
+		Result operator()(Args... args) const
+		{
+			if (m_stub == nullptr)
+				return Result();
+			return m_stub(m_storage, std::forward<Args>(args)...);
+		}
+
+		explicit operator bool() const
+		{
+			return m_stub != nullptr;
+		}
+	};
+}
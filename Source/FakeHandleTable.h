@@ -0,0 +1,307 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include "HandleRouter.h"
+#include "HookContainer.h"
+
+namespace TestHooks
+{
+	// Process wide table of the fake handles the hooks hand out (files,
+	// registry keys, device info sets, ...). Each handle carries its slot and
+	// a generation, so a stale or foreign handle never resolves to a live
+	// payload. The table is split into shards with lock free free lists;
+	// allocation and lookup never take a lock.
+	//
+	// Handle layout (all values are multiples of 4, like kernel handles):
+	//   bit  30     always set
+	//   bits 18-29  generation
+	//   bits 14-17  shard
+	//   bits 2-13   slot within the shard
+	//
+	// Payloads are owned by the table. A pointer returned by Lookup stays
+	// valid until the handle is released and the caller's read section ends;
+	// filters run inside one, otherwise hold an EpochDomain::ReadGuard.
+	class FakeHandleTable
+	{
+	public:
+		static constexpr HandleKey		FirstHandle { 0x40000000 };
+		static constexpr HandleKey		LastHandle { 0x7ffffffc };
+
+	private:
+		static constexpr unsigned int	SlotBits { 12 };
+		static constexpr unsigned int	ShardBits { 4 };
+		static constexpr unsigned int	GenerationBits { 12 };
+		static constexpr unsigned int	SlotShift { 2 };
+		static constexpr unsigned int	ShardShift { SlotShift + SlotBits };
+		static constexpr unsigned int	GenerationShift { ShardShift + ShardBits };
+
+		static constexpr uint32_t		SlotsPerShard { 1u << SlotBits };
+		static constexpr uint32_t		ShardCount { 1u << ShardBits };
+		static constexpr uint32_t		GenerationMask { (1u << GenerationBits) - 1 };
+		static constexpr uint32_t		SlotsPerChunk { 256 };
+		static constexpr uint32_t		ChunksPerShard { SlotsPerShard / SlotsPerChunk };
+		static constexpr uint32_t		NoSlot { UINT32_MAX };
+
+		// m_state holds the generation shifted left by one, and whether the slot is live in bit 0.
+		struct Slot
+		{
+			std::atomic<uint32_t>		m_state { 0 };
+			std::atomic<const void*>	m_type { nullptr };
+			std::atomic<void*>			m_payload { nullptr };
+			void						(*m_deleter)(void*) { nullptr };
+			std::atomic<uint32_t>		m_nextFree { NoSlot };
+		};
+
+		struct alignas(64) Shard
+		{
+			std::atomic<Slot*>			m_chunks[ChunksPerShard] {};
+			std::atomic<uint64_t>		m_freeList { NoSlot };		// Slot index, plus an ABA tag in the upper half.
+			std::atomic<uint32_t>		m_nextUnused { 0 };
+			std::atomic<uint32_t>		m_liveCount { 0 };
+		};
+
+		Shard							m_shards[ShardCount];
+
+		template<typename Payload>
+		static const void* TypeId()
+		{
+			static const char id { 0 };
+			return &id;
+		}
+
+		template<typename Payload>
+		static void DeletePayload(void* payload)
+		{
+			delete static_cast<Payload*>(payload);
+		}
+
+		static uint32_t HomeShard()
+		{
+			static thread_local uint32_t homeShard = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()) % ShardCount);
+			return homeShard;
+		}
+
+		Slot* FindSlot(uint32_t shardIndex, uint32_t slotIndex) const
+		{
+			Slot* chunk = m_shards[shardIndex].m_chunks[slotIndex / SlotsPerChunk].load(std::memory_order_acquire);
+			return chunk != nullptr ? &chunk[slotIndex % SlotsPerChunk] : nullptr;
+		}
+
+		// Creates the slot's chunk if needed. Slots that were ever handed out
+		// already have one, and going through here rather than FindSlot keeps
+		// the compiler from seeing a null chunk on those paths.
+		Slot* EnsureSlot(Shard& shard, uint32_t slotIndex)
+		{
+			std::atomic<Slot*>& chunkPointer = shard.m_chunks[slotIndex / SlotsPerChunk];
+			Slot* chunk = chunkPointer.load(std::memory_order_acquire);
+			if (chunk == nullptr)
+			{
+				Slot* newChunk = new Slot[SlotsPerChunk];
+				if (chunkPointer.compare_exchange_strong(chunk, newChunk, std::memory_order_acq_rel))
+					chunk = newChunk;
+				else
+					delete[] newChunk;
+			}
+			return &chunk[slotIndex % SlotsPerChunk];
+		}
+
+		uint32_t PopFree(uint32_t shardIndex)
+		{
+			Shard& shard = m_shards[shardIndex];
+			uint64_t head = shard.m_freeList.load(std::memory_order_acquire);
+			while (static_cast<uint32_t>(head) != NoSlot)
+			{
+				uint32_t slotIndex = static_cast<uint32_t>(head);
+				uint32_t next = EnsureSlot(shard, slotIndex)->m_nextFree.load(std::memory_order_relaxed);
+				uint64_t newHead = ((head >> 32) + 1) << 32 | next;
+				if (shard.m_freeList.compare_exchange_weak(head, newHead, std::memory_order_acq_rel))
+					return slotIndex;
+			}
+
+			uint32_t slotIndex = shard.m_nextUnused.load(std::memory_order_relaxed);
+			while (slotIndex < SlotsPerShard)
+			{
+				if (shard.m_nextUnused.compare_exchange_weak(slotIndex, slotIndex + 1, std::memory_order_relaxed))
+				{
+					EnsureSlot(shard, slotIndex);
+					return slotIndex;
+				}
+			}
+			return NoSlot;
+		}
+
+		void PushFree(uint32_t shardIndex, uint32_t slotIndex)
+		{
+			Shard& shard = m_shards[shardIndex];
+			Slot* slot = EnsureSlot(shard, slotIndex);
+			uint64_t head = shard.m_freeList.load(std::memory_order_relaxed);
+			uint64_t newHead;
+			do
+			{
+				slot->m_nextFree.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+				newHead = ((head >> 32) + 1) << 32 | slotIndex;
+			} while (!shard.m_freeList.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		static bool Decode(HandleKey handle, uint32_t& shardIndex, uint32_t& slotIndex, uint32_t& generation)
+		{
+			if (handle < FirstHandle || handle > LastHandle || (handle & 3) != 0)
+				return false;
+
+			slotIndex = static_cast<uint32_t>(handle >> SlotShift) & (SlotsPerShard - 1);
+			shardIndex = static_cast<uint32_t>(handle >> ShardShift) & (ShardCount - 1);
+			generation = static_cast<uint32_t>(handle >> GenerationShift) & GenerationMask;
+			return true;
+		}
+
+		void* Find(HandleKey handle, const void* type) const
+		{
+			uint32_t shardIndex, slotIndex, generation;
+			if (!Decode(handle, shardIndex, slotIndex, generation))
+				return nullptr;
+
+			Slot* slot = FindSlot(shardIndex, slotIndex);
+			if (slot == nullptr)
+				return nullptr;
+
+			// Validate, read, validate again: a slot can be released and reused concurrently.
+			uint32_t expected = (generation << 1) | 1;
+			if (slot->m_state.load(std::memory_order_acquire) != expected)
+				return nullptr;
+			void* payload = slot->m_payload.load(std::memory_order_acquire);
+			const void* payloadType = slot->m_type.load(std::memory_order_acquire);
+			if (slot->m_state.load(std::memory_order_acquire) != expected || payloadType != type)
+				return nullptr;
+
+			return payload;
+		}
+
+		HandleKey Insert(void* payload, const void* type, void (*deleter)(void*))
+		{
+			uint32_t homeShard = HomeShard();
+			for (uint32_t probe = 0; probe < ShardCount; ++probe)
+			{
+				uint32_t shardIndex = (homeShard + probe) % ShardCount;
+				uint32_t slotIndex = PopFree(shardIndex);
+				if (slotIndex == NoSlot)
+					continue;
+
+				Slot* slot = EnsureSlot(m_shards[shardIndex], slotIndex);
+				uint32_t generation = (slot->m_state.load(std::memory_order_relaxed) >> 1) & GenerationMask;
+				slot->m_deleter = deleter;
+				slot->m_type.store(type, std::memory_order_relaxed);
+				slot->m_payload.store(payload, std::memory_order_relaxed);
+				slot->m_state.store((generation << 1) | 1, std::memory_order_release);
+				m_shards[shardIndex].m_liveCount.fetch_add(1, std::memory_order_relaxed);
+
+				return FirstHandle
+					| static_cast<HandleKey>(generation) << GenerationShift
+					| static_cast<HandleKey>(shardIndex) << ShardShift
+					| static_cast<HandleKey>(slotIndex) << SlotShift;
+			}
+			return 0;
+		}
+
+	public:
+		FakeHandleTable() = default;
+		FakeHandleTable(const FakeHandleTable&) = delete;
+		FakeHandleTable& operator=(const FakeHandleTable&) = delete;
+
+		~FakeHandleTable()
+		{
+			for (uint32_t shardIndex = 0; shardIndex < ShardCount; ++shardIndex)
+			{
+				for (std::atomic<Slot*>& chunkPointer : m_shards[shardIndex].m_chunks)
+				{
+					Slot* chunk = chunkPointer.load();
+					if (chunk == nullptr)
+						continue;
+
+					for (uint32_t i = 0; i < SlotsPerChunk; ++i)
+					{
+						if ((chunk[i].m_state.load() & 1) != 0)
+							chunk[i].m_deleter(chunk[i].m_payload.load());
+					}
+					delete[] chunk;
+				}
+			}
+		}
+
+		static FakeHandleTable& Instance()
+		{
+			static FakeHandleTable table;
+			return table;
+		}
+
+		static bool IsInRange(HandleKey handle)
+		{
+			return handle >= FirstHandle && handle <= LastHandle;
+		}
+
+		// Returns 0 when every slot is in use.
+		template<typename Payload>
+		HandleKey Allocate(std::unique_ptr<Payload> payload)
+		{
+			HandleKey result = Insert(payload.get(), TypeId<Payload>(), &DeletePayload<Payload>);
+			if (result != 0)
+				payload.release();
+			return result;
+		}
+
+		template<typename Payload>
+		Payload* Lookup(HandleKey handle) const
+		{
+			return static_cast<Payload*>(Find(handle, TypeId<Payload>()));
+		}
+
+		template<typename Payload, typename Handle>
+		Payload* Lookup(Handle handle) const
+		{
+			return Lookup<Payload>(ToHandleKey(handle));
+		}
+
+		// Returns false if the handle was not live. The payload is destroyed
+		// once no read section can still be using it.
+		bool Release(HandleKey handle)
+		{
+			uint32_t shardIndex, slotIndex, generation;
+			if (!Decode(handle, shardIndex, slotIndex, generation))
+				return false;
+
+			Slot* slot = FindSlot(shardIndex, slotIndex);
+			if (slot == nullptr)
+				return false;
+
+			uint32_t expected = (generation << 1) | 1;
+			uint32_t released = ((generation + 1) & GenerationMask) << 1;
+			if (!slot->m_state.compare_exchange_strong(expected, released, std::memory_order_acq_rel))
+				return false;
+
+			void* payload = slot->m_payload.exchange(nullptr, std::memory_order_relaxed);
+			void (*deleter)(void*) = slot->m_deleter;
+			m_shards[shardIndex].m_liveCount.fetch_sub(1, std::memory_order_relaxed);
+			PushFree(shardIndex, slotIndex);
+
+			EpochDomain::Instance().Retire(payload, deleter);
+			return true;
+		}
+
+		template<typename Handle>
+		bool Release(Handle handle)
+		{
+			return Release(ToHandleKey(handle));
+		}
+
+		size_t LiveCount() const
+		{
+			size_t result = 0;
+			for (const Shard& shard : m_shards)
+				result += shard.m_liveCount.load(std::memory_order_relaxed);
+			return result;
+		}
+	};
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include "HookContainer.h"
+
+namespace TestHooks
+{
+	using HandleKey = uintptr_t;
+
+	template<typename Handle>
+	HandleKey ToHandleKey(Handle handle)
+	{
+		if constexpr (std::is_pointer_v<Handle>)
+			return reinterpret_cast<HandleKey>(handle);
+		else
+			return static_cast<HandleKey>(handle);
+	}
+
+	// Routes a call to the one filter that claimed its handle. Single handles
+	// live in an open addressed table, claimed ranges in a sorted vector, so
+	// a lookup costs the same however many filters are registered. Like
+	// HookContainer, claims are published as immutable snapshots and looked
+	// up without a lock.
+	template<typename FilterType>
+	class HandleRouter
+	{
+	private:
+		static constexpr uint32_t EmptySlot { 0 };
+
+		struct Route
+		{
+			FilterCookie				m_cookie;
+			HandleKey					m_first;
+			HandleKey					m_last;
+			FilterType					m_filter;
+		};
+
+		struct Snapshot
+		{
+			std::vector<Route>			m_routes;
+			std::vector<uint32_t>		m_slots;		// Route index + 1 of single handle routes.
+			std::vector<uint32_t>		m_ranges;		// Route indices of range routes, by first handle.
+			size_t						m_slotMask { 0 };
+		};
+
+		FilterCookie m_nextFilterCookie;
+		std::atomic<Snapshot*> m_snapshot;
+		std::atomic<size_t> m_activeCount;
+		std::mutex m_writerMutex;
+
+		static size_t HashHandle(HandleKey key)
+		{
+			// Handles are usually multiples of 4; Fibonacci hashing spreads them.
+			return static_cast<size_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> 32);
+		}
+
+		static void DeleteSnapshot(void* snapshot)
+		{
+			delete static_cast<Snapshot*>(snapshot);
+		}
+
+		static Snapshot* BuildSnapshot(std::vector<Route> routes)
+		{
+			if (routes.empty())
+				return nullptr;
+
+			Snapshot* snapshot = new Snapshot;
+			snapshot->m_routes = std::move(routes);
+
+			size_t slotCount = 8;
+			while (slotCount < snapshot->m_routes.size() * 2)
+				slotCount *= 2;
+			snapshot->m_slots.assign(slotCount, EmptySlot);
+			snapshot->m_slotMask = slotCount - 1;
+
+			for (uint32_t i = 0; i < snapshot->m_routes.size(); ++i)
+			{
+				const Route& route = snapshot->m_routes[i];
+				if (route.m_first == route.m_last)
+				{
+					size_t slot = HashHandle(route.m_first) & snapshot->m_slotMask;
+					while (snapshot->m_slots[slot] != EmptySlot)
+						slot = (slot + 1) & snapshot->m_slotMask;
+					snapshot->m_slots[slot] = i + 1;
+				}
+				else
+				{
+					snapshot->m_ranges.push_back(i);
+				}
+			}
+			std::sort(std::begin(snapshot->m_ranges), std::end(snapshot->m_ranges), [&](uint32_t left, uint32_t right) {
+					return snapshot->m_routes[left].m_first < snapshot->m_routes[right].m_first;
+				});
+
+			return snapshot;
+		}
+
+		static Route* FindRoute(Snapshot* snapshot, HandleKey key)
+		{
+			for (size_t slot = HashHandle(key) & snapshot->m_slotMask; snapshot->m_slots[slot] != EmptySlot; slot = (slot + 1) & snapshot->m_slotMask)
+			{
+				Route& route = snapshot->m_routes[snapshot->m_slots[slot] - 1];
+				if (route.m_first == key)
+					return &route;
+			}
+
+			if (snapshot->m_ranges.empty())
+				return nullptr;
+
+			auto iterator = std::upper_bound(std::begin(snapshot->m_ranges), std::end(snapshot->m_ranges), key, [&](HandleKey value, uint32_t index) {
+					return value < snapshot->m_routes[index].m_first;
+				});
+			if (iterator == std::begin(snapshot->m_ranges))
+				return nullptr;
+
+			Route& route = snapshot->m_routes[*std::prev(iterator)];
+			return key <= route.m_last ? &route : nullptr;
+		}
+
+		void Publish(Snapshot* newSnapshot)
+		{
+			Snapshot* oldSnapshot = m_snapshot.exchange(newSnapshot);
+			if (oldSnapshot != nullptr)
+				EpochDomain::Instance().Retire(oldSnapshot, &DeleteSnapshot);
+		}
+
+	public:
+		HandleRouter()
+			: m_nextFilterCookie(1),
+			  m_snapshot(nullptr),
+			  m_activeCount(0)
+		{
+		}
+
+		~HandleRouter()
+		{
+			Snapshot* snapshot = m_snapshot.load();
+			assert(snapshot == nullptr);
+			delete snapshot;
+		}
+
+		HandleRouter(const HandleRouter&) = delete;
+		HandleRouter& operator=(const HandleRouter&) = delete;
+
+		// Claims the handles first..last (inclusive) for filter. Returns
+		// InvalidCookie, and claims nothing, if any of them is already claimed.
+		FilterCookie Claim(HandleKey first, HandleKey last, FilterType filter)
+		{
+			assert(first <= last);
+			std::lock_guard<std::mutex> lock(m_writerMutex);
+
+			std::vector<Route> routes;
+			if (Snapshot* snapshot = m_snapshot.load(std::memory_order_relaxed))
+			{
+				bool overlaps = std::any_of(std::begin(snapshot->m_routes), std::end(snapshot->m_routes), [&](const Route& route) {
+						return first <= route.m_last && route.m_first <= last;
+					});
+				if (overlaps)
+					return InvalidCookie;
+
+				routes.reserve(snapshot->m_routes.size() + 1);
+				routes.insert(std::end(routes), std::begin(snapshot->m_routes), std::end(snapshot->m_routes));
+			}
+
+			FilterCookie result = m_nextFilterCookie++;
+			routes.push_back({ result, first, last, std::move(filter) });
+			Publish(BuildSnapshot(std::move(routes)));
+			m_activeCount.fetch_add(1, std::memory_order_relaxed);
+
+			return result;
+		}
+
+		// Like HookContainer::RemoveFilter, waits for calls still in the filter unless called from a filter.
+		void Release(FilterCookie cookie)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_writerMutex);
+
+				Snapshot* snapshot = m_snapshot.load(std::memory_order_relaxed);
+				assert(snapshot != nullptr);
+				if (snapshot == nullptr)
+					return;
+
+				std::vector<Route> routes;
+				routes.reserve(snapshot->m_routes.size());
+				std::copy_if(std::begin(snapshot->m_routes), std::end(snapshot->m_routes), std::back_inserter(routes), [&](const Route& route) {
+						return route.m_cookie != cookie;
+					});
+				assert(routes.size() + 1 == snapshot->m_routes.size());
+				if (routes.size() == snapshot->m_routes.size())
+					return;
+
+				m_activeCount.fetch_sub(1, std::memory_order_relaxed);
+				Publish(BuildSnapshot(std::move(routes)));
+			}
+
+			EpochDomain::Instance().Synchronize();
+		}
+
+		bool IsEmpty() const
+		{
+			return m_activeCount.load(std::memory_order_relaxed) == 0;
+		}
+
+		// Calls doFilter with the filter that claimed key, if any, and returns its result.
+		template<typename Callback>
+		bool DispatchToOwner(HandleKey key, Callback doFilter)
+		{
+			if (IsEmpty())
+				return false;
+
+			EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+			Snapshot* snapshot = m_snapshot.load();
+			if (snapshot == nullptr)
+				return false;
+
+			Route* route = FindRoute(snapshot, key);
+			return route != nullptr && doFilter(route->m_filter);
+		}
+	};
+}
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace TestHooks
+{
+	using FilterCookie = unsigned int;
+	inline constexpr FilterCookie InvalidCookie { 0 };
+
+	// Epoch based reclamation for the snapshots published by HookContainer.
+	// Readers announce the epoch they entered in, writers retire replaced
+	// snapshots and free them once no reader can still be looking at them.
+	// Publishing never waits for readers, so a filter may add or remove
+	// filters (or call into another hooked API) from inside a read section;
+	// Synchronize waits for the readers when called outside of one. There is
+	// one domain for all containers, so it waits for readers of every one.
+	class EpochDomain
+	{
+	private:
+		static constexpr uint64_t IdleEpoch { std::numeric_limits<uint64_t>::max() };
+		static constexpr size_t ReclaimBatch { 32 };
+		static constexpr unsigned int YieldAttempts { 64 };
+		static constexpr unsigned int MaxSleepShift { 10 };
+
+		struct alignas(64) ReaderRecord
+		{
+			std::atomic<uint64_t>		m_epoch { IdleEpoch };
+			std::atomic<bool>			m_inUse { true };
+			ReaderRecord*				m_next { nullptr };
+		};
+
+		struct RetiredItem
+		{
+			void*						m_pointer;
+			void						(*m_deleter)(void*);
+			uint64_t					m_epoch;
+		};
+
+		struct ThreadState
+		{
+			ReaderRecord*				m_record { nullptr };
+			unsigned int				m_depth { 0 };
+
+			~ThreadState()
+			{
+				if (m_record != nullptr)
+				{
+					m_record->m_epoch.store(IdleEpoch, std::memory_order_release);
+					m_record->m_inUse.store(false, std::memory_order_release);
+				}
+			}
+		};
+
+		std::atomic<uint64_t>			m_globalEpoch { 0 };
+		std::atomic<ReaderRecord*>		m_records { nullptr };
+		std::mutex						m_retiredMutex;
+		std::vector<RetiredItem>		m_retired;
+		size_t							m_reclaimThreshold { ReclaimBatch };
+
+		static ThreadState& CurrentThreadState()
+		{
+			static thread_local ThreadState threadState;
+			return threadState;
+		}
+
+		ReaderRecord* AcquireRecord()
+		{
+			for (ReaderRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->m_next)
+			{
+				bool inUse = false;
+				if (!record->m_inUse.load(std::memory_order_relaxed) && record->m_inUse.compare_exchange_strong(inUse, true))
+					return record;
+			}
+
+			// Records are never freed; a thread that exits hands its record to the next new thread.
+			ReaderRecord* record = new ReaderRecord;
+			ReaderRecord* head = m_records.load(std::memory_order_relaxed);
+			do
+			{
+				record->m_next = head;
+			} while (!m_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+
+			return record;
+		}
+
+		// Yields at first, then sleeps for twice as long each time, up to about
+		// a millisecond, so waiting on a slow filter does not hold a core.
+		static void Backoff(unsigned int attempt)
+		{
+			if (attempt < YieldAttempts)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::microseconds(1u << std::min(attempt - YieldAttempts, MaxSleepShift)));
+		}
+
+		uint64_t OldestActiveEpoch() const
+		{
+			uint64_t oldest = IdleEpoch;
+			for (ReaderRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->m_next)
+				oldest = std::min(oldest, record->m_epoch.load());
+
+			return oldest;
+		}
+
+	public:
+		class ReadGuard
+		{
+		private:
+			ThreadState&				m_state;
+		public:
+			explicit ReadGuard(EpochDomain& domain)
+				: m_state(CurrentThreadState())
+			{
+				if (m_state.m_depth++ == 0)
+				{
+					if (m_state.m_record == nullptr)
+						m_state.m_record = domain.AcquireRecord();
+
+					// Sequentially consistent so the announcement is visible before the snapshot load that follows.
+					m_state.m_record->m_epoch.store(domain.m_globalEpoch.load(std::memory_order_relaxed));
+				}
+			}
+
+			~ReadGuard()
+			{
+				if (--m_state.m_depth == 0)
+					m_state.m_record->m_epoch.store(IdleEpoch, std::memory_order_release);
+			}
+
+			ReadGuard(const ReadGuard&) = delete;
+			ReadGuard& operator=(const ReadGuard&) = delete;
+		};
+
+		~EpochDomain()
+		{
+			for (RetiredItem& item : m_retired)
+				item.m_deleter(item.m_pointer);
+		}
+
+		static EpochDomain& Instance()
+		{
+			static EpochDomain domain;
+			return domain;
+		}
+
+		// Reclaims in batches, so a retire is usually just a push; a batch
+		// that readers keep alive raises the threshold for the next one.
+		void Retire(void* pointer, void (*deleter)(void*))
+		{
+			bool reclaim;
+			{
+				std::lock_guard<std::mutex> lock(m_retiredMutex);
+				m_retired.push_back({ pointer, deleter, m_globalEpoch.fetch_add(1) });
+				reclaim = m_retired.size() >= m_reclaimThreshold;
+			}
+			if (reclaim)
+				Reclaim();
+		}
+
+		void Reclaim()
+		{
+			std::vector<RetiredItem> reclaimable;
+			{
+				std::lock_guard<std::mutex> lock(m_retiredMutex);
+
+				uint64_t oldest = OldestActiveEpoch();
+				auto firstKept = std::partition(std::begin(m_retired), std::end(m_retired), [&](const RetiredItem& item) {
+						return item.m_epoch < oldest;
+					});
+				reclaimable.assign(std::begin(m_retired), firstKept);
+				m_retired.erase(std::begin(m_retired), firstKept);
+				m_reclaimThreshold = std::max(ReclaimBatch, m_retired.size() * 2);
+			}
+
+			// Deleters run outside m_retiredMutex, so destroying a filter may
+			// retire more snapshots. Retire is called with the publishing
+			// container's writer lock held, though, so a deleter must not add
+			// or remove filters of that container.
+			for (RetiredItem& item : reclaimable)
+				item.m_deleter(item.m_pointer);
+		}
+
+		// Waits until every read section that was active on another thread
+		// when it was called has ended, then reclaims what they kept alive.
+		// A thread inside a read section cannot wait for itself, so there it
+		// returns false without waiting.
+		bool Synchronize()
+		{
+			if (CurrentThreadState().m_depth != 0)
+				return false;
+
+			uint64_t epoch = m_globalEpoch.fetch_add(1);
+			for (ReaderRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->m_next)
+			{
+				for (unsigned int attempt = 0; record->m_epoch.load() <= epoch; ++attempt)
+					Backoff(attempt);
+			}
+			Reclaim();
+
+			return true;
+		}
+
+		size_t PendingCount()
+		{
+			std::lock_guard<std::mutex> lock(m_retiredMutex);
+			return m_retired.size();
+		}
+	};
+
+	// Filters are kept in an immutable, cookie ordered snapshot. AddFilter and
+	// RemoveFilter copy the current snapshot, modify the copy and publish it
+	// with a single atomic exchange; the dispatch path takes no lock.
+	// Outside of a filter, RemoveFilter returns once no other thread can
+	// still be running the removed filter, so its owner may then be destroyed.
+	template<typename FilterType>
+	class HookContainer
+	{
+	private:
+		struct Snapshot
+		{
+			std::vector<std::pair<FilterCookie, FilterType>> m_filters;
+		};
+
+		FilterCookie m_nextFilterCookie;
+		std::atomic<Snapshot*> m_snapshot;
+		std::atomic<size_t> m_activeCount;
+		std::mutex m_writerMutex;
+
+		static void DeleteSnapshot(void* snapshot)
+		{
+			delete static_cast<Snapshot*>(snapshot);
+		}
+
+		void Publish(Snapshot* newSnapshot)
+		{
+			Snapshot* oldSnapshot = m_snapshot.exchange(newSnapshot);
+			if (oldSnapshot != nullptr)
+				EpochDomain::Instance().Retire(oldSnapshot, &DeleteSnapshot);
+		}
+
+	public:
+		HookContainer()
+			: m_nextFilterCookie(1),
+			  m_snapshot(nullptr),
+			  m_activeCount(0)
+		{
+		}
+
+		~HookContainer()
+		{
+			Snapshot* snapshot = m_snapshot.load();
+			assert(snapshot == nullptr);
+			delete snapshot;
+		}
+
+		HookContainer(const HookContainer&) = delete;
+		HookContainer& operator=(const HookContainer&) = delete;
+
+		FilterCookie AddFilter(FilterType newFilter)
+		{
+			std::lock_guard<std::mutex> lock(m_writerMutex);
+
+			FilterCookie result = m_nextFilterCookie++;
+
+			Snapshot* newSnapshot = new Snapshot;
+			if (Snapshot* snapshot = m_snapshot.load(std::memory_order_relaxed))
+			{
+				newSnapshot->m_filters.reserve(snapshot->m_filters.size() + 1);
+				newSnapshot->m_filters.insert(std::end(newSnapshot->m_filters), std::begin(snapshot->m_filters), std::end(snapshot->m_filters));
+			}
+			newSnapshot->m_filters.emplace_back(result, std::move(newFilter));
+			Publish(newSnapshot);
+			m_activeCount.fetch_add(1, std::memory_order_relaxed);
+
+			return result;
+		}
+
+		void RemoveFilter(FilterCookie cookie)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_writerMutex);
+
+				Snapshot* snapshot = m_snapshot.load(std::memory_order_relaxed);
+				assert(snapshot != nullptr);
+				if (snapshot == nullptr)
+					return;
+
+				auto iterator = std::find_if(std::begin(snapshot->m_filters), std::end(snapshot->m_filters), [&](auto& filterPair) {
+						return filterPair.first == cookie;
+					});
+				assert(iterator != std::end(snapshot->m_filters));
+				if (iterator == std::end(snapshot->m_filters))
+					return;
+
+				Snapshot* newSnapshot = nullptr;
+				if (snapshot->m_filters.size() > 1)
+				{
+					newSnapshot = new Snapshot;
+					newSnapshot->m_filters.reserve(snapshot->m_filters.size() - 1);
+					newSnapshot->m_filters.insert(std::end(newSnapshot->m_filters), std::begin(snapshot->m_filters), iterator);
+					newSnapshot->m_filters.insert(std::end(newSnapshot->m_filters), std::next(iterator), std::end(snapshot->m_filters));
+				}
+				m_activeCount.fetch_sub(1, std::memory_order_relaxed);
+				Publish(newSnapshot);
+			}
+
+			// Outside the lock; a filter still running on another thread may add or remove filters.
+			EpochDomain::Instance().Synchronize();
+		}
+
+		// A relaxed load of a counter; lets the detours go straight to the
+		// original function without entering a read section.
+		bool IsEmpty() const
+		{
+			return m_activeCount.load(std::memory_order_relaxed) == 0;
+		}
+
+		template<typename Callback>
+		bool ForEachFilterReturningBoolean(Callback doFilter)
+		{
+			if (IsEmpty())
+				return false;
+
+			EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+			Snapshot* snapshot = m_snapshot.load();
+			if (snapshot == nullptr)
+				return false;
+
+			return std::any_of(std::begin(snapshot->m_filters), std::end(snapshot->m_filters), [&](auto& filterPair) {
+					return doFilter(filterPair.second);
+				});
+		}
+
+		template<typename Callback>
+		void ForEachVoidFilter(Callback doFilter)
+		{
+			if (IsEmpty())
+				return;
+
+			EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+			Snapshot* snapshot = m_snapshot.load();
+			if (snapshot == nullptr)
+				return;
+
+			std::for_each(std::begin(snapshot->m_filters), std::end(snapshot->m_filters), [&](auto& filterPair) {
+				doFilter(filterPair.second);
+				});
+		}
+	};
+}
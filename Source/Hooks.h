@@ -1,8 +1,18 @@
 #include <boost/test/data/test_case.hpp>
 #include <boost/test/unit_test.hpp>
 #include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 #include <Windows.h>
 #include "MinHook/include/MinHook.h"
+#include "AsyncMonitorPipeline.h"
+#include "Delegate.h"
+#include "FakeHandleTable.h"
+#include "HandleRouter.h"
+#include "HookContainer.h"
+#include "VirtualFileSystem.h"
 
 #include <setupapi.h>
 #include <winreg.h>
@@ -11,333 +21,256 @@
 
 namespace TestHooks
 {
-	class FakeHandleCreator
+	// Adapts a member function to a hook's Filter or Monitor signature. The
+	// result only captures the owner pointer, so it is stored in place by Delegate.
+	template<auto Member, typename Owner>
+	auto BindMember(Owner* owner)
+	{
+		return [owner](auto&&... args) { return (owner->*Member)(std::forward<decltype(args)>(args)...); };
+	}
+
+	// While a batch is the innermost one on its thread, ApiHooks that need to
+	// create, enable or disable their MinHook hook leave that to the batch.
+	// Commit (or the destructor) then creates every queued hook under one
+	// lock acquisition and enables or disables all of them with a single
+	// suspension of the other threads, instead of one per hook.
+	class HookBatch
 	{
 	private:
-		static inline size_t			m_nextHandle { 0x01000000 };
-	public:
-		FakeHandleCreator()
-		{
-		}
+		std::vector<MH_HOOK_DESC>	m_creates;
+		std::vector<LPVOID>			m_disables;
+		HookBatch*					m_previous;
 
-		size_t GetNextHandle()
+		static HookBatch*& Innermost()
 		{
-			return m_nextHandle++;
+			static thread_local HookBatch* innermost { nullptr };
+			return innermost;
 		}
-	};
 
-	using FilterCookie = unsigned int;
-	inline constexpr FilterCookie InvalidCookie { 0 };
-
-	template<typename FilterType>
-	class HookContainer
-	{
-	private:
-		FilterCookie m_nextFilterCookie;
-		std::map<FilterCookie, FilterType> m_filters;
-		std::recursive_mutex m_mutex;
 	public:
-		HookContainer()
-			: m_nextFilterCookie(1)
+		HookBatch()
+			: m_previous(Innermost())
 		{
+			Innermost() = this;
 		}
 
-		~HookContainer()
+		~HookBatch()
 		{
-			assert(m_filters.empty());
+			Commit();
+			Innermost() = m_previous;
 		}
 
-		FilterCookie AddFilter(FilterType newFilter)
-		{
-			std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-			FilterCookie result = m_nextFilterCookie++;
-			m_filters.insert(std::make_pair(result, newFilter));
+		HookBatch(const HookBatch&) = delete;
+		HookBatch& operator=(const HookBatch&) = delete;
 
-			return result;
-		}
-
-		void RemoveFilter(FilterCookie cookie)
+		static HookBatch* Active()
 		{
-			std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-			auto iterator = m_filters.find(cookie);
-			assert(iterator != std::end(m_filters));
-			m_filters.erase(iterator);
+			return Innermost();
 		}
 
-		template<typename FilterType>
-		bool ForEachFilterReturningBoolean(FilterType doFilter)
+		void CreateAndEnable(LPVOID target, LPVOID detour, LPVOID* original)
 		{
-			std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-			return std::any_of(std::begin(m_filters), std::end(m_filters), [&](auto& filterPair) {
-					return doFilter(filterPair.second);
-				});
-
-			return false;
+			m_creates.push_back({ target, detour, original, MH_UNKNOWN });
 		}
 
-		template<typename FilterType>
-		void ForEachVoidFilter(FilterType doFilter)
+		void Disable(LPVOID target)
 		{
-			std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-			std::for_each(std::begin(m_filters), std::end(m_filters), [&](auto& filterPair) {
-				doFilter(filterPair.second);
-				});
+			m_disables.push_back(target);
 		}
-	};
 
-	class CloseHandleHook
-	{
-	private:
-		using Filter = std::function<bool(HANDLE handle, BOOL& result)>;
-		using Monitor = std::function<void(HANDLE handle, BOOL result)>;
-
-		typedef BOOL(WINAPI* CloseHandleType)(HANDLE);
-
-		static inline CloseHandleType fpCloseHandle;
-		static inline int HookCount;
-		static inline HookContainer<Filter> m_filterHookContainer;
-		static inline HookContainer<Monitor> m_monitorHookContainer;
-
-		static BOOL WINAPI DetourCloseHandle(HANDLE hObject)
+		MH_STATUS Commit()
 		{
-			BOOL result;
-			if (m_filterHookContainer.ForEachFilterReturningBoolean([&](Filter& filter) { return filter(hObject, result); }))
-				return result;
-
-			result = fpCloseHandle(hObject);
-			m_monitorHookContainer.ForEachVoidFilter([&](Monitor& monitor) { monitor(hObject, result); });
-
-			return result;
-		}
+			MH_STATUS status = MH_OK;
+			if (!m_creates.empty())
+			{
+				status = MH_CreateHooks(m_creates.data(), static_cast<UINT>(m_creates.size()));
 
-	public:
-		CloseHandleHook()
-		{
-			if (HookCount == 0)
+				// A hook created by an earlier, since destroyed, ApiHook was only disabled.
+				std::vector<LPVOID> targets;
+				for (const MH_HOOK_DESC& hook : m_creates)
+				{
+					if (hook.status == MH_OK || hook.status == MH_ERROR_ALREADY_CREATED)
+						targets.push_back(hook.pTarget);
+				}
+				MH_STATUS enableStatus = MH_EnableHooks(targets.data(), static_cast<UINT>(targets.size()));
+				if (status == MH_OK || status == MH_ERROR_ALREADY_CREATED)
+					status = enableStatus;
+				m_creates.clear();
+			}
+			if (!m_disables.empty())
 			{
-				MH_CreateHook(&CloseHandle, &DetourCloseHandle, reinterpret_cast<LPVOID*>(&fpCloseHandle));
-				MH_EnableHook(&CloseHandle);
+				MH_STATUS disableStatus = MH_DisableHooks(m_disables.data(), static_cast<UINT>(m_disables.size()));
+				if (status == MH_OK)
+					status = disableStatus;
+				m_disables.clear();
 			}
-			HookCount++;
-		}
-
-		~CloseHandleHook()
-		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&CloseHandle);
-		}
-
-		FilterCookie AddFilter(Filter newFilter)
-		{
-			return m_filterHookContainer.AddFilter(newFilter);
-		}
-
-		void RemoveFilter(FilterCookie cookie)
-		{
-			m_filterHookContainer.RemoveFilter(cookie);
-		}
-
-		FilterCookie AddMonitor(Monitor newMonitor)
-		{
-			return m_monitorHookContainer.AddFilter(newMonitor);
-		}
-
-		void RemoveMonitor(FilterCookie cookie)
-		{
-			m_monitorHookContainer.RemoveFilter(cookie);
+			return status;
 		}
 	};
 
-	class ReadFileHook
+	// One hook per API, generated from the address of the function. The
+	// signature is deduced from the function pointer type, so the detour,
+	// the trampoline pointer and the Filter/Monitor types are all typed
+	// for that API:
+	//   Filter:  bool(Args..., Result& result)  return true to skip the original function.
+	//   Monitor: void(Args..., Result result)   called after the original function.
+	// For an API returning void both take the arguments only.
+	// Every instance of ApiHook<&Api> shares one MinHook hook; it is enabled
+	// by the first instance and disabled again by the last one.
+	// Handle filters claim one handle, or a range of them, and only see
+	// calls whose first argument is one of their handles; the detour finds
+	// the owner with a single lookup before running the general filters.
+	// APIs whose first parameter is not a pointer or an integer have none.
+	// A claim overlapping an earlier one fails and returns InvalidCookie.
+	// Async monitors get a copy of the arguments and the result on a
+	// background thread, after the hooked call has returned; memory the
+	// arguments point to may no longer be valid by then. Filters and
+	// regular monitors always run synchronously.
+	template<auto Target, typename FunctionType = decltype(Target)>
+	class ApiHook;
+
+	template<typename Result, typename... Args>
+	struct ApiHookSignature
 	{
-	private:
-		using Filter = std::function<bool(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped,
-			LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine, BOOL& result)>;
-		using Monitor = std::function<void(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped,
-			LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine, BOOL result)>;
-
-		typedef BOOL(WINAPI* ReadFileType)(HANDLE, LPVOID, DWORD, LPOVERLAPPED, LPOVERLAPPED_COMPLETION_ROUTINE);
-
-		static inline ReadFileType fpReadFile;
-		static inline int HookCount;
-		static inline HookContainer<Filter> m_filterHookContainer;
-		static inline HookContainer<Monitor> m_monitorHookContainer;
+		using Filter = bool(Args..., Result& result);
+		using Monitor = void(Args..., Result result);
+		using AsyncEvent = std::tuple<std::decay_t<Args>..., Result>;
+		using ResultStorage = Result;
+	};
 
-		static BOOL WINAPI DetourReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped,
-			LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine)
-		{
-			BOOL result;
-			if (m_filterHookContainer.ForEachFilterReturningBoolean([&](Filter& filter) { return filter(hFile, lpBuffer, nNumberOfBytesToRead, lpOverlapped, lpCompletionRoutine, result); }))
-				return result;
+	template<typename... Args>
+	struct ApiHookSignature<void, Args...>
+	{
+		using Filter = bool(Args...);
+		using Monitor = void(Args...);
+		using AsyncEvent = std::tuple<std::decay_t<Args>...>;
+		using ResultStorage = std::tuple<>;		// Placeholder for the result the detour does not have.
+	};
 
-			result = fpReadFile(hFile, lpBuffer, nNumberOfBytesToRead, lpOverlapped, lpCompletionRoutine);
-			m_monitorHookContainer.ForEachVoidFilter([&](Monitor& monitor) { monitor(hFile, lpBuffer, nNumberOfBytesToRead, lpOverlapped, lpCompletionRoutine, result); });
+	// Whether calls with these arguments can be routed by a handle in the first one.
+	template<typename... Args>
+	inline constexpr bool RoutesByHandle { false };
 
-			return result;
-		}
+	template<typename First, typename... Rest>
+	inline constexpr bool RoutesByHandle<First, Rest...> { std::is_pointer_v<First> || std::is_integral_v<First> };
 
+	template<auto Target, typename Result, typename... Args>
+	class ApiHook<Target, Result(WINAPI*)(Args...)>
+	{
 	public:
-		ReadFileHook()
-		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&ReadFile, &DetourReadFile, reinterpret_cast<LPVOID*>(&fpReadFile));
-				MH_EnableHook(&ReadFile);
-			}
-			HookCount++;
-		}
+		using Filter = Delegate<typename ApiHookSignature<Result, Args...>::Filter>;
+		using Monitor = Delegate<typename ApiHookSignature<Result, Args...>::Monitor>;
 
-		~ReadFileHook()
-		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&ReadFile);
-		}
-
-		FilterCookie AddFilter(Filter newFilter)
-		{
-			return m_filterHookContainer.AddFilter(newFilter);
-		}
-
-		void RemoveFilter(FilterCookie cookie)
-		{
-			m_filterHookContainer.RemoveFilter(cookie);
-		}
-
-		FilterCookie AddMonitor(Monitor newMonitor)
-		{
-			return m_monitorHookContainer.AddFilter(newMonitor);
-		}
-
-		void RemoveMonitor(FilterCookie cookie)
-		{
-			m_monitorHookContainer.RemoveFilter(cookie);
-		}
-	};
-
-	class WriteFileHook
-	{
 	private:
-		using Filter = std::function<bool(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten,
-			LPOVERLAPPED lpOverlapped, BOOL& result)>;
-		using Monitor = std::function<void(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten,
-			LPOVERLAPPED lpOverlapped, BOOL result)>;
+		typedef Result(WINAPI* FunctionType)(Args...);
+		using ResultStorage = typename ApiHookSignature<Result, Args...>::ResultStorage;
 
-		typedef BOOL(WINAPI* WriteFileType)(HANDLE, LPCVOID, DWORD, LPDWORD, LPOVERLAPPED);
-
-		static inline WriteFileType fpWriteFile;
-		static inline int HookCount;
+		static inline FunctionType fpOriginal;
+		static inline int m_hookCount;
 		static inline HookContainer<Filter> m_filterHookContainer;
 		static inline HookContainer<Monitor> m_monitorHookContainer;
+		static inline HandleRouter<Filter> m_handleRouter;
 
-		static BOOL WINAPI DetourWriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten,
-			LPOVERLAPPED lpOverlapped)
-		{
-			BOOL result;
-			if (m_filterHookContainer.ForEachFilterReturningBoolean([&](Filter& filter) { return filter(hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped, result); }))
-				return result;
+		using AsyncEvent = typename ApiHookSignature<Result, Args...>::AsyncEvent;
+		using AsyncPipeline = AsyncMonitorPipeline<AsyncEvent>;
 
-			result = fpWriteFile(hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped);
-			m_monitorHookContainer.ForEachVoidFilter([&](Monitor& monitor) { monitor(hFile, lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped, result); });
-
-			return result;
-		}
+		static inline HookContainer<Monitor> m_asyncMonitorHookContainer;
+		static inline std::mutex m_asyncPipelineMutex;
+		static inline std::unique_ptr<AsyncPipeline> m_asyncPipelineOwner;
+		static inline std::atomic<AsyncPipeline*> m_asyncPipeline;
+		static inline Backpressure m_asyncBackpressure { Backpressure::Drop };
+		static inline size_t m_asyncRingCapacity { 4096 };
+		static inline unsigned int m_asyncSampleInterval { 16 };
 
-	public:
-		WriteFileHook()
+		template<typename First, typename... Rest>
+		static HandleKey RoutingKey(First first, Rest...)
 		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&WriteFile, &DetourWriteFile, reinterpret_cast<LPVOID*>(&fpWriteFile));
-				MH_EnableHook(&WriteFile);
-			}
-			HookCount++;
+			return ToHandleKey(first);
 		}
 
-		~WriteFileHook()
+		static void ConsumeAsyncEvent(AsyncEvent& event)
 		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&WriteFile);
+			m_asyncMonitorHookContainer.ForEachVoidFilter([&](Monitor& monitor) { std::apply(monitor, event); });
 		}
 
-		FilterCookie AddFilter(Filter newFilter)
+		// Calls callable with the arguments followed by the result, if the API has one.
+		template<typename Callable>
+		static auto CallWithResult(Callable&& callable, ResultStorage& result, Args... args)
 		{
-			return m_filterHookContainer.AddFilter(newFilter);
+			if constexpr (std::is_void_v<Result>)
+				return callable(args...);
+			else
+				return callable(args..., result);
 		}
 
-		void RemoveFilter(FilterCookie cookie)
+		static Result ReturnValue(ResultStorage& result)
 		{
-			m_filterHookContainer.RemoveFilter(cookie);
-		}
-
-		FilterCookie AddMonitor(Monitor newMonitor)
-		{
-			return m_monitorHookContainer.AddFilter(newMonitor);
+			if constexpr (!std::is_void_v<Result>)
+				return result;
 		}
 
-		void RemoveMonitor(FilterCookie cookie)
+		static Result WINAPI Detour(Args... args)
 		{
-			m_monitorHookContainer.RemoveFilter(cookie);
-		}
-	};
-
-	class CreateFileWHook
-	{
-	private:
-		using Filter = std::function<bool(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
-				LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile,
-				HANDLE& result)>;
-		using Monitor = std::function<void(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
-			LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile,
-			HANDLE result)>;
+			if (m_handleRouter.IsEmpty() && m_filterHookContainer.IsEmpty() && m_monitorHookContainer.IsEmpty() && m_asyncMonitorHookContainer.IsEmpty())
+				return fpOriginal(args...);
 
-		typedef HANDLE(WINAPI* CreateFileType)(LPCWSTR, DWORD, DWORD, LPSECURITY_ATTRIBUTES, DWORD, DWORD, HANDLE);
+			ResultStorage result {};
+			auto doFilter = [&](Filter& filter) { return CallWithResult(filter, result, args...); };
+			if constexpr (RoutesByHandle<Args...>)
+			{
+				if (m_handleRouter.DispatchToOwner(RoutingKey(args...), doFilter))
+					return ReturnValue(result);
+			}
 
-		static inline CreateFileType fpCreateFile;
-		static inline int m_hookCount;
-		static inline HookContainer<Filter> m_filterHookContainer;
-		static inline HookContainer<Monitor> m_monitorHookContainer;
+			if (m_filterHookContainer.ForEachFilterReturningBoolean(doFilter))
+				return ReturnValue(result);
 
-		static HANDLE WINAPI DetourCreateFile(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
-			LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
-		{
-			HANDLE result;
-			if (m_filterHookContainer.ForEachFilterReturningBoolean([&](Filter& filter) { return filter(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile, result); }))
-				return result;
+			if constexpr (std::is_void_v<Result>)
+				fpOriginal(args...);
+			else
+				result = fpOriginal(args...);
+			m_monitorHookContainer.ForEachVoidFilter([&](Monitor& monitor) { CallWithResult(monitor, result, args...); });
 
-			result = fpCreateFile(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
-			m_monitorHookContainer.ForEachVoidFilter([&](Monitor& monitor) { monitor(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile, result); });
+			if (!m_asyncMonitorHookContainer.IsEmpty())
+			{
+				if (AsyncPipeline* pipeline = m_asyncPipeline.load(std::memory_order_acquire))
+					pipeline->Publish(CallWithResult([](auto... values) { return AsyncEvent(values...); }, result, args...));
+			}
 
-			return result;
+			return ReturnValue(result);
 		}
 
 	public:
-		CreateFileWHook()
+		ApiHook()
 		{
 			if (m_hookCount == 0)
 			{
-				MH_CreateHook(&CreateFileW, &DetourCreateFile, reinterpret_cast<LPVOID*>(&fpCreateFile));
-				MH_EnableHook(&CreateFileW);
+				if (HookBatch* batch = HookBatch::Active())
+					batch->CreateAndEnable(reinterpret_cast<LPVOID>(Target), reinterpret_cast<LPVOID>(&Detour), reinterpret_cast<LPVOID*>(&fpOriginal));
+				else
+				{
+					MH_CreateHook(reinterpret_cast<LPVOID>(Target), reinterpret_cast<LPVOID>(&Detour), reinterpret_cast<LPVOID*>(&fpOriginal));
+					MH_EnableHook(reinterpret_cast<LPVOID>(Target));
+				}
 			}
 			m_hookCount++;
 		}
 
-		~CreateFileWHook()
+		~ApiHook()
 		{
 			m_hookCount--;
 			if (m_hookCount == 0)
-				MH_DisableHook(&CreateFileW);
+			{
+				if (HookBatch* batch = HookBatch::Active())
+					batch->Disable(reinterpret_cast<LPVOID>(Target));
+				else
+					MH_DisableHook(reinterpret_cast<LPVOID>(Target));
+			}
 		}
 
 		FilterCookie AddFilter(Filter newFilter)
 		{
-			return m_filterHookContainer.AddFilter(newFilter);
+			return m_filterHookContainer.AddFilter(std::move(newFilter));
 		}
 
 		void RemoveFilter(FilterCookie cookie)
@@ -347,441 +280,323 @@ namespace TestHooks
 
 		FilterCookie AddMonitor(Monitor newMonitor)
 		{
-			return m_monitorHookContainer.AddFilter(newMonitor);
+			return m_monitorHookContainer.AddFilter(std::move(newMonitor));
 		}
 
 		void RemoveMonitor(FilterCookie cookie)
 		{
 			m_monitorHookContainer.RemoveFilter(cookie);
 		}
-	};
-
-	/// <summary>
-	/// /////////////////////////////////////////////////////////////////////////////////
-	/// </summary>
-	class FileHook
-	{
-	private:
-		CloseHandleHook				m_closeHandleHook;
-		FilterCookie				m_closeHandleFilterCookie;
-		FilterCookie				m_closeHandleMonitorCookie;
-		CreateFileWHook				m_createFileWHook;
-		FilterCookie				m_createFileWFilterCookie;
-		FilterCookie				m_createFileWMonitorCookie;
-		ReadFileHook				m_readFileHook;
-		FilterCookie				m_readFileFilterCookie;
-		FilterCookie				m_readFileMonitorCookie;
-		WriteFileHook				m_writeFileHook;
-		FilterCookie				m_writeFileFilterCookie;
-		FilterCookie				m_writeFileMonitorCookie;
 
-	public:
-		FileHook()
-			: m_closeHandleFilterCookie { InvalidCookie },
-			  m_closeHandleMonitorCookie { InvalidCookie },
-			  m_createFileWFilterCookie { InvalidCookie },
-			  m_createFileWMonitorCookie { InvalidCookie },
-			  m_readFileFilterCookie { InvalidCookie },
-			  m_readFileMonitorCookie { InvalidCookie },
-			  m_writeFileFilterCookie { InvalidCookie },
-			  m_writeFileMonitorCookie { InvalidCookie }
+		template<typename Handle>
+		FilterCookie AddHandleFilter(Handle handle, Filter newFilter) requires RoutesByHandle<Args...>
 		{
-			m_closeHandleFilterCookie = m_closeHandleHook.AddFilter(std::bind(&FileHook::CloseHandleFilterHook, this, std::placeholders::_1, std::placeholders::_2));
-			m_closeHandleMonitorCookie = m_closeHandleHook.AddMonitor(std::bind(&FileHook::CloseHandleMonitorHook, this, std::placeholders::_1, std::placeholders::_2));
-			m_createFileWFilterCookie = m_createFileWHook.AddFilter(std::bind(&FileHook::CreateFileWFilterHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8));
-			m_createFileWMonitorCookie = m_createFileWHook.AddMonitor(std::bind(&FileHook::CreateFileWMonitorHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8));
-			m_readFileFilterCookie = m_readFileHook.AddFilter(std::bind(&FileHook::ReadFileFilterHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6));
-			m_readFileMonitorCookie = m_readFileHook.AddMonitor(std::bind(&FileHook::ReadFileMonitorHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6));
-			m_writeFileFilterCookie = m_writeFileHook.AddFilter(std::bind(&FileHook::WriteFileFilterHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6));
-			m_writeFileMonitorCookie = m_writeFileHook.AddMonitor(std::bind(&FileHook::WriteFileMonitorHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6));
+			return m_handleRouter.Claim(ToHandleKey(handle), ToHandleKey(handle), std::move(newFilter));
 		}
 
-		~FileHook()
+		FilterCookie AddHandleRangeFilter(HandleKey firstHandle, HandleKey lastHandle, Filter newFilter) requires RoutesByHandle<Args...>
 		{
-			m_closeHandleHook.RemoveFilter(m_closeHandleFilterCookie);
-			m_closeHandleHook.RemoveMonitor(m_closeHandleMonitorCookie);
-			m_createFileWHook.RemoveFilter(m_createFileWFilterCookie);
-			m_createFileWHook.RemoveMonitor(m_createFileWMonitorCookie);
-			m_readFileHook.RemoveFilter(m_readFileFilterCookie);
-			m_readFileHook.RemoveMonitor(m_readFileMonitorCookie);
-			m_writeFileHook.RemoveFilter(m_writeFileFilterCookie);
-			m_writeFileHook.RemoveMonitor(m_writeFileMonitorCookie);
+			return m_handleRouter.Claim(firstHandle, lastHandle, std::move(newFilter));
 		}
 
-	private:
-		bool CloseHandleFilterHook(HANDLE handle, BOOL& result)
+		void RemoveHandleFilter(FilterCookie cookie)
 		{
-			return false;
+			m_handleRouter.Release(cookie);
 		}
 
-		void CloseHandleMonitorHook(HANDLE handle, BOOL result)
+		// Applies to the pipeline created by the first AddAsyncMonitor call for this API.
+		static void ConfigureAsyncMonitors(Backpressure backpressure, size_t ringCapacity = 4096, unsigned int sampleInterval = 16)
 		{
-		}
+			std::lock_guard<std::mutex> lock(m_asyncPipelineMutex);
+			assert(m_asyncPipelineOwner == nullptr);
 
-		bool CreateFileWFilterHook(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
-			LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile,
-			HANDLE& result)
-		{
-			return false;
+			m_asyncBackpressure = backpressure;
+			m_asyncRingCapacity = ringCapacity;
+			m_asyncSampleInterval = sampleInterval;
 		}
 
-		void CreateFileWMonitorHook(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
-			LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile,
-			HANDLE result)
+		FilterCookie AddAsyncMonitor(Monitor newMonitor)
 		{
-		}
-
-		bool ReadFileFilterHook(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped,
-			LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine, BOOL& result)
-		{
-			return false;
-		}
-
-		void ReadFileMonitorHook(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped,
-			LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine, BOOL result)
-		{
-		}
-
-		bool WriteFileFilterHook(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten,
-			LPOVERLAPPED lpOverlapped, BOOL& result)
-		{
-			return false;
-		}
-
-		void WriteFileMonitorHook(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten,
-			LPOVERLAPPED lpOverlapped, BOOL result)
-		{
-		}
-	};
-
-	class SetupDiGetClassDevsWHook
-	{
-	private:
-		using Filter = std::function<bool(CONST GUID* ClassGuid, PCWSTR Enumerator, HWND hwndParent, DWORD Flags, HDEVINFO& result)>;
-
-		typedef HDEVINFO(WINAPI* SetupDiGetClassDevsWType)(CONST GUID* ClassGuid, PCWSTR Enumerator, HWND hwndParent, DWORD Flags);
-
-		static inline SetupDiGetClassDevsWType fpSetupDiGetClassDevsW;
-		static inline int HookCount;
-		static inline std::vector<Filter> filters;
-
-		static int SerialPortCount;
-
-		static HDEVINFO WINAPI DetourSetupDiGetClassDevsW(CONST GUID* ClassGuid, PCWSTR Enumerator, HWND hwndParent, DWORD Flags)
-		{
-			for (auto& filter : filters)
 			{
-				HDEVINFO result;
-				if (filter(ClassGuid, Enumerator, hwndParent, Flags, result))
-					return result;
+				std::lock_guard<std::mutex> lock(m_asyncPipelineMutex);
+				if (m_asyncPipelineOwner == nullptr)
+				{
+					m_asyncPipelineOwner = std::make_unique<AsyncPipeline>(&ConsumeAsyncEvent, m_asyncBackpressure, m_asyncRingCapacity, m_asyncSampleInterval);
+					m_asyncPipeline.store(m_asyncPipelineOwner.get(), std::memory_order_release);
+				}
 			}
-			return fpSetupDiGetClassDevsW(ClassGuid, Enumerator, hwndParent, Flags);
+			return m_asyncMonitorHookContainer.AddFilter(std::move(newMonitor));
 		}
 
-	public:
-		SetupDiGetClassDevsWHook()
+		void RemoveAsyncMonitor(FilterCookie cookie)
 		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&SetupDiGetClassDevsW, &DetourSetupDiGetClassDevsW, reinterpret_cast<LPVOID*>(&fpSetupDiGetClassDevsW));
-				MH_EnableHook(&SetupDiGetClassDevsW);
-			}
-			HookCount++;
+			FlushAsyncMonitors();
+			m_asyncMonitorHookContainer.RemoveFilter(cookie);
 		}
 
-		~SetupDiGetClassDevsWHook()
+		static void FlushAsyncMonitors()
 		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&SetupDiGetClassDevsW);
+			if (AsyncPipeline* pipeline = m_asyncPipeline.load(std::memory_order_acquire))
+				pipeline->Flush();
 		}
 
-		void AddFilter(Filter newFilter)
+		static AsyncMonitorStatistics GetAsyncMonitorStatistics()
 		{
-			filters.push_back(newFilter);
+			if (AsyncPipeline* pipeline = m_asyncPipeline.load(std::memory_order_acquire))
+				return pipeline->Statistics();
+			return {};
 		}
 	};
 
-	class SetupDiEnumDeviceInfoHook
+	using CloseHandleHook = ApiHook<&CloseHandle>;
+	using ReadFileHook = ApiHook<&ReadFile>;
+	using WriteFileHook = ApiHook<&WriteFile>;
+	using CreateFileWHook = ApiHook<&CreateFileW>;
+	using SetupDiGetClassDevsWHook = ApiHook<&SetupDiGetClassDevsW>;
+	using SetupDiEnumDeviceInfoHook = ApiHook<&SetupDiEnumDeviceInfo>;
+	using SetupDiDestroyDeviceInfoListHook = ApiHook<&SetupDiDestroyDeviceInfoList>;
+	using SetupDiGetDeviceRegistryPropertyHook = ApiHook<&SetupDiGetDeviceRegistryProperty>;
+	using SetupDiOpenDevRegKeyHook = ApiHook<&SetupDiOpenDevRegKey>;
+	using RegGetValueWHook = ApiHook<&RegGetValueW>;
+	using RegCloseKeyHook = ApiHook<&RegCloseKey>;
+
+	// One instance of each of Hooks, installed together through one
+	// HookBatch and removed together through another.
+	template<typename... Hooks>
+	class ApiHookSet
 	{
 	private:
-		using Filter = std::function<bool(HDEVINFO DeviceInfoSet, DWORD MemberIndex, PSP_DEVINFO_DATA DeviceInfoData, BOOL& result)>;
-
-		typedef BOOL(WINAPI* SetupDiEnumDeviceInfoType)(HDEVINFO DeviceInfoSet, DWORD MemberIndex, PSP_DEVINFO_DATA DeviceInfoData);
-
-		static inline SetupDiEnumDeviceInfoType fpSetupDiEnumDeviceInfo;
-		static inline int HookCount;
-		static inline std::vector<Filter> filters;
-
-		static BOOL WINAPI DetourSetupDiEnumDeviceInfo(HDEVINFO DeviceInfoSet, DWORD MemberIndex, PSP_DEVINFO_DATA DeviceInfoData)
-		{
-			for (auto& filter : filters)
-			{
-				BOOL result;
-				if (filter(DeviceInfoSet, MemberIndex, DeviceInfoData, result))
-					return result;
-			}
-			return fpSetupDiEnumDeviceInfo(DeviceInfoSet, MemberIndex, DeviceInfoData);
-		}
+		std::optional<std::tuple<Hooks...>>	m_hooks;
 
 	public:
-		SetupDiEnumDeviceInfoHook()
+		ApiHookSet()
 		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&SetupDiEnumDeviceInfo, &DetourSetupDiEnumDeviceInfo, reinterpret_cast<LPVOID*>(&fpSetupDiEnumDeviceInfo));
-				MH_EnableHook(&SetupDiEnumDeviceInfo);
-			}
-			HookCount++;
+			HookBatch batch;
+			m_hooks.emplace();
 		}
 
-		~SetupDiEnumDeviceInfoHook()
+		~ApiHookSet()
 		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&SetupDiEnumDeviceInfo);
+			HookBatch batch;
+			m_hooks.reset();
 		}
 
-		void AddFilter(Filter newFilter)
+		ApiHookSet(const ApiHookSet&) = delete;
+		ApiHookSet& operator=(const ApiHookSet&) = delete;
+
+		template<typename Hook>
+		Hook& Get()
 		{
-			filters.push_back(newFilter);
+			return std::get<Hook>(*m_hooks);
 		}
 	};
 
-	class SetupDiDestroyDeviceInfoListHook
+	// A filter for every fake handle of one API. If something else already
+	// claimed part of the fake handle range, it is added as a general filter
+	// instead; it passes on every handle that is not its own either way.
+	class FakeHandleRangeFilter
 	{
 	private:
-		using Filter = std::function<bool(HDEVINFO DeviceInfoSet, BOOL& result)>;
-
-		typedef BOOL(WINAPI* SetupDiDestroyDeviceInfoListType)(HDEVINFO DeviceInfoSet);
-
-		static inline SetupDiDestroyDeviceInfoListType fpSetupDiDestroyDeviceInfoList;
-		static inline int HookCount;
-		static inline std::vector<Filter> filters;
-
-		static BOOL WINAPI DetourSetupDiDestroyDeviceInfoList(HDEVINFO DeviceInfoSet)
-		{
-			for (auto& filter : filters)
-			{
-				BOOL result;
-				if (filter(DeviceInfoSet, result))
-					return result;
-			}
-			return fpSetupDiDestroyDeviceInfoList(DeviceInfoSet);
-		}
+		FilterCookie				m_cookie { InvalidCookie };
+		bool						m_routed { false };
 
 	public:
-		SetupDiDestroyDeviceInfoListHook()
+		template<typename Hook>
+		void Add(Hook& hook, typename Hook::Filter filter)
 		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&SetupDiDestroyDeviceInfoList, &DetourSetupDiDestroyDeviceInfoList, reinterpret_cast<LPVOID*>(&fpSetupDiDestroyDeviceInfoList));
-				MH_EnableHook(&SetupDiDestroyDeviceInfoList);
-			}
-			HookCount++;
+			m_cookie = hook.AddHandleRangeFilter(FakeHandleTable::FirstHandle, FakeHandleTable::LastHandle, filter);
+			m_routed = m_cookie != InvalidCookie;
+			if (!m_routed)
+				m_cookie = hook.AddFilter(filter);
 		}
 
-		~SetupDiDestroyDeviceInfoListHook()
+		template<typename Hook>
+		void Remove(Hook& hook)
 		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&SetupDiDestroyDeviceInfoList);
-		}
-
-		void AddFilter(Filter newFilter)
-		{
-			filters.push_back(newFilter);
+			if (m_routed)
+				hook.RemoveHandleFilter(m_cookie);
+			else
+				hook.RemoveFilter(m_cookie);
+			m_cookie = InvalidCookie;
 		}
 	};
 
-	class SetupDiGetDeviceRegistryPropertyHook
+	/// <summary>
+	/// /////////////////////////////////////////////////////////////////////////////////
+	/// </summary>
+	// Serves CreateFileW/ReadFile/WriteFile/CloseHandle from an in memory
+	// VirtualFileSystem for the paths it covers; every other path, and every
+	// real handle, goes to the real file system.
+	// Handles of virtual files identify their file by themselves, so the
+	// CloseHandle/ReadFile/WriteFile filters are static and the fake handle
+	// range is claimed once, by the first FileHook, for all of them.
+	class FileHook
 	{
 	private:
-		using Filter = std::function<bool(HDEVINFO DeviceInfoSet, PSP_DEVINFO_DATA DeviceInfoData, DWORD Property, PDWORD PropertyRegDataType, PBYTE PropertyBuffer, DWORD PropertyBufferSize, PDWORD RequiredSize, BOOL& result)>;
-
-		typedef BOOL(WINAPI* SetupDiGetDeviceRegistryPropertyType)(HDEVINFO DeviceInfoSet, PSP_DEVINFO_DATA DeviceInfoData, DWORD Property, PDWORD PropertyRegDataType, PBYTE PropertyBuffer, DWORD PropertyBufferSize, PDWORD RequiredSize);
-
-		static inline SetupDiGetDeviceRegistryPropertyType fpSetupDiGetDeviceRegistryProperty;
-		static inline int HookCount;
-		static inline std::vector<Filter> filters;
+		static inline std::mutex		m_handleFilterMutex;
+		static inline unsigned int		m_handleFilterUsers { 0 };
+		static inline FakeHandleRangeFilter	m_closeHandleFilter;
+		static inline FakeHandleRangeFilter	m_readFileFilter;
+		static inline FakeHandleRangeFilter	m_writeFileFilter;
+
+		VirtualFileSystem			m_fileSystem;
+		ApiHookSet<CloseHandleHook, CreateFileWHook, ReadFileHook, WriteFileHook>	m_hooks;
+		FilterCookie				m_createFileWFilterCookie;
 
-		static BOOL WINAPI DetourSetupDiGetDeviceRegistryProperty(HDEVINFO DeviceInfoSet, PSP_DEVINFO_DATA DeviceInfoData, DWORD Property, PDWORD PropertyRegDataType, PBYTE PropertyBuffer, DWORD PropertyBufferSize, PDWORD RequiredSize)
+	public:
+		FileHook()
+			: m_createFileWFilterCookie { InvalidCookie }
 		{
-			for (auto& filter : filters)
 			{
-				BOOL result;
-				if (filter(DeviceInfoSet, DeviceInfoData, Property, PropertyRegDataType, PropertyBuffer, PropertyBufferSize, RequiredSize, result))
-					return result;
+				std::lock_guard<std::mutex> lock(m_handleFilterMutex);
+				if (m_handleFilterUsers++ == 0)
+				{
+					m_closeHandleFilter.Add(m_hooks.Get<CloseHandleHook>(), &FileHook::CloseHandleFilterHook);
+					m_readFileFilter.Add(m_hooks.Get<ReadFileHook>(), &FileHook::ReadFileFilterHook);
+					m_writeFileFilter.Add(m_hooks.Get<WriteFileHook>(), &FileHook::WriteFileFilterHook);
+				}
 			}
-			return fpSetupDiGetDeviceRegistryProperty(DeviceInfoSet, DeviceInfoData, Property, PropertyRegDataType, PropertyBuffer, PropertyBufferSize, RequiredSize);
+			m_createFileWFilterCookie = m_hooks.Get<CreateFileWHook>().AddFilter(BindMember<&FileHook::CreateFileWFilterHook>(this));
 		}
 
-	public:
-		SetupDiGetDeviceRegistryPropertyHook()
+		// Each removal waits for calls still inside the filter, so none can reach m_fileSystem afterwards.
+		~FileHook()
 		{
-			if (HookCount == 0)
 			{
-				MH_CreateHook(&SetupDiGetDeviceRegistryProperty, &DetourSetupDiGetDeviceRegistryProperty, reinterpret_cast<LPVOID*>(&fpSetupDiGetDeviceRegistryProperty));
-				MH_EnableHook(&SetupDiGetDeviceRegistryProperty);
+				std::lock_guard<std::mutex> lock(m_handleFilterMutex);
+				if (--m_handleFilterUsers == 0)
+				{
+					m_closeHandleFilter.Remove(m_hooks.Get<CloseHandleHook>());
+					m_readFileFilter.Remove(m_hooks.Get<ReadFileHook>());
+					m_writeFileFilter.Remove(m_hooks.Get<WriteFileHook>());
+				}
 			}
-			HookCount++;
-		}
-
-		~SetupDiGetDeviceRegistryPropertyHook()
-		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&SetupDiGetDeviceRegistryProperty);
+			m_hooks.Get<CreateFileWHook>().RemoveFilter(m_createFileWFilterCookie);
 		}
 
-		void AddFilter(Filter newFilter)
+		VirtualFileSystem& FileSystem()
 		{
-			filters.push_back(newFilter);
+			return m_fileSystem;
 		}
-	};
 
-	class SetupDiOpenDevRegKeyHook
-	{
 	private:
-		using Filter = std::function<bool(HDEVINFO DeviceInfoSet, PSP_DEVINFO_DATA DeviceInfoData, DWORD Scope, DWORD HwProfile, DWORD KeyType, REGSAM samDesired, HKEY& result)>;
-
-		typedef HKEY(WINAPI* SetupDiOpenDevRegKeyType)(HDEVINFO DeviceInfoSet, PSP_DEVINFO_DATA DeviceInfoData, DWORD Scope, DWORD HwProfile, DWORD KeyType, REGSAM samDesired);
-
-		static inline SetupDiOpenDevRegKeyType fpSetupDiOpenDevRegKey;
-		static inline int HookCount;
-		static inline std::vector<Filter> filters;
-
-		static HKEY WINAPI DetourSetupDiOpenDevRegKey(HDEVINFO DeviceInfoSet, PSP_DEVINFO_DATA DeviceInfoData, DWORD Scope, DWORD HwProfile, DWORD KeyType, REGSAM samDesired)
+		static DWORD ToWin32Error(FileStatus status)
 		{
-			for (auto& filter : filters)
+			switch (status)
 			{
-				HKEY result;
-				if (filter(DeviceInfoSet, DeviceInfoData, Scope, HwProfile, KeyType, samDesired, result))
-					return result;
+				case FileStatus::Success:			return ERROR_SUCCESS;
+				case FileStatus::AlreadyExists:		return ERROR_ALREADY_EXISTS;
+				case FileStatus::FileNotFound:		return ERROR_FILE_NOT_FOUND;
+				case FileStatus::FileExists:		return ERROR_FILE_EXISTS;
+				case FileStatus::AccessDenied:		return ERROR_ACCESS_DENIED;
+				case FileStatus::InvalidHandle:		return ERROR_INVALID_HANDLE;
+				case FileStatus::DiskFull:			return ERROR_DISK_FULL;
+				default:							return ERROR_INVALID_PARAMETER;
 			}
-			return fpSetupDiOpenDevRegKey(DeviceInfoSet, DeviceInfoData, Scope, HwProfile, KeyType, samDesired);
 		}
 
-	public:
-		SetupDiOpenDevRegKeyHook()
+		static bool CloseHandleFilterHook(HANDLE handle, BOOL& result)
 		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&SetupDiOpenDevRegKey, &DetourSetupDiOpenDevRegKey, reinterpret_cast<LPVOID*>(&fpSetupDiOpenDevRegKey));
-				MH_EnableHook(&SetupDiOpenDevRegKey);
-			}
-			HookCount++;
-		}
+			if (VirtualFileSystem::Close(ToHandleKey(handle)) == FileStatus::InvalidHandle)
+				return false;
 
-		~SetupDiOpenDevRegKeyHook()
-		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&SetupDiOpenDevRegKey);
+			result = TRUE;
+			return true;
 		}
 
-		void AddFilter(Filter newFilter)
+		bool CreateFileWFilterHook(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+			LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile,
+			HANDLE& result)
 		{
-			filters.push_back(newFilter);
-		}
-	};
+			if (lpFileName == nullptr || !m_fileSystem.IsVirtual(lpFileName))
+				return false;
 
-	class RegGetValueWHook
-	{
-	private:
-		using Filter = std::function<bool(HKEY hkey, LPCWSTR lpSubKey, LPCWSTR lpValue, DWORD dwFlags, LPDWORD pdwType, PVOID pvData, LPDWORD pcbData, LSTATUS& result)>;
-
-		typedef LSTATUS(WINAPI* RegGetValueWType)(HKEY hkey, LPCWSTR lpSubKey, LPCWSTR lpValue, DWORD dwFlags, LPDWORD pdwType, PVOID pvData, LPDWORD pcbData);
-
-		static inline RegGetValueWType fpRegGetValueW;
-		static inline int HookCount;
-		static inline std::vector<Filter> filters;
-
-		static LSTATUS WINAPI DetourRegGetValueW(HKEY hkey, LPCWSTR lpSubKey, LPCWSTR lpValue, DWORD dwFlags, LPDWORD pdwType, PVOID pvData, LPDWORD pcbData)
-		{
-			for (auto& filter : filters)
-			{
-				LSTATUS result;
-				if (filter(hkey, lpSubKey, lpValue, dwFlags, pdwType, pvData, pcbData, result))
-					return result;
-			}
-			return fpRegGetValueW(hkey, lpSubKey, lpValue, dwFlags, pdwType, pvData, pcbData);
-		}
+			unsigned int access = 0;
+			if ((dwDesiredAccess & (GENERIC_READ | GENERIC_ALL | FILE_READ_DATA)) != 0)
+				access |= FileAccessRead;
+			if ((dwDesiredAccess & (GENERIC_WRITE | GENERIC_ALL | FILE_WRITE_DATA | FILE_APPEND_DATA)) != 0)
+				access |= FileAccessWrite;
 
-	public:
-		RegGetValueWHook()
-		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&RegGetValueW, &DetourRegGetValueW, reinterpret_cast<LPVOID*>(&fpRegGetValueW));
-				MH_EnableHook(&RegGetValueW);
-			}
-			HookCount++;
+			HandleKey handle;
+			FileStatus status = m_fileSystem.Open(lpFileName, access, static_cast<FileDisposition>(dwCreationDisposition), handle);
+			result = Succeeded(status) ? reinterpret_cast<HANDLE>(handle) : INVALID_HANDLE_VALUE;
+			SetLastError(ToWin32Error(status));
+			return true;
 		}
 
-		~RegGetValueWHook()
+		static uint64_t OverlappedOffset(LPOVERLAPPED lpOverlapped)
 		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&RegGetValueW);
+			return (static_cast<uint64_t>(lpOverlapped->OffsetHigh) << 32) | lpOverlapped->Offset;
 		}
 
-		void AddFilter(Filter newFilter)
+		// The NTSTATUS GetOverlappedResult turns back into the Win32 error.
+		static ULONG_PTR ToNtStatus(FileStatus status)
 		{
-			filters.push_back(newFilter);
-		}
-	};
-
-	class RegCloseKeyHook
-	{
-	private:
-		using Filter = std::function<bool(HKEY hKey, LSTATUS& result)>;
-
-		typedef LSTATUS(WINAPI* RegCloseKeyType)(HKEY hKey);
-
-		static inline RegCloseKeyType fpRegCloseKey;
-		static inline int HookCount;
-		static inline std::vector<Filter> filters;
-
-		static LSTATUS WINAPI DetourRegCloseKey(HKEY hKey)
-		{
-			for (auto& filter : filters)
+			switch (status)
 			{
-				LSTATUS result;
-				if (filter(hKey, result))
-					return result;
+				case FileStatus::Success:			return 0x00000000;		// STATUS_SUCCESS
+				case FileStatus::AccessDenied:		return 0xC0000022;		// STATUS_ACCESS_DENIED
+				case FileStatus::DiskFull:			return 0xC000007F;		// STATUS_DISK_FULL
+				default:							return 0xC000000D;		// STATUS_INVALID_PARAMETER
 			}
-			return fpRegCloseKey(hKey);
 		}
 
-	public:
-		RegCloseKeyHook()
+		// Virtual files complete overlapped calls synchronously, the way the
+		// system does when it can: the status and byte count are set before
+		// the call returns, and the event is signaled.
+		static void CompleteOverlapped(LPOVERLAPPED lpOverlapped, FileStatus status, size_t byteCount)
 		{
-			if (HookCount == 0)
-			{
-				MH_CreateHook(&RegCloseKey, &DetourRegCloseKey, reinterpret_cast<LPVOID*>(&fpRegCloseKey));
-				MH_EnableHook(&RegCloseKey);
-			}
-			HookCount++;
-		}
+			lpOverlapped->Internal = ToNtStatus(status);
+			lpOverlapped->InternalHigh = byteCount;
 
-		~RegCloseKeyHook()
-		{
-			HookCount--;
-			if (HookCount == 0)
-				MH_DisableHook(&RegCloseKey);
+			// A set low bit only asks for no completion port packet; it is not part of the handle.
+			HANDLE event = reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(lpOverlapped->hEvent) & ~static_cast<ULONG_PTR>(1));
+			if (event != nullptr)
+				SetEvent(event);
 		}
 
-		void AddFilter(Filter newFilter)
+		static bool ReadFileFilterHook(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead,
+			LPOVERLAPPED lpOverlapped, BOOL& result)
 		{
-			filters.push_back(newFilter);
-		}
-	};
+			size_t bytesRead;
+			FileStatus status = lpOverlapped != nullptr
+				? VirtualFileSystem::ReadAt(ToHandleKey(hFile), OverlappedOffset(lpOverlapped), lpBuffer, nNumberOfBytesToRead, bytesRead)
+				: VirtualFileSystem::Read(ToHandleKey(hFile), lpBuffer, nNumberOfBytesToRead, bytesRead);
+			if (status == FileStatus::InvalidHandle)
+				return false;
+
+			if (lpNumberOfBytesRead != nullptr)
+				*lpNumberOfBytesRead = static_cast<DWORD>(bytesRead);
+			if (lpOverlapped != nullptr)
+				CompleteOverlapped(lpOverlapped, status, bytesRead);
+			if (!Succeeded(status))
+				SetLastError(ToWin32Error(status));
+			result = Succeeded(status) ? TRUE : FALSE;
+			return true;
+		}
+		static bool WriteFileFilterHook(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten,
+			LPOVERLAPPED lpOverlapped, BOOL& result)
+		{
+			size_t bytesWritten;
+			FileStatus status = lpOverlapped != nullptr
+				? VirtualFileSystem::WriteAt(ToHandleKey(hFile), OverlappedOffset(lpOverlapped), lpBuffer, nNumberOfBytesToWrite, bytesWritten)
+				: VirtualFileSystem::Write(ToHandleKey(hFile), lpBuffer, nNumberOfBytesToWrite, bytesWritten);
+			if (status == FileStatus::InvalidHandle)
+				return false;
+
+			if (lpNumberOfBytesWritten != nullptr)
+				*lpNumberOfBytesWritten = static_cast<DWORD>(bytesWritten);
+			if (lpOverlapped != nullptr)
+				CompleteOverlapped(lpOverlapped, status, bytesWritten);
+			if (!Succeeded(status))
+				SetLastError(ToWin32Error(status));
+			result = Succeeded(status) ? TRUE : FALSE;
+			return true;
+		}	};
 
 	class SerialPortHook
 	{
 	private:
-		static const int FakeIteratorSignature = 0xcafebabe;
 		class FakeIterator
 		{
 		private:
@@ -798,25 +613,14 @@ namespace TestHooks
 				{
 				}
 			};
-			long						m_signature;
 			std::vector<DeviceInfo>		m_devices;
 
 		public:
-			FakeIterator()
-				: m_signature(FakeIteratorSignature)
-			{
-			}
-
 			bool IsIndexValid(size_t deviceIndex) const
 			{
 				return deviceIndex < m_devices.size();
 			}
 
-			bool Validate()
-			{
-				return m_signature == FakeIteratorSignature;
-			}
-
 			void AddDeviceInfo(GUID classGuid, DWORD deviceInstance, const std::wstring& deviceDescription)
 			{
 				m_devices.emplace_back(classGuid, deviceInstance, deviceDescription);
@@ -843,32 +647,46 @@ namespace TestHooks
 				return m_devices[deviceIndex].m_deviceDescription;
 			}
 		};
-		SetupDiGetClassDevsWHook				m_setupDiGetClassDevsWHook;
-		SetupDiEnumDeviceInfoHook				m_setupDiEnumDeviceInfoHook;
-		SetupDiDestroyDeviceInfoListHook		m_setupDiDestroyDeviceInfoListHook;
-		SetupDiGetDeviceRegistryPropertyHook	m_setupDiGetDeviceRegistryPropertyHook;
-		//	CreateFileHook							m_createFileHook;
-		CloseHandleHook							m_closeHandleHook;;
-		SetupDiOpenDevRegKeyHook				m_setupDiOpenDevRegKeyHook;
-		RegGetValueWHook						m_regGetValueWHook;
-		RegCloseKeyHook							m_regCloseKeyHook;
-		FakeHandleCreator						m_fakeHandleCreator;
-		std::vector<std::unique_ptr<FakeIterator>>	m_pendingIterators;
-		std::map<HKEY, int>						m_pendingFakeHKEYs;
+
+		struct FakeRegistryKey
+		{
+			std::wstring				m_registryPath;
+
+			explicit FakeRegistryKey(const std::wstring& registryPath)
+				: m_registryPath(registryPath)
+			{
+			}
+		};
+		ApiHookSet<TestHooks::SetupDiGetClassDevsWHook, TestHooks::SetupDiEnumDeviceInfoHook, SetupDiDestroyDeviceInfoListHook, SetupDiGetDeviceRegistryPropertyHook,
+			CloseHandleHook, SetupDiOpenDevRegKeyHook, RegGetValueWHook, RegCloseKeyHook>	m_hooks;
+		FilterCookie							m_setupDiGetClassDevsWFilterCookie;
+		FilterCookie							m_setupDiEnumDeviceInfoFilterCookie;
+		FilterCookie							m_setupDiDestroyDeviceInfoListFilterCookie;
+		FilterCookie							m_setupDiGetDeviceRegistryPropertyFilterCookie;
+		FilterCookie							m_setupDiOpenDevRegKeyFilterCookie;
+		FilterCookie							m_regGetValueWFilterCookie;
+		FilterCookie							m_regCloseKeyFilterCookie;
 	public:
 		SerialPortHook()
 		{
-			m_setupDiGetClassDevsWHook.AddFilter(std::bind(&SerialPortHook::SetupDiGetClassDevsWHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
-			m_setupDiEnumDeviceInfoHook.AddFilter(std::bind(&SerialPortHook::SetupDiEnumDeviceInfoHook, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-			m_setupDiDestroyDeviceInfoListHook.AddFilter(std::bind(&SerialPortHook::DetourSetupDiDestroyDeviceInfoList, this, std::placeholders::_1));
-			m_setupDiGetDeviceRegistryPropertyHook.AddFilter(std::bind(&SerialPortHook::DetourSetupDiGetDeviceRegistryProperty, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8));
-			m_setupDiOpenDevRegKeyHook.AddFilter(std::bind(&SerialPortHook::DetourSetupDiOpenDevRegKey, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7));
-			m_regGetValueWHook.AddFilter(std::bind(&SerialPortHook::DetourRegGetValueW, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5, std::placeholders::_6, std::placeholders::_7, std::placeholders::_8));
-			m_regCloseKeyHook.AddFilter(std::bind(&SerialPortHook::DetourRegCloseKey, this, std::placeholders::_1, std::placeholders::_2));
+			m_setupDiGetClassDevsWFilterCookie = m_hooks.Get<TestHooks::SetupDiGetClassDevsWHook>().AddFilter(BindMember<&SerialPortHook::SetupDiGetClassDevsWHook>(this));
+			m_setupDiEnumDeviceInfoFilterCookie = m_hooks.Get<TestHooks::SetupDiEnumDeviceInfoHook>().AddFilter(BindMember<&SerialPortHook::SetupDiEnumDeviceInfoHook>(this));
+			m_setupDiDestroyDeviceInfoListFilterCookie = m_hooks.Get<SetupDiDestroyDeviceInfoListHook>().AddFilter(BindMember<&SerialPortHook::DetourSetupDiDestroyDeviceInfoList>(this));
+			m_setupDiGetDeviceRegistryPropertyFilterCookie = m_hooks.Get<SetupDiGetDeviceRegistryPropertyHook>().AddFilter(BindMember<&SerialPortHook::DetourSetupDiGetDeviceRegistryProperty>(this));
+			m_setupDiOpenDevRegKeyFilterCookie = m_hooks.Get<SetupDiOpenDevRegKeyHook>().AddFilter(BindMember<&SerialPortHook::DetourSetupDiOpenDevRegKey>(this));
+			m_regGetValueWFilterCookie = m_hooks.Get<RegGetValueWHook>().AddFilter(BindMember<&SerialPortHook::DetourRegGetValueW>(this));
+			m_regCloseKeyFilterCookie = m_hooks.Get<RegCloseKeyHook>().AddFilter(BindMember<&SerialPortHook::DetourRegCloseKey>(this));
 		}
 
 		~SerialPortHook()
 		{
+			m_hooks.Get<TestHooks::SetupDiGetClassDevsWHook>().RemoveFilter(m_setupDiGetClassDevsWFilterCookie);
+			m_hooks.Get<TestHooks::SetupDiEnumDeviceInfoHook>().RemoveFilter(m_setupDiEnumDeviceInfoFilterCookie);
+			m_hooks.Get<SetupDiDestroyDeviceInfoListHook>().RemoveFilter(m_setupDiDestroyDeviceInfoListFilterCookie);
+			m_hooks.Get<SetupDiGetDeviceRegistryPropertyHook>().RemoveFilter(m_setupDiGetDeviceRegistryPropertyFilterCookie);
+			m_hooks.Get<SetupDiOpenDevRegKeyHook>().RemoveFilter(m_setupDiOpenDevRegKeyFilterCookie);
+			m_hooks.Get<RegGetValueWHook>().RemoveFilter(m_regGetValueWFilterCookie);
+			m_hooks.Get<RegCloseKeyHook>().RemoveFilter(m_regCloseKeyFilterCookie);
 		}
 
 		unsigned int AddSerialPort()
@@ -877,64 +695,48 @@ namespace TestHooks
 		}
 
 	private:
+		// Fake device info sets and registry keys are handles in FakeHandleTable,
+		// so telling them apart from real ones is a lookup, never a dereference.
 		static FakeIterator* HDEVINFOToFakeIterator(HDEVINFO DeviceInfoSet)
 		{
-			return reinterpret_cast<FakeIterator*>(DeviceInfoSet);
+			return FakeHandleTable::Instance().Lookup<FakeIterator>(DeviceInfoSet);
 		}
 
 		bool IsDeviceInfoSetAFake(HDEVINFO DeviceInfoSet) const
 		{
-			return (HDEVINFOToFakeIterator(DeviceInfoSet))->Validate();
+			return HDEVINFOToFakeIterator(DeviceInfoSet) != nullptr;
 		}
 
 		void DestroyFakeIterator(HDEVINFO DeviceInfoSet)
 		{
-			for (auto& iterator = std::begin(m_pendingIterators); iterator != std::end(m_pendingIterators); ++iterator)
-			{
-				if (iterator->get() == DeviceInfoSet)
-				{
-					m_pendingIterators.erase(iterator);
-					return;
-				}
-			}
-			assert(false);
+			bool released = FakeHandleTable::Instance().Release(DeviceInfoSet);
+			assert(released);
 		}
 
 		HDEVINFO ConstructNewFakeIterator()
 		{
-			HDEVINFO result = nullptr;
-
 			std::unique_ptr<FakeIterator> newIterator = std::make_unique<FakeIterator>();
 
 			GUID classGuid;
 			newIterator->AddDeviceInfo(classGuid, 1, L"device description");
 
-			result = reinterpret_cast<HDEVINFO>(newIterator.get());
-			m_pendingIterators.push_back(std::move(newIterator));
-
-			return result;
+			return reinterpret_cast<HDEVINFO>(FakeHandleTable::Instance().Allocate(std::move(newIterator)));
 		}
 
 		HKEY CreateNewFakeHKEY(const std::wstring& registryPath)
 		{
-			HKEY newHKEY = reinterpret_cast<HKEY>(m_fakeHandleCreator.GetNextHandle());
-			m_pendingFakeHKEYs.insert(std::make_pair(newHKEY, 0));
-
-			return newHKEY;
+			return reinterpret_cast<HKEY>(FakeHandleTable::Instance().Allocate(std::make_unique<FakeRegistryKey>(registryPath)));
 		}
 
 		bool IsFakeHKEY(HKEY fakeRegKey)
 		{
-			auto iterator = m_pendingFakeHKEYs.find(fakeRegKey);
-			return iterator != std::end(m_pendingFakeHKEYs);
+			return FakeHandleTable::Instance().Lookup<FakeRegistryKey>(fakeRegKey) != nullptr;
 		}
 
 		void DestroyFakeHKEY(HKEY fakeRegKey)
 		{
-			auto iterator = m_pendingFakeHKEYs.find(fakeRegKey);
-			assert(iterator != std::end(m_pendingFakeHKEYs));
-			if (iterator != std::end(m_pendingFakeHKEYs))
-				m_pendingFakeHKEYs.erase(iterator);
+			bool released = FakeHandleTable::Instance().Release(fakeRegKey);
+			assert(released);
 		}
 
 		bool SetupDiGetClassDevsWHook(CONST GUID* ClassGuid, PCWSTR Enumerator, HWND hwndParent, DWORD Flags, HDEVINFO& result)
@@ -972,11 +774,12 @@ namespace TestHooks
 			return false;
 		}
 
-		bool DetourSetupDiDestroyDeviceInfoList(HDEVINFO DeviceInfoSet)
+		bool DetourSetupDiDestroyDeviceInfoList(HDEVINFO DeviceInfoSet, BOOL& result)
 		{
 			if (IsDeviceInfoSetAFake(DeviceInfoSet))
 			{
 				DestroyFakeIterator(DeviceInfoSet);
+				result = TRUE;
 				return true;
 			}
 			return false;
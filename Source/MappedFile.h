@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace TestHooks
+{
+	// Read only view of a whole host file. Pages are only read in from disk
+	// when they are first touched, and are shared with every other process
+	// that maps the same file.
+	class MappedFile
+	{
+	private:
+		const unsigned char*			m_data { nullptr };
+		size_t							m_size { 0 };
+#ifdef _WIN32
+		HANDLE							m_mapping { nullptr };
+#endif
+
+		MappedFile() = default;
+
+	public:
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (m_data != nullptr)
+				UnmapViewOfFile(m_data);
+			if (m_mapping != nullptr)
+				CloseHandle(m_mapping);
+#else
+			if (m_data != nullptr)
+				munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+		}
+
+		// Returns nullptr if the file cannot be opened or mapped. Empty files
+		// map to a view without data.
+		static std::unique_ptr<MappedFile> Open(const std::filesystem::path& path)
+		{
+			std::unique_ptr<MappedFile> result(new MappedFile);
+#ifdef _WIN32
+			HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return nullptr;
+
+			LARGE_INTEGER size;
+			bool mapped = false;
+			if (GetFileSizeEx(file, &size))
+			{
+				result->m_size = static_cast<size_t>(size.QuadPart);
+				if (result->m_size == 0)
+					mapped = true;
+				else if ((result->m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) != nullptr)
+				{
+					result->m_data = static_cast<const unsigned char*>(MapViewOfFile(result->m_mapping, FILE_MAP_READ, 0, 0, 0));
+					mapped = result->m_data != nullptr;
+				}
+			}
+			CloseHandle(file);
+			return mapped ? std::move(result) : nullptr;
+#else
+			int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (file < 0)
+				return nullptr;
+
+			struct stat status;
+			bool mapped = false;
+			if (fstat(file, &status) == 0)
+			{
+				result->m_size = static_cast<size_t>(status.st_size);
+				if (result->m_size == 0)
+					mapped = true;
+				else
+				{
+					void* data = mmap(nullptr, result->m_size, PROT_READ, MAP_PRIVATE, file, 0);
+					if (data != MAP_FAILED)
+					{
+						madvise(data, result->m_size, MADV_SEQUENTIAL);
+						result->m_data = static_cast<const unsigned char*>(data);
+						mapped = true;
+					}
+				}
+			}
+			close(file);
+			return mapped ? std::move(result) : nullptr;
+#endif
+		}
+
+		const unsigned char* Data() const
+		{
+			return m_data;
+		}
+
+		size_t Size() const
+		{
+			return m_size;
+		}
+	};
+}
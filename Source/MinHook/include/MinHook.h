@@ -32,7 +32,24 @@
     #error MinHook supports only x86 and x64 systems.
 #endif
 
-#include <windows.h>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    // The Windows types of the API, for the other platforms.
+    #include <stddef.h>
+    #include <wchar.h>
+
+    #define WINAPI
+    #define VOID void
+    #define TRUE  1
+    #define FALSE 0
+
+    typedef int            BOOL;
+    typedef unsigned int   UINT;
+    typedef void          *LPVOID;
+    typedef const char    *LPCSTR;
+    typedef const wchar_t *LPCWSTR;
+#endif
 
 // MinHook Error Codes.
 typedef enum MH_STATUS
@@ -87,6 +104,16 @@ MH_STATUS;
 // MH_QueueEnableHook or MH_QueueDisableHook.
 #define MH_ALL_HOOKS NULL
 
+// One hook to be created by MH_CreateHooks.
+typedef struct _MH_HOOK_DESC
+{
+    LPVOID    pTarget;      // [in]  A pointer to the target function.
+    LPVOID    pDetour;      // [in]  A pointer to the detour function.
+    LPVOID   *ppOriginal;   // [out] Receives the trampoline function. Can be NULL.
+    MH_STATUS status;       // [out] The result of creating this hook.
+}
+MH_HOOK_DESC;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -110,6 +137,16 @@ extern "C" {
     //                    This parameter can be NULL.
     MH_STATUS WINAPI MH_CreateHook(LPVOID pTarget, LPVOID pDetour, LPVOID *ppOriginal);
 
+    // Creates several hooks, in disabled state. The trampolines are built
+    // without holding the library lock, then all hooks are registered under a
+    // single acquisition of it. Every hook is attempted; the status of each
+    // one is stored in its MH_HOOK_DESC.
+    // Parameters:
+    //   pHooks [in, out] The hooks to create.
+    //   count  [in]      The number of elements in pHooks.
+    // Returns MH_OK if every hook was created, otherwise the first error.
+    MH_STATUS WINAPI MH_CreateHooks(MH_HOOK_DESC *pHooks, UINT count);
+
     // Creates a Hook for the specified API function, in disabled state.
     // Parameters:
     //   pszModule  [in]  A pointer to the loaded module name which contains the
@@ -177,6 +214,38 @@ extern "C" {
     // Applies all queued changes in one go.
     MH_STATUS WINAPI MH_ApplyQueued(VOID);
 
+    // Enables several already created hooks, suspending the other threads of
+    // the process only once. If any target has no hook, nothing is changed.
+    // Changes queued earlier with MH_QueueEnableHook or MH_QueueDisableHook
+    // are applied as well.
+    // Parameters:
+    //   ppTargets [in] Pointers to the target functions.
+    //   count     [in] The number of elements in ppTargets.
+    MH_STATUS WINAPI MH_EnableHooks(LPVOID *ppTargets, UINT count);
+
+    // Disables several already created hooks in one go, like MH_EnableHooks.
+    // Parameters:
+    //   ppTargets [in] Pointers to the target functions.
+    //   count     [in] The number of elements in ppTargets.
+    MH_STATUS WINAPI MH_DisableHooks(LPVOID *ppTargets, UINT count);
+
+    // Sets whether hooks are enabled and disabled without suspending the
+    // other threads of the process, by swapping the jump in with one atomic
+    // 8-byte write. Hooks whose patched bytes do not allow that, and removal
+    // of enabled hooks, still suspend the threads. Off by default, and turned
+    // off again by MH_Uninitialize.
+    // Parameters:
+    //   enable [in] TRUE to patch atomically where possible.
+    MH_STATUS WINAPI MH_SetAtomicPatching(BOOL enable);
+
+    // Sets whether the trampolines of hooks created from now on are placed
+    // in memory mapped twice: once executable, where they run, and once
+    // writable, where MinHook writes them. No page is then both writable and
+    // executable. Off by default, and turned off again by MH_Uninitialize.
+    // Parameters:
+    //   enable [in] TRUE to dual-map new trampolines.
+    MH_STATUS WINAPI MH_SetDualMappedTrampolines(BOOL enable);
+
     // Translates the MH_STATUS to its name as a string.
     const char * WINAPI MH_StatusToString(MH_STATUS status);
 
@@ -26,43 +26,95 @@
  *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <windows.h>
+#include "platform/compat.h"
+#include "platform/memory.h"
 #include "buffer.h"
 
-// Size of each memory block. (= page size of VirtualAlloc)
+// Size of each memory block. (= page size of CommitCodeMemory)
 #define MEMORY_BLOCK_SIZE 0x1000
 
+// Size of the address space reserved at once, which blocks are committed in.
+// (= allocation granularity of Windows)
+#define MEMORY_RESERVATION_SIZE 0x10000
+
+// Number of blocks in a reservation.
+#define BLOCKS_PER_RESERVATION (MEMORY_RESERVATION_SIZE / MEMORY_BLOCK_SIZE)
+
+// usedBlocks of a reservation with every block committed.
+#define ALL_BLOCKS_USED ((DWORD)((1ULL << BLOCKS_PER_RESERVATION) - 1))
+
 // Max range for seeking a memory block. (= 1024MB)
 #define MAX_MEMORY_RANGE 0x40000000
 
-// Memory protection flags to check the executable address.
-#define PAGE_EXECUTE_FLAGS \
-    (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)
+// Number of slot sizes, from MEMORY_SLOT_SIZE up to MEMORY_SLOT_MAX_SIZE.
+#define SIZE_CLASSES 3
 
-// Memory slot.
-typedef struct _MEMORY_SLOT
-{
-    union
-    {
-        struct _MEMORY_SLOT *pNext;
-        UINT8 buffer[MEMORY_SLOT_SIZE];
-    };
-} MEMORY_SLOT, *PMEMORY_SLOT;
+// Number of the smallest slots in a block, including the first, which holds
+// the block info.
+#define SLOTS_PER_BLOCK ((UINT)(MEMORY_BLOCK_SIZE / MEMORY_SLOT_SIZE))
+
+// Initial capacity of the block and reservation indexes.
+#define INITIAL_BLOCK_CAPACITY 16
 
-// Memory block info. Placed at the head of each block.
+// Memory block info. Placed in the first slot of each block. Blocks are
+// aligned to MEMORY_BLOCK_SIZE, so a slot finds its block by rounding down.
+// All the slots of a block are the same size, so that small trampolines stay
+// packed together. In dual-mapped memory, the info is only written through
+// the writable view.
 typedef struct _MEMORY_BLOCK
 {
-    struct _MEMORY_BLOCK *pNext;
-    PMEMORY_SLOT pFree;         // First element of the free slot list.
-    UINT usedCount;
+    DWORD     freeSlots[SLOTS_PER_BLOCK / 32];  // A set bit for each unused slot.
+    UINT      usedCount;
+    UINT      sizeClass;                        // Slots are MEMORY_SLOT_SIZE << sizeClass bytes.
+    ULONG_PTR writableOffset;                   // Added to an address in the block to get its writable view.
 } MEMORY_BLOCK, *PMEMORY_BLOCK;
 
+// Memory blocks, sorted by address.
+typedef struct _BLOCK_INDEX
+{
+    PMEMORY_BLOCK *pItems;      // Data heap
+    UINT           size;        // Actual number of data items
+} BLOCK_INDEX, *PBLOCK_INDEX;
+
+// Address space reserved near a target. Blocks for targets nearby are
+// committed in it one by one, instead of each taking a whole allocation
+// granularity of the address space within reach.
+typedef struct _RESERVATION
+{
+    ULONG_PTR base;
+    ULONG_PTR writable;         // Base of the writable view if dual-mapped, otherwise 0.
+    DWORD     usedBlocks;       // A set bit for each committed block.
+} RESERVATION, *PRESERVATION;
+
+// Reservations, sorted by address.
+typedef struct _RESERVATION_INDEX
+{
+    PRESERVATION pItems;        // Data heap
+    UINT         size;          // Actual number of data items
+    UINT         capacity;      // Size of allocated data heap, items
+} RESERVATION_INDEX, *PRESERVATION_INDEX;
+
 //-------------------------------------------------------------------------
 // Global Variables:
 //-------------------------------------------------------------------------
 
-// First element of the memory block list.
-PMEMORY_BLOCK g_pMemoryBlocks;
+// All the memory blocks, and those of them with an unused slot for each
+// kind of memory and size class. All have room for g_blockCapacity items, so
+// that a block can always be added to g_freeBlocks without allocating.
+BLOCK_INDEX g_blocks;
+BLOCK_INDEX g_freeBlocks[2][SIZE_CLASSES];
+UINT        g_blockCapacity;
+
+// The reservations blocks are committed in. They are kept until
+// UninitializeBuffer(), even when all their blocks are decommitted.
+RESERVATION_INDEX g_reservations;
+
+// Are new buffers allocated in dual-mapped memory?
+BOOL g_dualMapped = FALSE;
+
+// Guards the memory blocks. Trampolines are built outside the hook lock, so
+// buffers are allocated and freed concurrently.
+SRWLOCK g_bufferLock = SRWLOCK_INIT;
 
 //-------------------------------------------------------------------------
 VOID InitializeBuffer(VOID)
@@ -73,42 +125,274 @@ VOID InitializeBuffer(VOID)
 //-------------------------------------------------------------------------
 VOID UninitializeBuffer(VOID)
 {
-    PMEMORY_BLOCK pBlock = g_pMemoryBlocks;
-    g_pMemoryBlocks = NULL;
+    RESERVATION_INDEX reservations;
+    UINT i;
+
+    AcquireSRWLockExclusive(&g_bufferLock);
+    reservations = g_reservations;
+    if (g_blocks.pItems != NULL)
+        HeapFree(GetProcessHeap(), 0, g_blocks.pItems);
+    for (i = 0; i < 2 * SIZE_CLASSES; ++i)
+    {
+        PBLOCK_INDEX pFreeBlocks = &g_freeBlocks[i / SIZE_CLASSES][i % SIZE_CLASSES];
+        if (pFreeBlocks->pItems != NULL)
+            HeapFree(GetProcessHeap(), 0, pFreeBlocks->pItems);
+
+        pFreeBlocks->pItems = NULL;
+        pFreeBlocks->size   = 0;
+    }
+
+    g_blocks.pItems         = NULL;
+    g_blocks.size           = 0;
+    g_blockCapacity         = 0;
+    g_reservations.pItems   = NULL;
+    g_reservations.size     = 0;
+    g_reservations.capacity = 0;
+    g_dualMapped            = FALSE;
+    ReleaseSRWLockExclusive(&g_bufferLock);
 
-    while (pBlock)
+    for (i = 0; i < reservations.size; ++i)
     {
-        PMEMORY_BLOCK pNext = pBlock->pNext;
-        VirtualFree(pBlock, 0, MEM_RELEASE);
-        pBlock = pNext;
+        ReleaseCodeMemory(
+            (LPVOID)reservations.pItems[i].base,
+            (LPVOID)reservations.pItems[i].writable,
+            MEMORY_RESERVATION_SIZE);
     }
+
+    if (reservations.pItems != NULL)
+        HeapFree(GetProcessHeap(), 0, reservations.pItems);
+}
+
+//-------------------------------------------------------------------------
+// Returns the position of the first block at or above address.
+static UINT FindBlockPos(const BLOCK_INDEX *pIndex, ULONG_PTR address)
+{
+    UINT low  = 0;
+    UINT high = pIndex->size;
+
+    while (low < high)
+    {
+        UINT mid = low + (high - low) / 2;
+        if ((ULONG_PTR)pIndex->pItems[mid] < address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+//-------------------------------------------------------------------------
+static VOID InsertBlock(PBLOCK_INDEX pIndex, PMEMORY_BLOCK pBlock)
+{
+    UINT pos = FindBlockPos(pIndex, (ULONG_PTR)pBlock);
+
+    memmove(&pIndex->pItems[pos + 1], &pIndex->pItems[pos], (pIndex->size - pos) * sizeof(PMEMORY_BLOCK));
+    pIndex->pItems[pos] = pBlock;
+    pIndex->size++;
+}
+
+//-------------------------------------------------------------------------
+static VOID RemoveBlock(PBLOCK_INDEX pIndex, PMEMORY_BLOCK pBlock)
+{
+    UINT pos = FindBlockPos(pIndex, (ULONG_PTR)pBlock);
+    if (pos < pIndex->size && pIndex->pItems[pos] == pBlock)
+    {
+        pIndex->size--;
+        memmove(&pIndex->pItems[pos], &pIndex->pItems[pos + 1], (pIndex->size - pos) * sizeof(PMEMORY_BLOCK));
+    }
+}
+
+//-------------------------------------------------------------------------
+static BOOL ResizeBlockIndex(PBLOCK_INDEX pIndex, UINT capacity)
+{
+    PMEMORY_BLOCK *p;
+    if (pIndex->pItems == NULL)
+        p = (PMEMORY_BLOCK *)HeapAlloc(GetProcessHeap(), 0, capacity * sizeof(PMEMORY_BLOCK));
+    else
+        p = (PMEMORY_BLOCK *)HeapReAlloc(GetProcessHeap(), 0, pIndex->pItems, capacity * sizeof(PMEMORY_BLOCK));
+    if (p == NULL)
+        return FALSE;
+
+    pIndex->pItems = p;
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+// Makes room for one more block in the indexes.
+static BOOL ReserveBlock(VOID)
+{
+    UINT capacity;
+    UINT i;
+
+    if (g_blocks.size < g_blockCapacity)
+        return TRUE;
+
+    capacity = g_blockCapacity != 0 ? g_blockCapacity * 2 : INITIAL_BLOCK_CAPACITY;
+    if (!ResizeBlockIndex(&g_blocks, capacity))
+        return FALSE;
+
+    for (i = 0; i < 2 * SIZE_CLASSES; ++i)
+    {
+        if (!ResizeBlockIndex(&g_freeBlocks[i / SIZE_CLASSES][i % SIZE_CLASSES], capacity))
+            return FALSE;
+    }
+
+    g_blockCapacity = capacity;
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+// Returns the block with an unused slot nearest to origin within
+// [minAddr, maxAddr), or NULL.
+static PMEMORY_BLOCK FindFreeBlock(const BLOCK_INDEX *pIndex, ULONG_PTR origin, ULONG_PTR minAddr, ULONG_PTR maxAddr)
+{
+    UINT          pos    = FindBlockPos(pIndex, origin);
+    PMEMORY_BLOCK pAbove = NULL;
+    PMEMORY_BLOCK pBelow = NULL;
+
+    if (pos < pIndex->size && (ULONG_PTR)pIndex->pItems[pos] < maxAddr)
+        pAbove = pIndex->pItems[pos];
+
+    if (pos > 0 && (ULONG_PTR)pIndex->pItems[pos - 1] >= minAddr)
+        pBelow = pIndex->pItems[pos - 1];
+
+    if (pAbove == NULL)
+        return pBelow;
+
+    if (pBelow == NULL)
+        return pAbove;
+
+    return ((ULONG_PTR)pAbove - origin < origin - (ULONG_PTR)pBelow) ? pAbove : pBelow;
+}
+
+//-------------------------------------------------------------------------
+// Returns the position of the first reservation above address.
+static UINT FindReservationPos(ULONG_PTR address)
+{
+    UINT low  = 0;
+    UINT high = g_reservations.size;
+
+    while (low < high)
+    {
+        UINT mid = low + (high - low) / 2;
+        if (g_reservations.pItems[mid].base <= address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+//-------------------------------------------------------------------------
+// Makes room for one more reservation in the index.
+static BOOL ReserveReservation(VOID)
+{
+    PRESERVATION p;
+    UINT         capacity;
+
+    if (g_reservations.size < g_reservations.capacity)
+        return TRUE;
+
+    capacity = g_reservations.capacity != 0 ? g_reservations.capacity * 2 : INITIAL_BLOCK_CAPACITY;
+    if (g_reservations.pItems == NULL)
+        p = (PRESERVATION)HeapAlloc(GetProcessHeap(), 0, capacity * sizeof(RESERVATION));
+    else
+        p = (PRESERVATION)HeapReAlloc(GetProcessHeap(), 0, g_reservations.pItems, capacity * sizeof(RESERVATION));
+    if (p == NULL)
+        return FALSE;
+
+    g_reservations.pItems   = p;
+    g_reservations.capacity = capacity;
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+static PRESERVATION InsertReservation(ULONG_PTR base, ULONG_PTR writable)
+{
+    UINT pos = FindReservationPos(base);
+
+    memmove(&g_reservations.pItems[pos + 1], &g_reservations.pItems[pos], (g_reservations.size - pos) * sizeof(RESERVATION));
+    g_reservations.pItems[pos].base       = base;
+    g_reservations.pItems[pos].writable   = writable;
+    g_reservations.pItems[pos].usedBlocks = 0;
+    g_reservations.size++;
+
+    return &g_reservations.pItems[pos];
+}
+
+//-------------------------------------------------------------------------
+// Returns the reservation of the current kind of memory with an uncommitted
+// block nearest to origin, all of whose blocks are within [minAddr, maxAddr),
+// or NULL.
+static PRESERVATION FindFreeReservation(ULONG_PTR origin, ULONG_PTR minAddr, ULONG_PTR maxAddr)
+{
+    UINT         pos    = FindReservationPos(origin);
+    PRESERVATION pAbove = NULL;
+    PRESERVATION pBelow = NULL;
+    UINT         i;
+
+    for (i = pos; i < g_reservations.size; ++i)
+    {
+        PRESERVATION p = &g_reservations.pItems[i];
+        if (p->base + (MEMORY_RESERVATION_SIZE - MEMORY_BLOCK_SIZE) >= maxAddr)
+            break;
+
+        if (p->usedBlocks != ALL_BLOCKS_USED && (p->writable != 0) == g_dualMapped)
+        {
+            pAbove = p;
+            break;
+        }
+    }
+
+    for (i = pos; i > 0; --i)
+    {
+        PRESERVATION p = &g_reservations.pItems[i - 1];
+        if (p->base < minAddr)
+            break;
+
+        if (p->usedBlocks != ALL_BLOCKS_USED && (p->writable != 0) == g_dualMapped)
+        {
+            pBelow = p;
+            break;
+        }
+    }
+
+    if (pAbove == NULL)
+        return pBelow;
+
+    if (pBelow == NULL)
+        return pAbove;
+
+    return (pAbove->base - origin < origin - pBelow->base) ? pAbove : pBelow;
 }
 
 //-------------------------------------------------------------------------
 #if defined(_M_X64) || defined(__x86_64__)
-static LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, DWORD dwAllocationGranularity)
+static LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, SIZE_T allocationGranularity)
 {
     ULONG_PTR tryAddr = (ULONG_PTR)pAddress;
 
     // Round down to the allocation granularity.
-    tryAddr -= tryAddr % dwAllocationGranularity;
+    tryAddr -= tryAddr % allocationGranularity;
 
     // Start from the previous allocation granularity multiply.
-    tryAddr -= dwAllocationGranularity;
+    tryAddr -= allocationGranularity;
 
     while (tryAddr >= (ULONG_PTR)pMinAddr)
     {
-        MEMORY_BASIC_INFORMATION mbi;
-        if (VirtualQuery((LPVOID)tryAddr, &mbi, sizeof(mbi)) == 0)
+        MEMORY_REGION region;
+        if (!QueryMemoryRegion((LPVOID)tryAddr, &region))
             break;
 
-        if (mbi.State == MEM_FREE)
+        if (region.isFree)
             return (LPVOID)tryAddr;
 
-        if ((ULONG_PTR)mbi.AllocationBase < dwAllocationGranularity)
+        if (region.allocationBase < allocationGranularity)
             break;
 
-        tryAddr = (ULONG_PTR)mbi.AllocationBase - dwAllocationGranularity;
+        tryAddr = region.allocationBase - allocationGranularity;
     }
 
     return NULL;
@@ -117,30 +401,30 @@ static LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, DWORD dwAlloc
 
 //-------------------------------------------------------------------------
 #if defined(_M_X64) || defined(__x86_64__)
-static LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, DWORD dwAllocationGranularity)
+static LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, SIZE_T allocationGranularity)
 {
     ULONG_PTR tryAddr = (ULONG_PTR)pAddress;
 
     // Round down to the allocation granularity.
-    tryAddr -= tryAddr % dwAllocationGranularity;
+    tryAddr -= tryAddr % allocationGranularity;
 
     // Start from the next allocation granularity multiply.
-    tryAddr += dwAllocationGranularity;
+    tryAddr += allocationGranularity;
 
     while (tryAddr <= (ULONG_PTR)pMaxAddr)
     {
-        MEMORY_BASIC_INFORMATION mbi;
-        if (VirtualQuery((LPVOID)tryAddr, &mbi, sizeof(mbi)) == 0)
+        MEMORY_REGION region;
+        if (!QueryMemoryRegion((LPVOID)tryAddr, &region))
             break;
 
-        if (mbi.State == MEM_FREE)
+        if (region.isFree)
             return (LPVOID)tryAddr;
 
-        tryAddr = (ULONG_PTR)mbi.BaseAddress + mbi.RegionSize;
+        tryAddr = region.base + region.size;
 
         // Round up to the next allocation granularity.
-        tryAddr += dwAllocationGranularity - 1;
-        tryAddr -= tryAddr % dwAllocationGranularity;
+        tryAddr += allocationGranularity - 1;
+        tryAddr -= tryAddr % allocationGranularity;
     }
 
     return NULL;
@@ -148,116 +432,184 @@ static LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, DWORD dwAlloc
 #endif
 
 //-------------------------------------------------------------------------
-static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin)
+// Reserves address space for a new reservation within [minAddr, maxAddr],
+// as near to origin as possible, and registers it.
+static PRESERVATION AddReservation(LPVOID pOrigin, ULONG_PTR minAddr, ULONG_PTR maxAddr)
 {
-    PMEMORY_BLOCK pBlock;
+    LPVOID  pBase      = NULL;
+    LPVOID  pWritable  = NULL;
+    LPVOID *ppWritable = g_dualMapped ? &pWritable : NULL;
 #if defined(_M_X64) || defined(__x86_64__)
-    ULONG_PTR minAddr;
-    ULONG_PTR maxAddr;
+    uintptr_t minAppAddr;
+    uintptr_t maxAppAddr;
+    size_t    allocationGranularity;
 
-    SYSTEM_INFO si;
-    GetSystemInfo(&si);
-    minAddr = (ULONG_PTR)si.lpMinimumApplicationAddress;
-    maxAddr = (ULONG_PTR)si.lpMaximumApplicationAddress;
+    GetMemoryLayout(&minAppAddr, &maxAppAddr, &allocationGranularity);
 
-    // pOrigin ± 512MB
-    if ((ULONG_PTR)pOrigin > MAX_MEMORY_RANGE && minAddr < (ULONG_PTR)pOrigin - MAX_MEMORY_RANGE)
-        minAddr = (ULONG_PTR)pOrigin - MAX_MEMORY_RANGE;
-
-    if (maxAddr > (ULONG_PTR)pOrigin + MAX_MEMORY_RANGE)
-        maxAddr = (ULONG_PTR)pOrigin + MAX_MEMORY_RANGE;
+    // Reservations are aligned to their size, even where the system would
+    // allow finer placement.
+    if (allocationGranularity < MEMORY_RESERVATION_SIZE)
+        allocationGranularity = MEMORY_RESERVATION_SIZE;
 
-    // Make room for MEMORY_BLOCK_SIZE bytes.
-    maxAddr -= MEMORY_BLOCK_SIZE - 1;
-#endif
-
-    // Look the registered blocks for a reachable one.
-    for (pBlock = g_pMemoryBlocks; pBlock != NULL; pBlock = pBlock->pNext)
-    {
-#if defined(_M_X64) || defined(__x86_64__)
-        // Ignore the blocks too far.
-        if ((ULONG_PTR)pBlock < minAddr || (ULONG_PTR)pBlock >= maxAddr)
-            continue;
-#endif
-        // The block has at least one unused slot.
-        if (pBlock->pFree != NULL)
-            return pBlock;
-    }
+    // Make room for MEMORY_RESERVATION_SIZE bytes.
+    maxAddr -= MEMORY_RESERVATION_SIZE - MEMORY_BLOCK_SIZE;
 
-#if defined(_M_X64) || defined(__x86_64__)
-    // Alloc a new block above if not found.
+    // Alloc a new reservation above if not found.
     {
         LPVOID pAlloc = pOrigin;
         while ((ULONG_PTR)pAlloc >= minAddr)
         {
-            pAlloc = FindPrevFreeRegion(pAlloc, (LPVOID)minAddr, si.dwAllocationGranularity);
+            pAlloc = FindPrevFreeRegion(pAlloc, (LPVOID)minAddr, allocationGranularity);
             if (pAlloc == NULL)
                 break;
 
-            pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-                pAlloc, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-            if (pBlock != NULL)
+            pBase = ReserveCodeMemory(pAlloc, MEMORY_RESERVATION_SIZE, ppWritable);
+            if (pBase != NULL)
                 break;
         }
     }
 
-    // Alloc a new block below if not found.
-    if (pBlock == NULL)
+    // Alloc a new reservation below if not found.
+    if (pBase == NULL)
     {
         LPVOID pAlloc = pOrigin;
         while ((ULONG_PTR)pAlloc <= maxAddr)
         {
-            pAlloc = FindNextFreeRegion(pAlloc, (LPVOID)maxAddr, si.dwAllocationGranularity);
+            pAlloc = FindNextFreeRegion(pAlloc, (LPVOID)maxAddr, allocationGranularity);
             if (pAlloc == NULL)
                 break;
 
-            pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-                pAlloc, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-            if (pBlock != NULL)
+            pBase = ReserveCodeMemory(pAlloc, MEMORY_RESERVATION_SIZE, ppWritable);
+            if (pBase != NULL)
                 break;
         }
     }
 #else
-    // In x86 mode, a memory block can be placed anywhere.
-    pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-        NULL, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    // In x86 mode, a reservation can be placed anywhere.
+    (void)pOrigin;
+    (void)minAddr;
+    (void)maxAddr;
+    pBase = ReserveCodeMemory(NULL, MEMORY_RESERVATION_SIZE, ppWritable);
+#endif
+
+    if (pBase == NULL)
+        return NULL;
+
+    return InsertReservation((ULONG_PTR)pBase, (ULONG_PTR)pWritable);
+}
+
+//-------------------------------------------------------------------------
+static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin, UINT sizeClass)
+{
+    PMEMORY_BLOCK pBlock;
+    PMEMORY_BLOCK pHeader;
+    PRESERVATION  pReservation;
+    LPVOID        pWritable = NULL;
+    DWORD         index;
+    UINT          i;
+    uintptr_t minAddr = 0;
+    uintptr_t maxAddr = UINTPTR_MAX;
+#if defined(_M_X64) || defined(__x86_64__)
+    size_t    allocationGranularity;
+
+    GetMemoryLayout(&minAddr, &maxAddr, &allocationGranularity);
+
+    // pOrigin ± 512MB
+    if ((ULONG_PTR)pOrigin > MAX_MEMORY_RANGE && minAddr < (ULONG_PTR)pOrigin - MAX_MEMORY_RANGE)
+        minAddr = (ULONG_PTR)pOrigin - MAX_MEMORY_RANGE;
+
+    if (maxAddr > (ULONG_PTR)pOrigin + MAX_MEMORY_RANGE)
+        maxAddr = (ULONG_PTR)pOrigin + MAX_MEMORY_RANGE;
+
+    // Make room for MEMORY_BLOCK_SIZE bytes.
+    maxAddr -= MEMORY_BLOCK_SIZE - 1;
 #endif
 
+    // Look the registered blocks for a reachable one.
+    pBlock = FindFreeBlock(&g_freeBlocks[g_dualMapped][sizeClass], (ULONG_PTR)pOrigin, minAddr, maxAddr);
     if (pBlock != NULL)
-    {
-        // Build a linked list of all the slots.
-        PMEMORY_SLOT pSlot = (PMEMORY_SLOT)pBlock + 1;
-        pBlock->pFree = NULL;
-        pBlock->usedCount = 0;
-        do
-        {
-            pSlot->pNext = pBlock->pFree;
-            pBlock->pFree = pSlot;
-            pSlot++;
-        } while ((ULONG_PTR)pSlot - (ULONG_PTR)pBlock <= MEMORY_BLOCK_SIZE - MEMORY_SLOT_SIZE);
+        return pBlock;
 
-        pBlock->pNext = g_pMemoryBlocks;
-        g_pMemoryBlocks = pBlock;
-    }
+    if (!ReserveBlock() || !ReserveReservation())
+        return NULL;
+
+    // Commit a new block in a reachable reservation, reserving a new one
+    // only when those nearby are used up.
+    pReservation = FindFreeReservation((ULONG_PTR)pOrigin, minAddr, maxAddr);
+    if (pReservation == NULL)
+        pReservation = AddReservation(pOrigin, minAddr, maxAddr);
+    if (pReservation == NULL)
+        return NULL;
+
+    BitScanForward(&index, ~pReservation->usedBlocks);
+    pBlock = (PMEMORY_BLOCK)(pReservation->base + index * MEMORY_BLOCK_SIZE);
+    if (pReservation->writable != 0)
+        pWritable = (LPVOID)(pReservation->writable + index * MEMORY_BLOCK_SIZE);
+    if (!CommitCodeMemory(pBlock, pWritable, MEMORY_BLOCK_SIZE))
+        return NULL;
+
+    pReservation->usedBlocks |= (DWORD)1 << index;
+
+    pHeader = pWritable != NULL ? (PMEMORY_BLOCK)pWritable : pBlock;
+
+    // Every slot but the first one is unused.
+    for (i = 0; i < SLOTS_PER_BLOCK / 32; ++i)
+        pHeader->freeSlots[i] = 0;
+    for (i = 1; i < SLOTS_PER_BLOCK >> sizeClass; ++i)
+        pHeader->freeSlots[i / 32] |= (DWORD)1 << (i % 32);
+    pHeader->usedCount      = 0;
+    pHeader->sizeClass      = sizeClass;
+    pHeader->writableOffset = (ULONG_PTR)pHeader - (ULONG_PTR)pBlock;
+
+    InsertBlock(&g_blocks, pBlock);
+    InsertBlock(&g_freeBlocks[g_dualMapped][sizeClass], pBlock);
 
     return pBlock;
 }
 
 //-------------------------------------------------------------------------
-LPVOID AllocateBuffer(LPVOID pOrigin)
+// Returns a slot of the smallest size class that holds size bytes.
+LPVOID AllocateBuffer(LPVOID pOrigin, UINT size)
 {
-    PMEMORY_SLOT  pSlot;
-    PMEMORY_BLOCK pBlock = GetMemoryBlock(pOrigin);
+    LPBYTE        pSlot;
+    PMEMORY_BLOCK pBlock;
+    PMEMORY_BLOCK pHeader;
+    DWORD         bit;
+    UINT          sizeClass = 0;
+    UINT          i;
+
+    while ((UINT)(MEMORY_SLOT_SIZE << sizeClass) < size)
+    {
+        if (++sizeClass == SIZE_CLASSES)
+            return NULL;
+    }
+
+    AcquireSRWLockExclusive(&g_bufferLock);
+
+    pBlock = GetMemoryBlock(pOrigin, sizeClass);
     if (pBlock == NULL)
+    {
+        ReleaseSRWLockExclusive(&g_bufferLock);
         return NULL;
+    }
 
-    // Remove an unused slot from the list.
-    pSlot = pBlock->pFree;
-    pBlock->pFree = pSlot->pNext;
-    pBlock->usedCount++;
+    pHeader = (PMEMORY_BLOCK)((ULONG_PTR)pBlock + pBlock->writableOffset);
+
+    // Take the lowest unused slot.
+    for (i = 0; pHeader->freeSlots[i] == 0; ++i)
+        ;
+    BitScanForward(&bit, pHeader->freeSlots[i]);
+    pHeader->freeSlots[i] &= ~((DWORD)1 << bit);
+    pSlot = (LPBYTE)pBlock + (i * 32 + bit) * (MEMORY_SLOT_SIZE << sizeClass);
+
+    pHeader->usedCount++;
+    if (pHeader->usedCount == (SLOTS_PER_BLOCK >> sizeClass) - 1)
+        RemoveBlock(&g_freeBlocks[g_dualMapped][sizeClass], pBlock);
+
+    ReleaseSRWLockExclusive(&g_bufferLock);
 #ifdef _DEBUG
     // Fill the slot with INT3 for debugging.
-    memset(pSlot, 0xCC, sizeof(MEMORY_SLOT));
+    memset(pSlot + pHeader->writableOffset, 0xCC, MEMORY_SLOT_SIZE << sizeClass);
 #endif
     return pSlot;
 }
@@ -265,48 +617,77 @@ LPVOID AllocateBuffer(LPVOID pOrigin)
 //-------------------------------------------------------------------------
 VOID FreeBuffer(LPVOID pBuffer)
 {
-    PMEMORY_BLOCK pBlock = g_pMemoryBlocks;
-    PMEMORY_BLOCK pPrev = NULL;
-    ULONG_PTR pTargetBlock = ((ULONG_PTR)pBuffer / MEMORY_BLOCK_SIZE) * MEMORY_BLOCK_SIZE;
-
-    while (pBlock != NULL)
+    PMEMORY_BLOCK pBlock = (PMEMORY_BLOCK)((ULONG_PTR)pBuffer & ~(ULONG_PTR)(MEMORY_BLOCK_SIZE - 1));
+    PMEMORY_BLOCK pHeader;
+    PBLOCK_INDEX  pFreeBlocks;
+    UINT          sizeClass;
+    UINT          slot;
+    UINT          pos;
+
+    AcquireSRWLockExclusive(&g_bufferLock);
+
+    // The block is gone if UninitializeBuffer() ran since the allocation.
+    pos = FindBlockPos(&g_blocks, (ULONG_PTR)pBlock);
+    if (pos == g_blocks.size || g_blocks.pItems[pos] != pBlock)
     {
-        if ((ULONG_PTR)pBlock == pTargetBlock)
-        {
-            PMEMORY_SLOT pSlot = (PMEMORY_SLOT)pBuffer;
+        ReleaseSRWLockExclusive(&g_bufferLock);
+        return;
+    }
+
+    pHeader     = (PMEMORY_BLOCK)((ULONG_PTR)pBlock + pBlock->writableOffset);
+    sizeClass   = pHeader->sizeClass;
+    slot        = (UINT)(((ULONG_PTR)pBuffer - (ULONG_PTR)pBlock) / (MEMORY_SLOT_SIZE << sizeClass));
+    pFreeBlocks = &g_freeBlocks[pHeader->writableOffset != 0][sizeClass];
+
 #ifdef _DEBUG
-            // Clear the released slot for debugging.
-            memset(pSlot, 0x00, sizeof(*pSlot));
+    // Clear the released slot for debugging.
+    memset((LPBYTE)pBuffer + pHeader->writableOffset, 0x00, MEMORY_SLOT_SIZE << sizeClass);
 #endif
-            // Restore the released slot to the list.
-            pSlot->pNext = pBlock->pFree;
-            pBlock->pFree = pSlot;
-            pBlock->usedCount--;
-
-            // Free if unused.
-            if (pBlock->usedCount == 0)
-            {
-                if (pPrev)
-                    pPrev->pNext = pBlock->pNext;
-                else
-                    g_pMemoryBlocks = pBlock->pNext;
-
-                VirtualFree(pBlock, 0, MEM_RELEASE);
-            }
 
-            break;
-        }
+    // A full block gets an unused slot again.
+    if (pHeader->usedCount == (SLOTS_PER_BLOCK >> sizeClass) - 1)
+        InsertBlock(pFreeBlocks, pBlock);
+
+    pHeader->freeSlots[slot / 32] |= (DWORD)1 << (slot % 32);
+    pHeader->usedCount--;
 
-        pPrev = pBlock;
-        pBlock = pBlock->pNext;
+    // Decommit if unused. The reservation stays for the next block nearby.
+    if (pHeader->usedCount == 0)
+    {
+        PRESERVATION pReservation = &g_reservations.pItems[FindReservationPos((ULONG_PTR)pBlock) - 1];
+        UINT         index        = (UINT)(((ULONG_PTR)pBlock - pReservation->base) / MEMORY_BLOCK_SIZE);
+
+        RemoveBlock(pFreeBlocks, pBlock);
+        RemoveBlock(&g_blocks, pBlock);
+
+        DecommitCodeMemory(pBlock, pHeader != pBlock ? pHeader : NULL, MEMORY_BLOCK_SIZE);
+        pReservation->usedBlocks &= ~((DWORD)1 << index);
     }
+
+    ReleaseSRWLockExclusive(&g_bufferLock);
+}
+
+//-------------------------------------------------------------------------
+LPVOID GetWritableBuffer(LPVOID pBuffer)
+{
+    PMEMORY_BLOCK pBlock = (PMEMORY_BLOCK)((ULONG_PTR)pBuffer & ~(ULONG_PTR)(MEMORY_BLOCK_SIZE - 1));
+    return (LPBYTE)pBuffer + pBlock->writableOffset;
+}
+
+//-------------------------------------------------------------------------
+VOID SetBufferDualMapping(BOOL enable)
+{
+    AcquireSRWLockExclusive(&g_bufferLock);
+    g_dualMapped = enable ? TRUE : FALSE;
+    ReleaseSRWLockExclusive(&g_bufferLock);
 }
 
 //-------------------------------------------------------------------------
 BOOL IsExecutableAddress(LPVOID pAddress)
 {
-    MEMORY_BASIC_INFORMATION mi;
-    VirtualQuery(pAddress, &mi, sizeof(mi));
+    MEMORY_REGION region;
+    if (!QueryMemoryRegion(pAddress, &region))
+        return FALSE;
 
-    return (mi.State == MEM_COMMIT && (mi.Protect & PAGE_EXECUTE_FLAGS));
+    return region.isExecutable;
 }
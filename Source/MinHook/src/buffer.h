@@ -35,8 +35,22 @@
     #define MEMORY_SLOT_SIZE 32
 #endif
 
+// Size of the largest memory slot. Slots come in MEMORY_SLOT_SIZE and its
+// doublings up to this.
+#define MEMORY_SLOT_MAX_SIZE (MEMORY_SLOT_SIZE * 4)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 VOID   InitializeBuffer(VOID);
 VOID   UninitializeBuffer(VOID);
-LPVOID AllocateBuffer(LPVOID pOrigin);
+LPVOID AllocateBuffer(LPVOID pOrigin, UINT size);
 VOID   FreeBuffer(LPVOID pBuffer);
+LPVOID GetWritableBuffer(LPVOID pBuffer);
+VOID   SetBufferDualMapping(BOOL enable);
 BOOL   IsExecutableAddress(LPVOID pAddress);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,7 @@
 
 #if defined(_M_IX86) || defined(__i386__)
 
+#include <string.h>
 #include "hde32.h"
 #include "table32.h"
 
@@ -17,7 +18,7 @@ unsigned int hde32_disasm(const void *code, hde32s *hs)
 
     // Avoid using memset to reduce the footprint.
 #ifndef _MSC_VER
-    memset((LPBYTE)hs, 0, sizeof(hde32s));
+    memset((uint8_t *)hs, 0, sizeof(hde32s));
 #else
     __stosb((LPBYTE)hs, 0, sizeof(hde32s));
 #endif
@@ -7,6 +7,7 @@
 
 #if defined(_M_X64) || defined(__x86_64__)
 
+#include <string.h>
 #include "hde64.h"
 #include "table64.h"
 
@@ -18,7 +19,7 @@ unsigned int hde64_disasm(const void *code, hde64s *hs)
 
     // Avoid using memset to reduce the footprint.
 #ifndef _MSC_VER
-    memset((LPBYTE)hs, 0, sizeof(hde64s));
+    memset((uint8_t *)hs, 0, sizeof(hde64s));
 #else
     __stosb((LPBYTE)hs, 0, sizeof(hde64s));
 #endif
@@ -60,6 +61,72 @@ unsigned int hde64_disasm(const void *code, hde64s *hs)
     if (!pref)
         pref |= PRE_NONE;
 
+    /* VEX (C4, C5), EVEX (62) and XOP (8F with a map of 8 or more, which
+       tells it from POP r/m). hs->opcode keeps the prefix byte, so that no
+       vector instruction passes for a legacy one. */
+    if (c == 0xc4 || c == 0xc5 || c == 0x62 || (c == 0x8f && (*p & 0x1f) >= 8)) {
+        uint8_t map;
+
+        hs->flags |= F_VEX;
+        hs->opcode = c;
+        if (pref & (PRE_F2 | PRE_F3 | PRE_66 | PRE_LOCK))
+            hs->flags |= F_ERROR | F_ERROR_OPCODE;
+
+        hs->rex_r = (~*p >> 7) & 1;
+        if (c == 0xc5) {
+            map = 1;
+            p++;
+        } else {
+            hs->rex_x = (~*p >> 6) & 1;
+            hs->rex_b = (~*p >> 5) & 1;
+            map = *p++ & (c == 0x62 ? 0x07 : 0x1f);
+            hs->rex_w = *p++ >> 7;
+            if (c == 0x62)
+                p++;
+        }
+        hs->vex_map = map;
+        hs->vex_opcode = opcode = *p++;
+
+        cflags = C_MODRM;
+        if (c == 0x8f) {
+            if (map == 8)
+                cflags |= C_IMM8;
+            else if (map == 10)
+                cflags |= C_IMM_P66;
+            else if (map != 9)
+                hs->flags |= F_ERROR | F_ERROR_OPCODE;
+        } else switch (map) {
+            case 1:
+                if (opcode == 0x77 && c != 0x62)
+                    cflags = C_NONE;    /* vzeroupper, vzeroall */
+                else if ((opcode >= 0x70 && opcode <= 0x73)
+                         || (opcode >= 0xc2 && opcode <= 0xc6 && opcode != 0xc3))
+                    cflags |= C_IMM8;
+                break;
+            case 2:
+                break;
+            case 3:
+                cflags |= C_IMM8;
+                break;
+            case 5: case 6:
+                if (c == 0x62)
+                    break;
+                /* fall through */
+            default:
+                hs->flags |= F_ERROR | F_ERROR_OPCODE;
+        }
+
+        if (!(cflags & C_MODRM))
+            goto vex_operands;
+
+        hs->flags |= F_MODRM;
+        hs->modrm = c = *p++;
+        hs->modrm_mod = m_mod = c >> 6;
+        hs->modrm_rm = m_rm = c & 7;
+        hs->modrm_reg = m_reg = (c & 0x3f) >> 3;
+        goto no_error_operand;
+    }
+
     if ((c & 0xf0) == 0x40) {
         hs->flags |= F_PREFIX_REX;
         if ((hs->rex_w = (c & 0xf) >> 3) && (*p & 0xf8) == 0xb8)
@@ -227,7 +294,7 @@ unsigned int hde64_disasm(const void *code, hde64s *hs)
       no_error_operand:
 
         c = *p++;
-        if (m_reg <= 1) {
+        if (m_reg <= 1 && !(hs->flags & F_VEX)) {
             if (opcode == 0xf6)
                 cflags |= C_IMM8;
             else if (opcode == 0xf7)
@@ -280,6 +347,7 @@ unsigned int hde64_disasm(const void *code, hde64s *hs)
     } else if (pref & PRE_LOCK)
         hs->flags |= F_ERROR | F_ERROR_LOCK;
 
+  vex_operands:
     if (cflags & C_IMM_P66) {
         if (cflags & C_REL32) {
             if (pref & PRE_66) {
@@ -31,6 +31,7 @@
 #define F_DISP16        0x00000080
 #define F_DISP32        0x00000100
 #define F_RELATIVE      0x00000200
+#define F_VEX           0x00000400
 #define F_ERROR         0x00001000
 #define F_ERROR_OPCODE  0x00002000
 #define F_ERROR_LENGTH  0x00004000
@@ -74,6 +75,8 @@ typedef struct {
     uint8_t rex_b;
     uint8_t opcode;
     uint8_t opcode2;
+    uint8_t vex_map;
+    uint8_t vex_opcode;
     uint8_t modrm;
     uint8_t modrm_mod;
     uint8_t modrm_reg;
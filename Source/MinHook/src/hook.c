@@ -26,13 +26,16 @@
  *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <windows.h>
-#include <tlhelp32.h>
 #include <limits.h>
+#include "platform/compat.h"
 
 #include "../include/MinHook.h"
 #include "buffer.h"
+#include "iprange.h"
+#include "patch.h"
 #include "trampoline.h"
+#include "platform/memory.h"
+#include "platform/thread.h"
 
 #ifndef ARRAYSIZE
     #define ARRAYSIZE(A) (sizeof(A)/sizeof((A)[0]))
@@ -41,8 +44,8 @@
 // Initial capacity of the HOOK_ENTRY buffer.
 #define INITIAL_HOOK_CAPACITY   32
 
-// Initial capacity of the thread IDs buffer.
-#define INITIAL_THREAD_CAPACITY 128
+// Number of attempts EnterLock() spins for before it blocks.
+#define LOCK_SPIN_COUNT 1024
 
 // Special hook position values.
 #define INVALID_HOOK_POS UINT_MAX
@@ -52,10 +55,7 @@
 #define ACTION_DISABLE      0
 #define ACTION_ENABLE       1
 #define ACTION_APPLY_QUEUED 2
-
-// Thread access rights for suspending/resuming threads.
-#define THREAD_ACCESS \
-    (THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION | THREAD_SET_CONTEXT)
+#define ACTION_REMOVE       3
 
 // Hook information.
 typedef struct _HOOK_ENTRY
@@ -68,55 +68,132 @@ typedef struct _HOOK_ENTRY
     UINT8  patchAbove  : 1;     // Uses the hot patch area.
     UINT8  isEnabled   : 1;     // Enabled.
     UINT8  queueEnable : 1;     // Queued for enabling/disabling when != isEnabled.
-
-    UINT   nIP : 4;             // Count of the instruction boundaries.
-    UINT8  oldIPs[8];           // Instruction boundaries of the target function.
-    UINT8  newIPs[8];           // Instruction boundaries of the trampoline function.
+    UINT8  usesRelay   : 1;     // pDetour is the relay function.
+    UINT8  unfrozen    : 1;     // Last disabled without Freeze(); threads may still be in the trampoline.
+
+    UINT8  nIP;                 // Count of the instruction boundaries.
+    UINT8  oldIPs[TRAMPOLINE_MAX_IPS]; // Instruction boundaries of the target function.
+    UINT8  newIPs[TRAMPOLINE_MAX_IPS]; // Instruction boundaries of the trampoline function.
+    UINT8  nIsland;             // Count of the branch islands.
+    UINT8  islandPos[TRAMPOLINE_MAX_ISLANDS];      // Branch islands in the trampoline function.
+    ULONG_PTR islandDests[TRAMPOLINE_MAX_ISLANDS]; // Where the branches through them go.
 } HOOK_ENTRY, *PHOOK_ENTRY;
 
-// Suspended threads for Freeze()/Unfreeze().
-typedef struct _FROZEN_THREADS
+// Code that Freeze() may have to move thread IPs out of, sorted by address.
+typedef struct _PATCHED_RANGES
+{
+    PIP_RANGE pItems;       // Data heap, NULL if it could not be allocated
+    UINT      size;         // Actual number of data items
+} PATCHED_RANGES, *PPATCHED_RANGES;
+
+// What Freeze() is about to do, for MoveThreadIP().
+typedef struct _FREEZE_CONTEXT
 {
-    LPDWORD pItems;         // Data heap
-    UINT    capacity;       // Size of allocated data heap, items
-    UINT    size;           // Actual number of data items
-} FROZEN_THREADS, *PFROZEN_THREADS;
+    UINT           pos;
+    UINT           action;
+    PATCHED_RANGES ranges;
+} FREEZE_CONTEXT, *PFREEZE_CONTEXT;
 
 //-------------------------------------------------------------------------
 // Global Variables:
 //-------------------------------------------------------------------------
 
-// Spin lock flag for EnterSpinLock()/LeaveSpinLock().
-volatile LONG g_isLocked = FALSE;
+// Lock for EnterLock()/LeaveLock().
+SRWLOCK g_lock = SRWLOCK_INIT;
 
 // Private heap handle. If not NULL, this library is initialized.
 HANDLE g_hHeap = NULL;
 
-// Hook entries.
+// Enable and disable hooks without Freeze() where PlanAtomicPatch() allows.
+BOOL g_atomicPatching = FALSE;
+
+// Hook entries, and an open addressed (linear probing) index of them by
+// target address. An index slot holds the position of an entry plus one,
+// or 0 if it is empty. The index has at least twice as many slots as the
+// entry buffer has items, so it is never more than half full.
 struct
 {
     PHOOK_ENTRY pItems;     // Data heap
     UINT        capacity;   // Size of allocated data heap, items
     UINT        size;       // Actual number of data items
+    PUINT       pIndex;     // Index heap
+    UINT        indexMask;  // Size of the index heap minus 1, a power of 2 minus 1
 } g_hooks;
 
 //-------------------------------------------------------------------------
-// Returns INVALID_HOOK_POS if not found.
-static UINT FindHookEntry(LPVOID pTarget)
+static UINT HashTarget(LPVOID pTarget)
 {
-    UINT i;
-    for (i = 0; i < g_hooks.size; ++i)
+    ULONG_PTR hash = (ULONG_PTR)pTarget;
+
+    // Functions are usually aligned, so mix the high bits into the low ones.
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3B;
+    hash ^= hash >> 16;
+
+    return (UINT)hash;
+}
+
+//-------------------------------------------------------------------------
+// Returns the index slot holding pTarget, or the empty slot that ends its
+// probe sequence.
+static UINT FindIndexSlot(LPVOID pTarget)
+{
+    UINT slot = HashTarget(pTarget) & g_hooks.indexMask;
+    while (g_hooks.pIndex[slot] != 0)
     {
-        if ((ULONG_PTR)pTarget == (ULONG_PTR)g_hooks.pItems[i].pTarget)
-            return i;
+        if ((ULONG_PTR)pTarget == (ULONG_PTR)g_hooks.pItems[g_hooks.pIndex[slot] - 1].pTarget)
+            break;
+
+        slot = (slot + 1) & g_hooks.indexMask;
     }
 
-    return INVALID_HOOK_POS;
+    return slot;
+}
+
+//-------------------------------------------------------------------------
+// Replaces the index with one of indexCapacity slots, built from the
+// current entries. indexCapacity must be a power of 2 and at least twice
+// the number of entries.
+static BOOL RebuildHookIndex(UINT indexCapacity)
+{
+    UINT i;
+    PUINT p = (PUINT)HeapAlloc(g_hHeap, HEAP_ZERO_MEMORY, indexCapacity * sizeof(UINT));
+    if (p == NULL)
+        return FALSE;
+
+    if (g_hooks.pIndex != NULL)
+        HeapFree(g_hHeap, 0, g_hooks.pIndex);
+
+    g_hooks.pIndex    = p;
+    g_hooks.indexMask = indexCapacity - 1;
+
+    for (i = 0; i < g_hooks.size; ++i)
+        g_hooks.pIndex[FindIndexSlot(g_hooks.pItems[i].pTarget)] = i + 1;
+
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+// Returns INVALID_HOOK_POS if not found.
+static UINT FindHookEntry(LPVOID pTarget)
+{
+    UINT slot;
+
+    if (g_hooks.pIndex == NULL)
+        return INVALID_HOOK_POS;
+
+    slot = FindIndexSlot(pTarget);
+    if (g_hooks.pIndex[slot] == 0)
+        return INVALID_HOOK_POS;
+
+    return g_hooks.pIndex[slot] - 1;
 }
 
 //-------------------------------------------------------------------------
-static PHOOK_ENTRY AddHookEntry()
+static PHOOK_ENTRY AddHookEntry(LPVOID pTarget)
 {
+    PHOOK_ENTRY pHook;
+
     if (g_hooks.pItems == NULL)
     {
         g_hooks.capacity = INITIAL_HOOK_CAPACITY;
@@ -136,18 +213,62 @@ static PHOOK_ENTRY AddHookEntry()
         g_hooks.pItems = p;
     }
 
-    return &g_hooks.pItems[g_hooks.size++];
+    if (g_hooks.pIndex == NULL || g_hooks.indexMask + 1 < g_hooks.capacity * 2)
+    {
+        if (!RebuildHookIndex(g_hooks.capacity * 2))
+            return NULL;
+    }
+
+    pHook = &g_hooks.pItems[g_hooks.size];
+    pHook->pTarget = pTarget;
+    g_hooks.pIndex[FindIndexSlot(pTarget)] = ++g_hooks.size;
+
+    return pHook;
+}
+
+//-------------------------------------------------------------------------
+// Empties an index slot, moving later entries of the same probe sequence
+// back so that lookups never need tombstones.
+static VOID DeleteIndexSlot(UINT slot)
+{
+    UINT next = slot;
+    for (;;)
+    {
+        UINT home;
+
+        next = (next + 1) & g_hooks.indexMask;
+        if (g_hooks.pIndex[next] == 0)
+            break;
+
+        // Move the entry in next back unless its home slot lies cyclically
+        // in (slot, next], where it would no longer be found.
+        home = HashTarget(g_hooks.pItems[g_hooks.pIndex[next] - 1].pTarget) & g_hooks.indexMask;
+        if (((next - home) & g_hooks.indexMask) >= ((next - slot) & g_hooks.indexMask))
+        {
+            g_hooks.pIndex[slot] = g_hooks.pIndex[next];
+            slot = next;
+        }
+    }
+
+    g_hooks.pIndex[slot] = 0;
 }
 
 //-------------------------------------------------------------------------
 static void DeleteHookEntry(UINT pos)
 {
+    DeleteIndexSlot(FindIndexSlot(g_hooks.pItems[pos].pTarget));
+
     if (pos < g_hooks.size - 1)
+    {
         g_hooks.pItems[pos] = g_hooks.pItems[g_hooks.size - 1];
+        g_hooks.pIndex[FindIndexSlot(g_hooks.pItems[pos].pTarget)] = pos + 1;
+    }
 
     g_hooks.size--;
 
-    if (g_hooks.capacity / 2 >= INITIAL_HOOK_CAPACITY && g_hooks.capacity / 2 >= g_hooks.size)
+    // Only shrink once the buffer is a quarter full, so that adding and
+    // removing a hook at a capacity boundary does not reallocate each time.
+    if (g_hooks.capacity / 2 >= INITIAL_HOOK_CAPACITY && g_hooks.capacity / 4 >= g_hooks.size)
     {
         PHOOK_ENTRY p = (PHOOK_ENTRY)HeapReAlloc(
             g_hHeap, 0, g_hooks.pItems, (g_hooks.capacity / 2) * sizeof(HOOK_ENTRY));
@@ -156,6 +277,9 @@ static void DeleteHookEntry(UINT pos)
 
         g_hooks.capacity /= 2;
         g_hooks.pItems = p;
+
+        // Keeping the larger index if this fails is harmless.
+        RebuildHookIndex(g_hooks.capacity * 2);
     }
 }
 
@@ -175,10 +299,17 @@ static DWORD_PTR FindOldIP(PHOOK_ENTRY pHook, DWORD_PTR ip)
 
 #if defined(_M_X64) || defined(__x86_64__)
     // Check relay function.
-    if (ip == (DWORD_PTR)pHook->pDetour)
+    if (pHook->usesRelay && ip == (DWORD_PTR)pHook->pDetour)
         return (DWORD_PTR)pHook->pTarget;
 #endif
 
+    // A thread on a branch island has taken the branch already.
+    for (i = 0; i < pHook->nIsland; ++i)
+    {
+        if (ip == ((DWORD_PTR)pHook->pTrampoline + pHook->islandPos[i]))
+            return pHook->islandDests[i];
+    }
+
     return 0;
 }
 
@@ -196,24 +327,54 @@ static DWORD_PTR FindNewIP(PHOOK_ENTRY pHook, DWORD_PTR ip)
 }
 
 //-------------------------------------------------------------------------
-static void ProcessThreadIPs(HANDLE hThread, UINT pos, UINT action)
+// Returns FALSE if the action leaves the hook's code alone. Otherwise sets
+// *pEnable to TRUE if threads move into the trampoline, FALSE if out of it.
+static BOOL GetHookAction(PHOOK_ENTRY pHook, UINT action, BOOL *pEnable)
 {
-    // If the thread suspended in the overwritten area,
-    // move IP to the proper address.
+    switch (action)
+    {
+    case ACTION_DISABLE:
+        *pEnable = FALSE;
+        break;
+
+    case ACTION_ENABLE:
+        *pEnable = TRUE;
+        break;
+
+    case ACTION_REMOVE:
+        // The trampoline is about to be freed, even if the hook is already disabled.
+        *pEnable = FALSE;
+        return pHook->isEnabled || pHook->unfrozen;
+
+    default: // ACTION_APPLY_QUEUED
+        *pEnable = pHook->queueEnable;
+        break;
+    }
 
-    CONTEXT c;
-#if defined(_M_X64) || defined(__x86_64__)
-    DWORD64 *pIP = &c.Rip;
-#else
-    DWORD   *pIP = &c.Eip;
-#endif
-    UINT count;
+    return pHook->isEnabled != *pEnable;
+}
 
-    c.ContextFlags = CONTEXT_CONTROL;
-    if (!GetThreadContext(hThread, &c))
-        return;
+//-------------------------------------------------------------------------
+// If the thread is suspended in the overwritten area, returns the proper
+// address to move its IP to.
+static uintptr_t MoveThreadIP(uintptr_t ip, void *pContext)
+{
+    PFREEZE_CONTEXT pFreeze = (PFREEZE_CONTEXT)pContext;
+    UINT      pos = pFreeze->pos;
+    UINT      count;
+    uintptr_t newIP = 0;
 
-    if (pos == ALL_HOOKS_POS)
+    if (pFreeze->ranges.pItems != NULL)
+    {
+        // Only the hook whose code the thread is in can need to move it.
+        const IP_RANGE *pRange = FindIPRange(pFreeze->ranges.pItems, pFreeze->ranges.size, ip);
+        if (pRange == NULL)
+            return 0;
+
+        pos = pRange->tag;
+        count = pos + 1;
+    }
+    else if (pos == ALL_HOOKS_POS)
     {
         pos = 0;
         count = g_hooks.size;
@@ -227,131 +388,158 @@ static void ProcessThreadIPs(HANDLE hThread, UINT pos, UINT action)
     {
         PHOOK_ENTRY pHook = &g_hooks.pItems[pos];
         BOOL        enable;
-        DWORD_PTR   ip;
-
-        switch (action)
-        {
-        case ACTION_DISABLE:
-            enable = FALSE;
-            break;
+        DWORD_PTR   found;
 
-        case ACTION_ENABLE:
-            enable = TRUE;
-            break;
-
-        default: // ACTION_APPLY_QUEUED
-            enable = pHook->queueEnable;
-            break;
-        }
-        if (pHook->isEnabled == enable)
+        if (!GetHookAction(pHook, pFreeze->action, &enable))
             continue;
 
         if (enable)
-            ip = FindNewIP(pHook, *pIP);
+            found = FindNewIP(pHook, ip);
         else
-            ip = FindOldIP(pHook, *pIP);
+            found = FindOldIP(pHook, ip);
 
-        if (ip != 0)
+        if (found != 0)
         {
-            *pIP = ip;
-            SetThreadContext(hThread, &c);
+            ip = found;
+            newIP = found;
         }
     }
+
+    return newIP;
 }
 
 //-------------------------------------------------------------------------
-static VOID EnumerateThreads(PFROZEN_THREADS pThreads)
+// Collects the code of the hooks that the action changes: the prologues
+// about to be overwritten when enabling, and the trampolines (with the relay
+// function on x64 and the branch islands) and hot patch jumps about to be
+// removed when disabling.
+// If this fails, MoveThreadIP() checks every hook instead.
+static VOID CollectPatchedRanges(PPATCHED_RANGES pRanges, UINT pos, UINT action)
 {
-    HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
-    if (hSnapshot != INVALID_HANDLE_VALUE)
+    UINT count;
+
+    pRanges->size   = 0;
+    pRanges->pItems = (PIP_RANGE)HeapAlloc(
+        g_hHeap, 0, (pos == ALL_HOOKS_POS ? g_hooks.size : 1) * 2 * sizeof(IP_RANGE));
+    if (pRanges->pItems == NULL)
+        return;
+
+    if (pos == ALL_HOOKS_POS)
+    {
+        pos = 0;
+        count = g_hooks.size;
+    }
+    else
+    {
+        count = pos + 1;
+    }
+
+    for (; pos < count; ++pos)
     {
-        THREADENTRY32 te;
-        te.dwSize = sizeof(THREADENTRY32);
-        if (Thread32First(hSnapshot, &te))
+        PHOOK_ENTRY pHook = &g_hooks.pItems[pos];
+        PIP_RANGE   pRange;
+        BOOL        enable;
+
+        if (!GetHookAction(pHook, action, &enable) || pHook->nIP == 0)
+            continue;
+
+        pRange = &pRanges->pItems[pRanges->size++];
+        pRange->tag = pos;
+        if (enable)
         {
-            do
-            {
-                if (te.dwSize >= (FIELD_OFFSET(THREADENTRY32, th32OwnerProcessID) + sizeof(DWORD))
-                    && te.th32OwnerProcessID == GetCurrentProcessId()
-                    && te.th32ThreadID != GetCurrentThreadId())
-                {
-                    if (pThreads->pItems == NULL)
-                    {
-                        pThreads->capacity = INITIAL_THREAD_CAPACITY;
-                        pThreads->pItems
-                            = (LPDWORD)HeapAlloc(g_hHeap, 0, pThreads->capacity * sizeof(DWORD));
-                        if (pThreads->pItems == NULL)
-                            break;
-                    }
-                    else if (pThreads->size >= pThreads->capacity)
-                    {
-                        LPDWORD p = (LPDWORD)HeapReAlloc(
-                            g_hHeap, 0, pThreads->pItems, (pThreads->capacity * 2) * sizeof(DWORD));
-                        if (p == NULL)
-                            break;
-
-                        pThreads->capacity *= 2;
-                        pThreads->pItems = p;
-                    }
-                    pThreads->pItems[pThreads->size++] = te.th32ThreadID;
-                }
+            pRange->start = (uintptr_t)pHook->pTarget;
+            pRange->end   = pRange->start + pHook->oldIPs[pHook->nIP - 1] + 1;
+        }
+        else
+        {
+            pRange->start = (uintptr_t)pHook->pTrampoline;
+            pRange->end   = pRange->start + pHook->newIPs[pHook->nIP - 1] + 1;
+
+            // The relay function follows the trampoline, and the branch
+            // islands follow both.
+            if (pHook->usesRelay)
+                pRange->end = (uintptr_t)pHook->pDetour + 1;
+            if (pHook->nIsland != 0)
+                pRange->end = pRange->start + pHook->islandPos[pHook->nIsland - 1] + 1;
 
-                te.dwSize = sizeof(THREADENTRY32);
-            } while (Thread32Next(hSnapshot, &te));
+            if (pHook->patchAbove)
+            {
+                pRange = &pRanges->pItems[pRanges->size++];
+                pRange->tag   = pos;
+                pRange->start = (uintptr_t)pHook->pTarget - sizeof(JMP_REL);
+                pRange->end   = pRange->start + 1;
+            }
         }
-        CloseHandle(hSnapshot);
     }
+
+    SortIPRanges(pRanges->pItems, pRanges->size);
 }
 
 //-------------------------------------------------------------------------
-static VOID Freeze(PFROZEN_THREADS pThreads, UINT pos, UINT action)
+static VOID Freeze(UINT pos, UINT action)
 {
-    pThreads->pItems   = NULL;
-    pThreads->capacity = 0;
-    pThreads->size     = 0;
-    EnumerateThreads(pThreads);
+    FREEZE_CONTEXT context;
+    context.pos    = pos;
+    context.action = action;
 
-    if (pThreads->pItems != NULL)
-    {
-        UINT i;
-        for (i = 0; i < pThreads->size; ++i)
-        {
-            HANDLE hThread = OpenThread(THREAD_ACCESS, FALSE, pThreads->pItems[i]);
-            if (hThread != NULL)
-            {
-                SuspendThread(hThread);
-                ProcessThreadIPs(hThread, pos, action);
-                CloseHandle(hThread);
-            }
-        }
-    }
+    // Built before any thread is suspended, so that each suspended
+    // thread costs one binary search however many hooks there are.
+    CollectPatchedRanges(&context.ranges, pos, action);
+
+    FreezeThreads(MoveThreadIP, &context);
+
+    if (context.ranges.pItems != NULL)
+        HeapFree(g_hHeap, 0, context.ranges.pItems);
 }
 
 //-------------------------------------------------------------------------
-static VOID Unfreeze(PFROZEN_THREADS pThreads)
+static VOID Unfreeze(VOID)
 {
-    if (pThreads->pItems != NULL)
-    {
-        UINT i;
-        for (i = 0; i < pThreads->size; ++i)
-        {
-            HANDLE hThread = OpenThread(THREAD_ACCESS, FALSE, pThreads->pItems[i]);
-            if (hThread != NULL)
-            {
-                ResumeThread(hThread);
-                CloseHandle(hThread);
-            }
-        }
+    UnfreezeThreads();
+}
 
-        HeapFree(g_hHeap, 0, pThreads->pItems);
-    }
+//-------------------------------------------------------------------------
+// Returns FALSE if enabling or disabling the hook needs Freeze().
+static BOOL PlanHookPatchLL(UINT pos, BOOL enable, PPATCH_PLAN pPlan)
+{
+    PHOOK_ENTRY  pHook = &g_hooks.pItems[pos];
+    PATCH_TARGET target;
+
+    if (!g_atomicPatching)
+        return FALSE;
+
+    target.pTarget    = (LPBYTE)pHook->pTarget;
+    target.pDetour    = (LPBYTE)pHook->pDetour;
+    target.patchAbove = pHook->patchAbove;
+    target.pBackup    = pHook->backup;
+    target.pOldIPs    = pHook->oldIPs;
+    target.nIP        = pHook->nIP;
+
+    return PlanAtomicPatch(&target, enable, pPlan);
+}
+
+//-------------------------------------------------------------------------
+static VOID WritePatchAtomically(const PATCH_WRITE *pWrite)
+{
+    volatile LONGLONG *pWord = (volatile LONGLONG *)GetPatchWord(pWrite);
+    LONGLONG oldWord;
+    LONGLONG newWord;
+
+    // Bytes around the patch in the same word may belong to another hook.
+    do
+    {
+        oldWord = *pWord;
+        newWord = (LONGLONG)MergePatchWord(pWrite, (UINT64)oldWord);
+    } while (InterlockedCompareExchange64(pWord, newWord, oldWord) != oldWord);
 }
 
 //-------------------------------------------------------------------------
 static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
 {
     PHOOK_ENTRY pHook = &g_hooks.pItems[pos];
-    DWORD  oldProtect;
+    PATCH_PLAN plan;
+    BOOL   atomic = PlanHookPatchLL(pos, enable, &plan);
+    UINT   oldProtect;
     SIZE_T patchSize    = sizeof(JMP_REL);
     LPBYTE pPatchTarget = (LPBYTE)pHook->pTarget;
 
@@ -361,10 +549,17 @@ static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
         patchSize    += sizeof(JMP_REL_SHORT);
     }
 
-    if (!VirtualProtect(pPatchTarget, patchSize, PAGE_EXECUTE_READWRITE, &oldProtect))
+    if (!UnprotectCode(pPatchTarget, patchSize, &oldProtect))
         return MH_ERROR_MEMORY_PROTECT;
 
-    if (enable)
+    if (atomic)
+    {
+        if (plan.above.size != 0)
+            memcpy(plan.above.pAddress, plan.above.bytes, plan.above.size);
+
+        WritePatchAtomically(&plan.atomic);
+    }
+    else if (enable)
     {
         PJMP_REL pJmp = (PJMP_REL)pPatchTarget;
         pJmp->opcode = 0xE9;
@@ -385,13 +580,14 @@ static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
             memcpy(pPatchTarget, pHook->backup, sizeof(JMP_REL));
     }
 
-    VirtualProtect(pPatchTarget, patchSize, oldProtect, &oldProtect);
+    RestoreCodeProtection(pPatchTarget, patchSize, oldProtect);
 
     // Just-in-case measure.
-    FlushInstructionCache(GetCurrentProcess(), pPatchTarget, patchSize);
+    FlushCode(pPatchTarget, patchSize);
 
     pHook->isEnabled   = enable;
     pHook->queueEnable = enable;
+    pHook->unfrozen    = !enable && atomic;
 
     return MH_OK;
 }
@@ -413,8 +609,17 @@ static MH_STATUS EnableAllHooksLL(BOOL enable)
 
     if (first != INVALID_HOOK_POS)
     {
-        FROZEN_THREADS threads;
-        Freeze(&threads, ALL_HOOKS_POS, enable ? ACTION_ENABLE : ACTION_DISABLE);
+        BOOL freeze = FALSE;
+        PATCH_PLAN plan;
+
+        for (i = first; i < g_hooks.size && !freeze; ++i)
+        {
+            if (g_hooks.pItems[i].isEnabled != enable)
+                freeze = !PlanHookPatchLL(i, enable, &plan);
+        }
+
+        if (freeze)
+            Freeze(ALL_HOOKS_POS, enable ? ACTION_ENABLE : ACTION_DISABLE);
 
         for (i = first; i < g_hooks.size; ++i)
         {
@@ -426,40 +631,35 @@ static MH_STATUS EnableAllHooksLL(BOOL enable)
             }
         }
 
-        Unfreeze(&threads);
+        if (freeze)
+            Unfreeze();
     }
 
     return status;
 }
 
 //-------------------------------------------------------------------------
-static VOID EnterSpinLock(VOID)
+static VOID EnterLock(VOID)
 {
-    SIZE_T spinCount = 0;
+    UINT i;
 
-    // Wait until the flag is FALSE.
-    while (InterlockedCompareExchange(&g_isLocked, TRUE, FALSE) != FALSE)
+    // The lock is usually held only briefly, so spin a little before
+    // letting the system block this thread.
+    for (i = 0; i < LOCK_SPIN_COUNT; ++i)
     {
-        // No need to generate a memory barrier here, since InterlockedCompareExchange()
-        // generates a full memory barrier itself.
-
-        // Prevent the loop from being too busy.
-        if (spinCount < 32)
-            Sleep(0);
-        else
-            Sleep(1);
+        if (TryAcquireSRWLockExclusive(&g_lock))
+            return;
 
-        spinCount++;
+        YieldProcessor();
     }
+
+    AcquireSRWLockExclusive(&g_lock);
 }
 
 //-------------------------------------------------------------------------
-static VOID LeaveSpinLock(VOID)
+static VOID LeaveLock(VOID)
 {
-    // No need to generate a memory barrier here, since InterlockedExchange()
-    // generates a full memory barrier itself.
-
-    InterlockedExchange(&g_isLocked, FALSE);
+    ReleaseSRWLockExclusive(&g_lock);
 }
 
 //-------------------------------------------------------------------------
@@ -467,7 +667,7 @@ MH_STATUS WINAPI MH_Initialize(VOID)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap == NULL)
     {
@@ -487,7 +687,7 @@ MH_STATUS WINAPI MH_Initialize(VOID)
         status = MH_ERROR_ALREADY_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -496,12 +696,27 @@ MH_STATUS WINAPI MH_Initialize(VOID)
 MH_STATUS WINAPI MH_Uninitialize(VOID)
 {
     MH_STATUS status = MH_OK;
+    UINT i;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
+        // The trampolines are freed below, so move threads out of them.
+        g_atomicPatching = FALSE;
+
         status = EnableAllHooksLL(FALSE);
+
+        // Including those of hooks disabled earlier without Freeze().
+        for (i = 0; i < g_hooks.size; ++i)
+        {
+            if (g_hooks.pItems[i].unfrozen)
+            {
+                Freeze(ALL_HOOKS_POS, ACTION_REMOVE);
+                Unfreeze();
+                break;
+            }
+        }
         if (status == MH_OK)
         {
             // Free the internal function buffer.
@@ -510,15 +725,19 @@ MH_STATUS WINAPI MH_Uninitialize(VOID)
             // memory leak without HeapFree.
 
             UninitializeBuffer();
+            ReleaseFrozenThreads();
 
             HeapFree(g_hHeap, 0, g_hooks.pItems);
+            HeapFree(g_hHeap, 0, g_hooks.pIndex);
             HeapDestroy(g_hHeap);
 
             g_hHeap = NULL;
 
-            g_hooks.pItems   = NULL;
-            g_hooks.capacity = 0;
-            g_hooks.size     = 0;
+            g_hooks.pItems    = NULL;
+            g_hooks.capacity  = 0;
+            g_hooks.size      = 0;
+            g_hooks.pIndex    = NULL;
+            g_hooks.indexMask = 0;
         }
     }
     else
@@ -526,97 +745,207 @@ MH_STATUS WINAPI MH_Uninitialize(VOID)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
 
 //-------------------------------------------------------------------------
-MH_STATUS WINAPI MH_CreateHook(LPVOID pTarget, LPVOID pDetour, LPVOID *ppOriginal)
+#if defined(_M_X64) || defined(__x86_64__)
+// Can a rel32 jump ending at pFrom reach pTo?
+static BOOL IsWithinRel32(LPVOID pFrom, LPVOID pTo)
 {
-    MH_STATUS status = MH_OK;
+    LONGLONG distance = (LONGLONG)((ULONG_PTR)pTo - (ULONG_PTR)pFrom);
+    return distance >= INT_MIN && distance <= INT_MAX;
+}
+#endif
 
-    EnterSpinLock();
+//-------------------------------------------------------------------------
+// Builds the trampoline and the entry of a new hook. Touches no state that
+// the hook lock guards, so it runs unlocked and concurrently.
+static MH_STATUS PrepareHook(LPVOID pTarget, LPVOID pDetour, PHOOK_ENTRY pHook)
+{
+    MH_STATUS status = MH_OK;
 
-    if (g_hHeap != NULL)
+    if (IsExecutableAddress(pTarget) && IsExecutableAddress(pDetour))
     {
-        if (IsExecutableAddress(pTarget) && IsExecutableAddress(pDetour))
+        TRAMPOLINE ct;
+        UINT       bufferSize = MEMORY_SLOT_SIZE;
+        LPVOID     pBuffer;
+
+        ct.pTarget = pTarget;
+        ct.pDetour = pDetour;
+
+        // Most trampolines fit in the smallest slot. Try the larger ones only
+        // for those that do not.
+        for (;;)
         {
-            UINT pos = FindHookEntry(pTarget);
-            if (pos == INVALID_HOOK_POS)
+            pBuffer = AllocateBuffer(pTarget, bufferSize);
+            if (pBuffer == NULL)
+                break;
+
+            ct.pTrampoline = pBuffer;
+            ct.bufferSize  = bufferSize;
+            if (CreateTrampolineFunction(&ct))
+                break;
+
+            FreeBuffer(pBuffer);
+            pBuffer = NULL;
+            if (!ct.tooLarge || bufferSize == MEMORY_SLOT_MAX_SIZE)
             {
-                LPVOID pBuffer = AllocateBuffer(pTarget);
-                if (pBuffer != NULL)
-                {
-                    TRAMPOLINE ct;
-
-                    ct.pTarget     = pTarget;
-                    ct.pDetour     = pDetour;
-                    ct.pTrampoline = pBuffer;
-                    if (CreateTrampolineFunction(&ct))
-                    {
-                        PHOOK_ENTRY pHook = AddHookEntry();
-                        if (pHook != NULL)
-                        {
-                            pHook->pTarget     = ct.pTarget;
+                status = MH_ERROR_UNSUPPORTED_FUNCTION;
+                break;
+            }
+
+            bufferSize *= 2;
+        }
+
+        if (pBuffer != NULL)
+        {
+            pHook->pTarget     = ct.pTarget;
+            pHook->pDetour     = ct.pDetour;
+            pHook->usesRelay   = FALSE;
 #if defined(_M_X64) || defined(__x86_64__)
-                            pHook->pDetour     = ct.pRelay;
-#else
-                            pHook->pDetour     = ct.pDetour;
+            // Jump straight to the detour if the patch can reach it, and
+            // through the relay function only otherwise.
+            if (!IsWithinRel32((LPBYTE)pTarget + (ct.patchAbove ? 0 : sizeof(JMP_REL)), pDetour))
+            {
+                pHook->pDetour   = ct.pRelay;
+                pHook->usesRelay = TRUE;
+            }
 #endif
-                            pHook->pTrampoline = ct.pTrampoline;
-                            pHook->patchAbove  = ct.patchAbove;
-                            pHook->isEnabled   = FALSE;
-                            pHook->queueEnable = FALSE;
-                            pHook->nIP         = ct.nIP;
-                            memcpy(pHook->oldIPs, ct.oldIPs, ARRAYSIZE(ct.oldIPs));
-                            memcpy(pHook->newIPs, ct.newIPs, ARRAYSIZE(ct.newIPs));
-
-                            // Back up the target function.
-
-                            if (ct.patchAbove)
-                            {
-                                memcpy(
-                                    pHook->backup,
-                                    (LPBYTE)pTarget - sizeof(JMP_REL),
-                                    sizeof(JMP_REL) + sizeof(JMP_REL_SHORT));
-                            }
-                            else
-                            {
-                                memcpy(pHook->backup, pTarget, sizeof(JMP_REL));
-                            }
-
-                            if (ppOriginal != NULL)
-                                *ppOriginal = pHook->pTrampoline;
-                        }
-                        else
-                        {
-                            status = MH_ERROR_MEMORY_ALLOC;
-                        }
-                    }
-                    else
-                    {
-                        status = MH_ERROR_UNSUPPORTED_FUNCTION;
-                    }
-
-                    if (status != MH_OK)
-                    {
-                        FreeBuffer(pBuffer);
-                    }
-                }
-                else
-                {
-                    status = MH_ERROR_MEMORY_ALLOC;
-                }
+            pHook->pTrampoline = ct.pTrampoline;
+            pHook->patchAbove  = ct.patchAbove;
+            pHook->isEnabled   = FALSE;
+            pHook->queueEnable = FALSE;
+            pHook->unfrozen    = FALSE;
+            pHook->nIP         = (UINT8)ct.nIP;
+            memcpy(pHook->oldIPs, ct.oldIPs, ct.nIP);
+            memcpy(pHook->newIPs, ct.newIPs, ct.nIP);
+            pHook->nIsland     = (UINT8)ct.nIsland;
+            memcpy(pHook->islandPos, ct.islandPos, ct.nIsland * sizeof(ct.islandPos[0]));
+            memcpy(pHook->islandDests, ct.islandDests, ct.nIsland * sizeof(ct.islandDests[0]));
+
+            // Back up the target function.
+
+            if (ct.patchAbove)
+            {
+                memcpy(
+                    pHook->backup,
+                    (LPBYTE)pTarget - sizeof(JMP_REL),
+                    sizeof(JMP_REL) + sizeof(JMP_REL_SHORT));
             }
             else
             {
-                status = MH_ERROR_ALREADY_CREATED;
+                memcpy(pHook->backup, pTarget, sizeof(JMP_REL));
             }
         }
+        else if (status == MH_OK)
+        {
+            status = MH_ERROR_MEMORY_ALLOC;
+        }
+    }
+    else
+    {
+        status = MH_ERROR_NOT_EXECUTABLE;
+    }
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+// Registers a hook built by PrepareHook(). On failure the caller still owns
+// the trampoline. Another thread may have created the same hook meanwhile,
+// so this checks for it again.
+static MH_STATUS InsertHookLL(PHOOK_ENTRY pPrepared, LPVOID *ppOriginal)
+{
+    MH_STATUS status = MH_OK;
+
+    if (g_hHeap == NULL)
+    {
+        status = MH_ERROR_NOT_INITIALIZED;
+    }
+    else if (FindHookEntry(pPrepared->pTarget) != INVALID_HOOK_POS)
+    {
+        status = MH_ERROR_ALREADY_CREATED;
+    }
+    else
+    {
+        PHOOK_ENTRY pHook = AddHookEntry(pPrepared->pTarget);
+        if (pHook != NULL)
+        {
+            *pHook = *pPrepared;
+
+            if (ppOriginal != NULL)
+                *ppOriginal = pHook->pTrampoline;
+        }
         else
         {
-            status = MH_ERROR_NOT_EXECUTABLE;
+            status = MH_ERROR_MEMORY_ALLOC;
+        }
+    }
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+// Only the registry checks hold the hook lock; the trampoline is built
+// without it, so threads creating different hooks do not wait on each other.
+MH_STATUS WINAPI MH_CreateHook(LPVOID pTarget, LPVOID pDetour, LPVOID *ppOriginal)
+{
+    MH_STATUS  status = MH_OK;
+    HOOK_ENTRY hook;
+
+    EnterLock();
+
+    if (g_hHeap == NULL)
+        status = MH_ERROR_NOT_INITIALIZED;
+    else if (FindHookEntry(pTarget) != INVALID_HOOK_POS)
+        status = MH_ERROR_ALREADY_CREATED;
+
+    LeaveLock();
+
+    if (status == MH_OK)
+        status = PrepareHook(pTarget, pDetour, &hook);
+
+    if (status == MH_OK)
+    {
+        EnterLock();
+        status = InsertHookLL(&hook, ppOriginal);
+        LeaveLock();
+
+        if (status != MH_OK)
+            FreeBuffer(hook.pTrampoline);
+    }
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_CreateHooks(MH_HOOK_DESC *pHooks, UINT count)
+{
+    MH_STATUS   status = MH_OK;
+    HANDLE      hHeap = NULL;
+    PHOOK_ENTRY pPrepared = NULL;
+    UINT        i;
+
+    EnterLock();
+
+    if (g_hHeap != NULL)
+    {
+        hHeap = g_hHeap;
+        pPrepared = (PHOOK_ENTRY)HeapAlloc(hHeap, 0, count * sizeof(HOOK_ENTRY));
+        if (pPrepared == NULL)
+            status = MH_ERROR_MEMORY_ALLOC;
+
+        for (i = 0; i < count; ++i)
+        {
+            if (status != MH_OK)
+                pHooks[i].status = status;
+            else if (FindHookEntry(pHooks[i].pTarget) != INVALID_HOOK_POS)
+                pHooks[i].status = MH_ERROR_ALREADY_CREATED;
+            else
+                pHooks[i].status = MH_OK;
         }
     }
     else
@@ -624,7 +953,40 @@ MH_STATUS WINAPI MH_CreateHook(LPVOID pTarget, LPVOID pDetour, LPVOID *ppOrigina
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
+
+    if (pPrepared == NULL)
+        return status;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (pHooks[i].status == MH_OK)
+            pHooks[i].status = PrepareHook(pHooks[i].pTarget, pHooks[i].pDetour, &pPrepared[i]);
+    }
+
+    // Register every prepared hook under one acquisition of the lock.
+    EnterLock();
+
+    for (i = 0; i < count; ++i)
+    {
+        if (pHooks[i].status == MH_OK)
+            pHooks[i].status = InsertHookLL(&pPrepared[i], pHooks[i].ppOriginal);
+        else
+            pPrepared[i].pTrampoline = NULL;
+    }
+
+    LeaveLock();
+
+    for (i = 0; i < count; ++i)
+    {
+        if (pHooks[i].status != MH_OK && pPrepared[i].pTrampoline != NULL)
+            FreeBuffer(pPrepared[i].pTrampoline);
+
+        if (status == MH_OK)
+            status = pHooks[i].status;
+    }
+
+    HeapFree(hHeap, 0, pPrepared);
 
     return status;
 }
@@ -634,21 +996,24 @@ MH_STATUS WINAPI MH_RemoveHook(LPVOID pTarget)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
         UINT pos = FindHookEntry(pTarget);
         if (pos != INVALID_HOOK_POS)
         {
-            if (g_hooks.pItems[pos].isEnabled)
+            PHOOK_ENTRY pHook = &g_hooks.pItems[pos];
+
+            // The trampoline is freed below, so move threads out of it.
+            if (pHook->isEnabled || pHook->unfrozen)
             {
-                FROZEN_THREADS threads;
-                Freeze(&threads, pos, ACTION_DISABLE);
+                Freeze(pos, ACTION_REMOVE);
 
-                status = EnableHookLL(pos, FALSE);
+                if (pHook->isEnabled)
+                    status = EnableHookLL(pos, FALSE);
 
-                Unfreeze(&threads);
+                Unfreeze();
             }
 
             if (status == MH_OK)
@@ -667,7 +1032,7 @@ MH_STATUS WINAPI MH_RemoveHook(LPVOID pTarget)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -677,7 +1042,7 @@ static MH_STATUS EnableHook(LPVOID pTarget, BOOL enable)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
@@ -687,21 +1052,25 @@ static MH_STATUS EnableHook(LPVOID pTarget, BOOL enable)
         }
         else
         {
-            FROZEN_THREADS threads;
             UINT pos = FindHookEntry(pTarget);
             if (pos != INVALID_HOOK_POS)
             {
-                if (g_hooks.pItems[pos].isEnabled != enable)
+                PATCH_PLAN plan;
+                if (g_hooks.pItems[pos].isEnabled == enable)
+                {
+                    status = enable ? MH_ERROR_ENABLED : MH_ERROR_DISABLED;
+                }
+                else if (PlanHookPatchLL(pos, enable, &plan))
                 {
-                    Freeze(&threads, pos, ACTION_ENABLE);
-
                     status = EnableHookLL(pos, enable);
-
-                    Unfreeze(&threads);
                 }
                 else
                 {
-                    status = enable ? MH_ERROR_ENABLED : MH_ERROR_DISABLED;
+                    Freeze(pos, ACTION_ENABLE);
+
+                    status = EnableHookLL(pos, enable);
+
+                    Unfreeze();
                 }
             }
             else
@@ -715,7 +1084,7 @@ static MH_STATUS EnableHook(LPVOID pTarget, BOOL enable)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -737,7 +1106,7 @@ static MH_STATUS QueueHook(LPVOID pTarget, BOOL queueEnable)
 {
     MH_STATUS status = MH_OK;
 
-    EnterSpinLock();
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
@@ -765,7 +1134,7 @@ static MH_STATUS QueueHook(LPVOID pTarget, BOOL queueEnable)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
@@ -783,41 +1152,144 @@ MH_STATUS WINAPI MH_QueueDisableHook(LPVOID pTarget)
 }
 
 //-------------------------------------------------------------------------
-MH_STATUS WINAPI MH_ApplyQueued(VOID)
+static MH_STATUS ApplyQueuedLL(VOID)
 {
     MH_STATUS status = MH_OK;
     UINT i, first = INVALID_HOOK_POS;
 
-    EnterSpinLock();
+    for (i = 0; i < g_hooks.size; ++i)
+    {
+        if (g_hooks.pItems[i].isEnabled != g_hooks.pItems[i].queueEnable)
+        {
+            first = i;
+            break;
+        }
+    }
+
+    if (first != INVALID_HOOK_POS)
+    {
+        BOOL freeze = FALSE;
+        PATCH_PLAN plan;
+
+        for (i = first; i < g_hooks.size && !freeze; ++i)
+        {
+            PHOOK_ENTRY pHook = &g_hooks.pItems[i];
+            if (pHook->isEnabled != pHook->queueEnable)
+                freeze = !PlanHookPatchLL(i, pHook->queueEnable, &plan);
+        }
+
+        if (freeze)
+            Freeze(ALL_HOOKS_POS, ACTION_APPLY_QUEUED);
+
+        for (i = first; i < g_hooks.size; ++i)
+        {
+            PHOOK_ENTRY pHook = &g_hooks.pItems[i];
+            if (pHook->isEnabled != pHook->queueEnable)
+            {
+                status = EnableHookLL(i, pHook->queueEnable);
+                if (status != MH_OK)
+                    break;
+            }
+        }
+
+        if (freeze)
+            Unfreeze();
+    }
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_ApplyQueued(VOID)
+{
+    MH_STATUS status = MH_OK;
+
+    EnterLock();
 
     if (g_hHeap != NULL)
     {
-        for (i = 0; i < g_hooks.size; ++i)
+        status = ApplyQueuedLL();
+    }
+    else
+    {
+        status = MH_ERROR_NOT_INITIALIZED;
+    }
+
+    LeaveLock();
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_SetAtomicPatching(BOOL enable)
+{
+    MH_STATUS status = MH_OK;
+
+    EnterLock();
+
+    if (g_hHeap != NULL)
+    {
+        g_atomicPatching = enable;
+    }
+    else
+    {
+        status = MH_ERROR_NOT_INITIALIZED;
+    }
+
+    LeaveLock();
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_SetDualMappedTrampolines(BOOL enable)
+{
+    MH_STATUS status = MH_OK;
+
+    EnterLock();
+
+    if (g_hHeap != NULL)
+    {
+        SetBufferDualMapping(enable);
+    }
+    else
+    {
+        status = MH_ERROR_NOT_INITIALIZED;
+    }
+
+    LeaveLock();
+
+    return status;
+}
+
+//-------------------------------------------------------------------------
+static MH_STATUS EnableHooks(LPVOID *ppTargets, UINT count, BOOL enable)
+{
+    MH_STATUS status = MH_OK;
+
+    EnterLock();
+
+    if (g_hHeap != NULL)
+    {
+        UINT i;
+
+        // Check every target first, so that a bad one changes nothing.
+        for (i = 0; i < count; ++i)
         {
-            if (g_hooks.pItems[i].isEnabled != g_hooks.pItems[i].queueEnable)
+            if (FindHookEntry(ppTargets[i]) == INVALID_HOOK_POS)
             {
-                first = i;
+                status = MH_ERROR_NOT_CREATED;
                 break;
             }
         }
 
-        if (first != INVALID_HOOK_POS)
+        if (status == MH_OK)
         {
-            FROZEN_THREADS threads;
-            Freeze(&threads, ALL_HOOKS_POS, ACTION_APPLY_QUEUED);
-
-            for (i = first; i < g_hooks.size; ++i)
-            {
-                PHOOK_ENTRY pHook = &g_hooks.pItems[i];
-                if (pHook->isEnabled != pHook->queueEnable)
-                {
-                    status = EnableHookLL(i, pHook->queueEnable);
-                    if (status != MH_OK)
-                        break;
-                }
-            }
+            for (i = 0; i < count; ++i)
+                g_hooks.pItems[FindHookEntry(ppTargets[i])].queueEnable = enable;
 
-            Unfreeze(&threads);
+            // One Freeze()/Unfreeze() cycle for the whole set.
+            status = ApplyQueuedLL();
         }
     }
     else
@@ -825,11 +1297,23 @@ MH_STATUS WINAPI MH_ApplyQueued(VOID)
         status = MH_ERROR_NOT_INITIALIZED;
     }
 
-    LeaveSpinLock();
+    LeaveLock();
 
     return status;
 }
 
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_EnableHooks(LPVOID *ppTargets, UINT count)
+{
+    return EnableHooks(ppTargets, count, TRUE);
+}
+
+//-------------------------------------------------------------------------
+MH_STATUS WINAPI MH_DisableHooks(LPVOID *ppTargets, UINT count)
+{
+    return EnableHooks(ppTargets, count, FALSE);
+}
+
 //-------------------------------------------------------------------------
 MH_STATUS WINAPI MH_CreateHookApiEx(
     LPCWSTR pszModule, LPCSTR pszProcName, LPVOID pDetour,
@@ -0,0 +1,72 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include "iprange.h"
+
+//-------------------------------------------------------------------------
+static int CompareIPRanges(const void *pLeft, const void *pRight)
+{
+    const IP_RANGE *pL = (const IP_RANGE *)pLeft;
+    const IP_RANGE *pR = (const IP_RANGE *)pRight;
+
+    if (pL->start != pR->start)
+        return pL->start < pR->start ? -1 : 1;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+void SortIPRanges(PIP_RANGE pRanges, unsigned count)
+{
+    if (count > 1)
+        qsort(pRanges, count, sizeof(IP_RANGE), CompareIPRanges);
+}
+
+//-------------------------------------------------------------------------
+const IP_RANGE *FindIPRange(const IP_RANGE *pRanges, unsigned count, uintptr_t ip)
+{
+    unsigned low  = 0;
+    unsigned high = count;
+
+    // Find the first range that starts after ip; only the one before it can
+    // contain ip.
+    while (low < high)
+    {
+        unsigned middle = low + (high - low) / 2;
+        if (pRanges[middle].start <= ip)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low == 0 || ip >= pRanges[low - 1].end)
+        return NULL;
+
+    return &pRanges[low - 1];
+}
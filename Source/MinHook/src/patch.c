@@ -0,0 +1,146 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "patch.h"
+
+// Sizes of the JMP rel32 and JMP rel8 instructions.
+#define PATCH_JMP_REL_SIZE       5
+#define PATCH_JMP_REL_SHORT_SIZE 2
+
+//-------------------------------------------------------------------------
+// Can a thread be stopped inside the first size bytes of the target, other
+// than at its start?
+static int HasInnerBoundary(const PATCH_TARGET *pTarget, unsigned size)
+{
+    unsigned i;
+    for (i = 0; i < pTarget->nIP; ++i)
+    {
+        if (pTarget->pOldIPs[i] > 0 && pTarget->pOldIPs[i] < size)
+            return 1;
+    }
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+static int FitsInWord(const uint8_t *pAddress, unsigned size)
+{
+    return ((uintptr_t)pAddress & 7) + size <= 8;
+}
+
+//-------------------------------------------------------------------------
+static void SetWrite(PPATCH_WRITE pWrite, uint8_t *pAddress, const uint8_t *pBytes, uint8_t size)
+{
+    pWrite->pAddress = pAddress;
+    pWrite->size     = size;
+    memset(pWrite->bytes, 0, sizeof(pWrite->bytes));
+    memcpy(pWrite->bytes, pBytes, size);
+}
+
+//-------------------------------------------------------------------------
+static void SetJmpRel(uint8_t *pBytes, const uint8_t *pFrom, const uint8_t *pTo)
+{
+    uint32_t operand = (uint32_t)(pTo - (pFrom + PATCH_JMP_REL_SIZE));
+
+    pBytes[0] = 0xE9;
+    pBytes[1] = (uint8_t)operand;
+    pBytes[2] = (uint8_t)(operand >> 8);
+    pBytes[3] = (uint8_t)(operand >> 16);
+    pBytes[4] = (uint8_t)(operand >> 24);
+}
+
+//-------------------------------------------------------------------------
+int PlanAtomicPatch(const PATCH_TARGET *pTarget, int enable, PPATCH_PLAN pPlan)
+{
+    uint8_t bytes[PATCH_JMP_REL_SIZE];
+
+    memset(pPlan, 0, sizeof(*pPlan));
+
+    if (pTarget->patchAbove)
+    {
+        uint8_t *pAbove = pTarget->pTarget - PATCH_JMP_REL_SIZE;
+
+        if (!enable)
+            return 0;
+
+        if (!FitsInWord(pTarget->pTarget, PATCH_JMP_REL_SHORT_SIZE)
+            || HasInnerBoundary(pTarget, PATCH_JMP_REL_SHORT_SIZE))
+        {
+            return 0;
+        }
+
+        // The long jump goes into padding, which nothing executes until the
+        // short jump to it appears.
+        SetJmpRel(bytes, pAbove, pTarget->pDetour);
+        SetWrite(&pPlan->above, pAbove, bytes, PATCH_JMP_REL_SIZE);
+
+        bytes[0] = 0xEB;
+        bytes[1] = (uint8_t)(0 - (PATCH_JMP_REL_SHORT_SIZE + PATCH_JMP_REL_SIZE));
+        SetWrite(&pPlan->atomic, pTarget->pTarget, bytes, PATCH_JMP_REL_SHORT_SIZE);
+    }
+    else
+    {
+        if (!FitsInWord(pTarget->pTarget, PATCH_JMP_REL_SIZE))
+            return 0;
+
+        // Restoring is always safe: no thread can be inside the jump.
+        if (enable)
+        {
+            if (HasInnerBoundary(pTarget, PATCH_JMP_REL_SIZE))
+                return 0;
+
+            SetJmpRel(bytes, pTarget->pTarget, pTarget->pDetour);
+            SetWrite(&pPlan->atomic, pTarget->pTarget, bytes, PATCH_JMP_REL_SIZE);
+        }
+        else
+        {
+            SetWrite(&pPlan->atomic, pTarget->pTarget, pTarget->pBackup, PATCH_JMP_REL_SIZE);
+        }
+    }
+
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+uint64_t *GetPatchWord(const PATCH_WRITE *pWrite)
+{
+    return (uint64_t *)((uintptr_t)pWrite->pAddress & ~(uintptr_t)7);
+}
+
+//-------------------------------------------------------------------------
+uint64_t MergePatchWord(const PATCH_WRITE *pWrite, uint64_t word)
+{
+    uint8_t bytes[8];
+
+    memcpy(bytes, &word, sizeof(bytes));
+    memcpy(bytes + ((uintptr_t)pWrite->pAddress & 7), pWrite->bytes, pWrite->size);
+    memcpy(&word, bytes, sizeof(word));
+
+    return word;
+}
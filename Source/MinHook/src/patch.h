@@ -0,0 +1,85 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Planning of the code patches that enable and disable a hook without
+// suspending the other threads of the process. Works on plain addresses and
+// bytes only, so it is independent of the platform.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes written at one address.
+typedef struct _PATCH_WRITE
+{
+    uint8_t *pAddress;      // First byte to write.
+    uint8_t  size;          // Number of bytes to write, 0 if none.
+    uint8_t  bytes[8];      // The bytes to write.
+} PATCH_WRITE, *PPATCH_WRITE;
+
+// A freeze-free patch: first the plain write "above", which no thread can
+// be executing, then the write "atomic", which lies within one aligned
+// 8-byte word and must become visible to other threads all at once.
+typedef struct _PATCH_PLAN
+{
+    PATCH_WRITE above;
+    PATCH_WRITE atomic;
+} PATCH_PLAN, *PPATCH_PLAN;
+
+// What is known about a hook's target when it is patched.
+typedef struct _PATCH_TARGET
+{
+    uint8_t       *pTarget;     // Address of the target function.
+    uint8_t       *pDetour;     // Address the enabled hook jumps to.
+    int            patchAbove;  // The long jump goes in the hot patch area above pTarget.
+    const uint8_t *pBackup;     // Original bytes, starting with the hot patch area if patchAbove.
+    const uint8_t *pOldIPs;     // Instruction boundaries in the target function.
+    unsigned       nIP;         // Number of instruction boundaries.
+} PATCH_TARGET, *PPATCH_TARGET;
+
+// Plans enabling or disabling the hook without suspending threads. Returns 0
+// if that is not safe: the bytes to swap straddle an aligned 8-byte word, a
+// thread could be stopped between instructions inside them, or the hook
+// uses the hot patch area and is being disabled (a thread may be between
+// the short jump and the long jump above).
+int PlanAtomicPatch(const PATCH_TARGET *pTarget, int enable, PPATCH_PLAN pPlan);
+
+// The aligned 8-byte word that contains the bytes of pWrite.
+uint64_t *GetPatchWord(const PATCH_WRITE *pWrite);
+
+// Returns word, the current value of GetPatchWord(pWrite), with the bytes of
+// pWrite written into it.
+uint64_t MergePatchWord(const PATCH_WRITE *pWrite, uint64_t word);
+
+#ifdef __cplusplus
+}
+#endif
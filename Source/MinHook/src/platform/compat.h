@@ -0,0 +1,191 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// The Windows types and runtime functions MinHook is written in. Other
+// platforms get them from here, mapped onto the C library and POSIX; what
+// differs in substance (code memory, thread suspension) is in the other
+// headers of this directory.
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/MinHook.h"
+
+#ifndef PATH_MAX
+    #define PATH_MAX 4096
+#endif
+
+typedef int8_t    INT8;
+typedef int16_t   INT16;
+typedef int32_t   INT32;
+typedef int64_t   INT64;
+typedef uint8_t   UINT8;
+typedef uint16_t  UINT16;
+typedef uint32_t  UINT32;
+typedef uint64_t  UINT64;
+typedef int64_t   LONGLONG;
+typedef uint32_t  DWORD;
+typedef uintptr_t ULONG_PTR;
+typedef uintptr_t DWORD_PTR;
+typedef size_t    SIZE_T;
+typedef void     *HANDLE;
+typedef void     *HMODULE;
+typedef UINT8    *LPBYTE;
+typedef UINT     *PUINT;
+typedef UINT32   *PUINT32;
+
+//-------------------------------------------------------------------------
+// Heaps. All of them are the C library heap; a handle merely tells that
+// the heap exists, which for MinHook's private heap means it is initialized.
+
+#define HEAP_ZERO_MEMORY 0x00000008
+
+static inline HANDLE HeapCreate(DWORD options, SIZE_T initialSize, SIZE_T maximumSize)
+{
+    static char heap;
+    (void)options;
+    (void)initialSize;
+    (void)maximumSize;
+    return &heap;
+}
+
+static inline HANDLE GetProcessHeap(VOID)
+{
+    static char heap;
+    return &heap;
+}
+
+static inline BOOL HeapDestroy(HANDLE hHeap)
+{
+    (void)hHeap;
+    return TRUE;
+}
+
+static inline LPVOID HeapAlloc(HANDLE hHeap, DWORD flags, SIZE_T size)
+{
+    (void)hHeap;
+    return (flags & HEAP_ZERO_MEMORY) ? calloc(1, size) : malloc(size);
+}
+
+static inline LPVOID HeapReAlloc(HANDLE hHeap, DWORD flags, LPVOID pMem, SIZE_T size)
+{
+    (void)hHeap;
+    (void)flags;
+    return realloc(pMem, size);
+}
+
+static inline BOOL HeapFree(HANDLE hHeap, DWORD flags, LPVOID pMem)
+{
+    (void)hHeap;
+    (void)flags;
+    free(pMem);
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+// Modules. Only ones already loaded are found, as with GetModuleHandleW().
+
+static inline HMODULE GetModuleHandleW(LPCWSTR pszModule)
+{
+    char name[PATH_MAX];
+    void *hModule;
+
+    if (pszModule == NULL)
+        return dlopen(NULL, RTLD_LAZY);
+
+    if (wcstombs(name, pszModule, sizeof(name)) >= sizeof(name))
+        return NULL;
+
+    // The reference dlopen() adds is dropped at once; the module stays
+    // loaded because somebody else already holds one.
+    hModule = dlopen(name, RTLD_LAZY | RTLD_NOLOAD);
+    if (hModule != NULL)
+        dlclose(hModule);
+
+    return hModule;
+}
+
+static inline void *GetProcAddress(HMODULE hModule, LPCSTR pszProcName)
+{
+    return dlsym(hModule, pszProcName);
+}
+
+//-------------------------------------------------------------------------
+// Locks. Only the exclusive mode is used.
+
+typedef pthread_mutex_t SRWLOCK, *PSRWLOCK;
+
+#define SRWLOCK_INIT PTHREAD_MUTEX_INITIALIZER
+
+static inline VOID AcquireSRWLockExclusive(PSRWLOCK pLock)
+{
+    pthread_mutex_lock(pLock);
+}
+
+static inline BOOL TryAcquireSRWLockExclusive(PSRWLOCK pLock)
+{
+    return pthread_mutex_trylock(pLock) == 0;
+}
+
+static inline VOID ReleaseSRWLockExclusive(PSRWLOCK pLock)
+{
+    pthread_mutex_unlock(pLock);
+}
+
+//-------------------------------------------------------------------------
+// Atomics and bit operations.
+
+#define YieldProcessor() __builtin_ia32_pause()
+
+static inline BOOL BitScanForward(DWORD *pIndex, DWORD mask)
+{
+    if (mask == 0)
+        return FALSE;
+
+    *pIndex = (DWORD)__builtin_ctz(mask);
+    return TRUE;
+}
+
+static inline LONGLONG InterlockedCompareExchange64(
+    volatile LONGLONG *pDestination, LONGLONG exchange, LONGLONG comparand)
+{
+    return __sync_val_compare_and_swap(pDestination, comparand, exchange);
+}
+
+#endif
@@ -0,0 +1,87 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The address space queries and code memory management MinHook needs, per
+// platform: VirtualAlloc() and friends on Windows, mmap(), mprotect() and
+// /proc/self/maps on Linux.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A run of pages in the same state, like MEMORY_BASIC_INFORMATION.
+typedef struct _MEMORY_REGION
+{
+    uintptr_t base;             // First address of the run.
+    size_t    size;             // Size of the run, in bytes.
+    uintptr_t allocationBase;   // First address of the allocation the run is part of.
+    int       isFree;           // Neither reserved nor mapped.
+    int       isExecutable;     // Committed and executable.
+} MEMORY_REGION, *PMEMORY_REGION;
+
+// Gets the lowest and highest address memory can be allocated at, and the
+// granularity allocations are aligned to.
+void GetMemoryLayout(uintptr_t *pMinAddress, uintptr_t *pMaxAddress, size_t *pGranularity);
+
+// Describes the region containing pAddress. Returns 0 if it cannot be told.
+int QueryMemoryRegion(const void *pAddress, PMEMORY_REGION pRegion);
+
+// Reserves address space exactly at pAddress, or anywhere if pAddress is
+// NULL, without committing memory to it. Returns NULL if that is not possible.
+// If ppWritable is not NULL, the memory is dual-mapped: it is mapped a second
+// time anywhere, at *ppWritable, and only that view is ever writable.
+void *ReserveCodeMemory(void *pAddress, size_t size, void **ppWritable);
+
+// Commits memory to reserved pages: readable, writable and executable, or
+// with pWritable, executable at pAddress and writable at pWritable. pWritable
+// is the view ReserveCodeMemory() returned, or NULL. Returns 0 on failure.
+int CommitCodeMemory(void *pAddress, void *pWritable, size_t size);
+
+// Returns committed pages to the reserved state, discarding their contents.
+void DecommitCodeMemory(void *pAddress, void *pWritable, size_t size);
+
+// Releases address space reserved by ReserveCodeMemory().
+void ReleaseCodeMemory(void *pAddress, void *pWritable, size_t size);
+
+// Makes code writable, keeping it executable. Returns 0 on failure.
+int UnprotectCode(void *pAddress, size_t size, unsigned *pOldProtect);
+
+// Restores the protection UnprotectCode() replaced.
+void RestoreCodeProtection(void *pAddress, size_t size, unsigned oldProtect);
+
+// Makes modified code visible to instruction fetch.
+void FlushCode(void *pAddress, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
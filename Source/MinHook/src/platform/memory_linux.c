@@ -0,0 +1,414 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "memory.h"
+
+// Not defined by older C libraries. Older kernels ignore it and take the
+// address as a hint, which ReserveCodeMemory() checks for.
+#ifndef MAP_FIXED_NOREPLACE
+    #define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// Lowest address mmap() hands out by default (vm.mmap_min_addr).
+#define MIN_APPLICATION_ADDRESS 0x10000
+
+// Highest user space address.
+#if defined(__x86_64__)
+    #define MAX_APPLICATION_ADDRESS 0x00007FFFFFFFFFFFULL
+#else
+    #define MAX_APPLICATION_ADDRESS 0xBFFFFFFFUL
+#endif
+
+// UnprotectCode() packs the protection of each page into this many bits.
+#define PROTECT_BITS 4
+
+// A line of /proc/self/maps, as far as it is needed.
+typedef struct _MAPPING
+{
+    uintptr_t start;
+    uintptr_t end;
+    int       protect;          // PROT_* flags
+} MAPPING, *PMAPPING;
+
+// Called for each mapping in address order. Returns nonzero to stop.
+typedef int (*PMAPPING_CALLBACK)(const MAPPING *pMapping, void *pContext);
+
+// QueryMemoryRegion() state for FindMapping().
+typedef struct _REGION_QUERY
+{
+    uintptr_t      address;
+    uintptr_t      prevEnd;     // End of the previous mapping.
+    PMEMORY_REGION pRegion;
+    int            protect;     // PROT_* flags of the mapping found, if any.
+    int            found;
+} REGION_QUERY, *PREGION_QUERY;
+
+//-------------------------------------------------------------------------
+static size_t GetPageSize(void)
+{
+    static size_t pageSize;
+    if (pageSize == 0)
+        pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    return pageSize;
+}
+
+//-------------------------------------------------------------------------
+static int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+//-------------------------------------------------------------------------
+// Parses /proc/self/maps ("start-end perms offset dev inode path") without
+// the C library's buffered I/O, which may allocate: this also runs while
+// the other threads are frozen, one of them possibly inside malloc().
+static int EnumerateMappings(PMAPPING_CALLBACK pCallback, void *pContext)
+{
+    char    buffer[1024];
+    MAPPING mapping = { 0, 0, 0 };
+    int     field = 0;      // 0: start, 1: end, 2: perms, 3: the rest
+    int     permIndex = 0;
+    ssize_t count;
+    int     fd;
+
+    fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    while ((count = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        ssize_t i;
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            close(fd);
+            return 0;
+        }
+
+        for (i = 0; i < count; ++i)
+        {
+            char c = buffer[i];
+            int  digit;
+
+            switch (field)
+            {
+            case 0:
+            case 1:
+                digit = HexDigit(c);
+                if (digit >= 0)
+                {
+                    if (field == 0)
+                        mapping.start = (mapping.start << 4) | (uintptr_t)digit;
+                    else
+                        mapping.end = (mapping.end << 4) | (uintptr_t)digit;
+                }
+                else
+                {
+                    field++;
+                }
+                break;
+
+            case 2:
+                if (c == ' ')
+                {
+                    field++;
+                }
+                else
+                {
+                    if (permIndex == 0 && c == 'r')
+                        mapping.protect |= PROT_READ;
+                    else if (permIndex == 1 && c == 'w')
+                        mapping.protect |= PROT_WRITE;
+                    else if (permIndex == 2 && c == 'x')
+                        mapping.protect |= PROT_EXEC;
+                    permIndex++;
+                }
+                break;
+
+            default:
+                if (c == '\n')
+                {
+                    if (pCallback(&mapping, pContext))
+                    {
+                        close(fd);
+                        return 1;
+                    }
+
+                    mapping.start   = 0;
+                    mapping.end     = 0;
+                    mapping.protect = 0;
+                    field     = 0;
+                    permIndex = 0;
+                }
+                break;
+            }
+        }
+    }
+
+    close(fd);
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+static int FindMapping(const MAPPING *pMapping, void *pContext)
+{
+    PREGION_QUERY  pQuery  = (PREGION_QUERY)pContext;
+    PMEMORY_REGION pRegion = pQuery->pRegion;
+
+    if (pQuery->address < pMapping->start)
+    {
+        // In the gap before this mapping.
+        pRegion->base           = pQuery->prevEnd;
+        pRegion->size           = pMapping->start - pQuery->prevEnd;
+        pRegion->allocationBase = pQuery->prevEnd;
+        pRegion->isFree         = 1;
+        pRegion->isExecutable   = 0;
+        pQuery->protect = PROT_NONE;
+        pQuery->found   = 1;
+        return 1;
+    }
+
+    if (pQuery->address < pMapping->end)
+    {
+        pRegion->base           = pMapping->start;
+        pRegion->size           = pMapping->end - pMapping->start;
+        pRegion->allocationBase = pMapping->start;
+        pRegion->isFree         = 0;
+        pRegion->isExecutable   = (pMapping->protect & PROT_EXEC) != 0;
+        pQuery->protect = pMapping->protect;
+        pQuery->found   = 1;
+        return 1;
+    }
+
+    pQuery->prevEnd = pMapping->end;
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+static int QueryMapping(uintptr_t address, PMEMORY_REGION pRegion, PREGION_QUERY pQuery)
+{
+    pQuery->address = address;
+    pQuery->prevEnd = 0;
+    pQuery->pRegion = pRegion;
+    pQuery->protect = PROT_NONE;
+    pQuery->found   = 0;
+
+    if (address > (uintptr_t)MAX_APPLICATION_ADDRESS)
+        return 0;
+
+    if (!EnumerateMappings(FindMapping, pQuery))
+        return 0;
+
+    if (!pQuery->found)
+    {
+        // Past the last mapping.
+        pRegion->base           = pQuery->prevEnd;
+        pRegion->size           = (uintptr_t)MAX_APPLICATION_ADDRESS + 1 - pQuery->prevEnd;
+        pRegion->allocationBase = pQuery->prevEnd;
+        pRegion->isFree         = 1;
+        pRegion->isExecutable   = 0;
+    }
+
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+void GetMemoryLayout(uintptr_t *pMinAddress, uintptr_t *pMaxAddress, size_t *pGranularity)
+{
+    *pMinAddress  = MIN_APPLICATION_ADDRESS;
+    *pMaxAddress  = (uintptr_t)MAX_APPLICATION_ADDRESS;
+    *pGranularity = GetPageSize();
+}
+
+//-------------------------------------------------------------------------
+int QueryMemoryRegion(const void *pAddress, PMEMORY_REGION pRegion)
+{
+    REGION_QUERY query;
+    return QueryMapping((uintptr_t)pAddress, pRegion, &query);
+}
+
+//-------------------------------------------------------------------------
+// Maps size bytes of fd, or anonymous memory if fd is -1, exactly at pAddress
+// or anywhere if pAddress is NULL. The pages are inaccessible.
+static void *MapInaccessible(void *pAddress, size_t size, int fd)
+{
+    int   flags = fd != -1 ? MAP_SHARED : MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    void *p;
+
+    if (pAddress != NULL)
+        flags |= MAP_FIXED_NOREPLACE;
+
+    p = mmap(pAddress, size, PROT_NONE, flags, fd, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    if (pAddress != NULL && p != pAddress)
+    {
+        munmap(p, size);
+        return NULL;
+    }
+
+    return p;
+}
+
+//-------------------------------------------------------------------------
+// Reserved pages are inaccessible mappings, which keep the address space
+// taken without being backed by memory. Dual-mapped memory is a memfd mapped
+// twice. The mappings keep the memfd alive, so it is closed right away.
+void *ReserveCodeMemory(void *pAddress, size_t size, void **ppWritable)
+{
+    int   fd;
+    void *p;
+
+    if (ppWritable == NULL)
+        return MapInaccessible(pAddress, size, -1);
+
+    fd = memfd_create("minhook", MFD_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    p = NULL;
+    if (ftruncate(fd, (off_t)size) == 0)
+    {
+        p = MapInaccessible(pAddress, size, fd);
+        if (p != NULL)
+        {
+            *ppWritable = MapInaccessible(NULL, size, fd);
+            if (*ppWritable == NULL)
+            {
+                munmap(p, size);
+                p = NULL;
+            }
+        }
+    }
+
+    close(fd);
+    return p;
+}
+
+//-------------------------------------------------------------------------
+int CommitCodeMemory(void *pAddress, void *pWritable, size_t size)
+{
+    if (pWritable == NULL)
+        return mprotect(pAddress, size, PROT_READ | PROT_WRITE | PROT_EXEC) == 0;
+
+    return mprotect(pWritable, size, PROT_READ | PROT_WRITE) == 0
+        && mprotect(pAddress, size, PROT_READ | PROT_EXEC) == 0;
+}
+
+//-------------------------------------------------------------------------
+// Mapping fresh inaccessible pages over the committed ones drops their
+// contents in the same call. The pages of a memfd are dropped from the file.
+void DecommitCodeMemory(void *pAddress, void *pWritable, size_t size)
+{
+    if (pWritable == NULL)
+    {
+        mmap(pAddress, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    }
+    else
+    {
+        madvise(pWritable, size, MADV_REMOVE);
+        mprotect(pWritable, size, PROT_NONE);
+        mprotect(pAddress, size, PROT_NONE);
+    }
+}
+
+//-------------------------------------------------------------------------
+void ReleaseCodeMemory(void *pAddress, void *pWritable, size_t size)
+{
+    if (pWritable != NULL)
+        munmap(pWritable, size);
+    munmap(pAddress, size);
+}
+
+//-------------------------------------------------------------------------
+// The old protection of each page is packed into *pOldProtect, which is
+// plenty for the few bytes of a patch.
+int UnprotectCode(void *pAddress, size_t size, unsigned *pOldProtect)
+{
+    size_t    pageSize = GetPageSize();
+    uintptr_t first    = (uintptr_t)pAddress & ~(pageSize - 1);
+    uintptr_t last     = ((uintptr_t)pAddress + size - 1) & ~(pageSize - 1);
+    uintptr_t page;
+    unsigned  shift    = 0;
+
+    *pOldProtect = 0;
+    for (page = first; page <= last; page += pageSize)
+    {
+        REGION_QUERY  query;
+        MEMORY_REGION region;
+
+        if (shift >= sizeof(unsigned) * 8)
+            return 0;
+
+        if (!QueryMapping(page, &region, &query) || region.isFree)
+            return 0;
+
+        *pOldProtect |= (unsigned)query.protect << shift;
+        shift += PROTECT_BITS;
+    }
+
+    return mprotect((void *)first, last - first + pageSize, PROT_READ | PROT_WRITE | PROT_EXEC) == 0;
+}
+
+//-------------------------------------------------------------------------
+void RestoreCodeProtection(void *pAddress, size_t size, unsigned oldProtect)
+{
+    size_t    pageSize = GetPageSize();
+    uintptr_t first    = (uintptr_t)pAddress & ~(pageSize - 1);
+    uintptr_t last     = ((uintptr_t)pAddress + size - 1) & ~(pageSize - 1);
+    uintptr_t page;
+
+    for (page = first; page <= last; page += pageSize)
+    {
+        mprotect((void *)page, pageSize, (int)(oldProtect & ((1u << PROTECT_BITS) - 1)));
+        oldProtect >>= PROTECT_BITS;
+    }
+}
+
+//-------------------------------------------------------------------------
+void FlushCode(void *pAddress, size_t size)
+{
+    __builtin___clear_cache((char *)pAddress, (char *)pAddress + size);
+}
@@ -0,0 +1,149 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <windows.h>
+#include "memory.h"
+
+// Memory protection flags to check the executable address.
+#define PAGE_EXECUTE_FLAGS \
+    (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)
+
+//-------------------------------------------------------------------------
+void GetMemoryLayout(uintptr_t *pMinAddress, uintptr_t *pMaxAddress, size_t *pGranularity)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+
+    *pMinAddress  = (uintptr_t)si.lpMinimumApplicationAddress;
+    *pMaxAddress  = (uintptr_t)si.lpMaximumApplicationAddress;
+    *pGranularity = si.dwAllocationGranularity;
+}
+
+//-------------------------------------------------------------------------
+int QueryMemoryRegion(const void *pAddress, PMEMORY_REGION pRegion)
+{
+    MEMORY_BASIC_INFORMATION mbi;
+    if (VirtualQuery(pAddress, &mbi, sizeof(mbi)) == 0)
+        return 0;
+
+    pRegion->base           = (uintptr_t)mbi.BaseAddress;
+    pRegion->size           = mbi.RegionSize;
+    pRegion->allocationBase = (uintptr_t)mbi.AllocationBase;
+    pRegion->isFree         = mbi.State == MEM_FREE;
+    pRegion->isExecutable   = mbi.State == MEM_COMMIT && (mbi.Protect & PAGE_EXECUTE_FLAGS);
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+// Dual-mapped memory is a pagefile-backed section with two views. The views
+// keep the section alive, so its handle is closed right away.
+void *ReserveCodeMemory(void *pAddress, size_t size, void **ppWritable)
+{
+    HANDLE hSection;
+    LPVOID pView;
+
+    if (ppWritable == NULL)
+        return VirtualAlloc(pAddress, size, MEM_RESERVE, PAGE_NOACCESS);
+
+    hSection = CreateFileMappingW(
+        INVALID_HANDLE_VALUE, NULL, PAGE_EXECUTE_READWRITE | SEC_RESERVE, 0, (DWORD)size, NULL);
+    if (hSection == NULL)
+        return NULL;
+
+    pView = MapViewOfFileEx(hSection, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, size, pAddress);
+    if (pView != NULL)
+    {
+        *ppWritable = MapViewOfFile(hSection, FILE_MAP_WRITE, 0, 0, size);
+        if (*ppWritable == NULL)
+        {
+            UnmapViewOfFile(pView);
+            pView = NULL;
+        }
+    }
+
+    CloseHandle(hSection);
+    return pView;
+}
+
+//-------------------------------------------------------------------------
+int CommitCodeMemory(void *pAddress, void *pWritable, size_t size)
+{
+    if (pWritable == NULL)
+        return VirtualAlloc(pAddress, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE) != NULL;
+
+    return VirtualAlloc(pWritable, size, MEM_COMMIT, PAGE_READWRITE) != NULL
+        && VirtualAlloc(pAddress, size, MEM_COMMIT, PAGE_EXECUTE_READ) != NULL;
+}
+
+//-------------------------------------------------------------------------
+// Pages of a section cannot be decommitted, so those of dual-mapped memory
+// stay committed until the views are released.
+void DecommitCodeMemory(void *pAddress, void *pWritable, size_t size)
+{
+    if (pWritable == NULL)
+        VirtualFree(pAddress, size, MEM_DECOMMIT);
+}
+
+//-------------------------------------------------------------------------
+void ReleaseCodeMemory(void *pAddress, void *pWritable, size_t size)
+{
+    (void)size;
+    if (pWritable == NULL)
+    {
+        VirtualFree(pAddress, 0, MEM_RELEASE);
+    }
+    else
+    {
+        UnmapViewOfFile(pWritable);
+        UnmapViewOfFile(pAddress);
+    }
+}
+
+//-------------------------------------------------------------------------
+int UnprotectCode(void *pAddress, size_t size, unsigned *pOldProtect)
+{
+    DWORD oldProtect;
+    if (!VirtualProtect(pAddress, size, PAGE_EXECUTE_READWRITE, &oldProtect))
+        return 0;
+
+    *pOldProtect = oldProtect;
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+void RestoreCodeProtection(void *pAddress, size_t size, unsigned oldProtect)
+{
+    DWORD protect;
+    VirtualProtect(pAddress, size, oldProtect, &protect);
+}
+
+//-------------------------------------------------------------------------
+void FlushCode(void *pAddress, size_t size)
+{
+    FlushInstructionCache(GetCurrentProcess(), pAddress, size);
+}
@@ -0,0 +1,57 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Suspending the other threads of the process while code they may be running
+// is patched. Implemented per platform; the buffer for the thread list is
+// kept from one freeze to the next. Calls must not overlap.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the address a suspended thread has to continue at instead of ip,
+// or 0 to leave it where it is.
+typedef uintptr_t (*PMOVE_THREAD_IP)(uintptr_t ip, void *pContext);
+
+// Suspends every other thread of the process and calls pMoveIP, unless it is
+// NULL, for each of them. Returns the number of threads suspended.
+unsigned FreezeThreads(PMOVE_THREAD_IP pMoveIP, void *pContext);
+
+// Resumes the threads suspended by FreezeThreads().
+void UnfreezeThreads(void);
+
+// Frees what is kept from one FreezeThreads() call to the next.
+void ReleaseFrozenThreads(void);
+
+#ifdef __cplusplus
+}
+#endif
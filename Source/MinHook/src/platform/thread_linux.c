@@ -0,0 +1,351 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "thread.h"
+
+// Signal that stops a thread. Override if the application uses it.
+#ifndef MH_FREEZE_SIGNAL
+    #define MH_FREEZE_SIGNAL (SIGRTMIN + 3)
+#endif
+
+// How long FreezeThreads() waits for a thread to stop, in milliseconds. A
+// thread that blocks MH_FREEZE_SIGNAL for longer is left running.
+#define FREEZE_TIMEOUT_MS 1000
+
+// Initial capacity of the thread buffer.
+#define INITIAL_THREAD_CAPACITY 128
+
+#if defined(__x86_64__)
+    #define CONTEXT_IP(uc) ((uc)->uc_mcontext.gregs[REG_RIP])
+#elif defined(__i386__)
+    #define CONTEXT_IP(uc) ((uc)->uc_mcontext.gregs[REG_EIP])
+#else
+    #error Unsupported architecture
+#endif
+
+// FROZEN_THREAD states.
+#define THREAD_IDLE     0
+#define THREAD_SIGNALED 1
+#define THREAD_STOPPED  2
+
+// A thread, and its IP while it is stopped in OnFreezeSignal().
+typedef struct _FROZEN_THREAD
+{
+    pid_t     tid;
+    int       state;        // THREAD_*, shared with the signal handler
+    uintptr_t ip;           // Where the thread was stopped
+    uintptr_t newIP;        // Where it continues, or 0 for ip
+} FROZEN_THREAD, *PFROZEN_THREAD;
+
+//-------------------------------------------------------------------------
+// Global Variables:
+//-------------------------------------------------------------------------
+
+// The threads of the current or last freeze. The buffer is kept between
+// freezes, and only changes while g_isFrozen is 0.
+static struct
+{
+    PFROZEN_THREAD pItems;  // Data heap
+    unsigned       capacity;// Size of allocated data heap, items
+    unsigned       size;    // Actual number of data items
+} g_threads;
+
+// 1 from just before the threads are signaled until they may resume. The
+// stopped threads wait on it as a futex.
+static int g_isFrozen;
+
+// Number of threads signaled but not stopped yet, and of threads still in
+// OnFreezeSignal() after UnfreezeThreads(). The freezing thread waits on
+// them as futexes, rather than spinning, which on a loaded or single CPU
+// would only wait out the time slices of the threads it is waiting for.
+static int g_signaledCount;
+static int g_stoppedCount;
+
+// Is OnFreezeSignal() installed?
+static int g_isHandlerInstalled;
+
+//-------------------------------------------------------------------------
+static pid_t GetThreadId(void)
+{
+    return (pid_t)syscall(SYS_gettid);
+}
+
+//-------------------------------------------------------------------------
+static void FutexWait(int *pFutex, int value, const struct timespec *pTimeout)
+{
+    syscall(SYS_futex, pFutex, FUTEX_WAIT_PRIVATE, value, pTimeout, NULL, 0);
+}
+
+//-------------------------------------------------------------------------
+static void FutexWake(int *pFutex)
+{
+    syscall(SYS_futex, pFutex, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+//-------------------------------------------------------------------------
+// Decrements *pCount and wakes its waiter when it reaches 0.
+static void CountDown(int *pCount)
+{
+    if (__atomic_sub_fetch(pCount, 1, __ATOMIC_ACQ_REL) == 0)
+        FutexWake(pCount);
+}
+
+//-------------------------------------------------------------------------
+// Only async-signal-safe calls from here on, until resumed.
+static void OnFreezeSignal(int signal, siginfo_t *pInfo, void *pUContext)
+{
+    ucontext_t    *pContext = (ucontext_t *)pUContext;
+    int            savedErrno = errno;
+    int            state = THREAD_SIGNALED;
+    pid_t          tid;
+    PFROZEN_THREAD pThread = NULL;
+    unsigned       i;
+
+    (void)signal;
+    (void)pInfo;
+
+    // Arrived after the freeze it was sent for gave up on this thread.
+    if (!__atomic_load_n(&g_isFrozen, __ATOMIC_ACQUIRE))
+        return;
+
+    tid = GetThreadId();
+    for (i = 0; i < g_threads.size; ++i)
+    {
+        if (g_threads.pItems[i].tid == tid)
+        {
+            pThread = &g_threads.pItems[i];
+            break;
+        }
+    }
+
+    if (pThread == NULL)
+        return;
+
+    pThread->ip    = (uintptr_t)CONTEXT_IP(pContext);
+    pThread->newIP = 0;
+
+    // Fails if FreezeThreads() has timed out waiting for this thread.
+    if (!__atomic_compare_exchange_n(&pThread->state, &state, THREAD_STOPPED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return;
+
+    CountDown(&g_signaledCount);
+
+    while (__atomic_load_n(&g_isFrozen, __ATOMIC_ACQUIRE))
+        FutexWait(&g_isFrozen, 1, NULL);
+
+    if (pThread->newIP != 0)
+        CONTEXT_IP(pContext) = pThread->newIP;
+
+    CountDown(&g_stoppedCount);
+    errno = savedErrno;
+}
+
+//-------------------------------------------------------------------------
+static int InstallHandler(void)
+{
+    struct sigaction action;
+
+    if (g_isHandlerInstalled)
+        return 1;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = OnFreezeSignal;
+    action.sa_flags     = SA_SIGINFO | SA_RESTART;
+    sigfillset(&action.sa_mask);
+    if (sigaction(MH_FREEZE_SIGNAL, &action, NULL) != 0)
+        return 0;
+
+    g_isHandlerInstalled = 1;
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+static int AddThread(pid_t tid)
+{
+    if (g_threads.size >= g_threads.capacity)
+    {
+        unsigned capacity = g_threads.capacity != 0 ? g_threads.capacity * 2 : INITIAL_THREAD_CAPACITY;
+        PFROZEN_THREAD p = (PFROZEN_THREAD)realloc(g_threads.pItems, capacity * sizeof(FROZEN_THREAD));
+        if (p == NULL)
+            return 0;
+
+        g_threads.capacity = capacity;
+        g_threads.pItems   = p;
+    }
+
+    g_threads.pItems[g_threads.size].tid   = tid;
+    g_threads.pItems[g_threads.size].state = THREAD_IDLE;
+    g_threads.pItems[g_threads.size].newIP = 0;
+    g_threads.size++;
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+// Lists the other threads of the process. /proc/self/task has only those,
+// unlike a walk of every process in the system.
+static void EnumerateThreads(void)
+{
+    pid_t          self = GetThreadId();
+    DIR           *pDir;
+    struct dirent *pEntry;
+
+    g_threads.size = 0;
+
+    pDir = opendir("/proc/self/task");
+    if (pDir == NULL)
+        return;
+
+    while ((pEntry = readdir(pDir)) != NULL)
+    {
+        pid_t tid = (pid_t)strtol(pEntry->d_name, NULL, 10);
+        if (tid > 0 && tid != self && !AddThread(tid))
+            break;
+    }
+
+    closedir(pDir);
+}
+
+//-------------------------------------------------------------------------
+unsigned FreezeThreads(PMOVE_THREAD_IP pMoveIP, void *pContext)
+{
+    pid_t           pid = getpid();
+    struct timespec deadline;
+    unsigned        stopped = 0;
+    unsigned        i;
+    int             count;
+
+    if (!InstallHandler())
+        return 0;
+
+    EnumerateThreads();
+
+    __atomic_store_n(&g_signaledCount, (int)g_threads.size, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_isFrozen, 1, __ATOMIC_RELEASE);
+
+    // Signal every thread first, so that they stop in parallel.
+    for (i = 0; i < g_threads.size; ++i)
+    {
+        PFROZEN_THREAD pThread = &g_threads.pItems[i];
+        __atomic_store_n(&pThread->state, THREAD_SIGNALED, __ATOMIC_RELEASE);
+        if (syscall(SYS_tgkill, pid, pThread->tid, MH_FREEZE_SIGNAL) != 0)
+        {
+            __atomic_store_n(&pThread->state, THREAD_IDLE, __ATOMIC_RELEASE);
+            CountDown(&g_signaledCount);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += FREEZE_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (FREEZE_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while ((count = __atomic_load_n(&g_signaledCount, __ATOMIC_ACQUIRE)) != 0)
+    {
+        struct timespec now;
+        struct timespec timeout;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout.tv_sec  = deadline.tv_sec - now.tv_sec;
+        timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+        if (timeout.tv_nsec < 0)
+        {
+            timeout.tv_sec--;
+            timeout.tv_nsec += 1000000000L;
+        }
+        if (timeout.tv_sec < 0)
+            break;
+
+        FutexWait(&g_signaledCount, count, &timeout);
+    }
+
+    for (i = 0; i < g_threads.size; ++i)
+    {
+        PFROZEN_THREAD pThread = &g_threads.pItems[i];
+        int state = THREAD_SIGNALED;
+
+        // Exited, or has the signal blocked. If the handler still runs, it
+        // finds the state changed and returns at once.
+        if (__atomic_compare_exchange_n(&pThread->state, &state, THREAD_IDLE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+
+        if (state == THREAD_STOPPED)
+        {
+            stopped++;
+            if (pMoveIP != NULL)
+                pThread->newIP = pMoveIP(pThread->ip, pContext);
+        }
+    }
+
+    __atomic_store_n(&g_stoppedCount, (int)stopped, __ATOMIC_RELEASE);
+    return stopped;
+}
+
+//-------------------------------------------------------------------------
+void UnfreezeThreads(void)
+{
+    int count;
+
+    __atomic_store_n(&g_isFrozen, 0, __ATOMIC_RELEASE);
+    FutexWake(&g_isFrozen);
+
+    // Wait until every stopped thread has taken its new IP and left the
+    // handler, since the next freeze reuses g_threads.
+    while ((count = __atomic_load_n(&g_stoppedCount, __ATOMIC_ACQUIRE)) != 0)
+        FutexWait(&g_stoppedCount, count, NULL);
+
+    g_threads.size = 0;
+}
+
+//-------------------------------------------------------------------------
+void ReleaseFrozenThreads(void)
+{
+    free(g_threads.pItems);
+
+    g_threads.pItems   = NULL;
+    g_threads.capacity = 0;
+    g_threads.size     = 0;
+}
@@ -0,0 +1,215 @@
+﻿/*
+ *  MinHook - The Minimalistic API Hooking Library for x64/x86
+ *  Copyright (C) 2009-2017 Tsuda Kageyu.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ *  TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ *  PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER
+ *  OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <windows.h>
+#include <tlhelp32.h>
+#include "thread.h"
+
+// Initial capacity of the thread handles buffer.
+#define INITIAL_THREAD_CAPACITY 128
+
+// Thread access rights for suspending/resuming threads.
+#define THREAD_ACCESS \
+    (THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION | THREAD_SET_CONTEXT)
+
+// Walks the threads of one process, opening each in turn. Available from
+// Windows Vista on, but not declared by the SDK.
+typedef LONG (NTAPI *NT_GET_NEXT_THREAD)(
+    HANDLE ProcessHandle, HANDLE ThreadHandle, ACCESS_MASK DesiredAccess,
+    ULONG HandleAttributes, ULONG Flags, PHANDLE NewThreadHandle);
+
+//-------------------------------------------------------------------------
+// Global Variables:
+//-------------------------------------------------------------------------
+
+// Handles of the suspended threads. The buffer is kept between freezes.
+static struct
+{
+    LPHANDLE pItems;        // Data heap
+    UINT     capacity;      // Size of allocated data heap, items
+    UINT     size;          // Actual number of data items
+} g_threads;
+
+// NtGetNextThread, or NULL if ntdll.dll does not export it.
+static NT_GET_NEXT_THREAD g_pNtGetNextThread;
+static BOOL g_isNtGetNextThreadResolved;
+
+//-------------------------------------------------------------------------
+static BOOL AddThread(HANDLE hThread)
+{
+    if (g_threads.pItems == NULL)
+    {
+        g_threads.capacity = INITIAL_THREAD_CAPACITY;
+        g_threads.pItems = (LPHANDLE)HeapAlloc(
+            GetProcessHeap(), 0, g_threads.capacity * sizeof(HANDLE));
+        if (g_threads.pItems == NULL)
+            return FALSE;
+    }
+    else if (g_threads.size >= g_threads.capacity)
+    {
+        LPHANDLE p = (LPHANDLE)HeapReAlloc(
+            GetProcessHeap(), 0, g_threads.pItems, (g_threads.capacity * 2) * sizeof(HANDLE));
+        if (p == NULL)
+            return FALSE;
+
+        g_threads.capacity *= 2;
+        g_threads.pItems = p;
+    }
+
+    g_threads.pItems[g_threads.size++] = hThread;
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+// Keeps hThread unless it is the current thread.
+static VOID AddOtherThread(HANDLE hThread)
+{
+    if (GetThreadId(hThread) == GetCurrentThreadId() || !AddThread(hThread))
+        CloseHandle(hThread);
+}
+
+//-------------------------------------------------------------------------
+// Opens every other thread of the process. NtGetNextThread visits only the
+// threads of this process and opens them as it goes; the fallback walks a
+// snapshot of every thread in the system.
+static VOID EnumerateThreads(VOID)
+{
+    if (!g_isNtGetNextThreadResolved)
+    {
+        HMODULE hNtdll = GetModuleHandleW(L"ntdll.dll");
+        if (hNtdll != NULL)
+            g_pNtGetNextThread = (NT_GET_NEXT_THREAD)GetProcAddress(hNtdll, "NtGetNextThread");
+
+        g_isNtGetNextThreadResolved = TRUE;
+    }
+
+    if (g_pNtGetNextThread != NULL)
+    {
+        HANDLE hThread = NULL;
+        HANDLE hNext;
+
+        // The previous handle is needed to find the next one.
+        while (g_pNtGetNextThread(GetCurrentProcess(), hThread, THREAD_ACCESS, 0, 0, &hNext) >= 0)
+        {
+            if (hThread != NULL)
+                AddOtherThread(hThread);
+
+            hThread = hNext;
+        }
+
+        if (hThread != NULL)
+            AddOtherThread(hThread);
+    }
+    else
+    {
+        HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+        if (hSnapshot != INVALID_HANDLE_VALUE)
+        {
+            THREADENTRY32 te;
+            te.dwSize = sizeof(THREADENTRY32);
+            if (Thread32First(hSnapshot, &te))
+            {
+                do
+                {
+                    if (te.dwSize >= (FIELD_OFFSET(THREADENTRY32, th32OwnerProcessID) + sizeof(DWORD))
+                        && te.th32OwnerProcessID == GetCurrentProcessId()
+                        && te.th32ThreadID != GetCurrentThreadId())
+                    {
+                        HANDLE hThread = OpenThread(THREAD_ACCESS, FALSE, te.th32ThreadID);
+                        if (hThread != NULL && !AddThread(hThread))
+                            CloseHandle(hThread);
+                    }
+
+                    te.dwSize = sizeof(THREADENTRY32);
+                } while (Thread32Next(hSnapshot, &te));
+            }
+            CloseHandle(hSnapshot);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+unsigned FreezeThreads(PMOVE_THREAD_IP pMoveIP, void *pContext)
+{
+    UINT i;
+
+    g_threads.size = 0;
+    EnumerateThreads();
+
+    for (i = 0; i < g_threads.size; ++i)
+    {
+        HANDLE hThread = g_threads.pItems[i];
+        CONTEXT c;
+#if defined(_M_X64) || defined(__x86_64__)
+        DWORD64 *pIP = &c.Rip;
+#else
+        DWORD   *pIP = &c.Eip;
+#endif
+
+        SuspendThread(hThread);
+
+        // If the thread is stopped in code that is about to change, move
+        // its IP to the proper address.
+        c.ContextFlags = CONTEXT_CONTROL;
+        if (pMoveIP != NULL && GetThreadContext(hThread, &c))
+        {
+            uintptr_t ip = pMoveIP((uintptr_t)*pIP, pContext);
+            if (ip != 0)
+            {
+                *pIP = ip;
+                SetThreadContext(hThread, &c);
+            }
+        }
+    }
+
+    return g_threads.size;
+}
+
+//-------------------------------------------------------------------------
+void UnfreezeThreads(void)
+{
+    UINT i;
+    for (i = 0; i < g_threads.size; ++i)
+    {
+        ResumeThread(g_threads.pItems[i]);
+        CloseHandle(g_threads.pItems[i]);
+    }
+
+    g_threads.size = 0;
+}
+
+//-------------------------------------------------------------------------
+void ReleaseFrozenThreads(void)
+{
+    if (g_threads.pItems != NULL)
+        HeapFree(GetProcessHeap(), 0, g_threads.pItems);
+
+    g_threads.pItems   = NULL;
+    g_threads.capacity = 0;
+    g_threads.size     = 0;
+}
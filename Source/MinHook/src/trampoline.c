@@ -26,7 +26,8 @@
  *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <windows.h>
+#include <limits.h>
+#include "platform/compat.h"
 
 #ifndef ARRAYSIZE
     #define ARRAYSIZE(A) (sizeof(A)/sizeof((A)[0]))
@@ -45,13 +46,25 @@
 #include "trampoline.h"
 #include "buffer.h"
 
-// Maximum size of a trampoline function.
+// Maximum size of a trampoline function in a buffer of the given size.
 #if defined(_M_X64) || defined(__x86_64__)
-    #define TRAMPOLINE_MAX_SIZE (MEMORY_SLOT_SIZE - sizeof(JMP_ABS))
+    #define TRAMPOLINE_MAX_SIZE(bufferSize) ((bufferSize) - sizeof(JMP_ABS))
 #else
-    #define TRAMPOLINE_MAX_SIZE MEMORY_SLOT_SIZE
+    #define TRAMPOLINE_MAX_SIZE(bufferSize) (bufferSize)
 #endif
 
+// A branch whose displacement is only known once the whole trampoline
+// function is laid out: a jump to an instruction of the trampoline function,
+// or a LOOP/JECXZ to the outside, which goes through a branch island.
+typedef struct _BRANCH_FIXUP
+{
+    UINT8     relPos;   // Position of the displacement in the trampoline function.
+    UINT8     relSize;  // Size of the displacement, 1 or 4.
+    UINT8     nextPos;  // Position of the next instruction in the trampoline function.
+    BOOL      internal; // Does it go to an instruction of the trampoline function?
+    ULONG_PTR dest;     // Destination address of the original branch.
+} BRANCH_FIXUP, *PBRANCH_FIXUP;
+
 //-------------------------------------------------------------------------
 static BOOL IsCodePadding(LPBYTE pInst, UINT size)
 {
@@ -69,7 +82,34 @@ static BOOL IsCodePadding(LPBYTE pInst, UINT size)
 }
 
 //-------------------------------------------------------------------------
-BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
+// Where in the trampoline function an internal jump to dest has to go, or
+// -1 if it jumps into an instruction that changed in size.
+static INT32 FindNewPos(PTRAMPOLINE_BUILD pBuild, ULONG_PTR dest)
+{
+    UINT offset = (UINT)(dest - pBuild->codeAddress);
+    UINT i;
+
+    for (i = pBuild->nIP; i-- > 0;)
+    {
+        if (pBuild->pOldIPs[i] > offset)
+            continue;
+
+        if (pBuild->pOldIPs[i] == offset)
+            return pBuild->pNewIPs[i];
+
+        // Into the middle of an instruction, as long as it was copied as is.
+        if (i + 1 < pBuild->nIP
+            && pBuild->pNewIPs[i + 1] - pBuild->pNewIPs[i] == pBuild->pOldIPs[i + 1] - pBuild->pOldIPs[i])
+        {
+            return pBuild->pNewIPs[i] + (offset - pBuild->pOldIPs[i]);
+        }
+        break;
+    }
+    return -1;
+}
+
+//-------------------------------------------------------------------------
+BOOL BuildTrampoline(PTRAMPOLINE_BUILD pBuild)
 {
 #if defined(_M_X64) || defined(__x86_64__)
     CALL_ABS call = {
@@ -108,23 +148,46 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
 #if defined(_M_X64) || defined(__x86_64__)
     UINT8     instBuf[16];
 #endif
-
-    ct->patchAbove = FALSE;
-    ct->nIP        = 0;
+    UINT8     codeBuf[16];      // The last bytes of the code, padded for the disassembler.
+    BRANCH_FIXUP fixups[TRAMPOLINE_MAX_IPS]; // Branches to point at their destinations last.
+    UINT      nFixup      = 0;
+    UINT      islandsSize = 0;  // Size of the branch islands after the relay function.
+    UINT      i;
+
+    pBuild->size            = 0;
+    pBuild->needsPatchAbove = FALSE;
+    pBuild->tooLarge        = FALSE;
+    pBuild->nIP             = 0;
+    pBuild->nIsland         = 0;
 
     do
     {
-        HDE       hs;
-        UINT      copySize;
-        LPVOID    pCopySrc;
-        ULONG_PTR pOldInst = (ULONG_PTR)ct->pTarget     + oldPos;
-        ULONG_PTR pNewInst = (ULONG_PTR)ct->pTrampoline + newPos;
+        HDE          hs;
+        UINT         copySize;
+        UINT         relSize  = 0;     // Size of the displacement to fix up, if any.
+        BOOL         internal = FALSE;
+        ULONG_PTR    dest     = 0;
+        const void  *pCopySrc;
+        const UINT8 *pInst    = pBuild->pCode + oldPos;
+        ULONG_PTR    pOldInst = pBuild->codeAddress       + oldPos;
+        ULONG_PTR    pNewInst = pBuild->trampolineAddress + newPos;
+
+        // Don't let the disassembler read past the code. Where the code ends
+        // right after what is relocated, it reads zeros in place of the
+        // instruction that the final jump goes to.
+        if (oldPos >= pBuild->codeSize || pBuild->codeSize - oldPos < sizeof(codeBuf))
+        {
+            memset(codeBuf, 0, sizeof(codeBuf));
+            if (oldPos < pBuild->codeSize)
+                memcpy(codeBuf, pInst, pBuild->codeSize - oldPos);
+            pInst = codeBuf;
+        }
 
-        copySize = HDE_DISASM((LPVOID)pOldInst, &hs);
+        copySize = HDE_DISASM(pInst, &hs);
         if (hs.flags & F_ERROR)
             return FALSE;
 
-        pCopySrc = (LPVOID)pOldInst;
+        pCopySrc = pInst;
         if (oldPos >= sizeof(JMP_REL))
         {
             // The trampoline function is long enough.
@@ -139,6 +202,11 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
 
             finished = TRUE;
         }
+        else if (oldPos + hs.len > pBuild->codeSize)
+        {
+            // The instruction runs past the code.
+            return FALSE;
+        }
 #if defined(_M_X64) || defined(__x86_64__)
         else if ((hs.modrm & 0xC7) == 0x05)
         {
@@ -149,9 +217,9 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
 
             // Avoid using memcpy to reduce the footprint.
 #ifndef _MSC_VER
-            memcpy(instBuf, (LPBYTE)pOldInst, copySize);
+            memcpy(instBuf, pInst, copySize);
 #else
-            __movsb(instBuf, (LPBYTE)pOldInst, copySize);
+            __movsb(instBuf, pInst, copySize);
 #endif
             pCopySrc = instBuf;
 
@@ -180,19 +248,23 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
         else if ((hs.opcode & 0xFD) == 0xE9)
         {
             // Direct relative JMP (EB or E9)
-            ULONG_PTR dest = pOldInst + hs.len;
+            dest = pOldInst + hs.len;
 
             if (hs.opcode == 0xEB) // isShort jmp
                 dest += (INT8)hs.imm.imm8;
             else
                 dest += (INT32)hs.imm.imm32;
 
-            // Simply copy an internal jump.
-            if ((ULONG_PTR)ct->pTarget <= dest
-                && dest < ((ULONG_PTR)ct->pTarget + sizeof(JMP_REL)))
+            // Copy an internal jump, and fix it up once the instruction it
+            // jumps to is relocated.
+            if (pBuild->codeAddress <= dest
+                && dest < (pBuild->codeAddress + sizeof(JMP_REL)))
             {
                 if (jmpDest < dest)
                     jmpDest = dest;
+
+                relSize  = (hs.opcode == 0xEB) ? 1 : 4;
+                internal = TRUE;
             }
             else
             {
@@ -213,25 +285,36 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
             || (hs.opcode2 & 0xF0) == 0x80)
         {
             // Direct relative Jcc
-            ULONG_PTR dest = pOldInst + hs.len;
+            dest = pOldInst + hs.len;
 
             if ((hs.opcode & 0xF0) == 0x70      // Jcc
                 || (hs.opcode & 0xFC) == 0xE0)  // LOOPNZ/LOOPZ/LOOP/JECXZ
+            {
                 dest += (INT8)hs.imm.imm8;
+                relSize = 1;
+            }
             else
+            {
                 dest += (INT32)hs.imm.imm32;
+                relSize = 4;
+            }
 
-            // Simply copy an internal jump.
-            if ((ULONG_PTR)ct->pTarget <= dest
-                && dest < ((ULONG_PTR)ct->pTarget + sizeof(JMP_REL)))
+            // Copy an internal jump, and fix it up once the instruction it
+            // jumps to is relocated.
+            if (pBuild->codeAddress <= dest
+                && dest < (pBuild->codeAddress + sizeof(JMP_REL)))
             {
                 if (jmpDest < dest)
                     jmpDest = dest;
+
+                internal = TRUE;
             }
             else if ((hs.opcode & 0xFC) == 0xE0)
             {
-                // LOOPNZ/LOOPZ/LOOP/JCXZ/JECXZ to the outside are not supported.
-                return FALSE;
+                // LOOPNZ/LOOPZ/LOOP/JCXZ/JECXZ have no rel32 form. Copy them
+                // and let them jump to a branch island that jumps to the
+                // destination.
+                islandsSize += sizeof(jmp);
             }
             else
             {
@@ -246,6 +329,7 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
 #endif
                 pCopySrc = &jcc;
                 copySize = sizeof(jcc);
+                relSize  = 0;
             }
         }
         else if ((hs.opcode & 0xFE) == 0xC2)
@@ -256,27 +340,39 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
             finished = (pOldInst >= jmpDest);
         }
 
-        // Can't alter the instruction length in a branch.
-        if (pOldInst < jmpDest && copySize != hs.len)
-            return FALSE;
-
         // Trampoline function is too large.
-        if ((newPos + copySize) > TRAMPOLINE_MAX_SIZE)
+        if ((newPos + copySize + islandsSize) > TRAMPOLINE_MAX_SIZE(pBuild->outputSize))
+        {
+            pBuild->tooLarge = TRUE;
             return FALSE;
+        }
+
+        if (relSize != 0)
+        {
+            if (nFixup >= ARRAYSIZE(fixups))
+                return FALSE;
+
+            fixups[nFixup].relPos   = (UINT8)(newPos + hs.len - relSize);
+            fixups[nFixup].relSize  = (UINT8)relSize;
+            fixups[nFixup].nextPos  = (UINT8)(newPos + hs.len);
+            fixups[nFixup].internal = internal;
+            fixups[nFixup].dest     = dest;
+            nFixup++;
+        }
 
-        // Trampoline function has too many instructions.
-        if (ct->nIP >= ARRAYSIZE(ct->oldIPs))
+        // No room left in the instruction boundary maps.
+        if (pBuild->nIP >= pBuild->maxIP)
             return FALSE;
 
-        ct->oldIPs[ct->nIP] = oldPos;
-        ct->newIPs[ct->nIP] = newPos;
-        ct->nIP++;
+        pBuild->pOldIPs[pBuild->nIP] = oldPos;
+        pBuild->pNewIPs[pBuild->nIP] = newPos;
+        pBuild->nIP++;
 
         // Avoid using memcpy to reduce the footprint.
 #ifndef _MSC_VER
-        memcpy((LPBYTE)ct->pTrampoline + newPos, pCopySrc, copySize);
+        memcpy(pBuild->pOutput + newPos, pCopySrc, copySize);
 #else
-        __movsb((LPBYTE)ct->pTrampoline + newPos, pCopySrc, copySize);
+        __movsb(pBuild->pOutput + newPos, pCopySrc, copySize);
 #endif
         newPos += copySize;
         oldPos += hs.len;
@@ -285,15 +381,113 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
 
     // Is there enough place for a long jump?
     if (oldPos < sizeof(JMP_REL)
-        && !IsCodePadding((LPBYTE)ct->pTarget + oldPos, sizeof(JMP_REL) - oldPos))
+        && (pBuild->codeSize < sizeof(JMP_REL)
+            || !IsCodePadding((LPBYTE)pBuild->pCode + oldPos, sizeof(JMP_REL) - oldPos)))
     {
         // Is there enough place for a short jump?
         if (oldPos < sizeof(JMP_REL_SHORT)
-            && !IsCodePadding((LPBYTE)ct->pTarget + oldPos, sizeof(JMP_REL_SHORT) - oldPos))
+            && (pBuild->codeSize < sizeof(JMP_REL_SHORT)
+                || !IsCodePadding((LPBYTE)pBuild->pCode + oldPos, sizeof(JMP_REL_SHORT) - oldPos)))
         {
             return FALSE;
         }
 
+        // The long jump has to go above the function.
+        pBuild->needsPatchAbove = TRUE;
+    }
+
+#if defined(_M_X64) || defined(__x86_64__)
+    // Create a relay function.
+    jmp.address = pBuild->detourAddress;
+
+    pBuild->relayOffset = newPos;
+    memcpy(pBuild->pOutput + newPos, &jmp, sizeof(jmp));
+    newPos += sizeof(jmp);
+#endif
+
+    // Point the branches at their relocated destinations, and at the branch
+    // islands at the end.
+    for (i = 0; i < nFixup; ++i)
+    {
+        PBRANCH_FIXUP pFixup = &fixups[i];
+        INT32         destPos;
+        INT32         rel;
+
+        if (pFixup->internal)
+        {
+            destPos = FindNewPos(pBuild, pFixup->dest);
+            if (destPos < 0)
+                return FALSE;
+        }
+        else
+        {
+            if (pBuild->nIsland >= ARRAYSIZE(pBuild->islandPos))
+                return FALSE;
+
+#if defined(_M_X64) || defined(__x86_64__)
+            jmp.address = pFixup->dest;
+#else
+            jmp.operand = (UINT32)(pFixup->dest - (pBuild->trampolineAddress + newPos + sizeof(jmp)));
+#endif
+            memcpy(pBuild->pOutput + newPos, &jmp, sizeof(jmp));
+            destPos = newPos;
+
+            // Freeze() moves a thread off the island to where it jumps.
+            pBuild->islandPos[pBuild->nIsland]   = newPos;
+            pBuild->islandDests[pBuild->nIsland] = pFixup->dest;
+            pBuild->nIsland++;
+
+            newPos += sizeof(jmp);
+        }
+
+        rel = destPos - pFixup->nextPos;
+        if (pFixup->relSize == 1)
+        {
+            if (rel < -128 || rel > 127)
+                return FALSE;
+
+            pBuild->pOutput[pFixup->relPos] = (UINT8)rel;
+        }
+        else
+        {
+            memcpy(pBuild->pOutput + pFixup->relPos, &rel, sizeof(rel));
+        }
+    }
+
+    pBuild->size = newPos;
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
+{
+    TRAMPOLINE_BUILD build;
+
+    // The live target is read as far as its instructions go.
+    build.pCode             = (const UINT8 *)ct->pTarget;
+    build.codeSize          = UINT_MAX;
+    build.codeAddress       = (ULONG_PTR)ct->pTarget;
+    build.trampolineAddress = (ULONG_PTR)ct->pTrampoline;
+    build.detourAddress     = (ULONG_PTR)ct->pDetour;
+    build.pOutput           = (UINT8 *)GetWritableBuffer(ct->pTrampoline);
+    build.outputSize        = ct->bufferSize;
+    build.pOldIPs           = ct->oldIPs;
+    build.pNewIPs           = ct->newIPs;
+    build.maxIP             = ARRAYSIZE(ct->oldIPs);
+
+    ct->patchAbove = FALSE;
+    ct->nIP        = 0;
+    ct->nIsland    = 0;
+
+    if (!BuildTrampoline(&build))
+    {
+        ct->tooLarge = build.tooLarge;
+        return FALSE;
+    }
+    ct->tooLarge = FALSE;
+
+    if (build.needsPatchAbove)
+    {
         // Can we place the long jump above the function?
         if (!IsExecutableAddress((LPBYTE)ct->pTarget - sizeof(JMP_REL)))
             return FALSE;
@@ -305,12 +499,12 @@ BOOL CreateTrampolineFunction(PTRAMPOLINE ct)
     }
 
 #if defined(_M_X64) || defined(__x86_64__)
-    // Create a relay function.
-    jmp.address = (ULONG_PTR)ct->pDetour;
-
-    ct->pRelay = (LPBYTE)ct->pTrampoline + newPos;
-    memcpy(ct->pRelay, &jmp, sizeof(jmp));
+    ct->pRelay = (LPBYTE)ct->pTrampoline + build.relayOffset;
 #endif
+    ct->nIP     = build.nIP;
+    ct->nIsland = build.nIsland;
+    memcpy(ct->islandPos, build.islandPos, build.nIsland * sizeof(build.islandPos[0]));
+    memcpy(ct->islandDests, build.islandDests, build.nIsland * sizeof(build.islandDests[0]));
 
     return TRUE;
 }
@@ -87,19 +87,75 @@ typedef struct _JCC_ABS
 
 #pragma pack(pop)
 
+// Most instruction boundaries a trampoline function can have: one for each
+// instruction that starts in the bytes the jump overwrites, and one for the
+// jump back to the target function.
+#define TRAMPOLINE_MAX_IPS (sizeof(JMP_REL) + 1)
+
+// Most branch islands a trampoline function can have: one for each LOOP or
+// JECXZ, at least 2 bytes long, that starts in the bytes the jump overwrites.
+#define TRAMPOLINE_MAX_ISLANDS ((sizeof(JMP_REL) + 1) / 2)
+
 typedef struct _TRAMPOLINE
 {
     LPVOID pTarget;         // [In] Address of the target function.
     LPVOID pDetour;         // [In] Address of the detour function.
     LPVOID pTrampoline;     // [In] Buffer address for the trampoline and relay function.
+    UINT   bufferSize;      // [In] Size of the buffer.
 
 #if defined(_M_X64) || defined(__x86_64__)
     LPVOID pRelay;          // [Out] Address of the relay function.
 #endif
     BOOL   patchAbove;      // [Out] Should use the hot patch area?
+    BOOL   tooLarge;        // [Out] Did it fail only for lack of buffer space?
     UINT   nIP;             // [Out] Number of the instruction boundaries.
-    UINT8  oldIPs[8];       // [Out] Instruction boundaries of the target function.
-    UINT8  newIPs[8];       // [Out] Instruction boundaries of the trampoline function.
+    UINT8  oldIPs[TRAMPOLINE_MAX_IPS]; // [Out] Instruction boundaries of the target function.
+    UINT8  newIPs[TRAMPOLINE_MAX_IPS]; // [Out] Instruction boundaries of the trampoline function.
+    UINT   nIsland;         // [Out] Number of the branch islands.
+    UINT8  islandPos[TRAMPOLINE_MAX_ISLANDS];      // [Out] Offsets of the branch islands in the buffer.
+    ULONG_PTR islandDests[TRAMPOLINE_MAX_ISLANDS]; // [Out] Where the branch islands jump to.
 } TRAMPOLINE, *PTRAMPOLINE;
 
+// Input and output of BuildTrampoline(), which works on a copy of the target
+// function and touches no memory but the buffers given, so that it runs the
+// same anywhere.
+typedef struct _TRAMPOLINE_BUILD
+{
+    const UINT8 *pCode;             // [In] Code of the target function.
+    UINT         codeSize;          // [In] Number of bytes at pCode.
+    ULONG_PTR    codeAddress;       // [In] Address the target function runs at.
+    ULONG_PTR    trampolineAddress; // [In] Address the trampoline function will run at.
+    ULONG_PTR    detourAddress;     // [In] Address of the detour function.
+    UINT8       *pOutput;           // [In] Buffer for the trampoline and relay function and branch islands.
+    UINT         outputSize;        // [In] Size of the buffer.
+    UINT8       *pOldIPs;           // [In] Buffer for the instruction boundaries of the target function.
+    UINT8       *pNewIPs;           // [In] Buffer for the instruction boundaries of the trampoline function.
+    UINT         maxIP;             // [In] Number of entries in each of them.
+
+    UINT         size;              // [Out] Number of bytes written to the buffer.
+#if defined(_M_X64) || defined(__x86_64__)
+    UINT         relayOffset;       // [Out] Offset of the relay function in the buffer.
+#endif
+    BOOL         needsPatchAbove;   // [Out] Does the jump have to be in the hot patch area?
+    BOOL         tooLarge;          // [Out] Did it fail only for lack of buffer space?
+    UINT         nIP;               // [Out] Number of the instruction boundaries.
+    UINT         nIsland;           // [Out] Number of the branch islands.
+    UINT8        islandPos[TRAMPOLINE_MAX_ISLANDS];   // [Out] Offsets of the branch islands in the buffer.
+    ULONG_PTR    islandDests[TRAMPOLINE_MAX_ISLANDS]; // [Out] Where the branch islands jump to.
+} TRAMPOLINE_BUILD, *PTRAMPOLINE_BUILD;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates the trampoline and relay function of a live target function.
 BOOL CreateTrampolineFunction(PTRAMPOLINE ct);
+
+// Builds the trampoline and relay function of the code at pBuild->pCode as if
+// it ran at pBuild->codeAddress, for pBuild->trampolineAddress. Checking the
+// hot patch area is left to the caller.
+BOOL BuildTrampoline(PTRAMPOLINE_BUILD pBuild);
+
+#ifdef __cplusplus
+}
+#endif
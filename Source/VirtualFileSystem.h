@@ -0,0 +1,545 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "FakeHandleTable.h"
+#include "HookContainer.h"
+#include "MappedFile.h"
+
+namespace TestHooks
+{
+	// Same values as the dwCreationDisposition of CreateFileW.
+	enum class FileDisposition
+	{
+		CreateNew = 1,
+		CreateAlways = 2,
+		OpenExisting = 3,
+		OpenAlways = 4,
+		TruncateExisting = 5
+	};
+
+	enum FileAccess : unsigned int
+	{
+		FileAccessRead = 1,
+		FileAccessWrite = 2
+	};
+
+	enum class FileStatus
+	{
+		Success,
+		AlreadyExists,		// Success, but CreateAlways/OpenAlways found an existing file.
+		FileNotFound,
+		FileExists,
+		AccessDenied,
+		InvalidHandle,
+		InvalidParameter,
+		DiskFull
+	};
+
+	inline bool Succeeded(FileStatus status)
+	{
+		return status == FileStatus::Success || status == FileStatus::AlreadyExists;
+	}
+
+	// Contents of one virtual file, kept in fixed size extents so that
+	// growing a file never copies what was already written. Extents are
+	// keyed by index and only exist once written, so a write far past the
+	// end costs one extent; the hole before it reads as zeros. Writes that
+	// would end past MaxSize fail with DiskFull.
+	// A file mounted from a fixture directory is read only and has no
+	// extents: its host file is mapped on the first read and reads copy
+	// straight from the mapped pages.
+	class VirtualFile
+	{
+	public:
+		static constexpr size_t			ExtentSize { 64 * 1024 };
+		static constexpr uint64_t		MaxSize { uint64_t { 1 } << 40 };
+
+	private:
+		mutable std::shared_mutex		m_mutex;
+		std::map<uint64_t, std::unique_ptr<unsigned char[]>>	m_extents;
+		uint64_t						m_size { 0 };
+
+		std::filesystem::path			m_hostPath;
+		mutable std::once_flag			m_mapOnce;
+		mutable std::unique_ptr<MappedFile>	m_mapping;
+		mutable std::atomic<bool>		m_mapped { false };
+
+		const MappedFile* Mapping() const
+		{
+			std::call_once(m_mapOnce, [this] {
+					m_mapping = MappedFile::Open(m_hostPath);
+					m_mapped.store(true, std::memory_order_release);
+				});
+			return m_mapping.get();
+		}
+
+	public:
+		VirtualFile() = default;
+
+		// size, taken when the directory was mounted, is what Size reports
+		// until the file is first read; from then on the mapping decides.
+		VirtualFile(std::filesystem::path hostPath, uint64_t size)
+			: m_size(size),
+			  m_hostPath(std::move(hostPath))
+		{
+		}
+
+		bool IsReadOnly() const
+		{
+			return !m_hostPath.empty();
+		}
+
+		uint64_t Size() const
+		{
+			if (IsReadOnly())
+			{
+				if (!m_mapped.load(std::memory_order_acquire))
+					return m_size;
+
+				const MappedFile* mapping = Mapping();
+				return mapping != nullptr ? mapping->Size() : 0;
+			}
+
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+			return m_size;
+		}
+
+		void Truncate()
+		{
+			if (IsReadOnly())
+				return;
+
+			std::unique_lock<std::shared_mutex> lock(m_mutex);
+			m_extents.clear();
+			m_size = 0;
+		}
+
+		size_t ReadAt(uint64_t offset, void* buffer, size_t count) const
+		{
+			if (IsReadOnly())
+			{
+				const MappedFile* mapping = Mapping();
+				if (mapping == nullptr || offset >= mapping->Size())
+					return 0;
+
+				count = static_cast<size_t>(std::min<uint64_t>(count, mapping->Size() - offset));
+				std::memcpy(buffer, mapping->Data() + offset, count);
+				return count;
+			}
+
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+			if (offset >= m_size)
+				return 0;
+			count = static_cast<size_t>(std::min<uint64_t>(count, m_size - offset));
+
+			unsigned char* destination = static_cast<unsigned char*>(buffer);
+			for (size_t done = 0; done < count; )
+			{
+				uint64_t position = offset + done;
+				size_t extentOffset = static_cast<size_t>(position % ExtentSize);
+				size_t chunk = std::min(count - done, ExtentSize - extentOffset);
+				auto extent = m_extents.find(position / ExtentSize);
+				if (extent != std::end(m_extents))
+					std::memcpy(destination + done, extent->second.get() + extentOffset, chunk);
+				else
+					std::memset(destination + done, 0, chunk);
+				done += chunk;
+			}
+			return count;
+		}
+
+		// offset comes straight from the caller's OVERLAPPED, so the end of the write is checked before anything is allocated.
+		FileStatus WriteAt(uint64_t offset, const void* buffer, size_t count, size_t& bytesWritten)
+		{
+			bytesWritten = 0;
+			if (IsReadOnly())
+				return FileStatus::AccessDenied;
+			if (count > std::numeric_limits<uint64_t>::max() - offset)
+				return FileStatus::InvalidParameter;
+			uint64_t end = offset + count;
+			if (end > MaxSize)
+				return FileStatus::DiskFull;
+
+			std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+			const unsigned char* source = static_cast<const unsigned char*>(buffer);
+			for (size_t done = 0; done < count; )
+			{
+				uint64_t position = offset + done;
+				size_t extentOffset = static_cast<size_t>(position % ExtentSize);
+				size_t chunk = std::min(count - done, ExtentSize - extentOffset);
+				std::unique_ptr<unsigned char[]>& extent = m_extents[position / ExtentSize];
+				if (extent == nullptr)
+				{
+					// Only zero what this write does not cover.
+					extent.reset(new unsigned char[ExtentSize]);
+					std::memset(extent.get(), 0, extentOffset);
+					std::memset(extent.get() + extentOffset + chunk, 0, ExtentSize - extentOffset - chunk);
+				}
+				std::memcpy(extent.get() + extentOffset, source + done, chunk);
+				done += chunk;
+			}
+			m_size = std::max(m_size, end);
+			bytesWritten = count;
+			return FileStatus::Success;
+		}
+	};
+
+	// In memory file system behind FileHook. Paths are interned once, when a
+	// file is opened; reads and writes go from the handle, through
+	// FakeHandleTable, straight to the file's extents without touching the
+	// path table. Paths are compared the way Windows does: '/' and '\' are
+	// the same separator and ASCII letters are case insensitive.
+	// Only paths below a root added with AddRoot, or files added with
+	// AddFile, are virtual; everything else is left to the real file system.
+	class VirtualFileSystem
+	{
+	private:
+		using PathId = uint32_t;
+
+		struct OpenFile
+		{
+			std::shared_ptr<VirtualFile>	m_file;
+			unsigned int					m_access;
+			std::atomic<uint64_t>			m_position { 0 };
+
+			OpenFile(std::shared_ptr<VirtualFile> file, unsigned int access)
+				: m_file(std::move(file)),
+				  m_access(access)
+			{
+			}
+		};
+
+		struct Root
+		{
+			std::wstring					m_prefix;		// Normalized, with a trailing separator.
+			bool							m_readOnly;
+		};
+
+		mutable std::shared_mutex		m_mutex;
+		std::unordered_map<std::wstring, PathId>	m_pathIds;
+		std::vector<std::wstring>		m_paths;
+		std::vector<std::shared_ptr<VirtualFile>>	m_files;		// By PathId, null if the path has no file.
+		std::vector<Root>				m_roots;
+
+		static std::wstring NormalizePath(std::wstring_view path)
+		{
+			constexpr std::wstring_view LongPathPrefix { L"\\\\?\\" };
+			if (path.substr(0, LongPathPrefix.size()) == LongPathPrefix)
+				path.remove_prefix(LongPathPrefix.size());
+
+			std::wstring result;
+			result.reserve(path.size());
+			for (wchar_t character : path)
+			{
+				if (character == L'/')
+					character = L'\\';
+				else if (character >= L'A' && character <= L'Z')
+					character = static_cast<wchar_t>(character - L'A' + L'a');
+
+				if (character == L'\\' && !result.empty() && result.back() == L'\\' && result.size() > 1)
+					continue;
+				result.push_back(character);
+			}
+			return result;
+		}
+
+		PathId InternLocked(const std::wstring& normalizedPath)
+		{
+			auto iterator = m_pathIds.find(normalizedPath);
+			if (iterator != std::end(m_pathIds))
+				return iterator->second;
+
+			PathId result = static_cast<PathId>(m_paths.size());
+			m_paths.push_back(normalizedPath);
+			m_files.emplace_back();
+			m_pathIds.emplace(normalizedPath, result);
+			return result;
+		}
+
+		std::shared_ptr<VirtualFile> FindLocked(const std::wstring& normalizedPath) const
+		{
+			auto iterator = m_pathIds.find(normalizedPath);
+			return iterator != std::end(m_pathIds) ? m_files[iterator->second] : nullptr;
+		}
+
+		const Root* FindRootLocked(const std::wstring& normalizedPath) const
+		{
+			auto iterator = std::find_if(std::begin(m_roots), std::end(m_roots), [&](const Root& root) {
+					return normalizedPath.size() > root.m_prefix.size() && normalizedPath.compare(0, root.m_prefix.size(), root.m_prefix) == 0;
+				});
+			return iterator != std::end(m_roots) ? &*iterator : nullptr;
+		}
+
+		static std::wstring NormalizeDirectory(std::wstring_view directory)
+		{
+			std::wstring result = NormalizePath(directory);
+			if (result.empty() || result.back() != L'\\')
+				result.push_back(L'\\');
+			return result;
+		}
+
+		static OpenFile* FindOpenFile(HandleKey handle)
+		{
+			return FakeHandleTable::Instance().Lookup<OpenFile>(handle);
+		}
+
+	public:
+		VirtualFileSystem() = default;
+		VirtualFileSystem(const VirtualFileSystem&) = delete;
+		VirtualFileSystem& operator=(const VirtualFileSystem&) = delete;
+
+		// Makes every path below directory virtual, whether or not it exists yet.
+		void AddRoot(std::wstring_view directory)
+		{
+			std::wstring root = NormalizeDirectory(directory);
+
+			std::unique_lock<std::shared_mutex> lock(m_mutex);
+			m_roots.push_back({ std::move(root), false });
+		}
+
+		// Makes every file below hostDirectory available, read only, below
+		// directory. Only the directory tree is walked here; a file's
+		// contents are mapped when it is first read and paged in as reads
+		// touch them. Returns the number of files mounted.
+		size_t MountDirectory(std::wstring_view directory, const std::filesystem::path& hostDirectory)
+		{
+			std::wstring root = NormalizeDirectory(directory);
+
+			std::vector<std::pair<std::wstring, std::shared_ptr<VirtualFile>>> files;
+			std::error_code error;
+			for (std::filesystem::recursive_directory_iterator iterator(hostDirectory, error), end; !error && iterator != end; iterator.increment(error))
+			{
+				std::error_code entryError;
+				if (!iterator->is_regular_file(entryError))
+					continue;
+
+				std::wstring relativePath = iterator->path().lexically_relative(hostDirectory).wstring();
+				uint64_t size = iterator->file_size(entryError);
+				files.emplace_back(NormalizePath(root + relativePath), std::make_shared<VirtualFile>(iterator->path(), entryError ? 0 : size));
+			}
+
+			std::unique_lock<std::shared_mutex> lock(m_mutex);
+			m_roots.push_back({ std::move(root), true });
+			for (auto& file : files)
+				m_files[InternLocked(file.first)] = std::move(file.second);
+			return files.size();
+		}
+
+		// Creates path, or replaces its contents.
+		void AddFile(std::wstring_view path, const void* data, size_t size)
+		{
+			std::shared_ptr<VirtualFile> file = std::make_shared<VirtualFile>();
+			size_t bytesWritten;
+			file->WriteAt(0, data, size, bytesWritten);
+
+			std::wstring normalizedPath = NormalizePath(path);
+			std::unique_lock<std::shared_mutex> lock(m_mutex);
+			m_files[InternLocked(normalizedPath)] = std::move(file);
+		}
+
+		bool RemoveFile(std::wstring_view path)
+		{
+			std::wstring normalizedPath = NormalizePath(path);
+			std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+			auto iterator = m_pathIds.find(normalizedPath);
+			if (iterator == std::end(m_pathIds) || m_files[iterator->second] == nullptr)
+				return false;
+
+			// Handles that are still open keep the contents alive.
+			m_files[iterator->second].reset();
+			return true;
+		}
+
+		bool IsVirtual(std::wstring_view path) const
+		{
+			std::wstring normalizedPath = NormalizePath(path);
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+			return FindLocked(normalizedPath) != nullptr || FindRootLocked(normalizedPath) != nullptr;
+		}
+
+		bool Exists(std::wstring_view path) const
+		{
+			std::wstring normalizedPath = NormalizePath(path);
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+			return FindLocked(normalizedPath) != nullptr;
+		}
+
+		std::vector<unsigned char> ReadContents(std::wstring_view path) const
+		{
+			std::shared_ptr<VirtualFile> file;
+			{
+				std::wstring normalizedPath = NormalizePath(path);
+				std::shared_lock<std::shared_mutex> lock(m_mutex);
+				file = FindLocked(normalizedPath);
+			}
+
+			std::vector<unsigned char> result;
+			if (file != nullptr)
+			{
+				result.resize(static_cast<size_t>(file->Size()));
+				result.resize(file->ReadAt(0, result.data(), result.size()));
+			}
+			return result;
+		}
+
+		// access is a combination of FileAccess flags.
+		FileStatus Open(std::wstring_view path, unsigned int access, FileDisposition disposition, HandleKey& handle)
+		{
+			handle = 0;
+			std::wstring normalizedPath = NormalizePath(path);
+
+			std::shared_ptr<VirtualFile> file;
+			FileStatus result = FileStatus::Success;
+			{
+				std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+				file = FindLocked(normalizedPath);
+				bool truncate = false;
+				switch (disposition)
+				{
+					case FileDisposition::CreateNew:
+						if (file != nullptr)
+							return FileStatus::FileExists;
+						break;
+
+					case FileDisposition::CreateAlways:
+						truncate = file != nullptr;
+						result = file != nullptr ? FileStatus::AlreadyExists : FileStatus::Success;
+						break;
+
+					case FileDisposition::OpenExisting:
+						if (file == nullptr)
+							return FileStatus::FileNotFound;
+						break;
+
+					case FileDisposition::OpenAlways:
+						result = file != nullptr ? FileStatus::AlreadyExists : FileStatus::Success;
+						break;
+
+					case FileDisposition::TruncateExisting:
+						if (file == nullptr)
+							return FileStatus::FileNotFound;
+						if ((access & FileAccessWrite) == 0)
+							return FileStatus::AccessDenied;
+						truncate = true;
+						break;
+
+					default:
+						return FileStatus::InvalidParameter;
+				}
+
+				if (file != nullptr && file->IsReadOnly() && (truncate || (access & FileAccessWrite) != 0))
+					return FileStatus::AccessDenied;
+
+				if (file == nullptr)
+				{
+					const Root* root = FindRootLocked(normalizedPath);
+					if (root == nullptr)
+						return FileStatus::FileNotFound;
+					if (root->m_readOnly)
+						return FileStatus::AccessDenied;
+
+					file = std::make_shared<VirtualFile>();
+					m_files[InternLocked(normalizedPath)] = file;
+				}
+				else if (truncate)
+				{
+					file->Truncate();
+				}
+			}
+
+			handle = FakeHandleTable::Instance().Allocate(std::make_unique<OpenFile>(std::move(file), access));
+			return handle != 0 ? result : FileStatus::AccessDenied;
+		}
+
+		// Handles that are not virtual files report InvalidHandle, so the caller can pass the call on.
+		static FileStatus Read(HandleKey handle, void* buffer, size_t count, size_t& bytesRead)
+		{
+			EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+			bytesRead = 0;
+			OpenFile* openFile = FindOpenFile(handle);
+			if (openFile == nullptr)
+				return FileStatus::InvalidHandle;
+			if ((openFile->m_access & FileAccessRead) == 0)
+				return FileStatus::AccessDenied;
+
+			bytesRead = openFile->m_file->ReadAt(openFile->m_position.load(std::memory_order_relaxed), buffer, count);
+			openFile->m_position.fetch_add(bytesRead, std::memory_order_relaxed);
+			return FileStatus::Success;
+		}
+
+		static FileStatus ReadAt(HandleKey handle, uint64_t offset, void* buffer, size_t count, size_t& bytesRead)
+		{
+			EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+			bytesRead = 0;
+			OpenFile* openFile = FindOpenFile(handle);
+			if (openFile == nullptr)
+				return FileStatus::InvalidHandle;
+			if ((openFile->m_access & FileAccessRead) == 0)
+				return FileStatus::AccessDenied;
+
+			bytesRead = openFile->m_file->ReadAt(offset, buffer, count);
+			return FileStatus::Success;
+		}
+
+		static FileStatus Write(HandleKey handle, const void* buffer, size_t count, size_t& bytesWritten)
+		{
+			EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+			bytesWritten = 0;
+			OpenFile* openFile = FindOpenFile(handle);
+			if (openFile == nullptr)
+				return FileStatus::InvalidHandle;
+			if ((openFile->m_access & FileAccessWrite) == 0)
+				return FileStatus::AccessDenied;
+
+			uint64_t position = openFile->m_position.fetch_add(count, std::memory_order_relaxed);
+			FileStatus status = openFile->m_file->WriteAt(position, buffer, count, bytesWritten);
+			if (!Succeeded(status))
+				openFile->m_position.fetch_sub(count, std::memory_order_relaxed);
+			return status;
+		}
+
+		static FileStatus WriteAt(HandleKey handle, uint64_t offset, const void* buffer, size_t count, size_t& bytesWritten)
+		{
+			EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+			bytesWritten = 0;
+			OpenFile* openFile = FindOpenFile(handle);
+			if (openFile == nullptr)
+				return FileStatus::InvalidHandle;
+			if ((openFile->m_access & FileAccessWrite) == 0)
+				return FileStatus::AccessDenied;
+
+			return openFile->m_file->WriteAt(offset, buffer, count, bytesWritten);
+		}
+
+		static FileStatus Close(HandleKey handle)
+		{
+			{
+				EpochDomain::ReadGuard guard(EpochDomain::Instance());
+				if (FindOpenFile(handle) == nullptr)
+					return FileStatus::InvalidHandle;
+			}
+			return FakeHandleTable::Instance().Release(handle) ? FileStatus::Success : FileStatus::InvalidHandle;
+		}
+	};
+}
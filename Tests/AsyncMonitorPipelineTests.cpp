@@ -0,0 +1,235 @@
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "AsyncMonitorPipeline.h"
+
+using TestHooks::AsyncMonitorPipeline;
+using TestHooks::Backpressure;
+
+namespace
+{
+	// Events are (producer, sequence) pairs; the consumer records them and,
+	// while m_gateOpen is false, holds up the consumer thread.
+	struct Event
+	{
+		int							m_producer { 0 };
+		int							m_sequence { 0 };
+	};
+
+	struct Recorder
+	{
+		std::mutex					m_mutex;
+		std::vector<Event>			m_events;
+		std::atomic<bool>			m_gateOpen { true };
+		std::atomic<int>			m_waiting { 0 };
+		std::atomic<bool>			m_flushedFromConsumer { true };
+		bool						m_flushFromConsumer { false };
+
+		std::vector<int> SequencesOf(int producer)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::vector<int> result;
+			for (const Event& event : m_events)
+			{
+				if (event.m_producer == producer)
+					result.push_back(event.m_sequence);
+			}
+			return result;
+		}
+	};
+
+	using Pipeline = AsyncMonitorPipeline<Event>;
+
+	Pipeline::Consumer RecordInto(Recorder& recorder, Pipeline** self = nullptr)
+	{
+		return [&recorder, self](Event& event) {
+				++recorder.m_waiting;
+				while (!recorder.m_gateOpen.load())
+					std::this_thread::yield();
+				--recorder.m_waiting;
+
+				if (recorder.m_flushFromConsumer && self != nullptr)
+					recorder.m_flushedFromConsumer = (*self)->Flush();
+
+				std::lock_guard<std::mutex> lock(recorder.m_mutex);
+				recorder.m_events.push_back(event);
+			};
+	}
+
+	std::vector<int> Sequence(int count)
+	{
+		std::vector<int> result;
+		for (int i = 0; i < count; ++i)
+			result.push_back(i);
+		return result;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(AsyncMonitorPipeline_)
+
+BOOST_AUTO_TEST_CASE(EachProducersEventsAreConsumedInOrder)
+{
+	Recorder recorder;
+	Pipeline pipeline(RecordInto(recorder), Backpressure::Block, 16);
+
+	std::vector<std::thread> producers;
+	for (int producer = 1; producer <= 3; ++producer)
+	{
+		producers.emplace_back([&pipeline, producer] {
+				for (int i = 0; i < 1000; ++i)
+					pipeline.Publish({ producer, i });
+			});
+	}
+	for (std::thread& producer : producers)
+		producer.join();
+
+	BOOST_TEST(pipeline.Flush());
+	for (int producer = 1; producer <= 3; ++producer)
+		BOOST_TEST(recorder.SequencesOf(producer) == Sequence(1000));
+
+	TestHooks::AsyncMonitorStatistics statistics = pipeline.Statistics();
+	BOOST_TEST(statistics.m_published == 3000u);
+	BOOST_TEST(statistics.m_consumed == 3000u);
+	BOOST_TEST(statistics.m_dropped == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(DropDiscardsWhatAFullRingCannotHold)
+{
+	Recorder recorder;
+	recorder.m_gateOpen = false;
+	Pipeline pipeline(RecordInto(recorder), Backpressure::Drop, 4);
+
+	int accepted = 0;
+	for (int i = 0; i < 10; ++i)
+		accepted += pipeline.Publish({ 1, i }) ? 1 : 0;
+
+	// The event the consumer is holding still occupies its slot.
+	BOOST_TEST(accepted == 4);
+	BOOST_TEST(pipeline.Statistics().m_dropped == 6u);
+
+	recorder.m_gateOpen = true;
+	BOOST_TEST(pipeline.Flush());
+	BOOST_TEST(recorder.SequencesOf(1) == Sequence(4));
+}
+
+BOOST_AUTO_TEST_CASE(BlockWaitsForRoomAndLosesNothing)
+{
+	Recorder recorder;
+	recorder.m_gateOpen = false;
+	Pipeline pipeline(RecordInto(recorder), Backpressure::Block, 4);
+
+	std::atomic<bool> done { false };
+	std::thread producer([&] {
+			for (int i = 0; i < 50; ++i)
+				pipeline.Publish({ 1, i });
+			done = true;
+		});
+
+	while (recorder.m_waiting.load() == 0 || pipeline.Statistics().m_published < 4)
+		std::this_thread::yield();
+	BOOST_TEST(!done.load());
+
+	recorder.m_gateOpen = true;
+	producer.join();
+	BOOST_TEST(pipeline.Flush());
+
+	BOOST_TEST(recorder.SequencesOf(1) == Sequence(50));
+	BOOST_TEST(pipeline.Statistics().m_dropped == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(FlushWaitsForEverythingPublishedBeforeIt)
+{
+	Recorder recorder;
+	Pipeline pipeline(RecordInto(recorder), Backpressure::Block, 64);
+
+	for (int i = 0; i < 500; ++i)
+		pipeline.Publish({ 1, i });
+	BOOST_TEST(pipeline.Flush());
+
+	BOOST_TEST(recorder.SequencesOf(1) == Sequence(500));
+	BOOST_TEST(pipeline.Statistics().m_consumed == 500u);
+}
+
+BOOST_AUTO_TEST_CASE(FlushFromTheConsumerDoesNotWaitOnItself)
+{
+	Recorder recorder;
+	recorder.m_flushFromConsumer = true;
+	Pipeline* self = nullptr;
+	Pipeline pipeline(RecordInto(recorder, &self), Backpressure::Block, 16);
+	self = &pipeline;
+
+	pipeline.Publish({ 1, 0 });
+	BOOST_TEST(pipeline.Flush());
+
+	BOOST_TEST(!recorder.m_flushedFromConsumer.load());
+	BOOST_TEST(recorder.SequencesOf(1) == Sequence(1));
+}
+
+BOOST_AUTO_TEST_CASE(ThreadKeepsItsRingInEachPipelineOfAnEventType)
+{
+	Recorder held;
+	held.m_gateOpen = false;
+	Recorder open;
+	Pipeline first(RecordInto(held), Backpressure::Drop, 4);
+	Pipeline second(RecordInto(open), Backpressure::Drop, 4);
+
+	// Publishing to the second pipeline in between must not hand this
+	// thread a fresh, empty ring in the first one.
+	int accepted = 0;
+	for (int i = 0; i < 10; ++i)
+	{
+		accepted += first.Publish({ 1, i }) ? 1 : 0;
+		BOOST_TEST(second.Publish({ 2, i }));
+		BOOST_TEST(second.Flush());
+	}
+
+	BOOST_TEST(accepted == 4);
+	BOOST_TEST(first.Statistics().m_dropped == 6u);
+	BOOST_TEST(open.SequencesOf(2) == Sequence(10));
+
+	held.m_gateOpen = true;
+	BOOST_TEST(first.Flush());
+	BOOST_TEST(held.SequencesOf(1) == Sequence(4));
+}
+
+BOOST_AUTO_TEST_CASE(PipelineCanBeDestroyedWhileItsProducersLive)
+{
+	Recorder recorder;
+	std::optional<Pipeline> pipeline;
+	pipeline.emplace(RecordInto(recorder), Backpressure::Block, 16);
+
+	std::atomic<int> step { 0 };
+	std::thread producer([&] {
+			pipeline->Publish({ 1, 0 });
+			step = 1;
+			while (step.load() != 2)
+				std::this_thread::yield();
+
+			// A new pipeline at the same address; the thread must not reuse its old ring.
+			pipeline->Publish({ 2, 0 });
+			step = 3;
+		});
+
+	while (step.load() != 1)
+		std::this_thread::yield();
+	BOOST_TEST(pipeline->Flush());
+	pipeline.reset();
+	pipeline.emplace(RecordInto(recorder), Backpressure::Block, 16);
+	step = 2;
+
+	while (step.load() != 3)
+		std::this_thread::yield();
+	BOOST_TEST(pipeline->Flush());
+	BOOST_TEST(pipeline->Statistics().m_published == 1u);
+	BOOST_TEST(recorder.SequencesOf(2) == Sequence(1));
+
+	// The thread exits while the pipeline it registered with first is gone.
+	pipeline.reset();
+	producer.join();
+	BOOST_TEST(recorder.SequencesOf(1) == Sequence(1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
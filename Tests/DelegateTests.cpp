@@ -0,0 +1,129 @@
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "Delegate.h"
+
+using TestHooks::Delegate;
+
+namespace
+{
+	using Filter = Delegate<bool(int value, int& result)>;
+
+	struct Owner
+	{
+		int							m_offset;
+
+		bool Add(int value, int& result)
+		{
+			result = value + m_offset;
+			return true;
+		}
+	};
+
+	bool Double(int value, int& result)
+	{
+		result = value * 2;
+		return true;
+	}
+
+	int Call(const Filter& filter, int value)
+	{
+		int result = -1;
+		filter(value, result);
+		return result;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(Delegate_)
+
+BOOST_AUTO_TEST_CASE(BindsMemberFunctions)
+{
+	Owner owner { 10 };
+	Filter filter = Filter::FromMember<&Owner::Add>(&owner);
+
+	BOOST_TEST(static_cast<bool>(filter));
+	BOOST_TEST(Call(filter, 5) == 15);
+
+	// The delegate holds the object pointer, not a copy of the object.
+	owner.m_offset = 20;
+	BOOST_TEST(Call(filter, 5) == 25);
+}
+
+BOOST_AUTO_TEST_CASE(BindsFreeFunctionsAndSmallLambdas)
+{
+	Filter function(&Double);
+	BOOST_TEST(Call(function, 21) == 42);
+
+	Filter stateless([](int value, int& result) { result = -value; return true; });
+	BOOST_TEST(Call(stateless, 3) == -3);
+
+	int offset = 100;
+	int scale = 3;
+	Filter capturing([&offset, &scale](int value, int& result) { result = value * scale + offset; return true; });
+	BOOST_TEST(Call(capturing, 2) == 106);
+	offset = 200;
+	BOOST_TEST(Call(capturing, 2) == 206);
+}
+
+BOOST_AUTO_TEST_CASE(CopiesAndMovesCallTheSameTarget)
+{
+	Owner owner { 1 };
+	Filter original = Filter::FromMember<&Owner::Add>(&owner);
+
+	Filter copy(original);
+	Filter assigned;
+	assigned = original;
+	Filter moved(std::move(copy));
+	Filter moveAssigned;
+	moveAssigned = std::move(assigned);
+
+	BOOST_TEST(Call(original, 1) == 2);
+	BOOST_TEST(Call(moved, 1) == 2);
+	BOOST_TEST(Call(moveAssigned, 1) == 2);
+
+	int offset = 7;
+	Filter lambda([&offset](int value, int& result) { result = value + offset; return true; });
+	Filter lambdaCopy = lambda;
+	offset = 8;
+	BOOST_TEST(Call(lambdaCopy, 1) == 9);
+}
+
+BOOST_AUTO_TEST_CASE(EmptyDelegatesReturnAValueInitializedResult)
+{
+	Filter filter;
+	BOOST_TEST(!static_cast<bool>(filter));
+
+	int result = -1;
+	BOOST_TEST(filter(1, result) == false);
+	BOOST_TEST(result == -1);
+
+	Delegate<void(int)> monitor;
+	monitor(1);
+	BOOST_TEST(!static_cast<bool>(monitor));
+}
+
+BOOST_AUTO_TEST_CASE(OversizedOrNonTrivialCallablesAreRejected)
+{
+	int a = 0, b = 0, c = 0;
+	auto twoPointers = [&a, &b](int, int&) { return a == b; };
+	auto threePointers = [&a, &b, &c](int, int&) { return a == b && b == c; };
+	auto owning = [text = std::string("state")](int, int&) { return text.empty(); };
+	auto shared = [pointer = std::make_shared<int>(0)](int, int&) { return *pointer == 0; };
+
+	static_assert(Filter::IsStorable<decltype(twoPointers)>);
+	static_assert(std::is_constructible_v<Filter, decltype(twoPointers)>);
+	static_assert(!Filter::IsStorable<decltype(threePointers)>);
+	static_assert(!std::is_constructible_v<Filter, decltype(threePointers)>);
+	static_assert(!std::is_constructible_v<Filter, decltype(owning)>);
+	static_assert(!std::is_constructible_v<Filter, decltype(shared)>);
+
+	BOOST_TEST(!(Filter::IsStorable<decltype(threePointers)>));
+	BOOST_TEST(twoPointers(0, a));
+	BOOST_TEST(threePointers(0, a));
+	BOOST_TEST(!owning(0, a));
+	BOOST_TEST(shared(0, a));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,206 @@
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FakeHandleTable.h"
+
+namespace
+{
+	struct FakeFile
+	{
+		std::string					m_name;
+
+		explicit FakeFile(const std::string& name)
+			: m_name(name)
+		{
+		}
+	};
+
+	struct FakeKey
+	{
+		int							m_value;
+
+		explicit FakeKey(int value)
+			: m_value(value)
+		{
+		}
+	};
+
+	struct CountedPayload
+	{
+		std::atomic<int>&			m_liveCount;
+
+		explicit CountedPayload(std::atomic<int>& liveCount)
+			: m_liveCount(liveCount)
+		{
+			++m_liveCount;
+		}
+
+		~CountedPayload()
+		{
+			--m_liveCount;
+		}
+	};
+}
+
+BOOST_AUTO_TEST_SUITE(FakeHandleTable_)
+
+BOOST_AUTO_TEST_CASE(AllocateAndLookup)
+{
+	TestHooks::FakeHandleTable table;
+
+	TestHooks::HandleKey file = table.Allocate(std::make_unique<FakeFile>("COM4"));
+	TestHooks::HandleKey key = table.Allocate(std::make_unique<FakeKey>(42));
+
+	BOOST_TEST(file != 0);
+	BOOST_TEST(key != 0);
+	BOOST_TEST(file != key);
+	BOOST_TEST(TestHooks::FakeHandleTable::IsInRange(file));
+	BOOST_TEST((file & 3) == 0u);
+	BOOST_TEST(table.LiveCount() == 2u);
+
+	BOOST_REQUIRE(table.Lookup<FakeFile>(file) != nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(file)->m_name == "COM4");
+	BOOST_REQUIRE(table.Lookup<FakeKey>(key) != nullptr);
+	BOOST_TEST(table.Lookup<FakeKey>(key)->m_value == 42);
+}
+
+BOOST_AUTO_TEST_CASE(LookupChecksPayloadType)
+{
+	TestHooks::FakeHandleTable table;
+
+	TestHooks::HandleKey file = table.Allocate(std::make_unique<FakeFile>("file"));
+
+	BOOST_TEST(table.Lookup<FakeKey>(file) == nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(file) != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(ForeignHandlesDoNotResolve)
+{
+	TestHooks::FakeHandleTable table;
+
+	TestHooks::HandleKey file = table.Allocate(std::make_unique<FakeFile>("file"));
+
+	BOOST_TEST(table.Lookup<FakeFile>(TestHooks::HandleKey { 0 }) == nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(TestHooks::HandleKey { 0x1234 }) == nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(file + 1) == nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(file + 4) == nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(TestHooks::FakeHandleTable::LastHandle) == nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(static_cast<void*>(&table)) == nullptr);
+	BOOST_TEST(!table.Release(TestHooks::HandleKey { 0x1234 }));
+}
+
+BOOST_AUTO_TEST_CASE(StaleHandleIsRejected)
+{
+	TestHooks::FakeHandleTable table;
+
+	TestHooks::HandleKey first = table.Allocate(std::make_unique<FakeFile>("first"));
+	BOOST_TEST(table.Release(first));
+	BOOST_TEST(!table.Release(first));
+	BOOST_TEST(table.Lookup<FakeFile>(first) == nullptr);
+
+	// The slot is reused, with a new generation.
+	TestHooks::HandleKey second = table.Allocate(std::make_unique<FakeFile>("second"));
+	BOOST_TEST(second != first);
+	BOOST_TEST(table.Lookup<FakeFile>(first) == nullptr);
+	BOOST_REQUIRE(table.Lookup<FakeFile>(second) != nullptr);
+	BOOST_TEST(table.Lookup<FakeFile>(second)->m_name == "second");
+	BOOST_TEST(table.LiveCount() == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(ReleaseDefersDestructionPastReaders)
+{
+	std::atomic<int> liveCount { 0 };
+	TestHooks::FakeHandleTable table;
+
+	TestHooks::HandleKey handle = table.Allocate(std::make_unique<CountedPayload>(liveCount));
+	{
+		TestHooks::EpochDomain::ReadGuard guard(TestHooks::EpochDomain::Instance());
+
+		CountedPayload* payload = table.Lookup<CountedPayload>(handle);
+		BOOST_REQUIRE(payload != nullptr);
+		BOOST_TEST(table.Release(handle));
+		BOOST_TEST(liveCount.load() == 1);
+		BOOST_TEST(&payload->m_liveCount == &liveCount);
+	}
+	TestHooks::EpochDomain::Instance().Reclaim();
+	BOOST_TEST(liveCount.load() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(DestructorFreesLivePayloads)
+{
+	std::atomic<int> liveCount { 0 };
+	{
+		TestHooks::FakeHandleTable table;
+		for (int i = 0; i < 1000; ++i)
+			table.Allocate(std::make_unique<CountedPayload>(liveCount));
+		BOOST_TEST(liveCount.load() == 1000);
+	}
+	BOOST_TEST(liveCount.load() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ExhaustionReturnsZero)
+{
+	TestHooks::FakeHandleTable table;
+
+	std::vector<TestHooks::HandleKey> handles;
+	for (;;)
+	{
+		TestHooks::HandleKey handle = table.Allocate(std::make_unique<FakeKey>(0));
+		if (handle == 0)
+			break;
+		handles.push_back(handle);
+	}
+	BOOST_TEST(handles.size() == 65536u);
+	BOOST_TEST(table.LiveCount() == handles.size());
+
+	BOOST_TEST(table.Release(handles.back()));
+	BOOST_TEST(table.Allocate(std::make_unique<FakeKey>(1)) != 0u);
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentAllocateLookupRelease)
+{
+	constexpr int ThreadCount { 8 };
+	constexpr int IterationCount { 20000 };
+
+	TestHooks::FakeHandleTable table;
+	std::atomic<int> failures { 0 };
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < ThreadCount; ++t)
+	{
+		threads.emplace_back([&, t] {
+			std::vector<TestHooks::HandleKey> owned;
+			for (int i = 0; i < IterationCount; ++i)
+			{
+				int value = t * IterationCount + i;
+				TestHooks::HandleKey handle = table.Allocate(std::make_unique<FakeKey>(value));
+
+				TestHooks::EpochDomain::ReadGuard guard(TestHooks::EpochDomain::Instance());
+				FakeKey* key = table.Lookup<FakeKey>(handle);
+				if (key == nullptr || key->m_value != value)
+					++failures;
+
+				owned.push_back(handle);
+				if (owned.size() > 16)
+				{
+					TestHooks::HandleKey released = owned.front();
+					owned.erase(owned.begin());
+					if (!table.Release(released) || table.Lookup<FakeKey>(released) != nullptr)
+						++failures;
+				}
+			}
+			for (TestHooks::HandleKey handle : owned)
+				table.Release(handle);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	BOOST_TEST(failures.load() == 0);
+	BOOST_TEST(table.LiveCount() == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <functional>
+#include "HandleRouter.h"
+
+using TestHooks::FilterCookie;
+using TestHooks::HandleKey;
+using TestHooks::InvalidCookie;
+
+namespace
+{
+	// Filters return true and report which claim they belong to.
+	using Filter = std::function<bool(int& owner)>;
+	using Router = TestHooks::HandleRouter<Filter>;
+
+	Filter Owner(int owner)
+	{
+		return [owner](int& result) { result = owner; return true; };
+	}
+
+	int Route(Router& router, HandleKey key)
+	{
+		int owner = 0;
+		router.DispatchToOwner(key, [&](Filter& filter) { return filter(owner); });
+		return owner;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(HandleRouter_)
+
+BOOST_AUTO_TEST_CASE(SingleHandlesRouteOnlyToTheirOwner)
+{
+	Router router;
+	BOOST_TEST(router.IsEmpty());
+	BOOST_TEST(Route(router, 0x100) == 0);
+
+	FilterCookie first = router.Claim(0x100, 0x100, Owner(1));
+	FilterCookie second = router.Claim(0x104, 0x104, Owner(2));
+	BOOST_TEST(first != InvalidCookie);
+	BOOST_TEST(second != InvalidCookie);
+	BOOST_TEST(first != second);
+	BOOST_TEST(!router.IsEmpty());
+
+	BOOST_TEST(Route(router, 0x100) == 1);
+	BOOST_TEST(Route(router, 0x104) == 2);
+	BOOST_TEST(Route(router, 0x0fc) == 0);
+	BOOST_TEST(Route(router, 0x108) == 0);
+
+	router.Release(first);
+	router.Release(second);
+}
+
+BOOST_AUTO_TEST_CASE(RangesIncludeBothEdges)
+{
+	Router router;
+	FilterCookie low = router.Claim(0x1000, 0x1ffc, Owner(1));
+	FilterCookie high = router.Claim(0x2000, 0x2ffc, Owner(2));
+	FilterCookie top = router.Claim(0x3000, UINTPTR_MAX, Owner(3));
+
+	BOOST_TEST(Route(router, 0x0ffc) == 0);
+	BOOST_TEST(Route(router, 0x1000) == 1);
+	BOOST_TEST(Route(router, 0x1ffc) == 1);
+	BOOST_TEST(Route(router, 0x1ffd) == 0);
+	BOOST_TEST(Route(router, 0x2000) == 2);
+	BOOST_TEST(Route(router, 0x2ffc) == 2);
+	BOOST_TEST(Route(router, 0x2ffd) == 0);
+	BOOST_TEST(Route(router, 0x3000) == 3);
+	BOOST_TEST(Route(router, UINTPTR_MAX) == 3);
+
+	router.Release(low);
+	router.Release(high);
+	router.Release(top);
+}
+
+BOOST_AUTO_TEST_CASE(ReleasedClaimsNoLongerRouteAndCanBeClaimedAgain)
+{
+	Router router;
+	FilterCookie range = router.Claim(0x1000, 0x1ffc, Owner(1));
+	FilterCookie single = router.Claim(0x4000, 0x4000, Owner(2));
+
+	router.Release(range);
+	BOOST_TEST(Route(router, 0x1000) == 0);
+	BOOST_TEST(Route(router, 0x4000) == 2);
+
+	FilterCookie again = router.Claim(0x1000, 0x1ffc, Owner(3));
+	BOOST_TEST(again != InvalidCookie);
+	BOOST_TEST(again != range);
+	BOOST_TEST(Route(router, 0x1800) == 3);
+
+	router.Release(single);
+	router.Release(again);
+	BOOST_TEST(router.IsEmpty());
+	BOOST_TEST(Route(router, 0x1800) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(OverlappingClaimsAreRejected)
+{
+	Router router;
+	FilterCookie range = router.Claim(0x1000, 0x1ffc, Owner(1));
+	FilterCookie single = router.Claim(0x4000, 0x4000, Owner(2));
+
+	BOOST_TEST(router.Claim(0x1000, 0x1ffc, Owner(3)) == InvalidCookie);
+	BOOST_TEST(router.Claim(0x0800, 0x1000, Owner(3)) == InvalidCookie);
+	BOOST_TEST(router.Claim(0x1ffc, 0x2800, Owner(3)) == InvalidCookie);
+	BOOST_TEST(router.Claim(0x1400, 0x1400, Owner(3)) == InvalidCookie);
+	BOOST_TEST(router.Claim(0x0000, 0xffff, Owner(3)) == InvalidCookie);
+	BOOST_TEST(router.Claim(0x4000, 0x4000, Owner(3)) == InvalidCookie);
+	BOOST_TEST(router.Claim(0x3ffc, 0x4004, Owner(3)) == InvalidCookie);
+
+	// A rejected claim changes nothing.
+	BOOST_TEST(Route(router, 0x1000) == 1);
+	BOOST_TEST(Route(router, 0x4000) == 2);
+	BOOST_TEST(Route(router, 0x0800) == 0);
+
+	FilterCookie adjacent = router.Claim(0x2000, 0x2ffc, Owner(4));
+	BOOST_TEST(adjacent != InvalidCookie);
+	BOOST_TEST(Route(router, 0x2000) == 4);
+
+	router.Release(range);
+	router.Release(single);
+	router.Release(adjacent);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
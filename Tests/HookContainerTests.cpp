@@ -0,0 +1,140 @@
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "HookContainer.h"
+
+using TestHooks::EpochDomain;
+using TestHooks::FilterCookie;
+using TestHooks::HookContainer;
+
+namespace
+{
+	using Filter = std::function<bool(int)>;
+
+	bool Dispatch(HookContainer<Filter>& container, int value)
+	{
+		return container.ForEachFilterReturningBoolean([&](Filter& filter) { return filter(value); });
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(HookContainer_)
+
+BOOST_AUTO_TEST_CASE(FiltersRunInCookieOrderUntilOneHandlesTheCall)
+{
+	HookContainer<Filter> container;
+	std::vector<int> calls;
+
+	BOOST_TEST(container.IsEmpty());
+	FilterCookie first = container.AddFilter([&](int) { calls.push_back(1); return false; });
+	FilterCookie second = container.AddFilter([&](int value) { calls.push_back(2); return value == 2; });
+	FilterCookie third = container.AddFilter([&](int) { calls.push_back(3); return false; });
+	BOOST_TEST(!container.IsEmpty());
+
+	BOOST_TEST(!Dispatch(container, 0));
+	BOOST_TEST(calls == std::vector<int>({ 1, 2, 3 }));
+
+	calls.clear();
+	BOOST_TEST(Dispatch(container, 2));
+	BOOST_TEST(calls == std::vector<int>({ 1, 2 }));
+
+	container.RemoveFilter(second);
+	calls.clear();
+	BOOST_TEST(!Dispatch(container, 2));
+	BOOST_TEST(calls == std::vector<int>({ 1, 3 }));
+
+	container.RemoveFilter(first);
+	container.RemoveFilter(third);
+	BOOST_TEST(container.IsEmpty());
+	BOOST_TEST(!Dispatch(container, 0));
+}
+
+BOOST_AUTO_TEST_CASE(RetiredSnapshotsAreReclaimed)
+{
+	HookContainer<Filter> container;
+	auto payload = std::make_shared<int>(0);
+	std::weak_ptr<int> watcher = payload;
+
+	std::vector<FilterCookie> cookies;
+	for (int i = 0; i < 8; ++i)
+		cookies.push_back(container.AddFilter([payload](int) { return false; }));
+	payload.reset();
+	BOOST_TEST(!Dispatch(container, 0));
+
+	for (FilterCookie cookie : cookies)
+		container.RemoveFilter(cookie);
+
+	// Every snapshot holding a copy of the filter has been freed.
+	BOOST_TEST(watcher.expired());
+	BOOST_TEST(EpochDomain::Instance().PendingCount() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(RemovedFilterIsNotRunningOrCalledAfterwards)
+{
+	HookContainer<Filter> container;
+	std::atomic<int> inside { 0 };
+	std::atomic<int> callCount { 0 };
+	FilterCookie cookie = container.AddFilter([&](int) {
+			++inside;
+			++callCount;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			--inside;
+			return false;
+		});
+
+	std::atomic<bool> stop { false };
+	std::thread dispatcher([&] {
+			while (!stop.load())
+				Dispatch(container, 0);
+		});
+
+	while (callCount.load() < 3)
+		std::this_thread::yield();
+
+	container.RemoveFilter(cookie);
+	BOOST_TEST(inside.load() == 0);
+	int callsAtRemoval = callCount.load();
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	stop.store(true);
+	dispatcher.join();
+
+	BOOST_TEST(callCount.load() == callsAtRemoval);
+}
+
+BOOST_AUTO_TEST_CASE(FilterCanAddAndRemoveFiltersWhileRunning)
+{
+	HookContainer<Filter> container;
+	FilterCookie self = TestHooks::InvalidCookie;
+	FilterCookie added = TestHooks::InvalidCookie;
+	int replacementCalls = 0;
+
+	self = container.AddFilter([&](int) {
+			added = container.AddFilter([&](int) { ++replacementCalls; return true; });
+			container.RemoveFilter(self);
+			return false;
+		});
+
+	// The running snapshot is unchanged, so the new filter only sees later calls.
+	BOOST_TEST(!Dispatch(container, 0));
+	BOOST_TEST(replacementCalls == 0);
+
+	BOOST_TEST(Dispatch(container, 0));
+	BOOST_TEST(replacementCalls == 1);
+
+	container.RemoveFilter(added);
+	BOOST_TEST(container.IsEmpty());
+	BOOST_TEST(EpochDomain::Instance().PendingCount() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(SynchronizeDoesNotWaitInsideAReadSection)
+{
+	EpochDomain::ReadGuard guard(EpochDomain::Instance());
+
+	BOOST_TEST(!EpochDomain::Instance().Synchronize());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
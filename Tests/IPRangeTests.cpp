@@ -0,0 +1,66 @@
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "MinHook/src/iprange.h"
+
+BOOST_AUTO_TEST_SUITE(IPRange_)
+
+BOOST_AUTO_TEST_CASE(FindsTheRangeContainingAnAddress)
+{
+	std::vector<IP_RANGE> ranges {
+		{ 0x3000, 0x3040, 2 },
+		{ 0x1000, 0x1005, 0 },
+		{ 0x2000, 0x2001, 1 },
+	};
+	SortIPRanges(ranges.data(), static_cast<unsigned>(ranges.size()));
+
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x0fff) == nullptr);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x1000)->tag == 0u);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x1004)->tag == 0u);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x1005) == nullptr);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x2000)->tag == 1u);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x2001) == nullptr);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x303f)->tag == 2u);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, 0x3040) == nullptr);
+	BOOST_TEST(FindIPRange(ranges.data(), 3, UINTPTR_MAX) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(EmptyTableFindsNothing)
+{
+	BOOST_TEST(FindIPRange(nullptr, 0, 0x1000) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(AgreesWithALinearScan)
+{
+	// Trampoline slots of 64 bytes and prologues of up to 8 bytes, in random order.
+	std::mt19937 random(7);
+	std::vector<IP_RANGE> ranges;
+	for (unsigned i = 0; i < 2000; ++i)
+	{
+		uintptr_t start = 0x10000 + i * 128 + (random() % 2) * 64;
+		ranges.push_back({ start, start + 1 + random() % 64, i });
+	}
+	std::shuffle(ranges.begin(), ranges.end(), random);
+	std::vector<IP_RANGE> unsorted = ranges;
+	SortIPRanges(ranges.data(), static_cast<unsigned>(ranges.size()));
+
+	for (int probe = 0; probe < 20000; ++probe)
+	{
+		uintptr_t ip = 0x10000 - 64 + random() % (2000 * 128 + 128);
+		const IP_RANGE* expected = nullptr;
+		for (const IP_RANGE& range : unsorted)
+		{
+			if (ip >= range.start && ip < range.end)
+				expected = &range;
+		}
+
+		const IP_RANGE* found = FindIPRange(ranges.data(), static_cast<unsigned>(ranges.size()), ip);
+		BOOST_REQUIRE((found == nullptr) == (expected == nullptr));
+		if (found != nullptr)
+			BOOST_TEST(found->tag == expected->tag);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
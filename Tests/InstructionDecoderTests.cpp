@@ -0,0 +1,204 @@
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "MinHook/src/hde/hde64.h"
+
+#if defined(__x86_64__)
+namespace
+{
+	struct Instruction
+	{
+		std::vector<uint8_t> bytes;
+		std::string text;
+	};
+
+	// Encodings from the GNU assembler, with the disassembly objdump gives
+	// for them. Memory operands relative to RIP all have a displacement of
+	// 0x12345678.
+	const std::vector<Instruction> Corpus
+	{
+		{ { 0x55 }, "push %rbp" },
+		{ { 0x48, 0x89, 0xE5 }, "mov %rsp,%rbp" },
+		{ { 0x48, 0x83, 0xEC, 0x28 }, "sub $0x28,%rsp" },
+		{ { 0x48, 0x8B, 0x05, 0x78, 0x56, 0x34, 0x12 }, "mov 0x12345678(%rip),%rax" },
+		{ { 0x48, 0x8D, 0x0D, 0x78, 0x56, 0x34, 0x12 }, "lea 0x12345678(%rip),%rcx" },
+		{ { 0xC7, 0x05, 0x78, 0x56, 0x34, 0x12, 0x44, 0x33, 0x22, 0x11 }, "movl $0x11223344,0x12345678(%rip)" },
+		{ { 0x80, 0x3D, 0x78, 0x56, 0x34, 0x12, 0x7F }, "cmpb $0x7f,0x12345678(%rip)" },
+		{ { 0x48, 0xB8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 }, "movabs $0x1122334455667788,%rax" },
+		{ { 0xE8, 0xFB, 0x00, 0x00, 0x00 }, "call 0x131" },
+		{ { 0xE9, 0xFB, 0x00, 0x00, 0x00 }, "jmp 0x136" },
+		{ { 0x74, 0x0E }, "je 0x4b" },
+		{ { 0xFF, 0x25, 0x78, 0x56, 0x34, 0x12 }, "jmp *0x12345678(%rip)" },
+		{ { 0x8F, 0x00 }, "pop (%rax)" },
+		{ { 0x41, 0x5C }, "pop %r12" },
+		{ { 0xC3 }, "ret" },
+		{ { 0xF3, 0x0F, 0x1E, 0xFA }, "endbr64" },
+		{ { 0xF3, 0x0F, 0x6F, 0x06 }, "movdqu (%rsi),%xmm0" },
+		{ { 0x0F, 0x29, 0x44, 0x24, 0x10 }, "movaps %xmm0,0x10(%rsp)" },
+		{ { 0x66, 0x0F, 0x70, 0xD1, 0x1B }, "pshufd $0x1b,%xmm1,%xmm2" },
+		{ { 0xC5, 0xF8, 0x77 }, "vzeroupper" },
+		{ { 0xC5, 0xFC, 0x77 }, "vzeroall" },
+		{ { 0xC5, 0xFE, 0x6F, 0x06 }, "vmovdqu (%rsi),%ymm0" },
+		{ { 0xC5, 0xFE, 0x7F, 0x07 }, "vmovdqu %ymm0,(%rdi)" },
+		{ { 0xC5, 0xFE, 0x6F, 0x0D, 0x78, 0x56, 0x34, 0x12 }, "vmovdqu 0x12345678(%rip),%ymm1" },
+		{ { 0xC5, 0xF8, 0x11, 0x44, 0x8C, 0xF0 }, "vmovups %xmm0,-0x10(%rsp,%rcx,4)" },
+		{ { 0xC5, 0xFD, 0xEF, 0xC0 }, "vpxor %ymm0,%ymm0,%ymm0" },
+		{ { 0xC5, 0xFD, 0x74, 0x0F }, "vpcmpeqb (%rdi),%ymm0,%ymm1" },
+		{ { 0xC5, 0xFD, 0xD7, 0xC1 }, "vpmovmskb %ymm1,%eax" },
+		{ { 0xC5, 0xF9, 0x6E, 0x05, 0x78, 0x56, 0x34, 0x12 }, "vmovd 0x12345678(%rip),%xmm0" },
+		{ { 0xC5, 0xF9, 0x70, 0xD1, 0x1B }, "vpshufd $0x1b,%xmm1,%xmm2" },
+		{ { 0xC5, 0xF9, 0x70, 0x15, 0x78, 0x56, 0x34, 0x12, 0x1B }, "vpshufd $0x1b,0x12345678(%rip),%xmm2" },
+		{ { 0xC5, 0xE9, 0x73, 0xD9, 0x08 }, "vpsrldq $0x8,%xmm1,%xmm2" },
+		{ { 0xC5, 0xEC, 0xC2, 0xD9, 0x01 }, "vcmpltps %ymm1,%ymm2,%ymm3" },
+		{ { 0xC5, 0xEC, 0xC2, 0x1D, 0x78, 0x56, 0x34, 0x12, 0x01 }, "vcmpltps 0x12345678(%rip),%ymm2,%ymm3" },
+		{ { 0xC5, 0xF1, 0xC4, 0xD0, 0x03 }, "vpinsrw $0x3,%eax,%xmm1,%xmm2" },
+		{ { 0xC5, 0xF9, 0xC5, 0xC1, 0x03 }, "vpextrw $0x3,%xmm1,%eax" },
+		{ { 0xC5, 0xE8, 0xC6, 0xD9, 0x44 }, "vshufps $0x44,%xmm1,%xmm2,%xmm3" },
+		{ { 0xC5, 0xED, 0x71, 0xF1, 0x02 }, "vpsllw $0x2,%ymm1,%ymm2" },
+		{ { 0xC4, 0x41, 0x7E, 0x6F, 0x00 }, "vmovdqu (%r8),%ymm8" },
+		{ { 0xC5, 0x7E, 0x6F, 0x0D, 0x78, 0x56, 0x34, 0x12 }, "vmovdqu 0x12345678(%rip),%ymm9" },
+		{ { 0xC4, 0xE2, 0x7D, 0x78, 0x06 }, "vpbroadcastb (%rsi),%ymm0" },
+		{ { 0xC4, 0xE2, 0x75, 0x00, 0x15, 0x78, 0x56, 0x34, 0x12 }, "vpshufb 0x12345678(%rip),%ymm1,%ymm2" },
+		{ { 0xC4, 0xE3, 0xFD, 0x00, 0xD1, 0xD8 }, "vpermq $0xd8,%ymm1,%ymm2" },
+		{ { 0xC4, 0xE3, 0xFD, 0x00, 0x15, 0x78, 0x56, 0x34, 0x12, 0xD8 }, "vpermq $0xd8,0x12345678(%rip),%ymm2" },
+		{ { 0xC4, 0xE3, 0x75, 0x38, 0x16, 0x01 }, "vinserti128 $0x1,(%rsi),%ymm1,%ymm2" },
+		{ { 0xC4, 0xE3, 0x75, 0x0F, 0x15, 0x78, 0x56, 0x34, 0x12, 0x04 }, "vpalignr $0x4,0x12345678(%rip),%ymm1,%ymm2" },
+		{ { 0xC4, 0xE2, 0x75, 0x8C, 0x16 }, "vpmaskmovd (%rsi),%ymm1,%ymm2" },
+		{ { 0xC4, 0xE2, 0x75, 0xB8, 0x15, 0x78, 0x56, 0x34, 0x12 }, "vfmadd231ps 0x12345678(%rip),%ymm1,%ymm2" },
+		{ { 0xC4, 0xE2, 0x60, 0xF2, 0xC8 }, "andn %eax,%ebx,%ecx" },
+		{ { 0xC4, 0xE2, 0xF9, 0xF7, 0xCB }, "shlx %rax,%rbx,%rcx" },
+		{ { 0xC4, 0xE2, 0xFB, 0xF6, 0x1E }, "mulx (%rsi),%rax,%rbx" },
+		{ { 0xC4, 0xE3, 0xFB, 0xF0, 0xD8, 0x07 }, "rorx $0x7,%rax,%rbx" },
+		{ { 0xC4, 0xE2, 0x78, 0xF7, 0xCB }, "bextr %eax,%ebx,%ecx" },
+		{ { 0xC4, 0xE2, 0x75, 0x90, 0x1C, 0x96 }, "vpgatherdd %ymm1,(%rsi,%ymm2,4),%ymm3" },
+		{ { 0xC5, 0xF8, 0x93, 0xC1 }, "kmovw %k1,%eax" },
+		{ { 0x62, 0xF1, 0xFE, 0x48, 0x6F, 0x06 }, "vmovdqu64 (%rsi),%zmm0" },
+		{ { 0x62, 0xF1, 0xFE, 0x48, 0x7F, 0x47, 0x01 }, "vmovdqu64 %zmm0,0x40(%rdi)" },
+		{ { 0x62, 0xF1, 0xFE, 0x48, 0x6F, 0x0D, 0x78, 0x56, 0x34, 0x12 }, "vmovdqu64 0x12345678(%rip),%zmm1" },
+		{ { 0x62, 0xE1, 0x7F, 0xC9, 0x6F, 0x06 }, "vmovdqu8 (%rsi),%zmm16{%k1}{z}" },
+		{ { 0x62, 0xF1, 0xFD, 0x48, 0xEF, 0xC0 }, "vpxorq %zmm0,%zmm0,%zmm0" },
+		{ { 0x62, 0xF1, 0x7D, 0x48, 0x74, 0x0F }, "vpcmpeqb (%rdi),%zmm0,%k1" },
+		{ { 0x62, 0xF3, 0x7D, 0x48, 0x25, 0xC0, 0xFF }, "vpternlogd $0xff,%zmm0,%zmm0,%zmm0" },
+		{ { 0x62, 0xF3, 0x75, 0x48, 0x25, 0x15, 0x78, 0x56, 0x34, 0x12, 0x96 }, "vpternlogd $0x96,0x12345678(%rip),%zmm1,%zmm2" },
+		{ { 0x62, 0xF1, 0x7D, 0x48, 0x70, 0xD1, 0x1B }, "vpshufd $0x1b,%zmm1,%zmm2" },
+		{ { 0x62, 0xF1, 0x7D, 0x48, 0x70, 0x15, 0x78, 0x56, 0x34, 0x12, 0x1B }, "vpshufd $0x1b,0x12345678(%rip),%zmm2" },
+		{ { 0x62, 0xF1, 0x6C, 0x48, 0xC2, 0xC9, 0x01 }, "vcmpltps %zmm1,%zmm2,%k1" },
+		{ { 0x62, 0xF2, 0x7D, 0x48, 0x58, 0x1E }, "vpbroadcastd (%rsi),%zmm3" },
+		{ { 0x62, 0xF1, 0x74, 0x58, 0x58, 0x15, 0x78, 0x56, 0x34, 0x12 }, "vaddps 0x12345678(%rip){1to16},%zmm1,%zmm2" },
+		{ { 0x62, 0x61, 0x7C, 0x48, 0x10, 0x7C, 0xCC, 0x40 }, "vmovups 0x1000(%rsp,%rcx,8),%zmm31" },
+		{ { 0x62, 0xF5, 0x6C, 0x48, 0x58, 0xD9 }, "vaddph %zmm1,%zmm2,%zmm3" },
+		{ { 0x62, 0xF5, 0x6C, 0x48, 0x58, 0x1D, 0x78, 0x56, 0x34, 0x12 }, "vaddph 0x12345678(%rip),%zmm2,%zmm3" },
+		{ { 0x62, 0xF6, 0x6D, 0x48, 0x98, 0x1E }, "vfmadd132ph (%rsi),%zmm2,%zmm3" },
+		{ { 0x62, 0xF1, 0xED, 0x48, 0x73, 0xD1, 0x03 }, "vpsrlq $0x3,%zmm1,%zmm2" },
+		{ { 0x8F, 0xE8, 0x60, 0xA2, 0xE2, 0x10 }, "vpcmov %xmm1,%xmm2,%xmm3,%xmm4" },
+		{ { 0x8F, 0xE8, 0x78, 0xC0, 0xD1, 0x03 }, "vprotb $0x3,%xmm1,%xmm2" },
+		{ { 0x8F, 0xE8, 0x78, 0xC0, 0x15, 0x78, 0x56, 0x34, 0x12, 0x03 }, "vprotb $0x3,0x12345678(%rip),%xmm2" },
+		{ { 0x8F, 0xE9, 0x78, 0x80, 0xD1 }, "vfrczps %xmm1,%xmm2" },
+		{ { 0x8F, 0xE9, 0x78, 0x80, 0x15, 0x78, 0x56, 0x34, 0x12 }, "vfrczps 0x12345678(%rip),%xmm2" },
+		{ { 0x8F, 0xE9, 0x78, 0xC1, 0x0E }, "vphaddbw (%rsi),%xmm1" },
+		{ { 0x8F, 0xEA, 0x78, 0x10, 0xD8, 0x34, 0x12, 0x00, 0x00 }, "bextr $0x1234,%eax,%ebx" },
+		{ { 0x8F, 0xEA, 0x78, 0x10, 0x1D, 0x78, 0x56, 0x34, 0x12, 0x34, 0x12, 0x00, 0x00 }, "bextr $0x1234,0x12345678(%rip),%ebx" },
+	};
+
+	constexpr uint32_t RipDisplacement { 0x12345678 };
+
+	bool IsRipRelative(const Instruction& instruction)
+	{
+		return instruction.text.find("(%rip)") != std::string::npos;
+	}
+
+	bool HasVectorPrefix(const Instruction& instruction)
+	{
+		uint8_t first = instruction.bytes[0];
+		return first == 0xC4 || first == 0xC5 || first == 0x62 || (first == 0x8F && (instruction.bytes[1] & 0x1F) >= 8);
+	}
+
+	// Decodes the instruction followed by int3 padding, as it would be met
+	// in a function.
+	hde64s Decode(const Instruction& instruction)
+	{
+		uint8_t code[32];
+		std::memset(code, 0xCC, sizeof(code));
+		std::memcpy(code, instruction.bytes.data(), instruction.bytes.size());
+
+		hde64s hs;
+		hde64_disasm(code, &hs);
+		return hs;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(InstructionDecoder_)
+
+BOOST_AUTO_TEST_CASE(CorpusInstructionsHaveTheirLength)
+{
+	for (const Instruction& instruction : Corpus)
+	{
+		hde64s hs = Decode(instruction);
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_TEST(hs.len == instruction.bytes.size());
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_TEST(!(hs.flags & F_ERROR));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(RipRelativeOperandsAreFoundWhereTheTrampolineLooksForThem)
+{
+	for (const Instruction& instruction : Corpus)
+	{
+		hde64s hs = Decode(instruction);
+		bool ripRelative = (hs.flags & F_MODRM) && (hs.modrm & 0xC7) == 0x05;
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_TEST(ripRelative == IsRipRelative(instruction));
+		if (!ripRelative)
+			continue;
+
+		// CreateTrampolineFunction() rewrites the four bytes before the
+		// immediate.
+		size_t offset = hs.len - ((hs.flags & 0x3C) >> 2) - 4;
+		uint32_t displacement;
+		std::memcpy(&displacement, instruction.bytes.data() + offset, sizeof(displacement));
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_TEST(displacement == RipDisplacement);
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_TEST(hs.disp.disp32 == RipDisplacement);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(VectorInstructionsKeepTheirPrefixAsOpcode)
+{
+	// So that none of them is taken for a branch the trampoline relocates.
+	for (const Instruction& instruction : Corpus)
+	{
+		hde64s hs = Decode(instruction);
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_TEST(((hs.flags & F_VEX) != 0) == HasVectorPrefix(instruction));
+		if (!HasVectorPrefix(instruction))
+			continue;
+
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_TEST(hs.opcode == instruction.bytes[0]);
+		BOOST_TEST(hs.opcode2 == 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CorpusDecodesAsOneStream)
+{
+	std::vector<uint8_t> code;
+	for (const Instruction& instruction : Corpus)
+		code.insert(code.end(), instruction.bytes.begin(), instruction.bytes.end());
+	code.resize(code.size() + 16, 0xCC);
+
+	size_t offset = 0;
+	for (const Instruction& instruction : Corpus)
+	{
+		hde64s hs;
+		offset += hde64_disasm(code.data() + offset, &hs);
+		BOOST_TEST_INFO(instruction.text);
+		BOOST_REQUIRE_EQUAL(hs.len, instruction.bytes.size());
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
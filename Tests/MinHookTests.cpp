@@ -0,0 +1,444 @@
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <vector>
+#include "MinHook/include/MinHook.h"
+
+// Targets with known prologues, so that what the trampoline has to relocate
+// does not depend on the compiler.
+asm(".text\n"
+	".p2align 4\n"
+	// mov eax, 1; ret
+	".globl MinHookReturnsOne\n"
+	"MinHookReturnsOne:\n"
+	"	movl $1, %eax\n"
+	"	ret\n"
+	".p2align 4\n"
+	// mov eax, [rip + MinHookValue]; ret
+	".globl MinHookReturnsValue\n"
+	"MinHookReturnsValue:\n"
+	"	movl MinHookValue(%rip), %eax\n"
+	"	ret\n"
+	".p2align 4\n"
+	// test edi, edi; jz 1f; mov eax, 2; ret; 1: mov eax, 3; ret
+	".globl MinHookBranches\n"
+	"MinHookBranches:\n"
+	"	testl %edi, %edi\n"
+	"	jz 1f\n"
+	"	movl $2, %eax\n"
+	"	ret\n"
+	"1:\n"
+	"	movl $3, %eax\n"
+	"	ret\n"
+	".p2align 4\n"
+	// jz 1f; jc 1f; js 1f; mov eax, 4; ret; 1: mov eax, 4; ret
+	// Each branch grows to 16 bytes in the trampoline, too many for the
+	// smallest slot.
+	".globl MinHookManyBranches\n"
+	"MinHookManyBranches:\n"
+	"	jz 1f\n"
+	"	jc 1f\n"
+	"	js 1f\n"
+	"	movl $4, %eax\n"
+	"	ret\n"
+	"1:\n"
+	"	movl $4, %eax\n"
+	"	ret\n"
+	".p2align 4\n"
+	// push rbx; push rbp; pop rbp; pop rbx; nop; mov eax, 5; ret
+	// An instruction starts at each byte that the patch overwrites.
+	".globl MinHookOneByteInstructions\n"
+	"MinHookOneByteInstructions:\n"
+	"	pushq %rbx\n"
+	"	pushq %rbp\n"
+	"	popq %rbp\n"
+	"	popq %rbx\n"
+	"	nop\n"
+	"	movl $5, %eax\n"
+	"	ret\n"
+	".p2align 4\n"
+	// xor eax, eax; jrcxz 2f; loop 1f; mov eax, 100; ret; 1: mov eax, 1; ret;
+	// 2: mov eax, -1; ret
+	// Neither branch has a rel32 form to relocate it to.
+	".globl MinHookLoops\n"
+	"MinHookLoops:\n"
+	"	xorl %eax, %eax\n"
+	"	jrcxz 2f\n"
+	"	loop 1f\n"
+	"	movl $100, %eax\n"
+	"	ret\n"
+	"1:\n"
+	"	movl $1, %eax\n"
+	"	ret\n"
+	"2:\n"
+	"	movl $-1, %eax\n"
+	"	ret\n"
+	".p2align 4\n"
+	// vzeroupper; vmovd xmm0, [rip + MinHookValue]; vmovd eax, xmm0; ret
+	".globl MinHookVectorValue\n"
+	"MinHookVectorValue:\n"
+	"	vzeroupper\n"
+	"	vmovd MinHookValue(%rip), %xmm0\n"
+	"	vmovd %xmm0, %eax\n"
+	"	ret\n");
+
+extern "C"
+{
+	int MinHookReturnsOne();
+	int MinHookReturnsValue();
+	int MinHookBranches(int value);
+	int MinHookManyBranches();
+	int MinHookOneByteInstructions();
+	int MinHookLoops(int, int, int, long count);
+	int MinHookVectorValue();
+
+	int MinHookValue { 7 };
+}
+
+namespace
+{
+	struct MinHookFixture
+	{
+		MinHookFixture()
+		{
+			BOOST_REQUIRE(MH_Initialize() == MH_OK);
+		}
+
+		~MinHookFixture()
+		{
+			BOOST_CHECK(MH_Uninitialize() == MH_OK);
+		}
+	};
+
+	LPVOID Address(auto function)
+	{
+		return reinterpret_cast<LPVOID>(function);
+	}
+
+	int ReturnsTen()
+	{
+		return 10;
+	}
+
+	int (*g_originalBranches)(int);
+
+	int BranchesPlusHundred(int value)
+	{
+		return g_originalBranches(value) + 100;
+	}
+
+	int (*g_originalLoops)(int, int, int, long);
+
+	int LoopsPlusThousand(int a, int b, int c, long count)
+	{
+		return g_originalLoops(a, b, c, count) + 1000;
+	}
+
+	// Where the patch at the target jumps to.
+	uintptr_t PatchDestination(LPVOID target)
+	{
+		auto patch = static_cast<const unsigned char*>(target);
+		int32_t operand;
+		std::memcpy(&operand, patch + 1, sizeof(operand));
+		return patch[0] == 0xE9 ? reinterpret_cast<uintptr_t>(patch) + 5 + operand : 0;
+	}
+
+	// mov eax, 10; ret, mapped more than 2 GB away from the code of the test.
+	class FarDetour
+	{
+	public:
+		FarDetour()
+		{
+			static const unsigned char code[] { 0xB8, 0x0A, 0x00, 0x00, 0x00, 0xC3 };
+			uintptr_t hint = (reinterpret_cast<uintptr_t>(&MinHookReturnsOne) + 0x400000000) & ~uintptr_t(0xFFFF);
+			m_code = mmap(reinterpret_cast<void*>(hint), 0x1000, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			BOOST_REQUIRE(m_code != MAP_FAILED);
+			std::memcpy(m_code, code, sizeof(code));
+		}
+
+		~FarDetour()
+		{
+			munmap(m_code, 0x1000);
+		}
+
+		LPVOID Address() const
+		{
+			return m_code;
+		}
+
+	private:
+		void* m_code;
+	};
+
+	pid_t (*g_originalGetpid)();
+
+	pid_t GetpidPlusOne()
+	{
+		return g_originalGetpid() + 1;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(MinHook_)
+
+BOOST_AUTO_TEST_CASE(InitializeOnlyOnce)
+{
+	BOOST_TEST(MH_Uninitialize() == MH_ERROR_NOT_INITIALIZED);
+	BOOST_TEST(MH_SetDualMappedTrampolines(TRUE) == MH_ERROR_NOT_INITIALIZED);
+	BOOST_TEST(MH_Initialize() == MH_OK);
+	BOOST_TEST(MH_Initialize() == MH_ERROR_ALREADY_INITIALIZED);
+	BOOST_TEST(MH_Uninitialize() == MH_OK);
+}
+
+BOOST_FIXTURE_TEST_CASE(EnabledHookCallsTheDetour, MinHookFixture)
+{
+	int (*original)() = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsOne), Address(&ReturnsTen), reinterpret_cast<LPVOID*>(&original)) == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 1);
+
+	unsigned char prologue[6];
+	std::memcpy(prologue, Address(&MinHookReturnsOne), sizeof(prologue));
+
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookReturnsOne)) == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 10);
+	BOOST_TEST(original() == 1);
+	BOOST_TEST(MH_EnableHook(Address(&MinHookReturnsOne)) == MH_ERROR_ENABLED);
+
+	BOOST_REQUIRE(MH_DisableHook(Address(&MinHookReturnsOne)) == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 1);
+	BOOST_TEST(std::memcmp(prologue, Address(&MinHookReturnsOne), sizeof(prologue)) == 0);
+
+	BOOST_TEST(MH_RemoveHook(Address(&MinHookReturnsOne)) == MH_OK);
+	BOOST_TEST(MH_RemoveHook(Address(&MinHookReturnsOne)) == MH_ERROR_NOT_CREATED);
+}
+
+BOOST_FIXTURE_TEST_CASE(TrampolineRelocatesRipRelativeOperands, MinHookFixture)
+{
+	int (*original)() = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsValue), Address(&ReturnsTen), reinterpret_cast<LPVOID*>(&original)) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookReturnsValue)) == MH_OK);
+
+	BOOST_TEST(MinHookReturnsValue() == 10);
+	BOOST_TEST(original() == 7);
+	MinHookValue = 8;
+	BOOST_TEST(original() == 8);
+	MinHookValue = 7;
+}
+
+BOOST_FIXTURE_TEST_CASE(TrampolineRelocatesBranches, MinHookFixture)
+{
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookBranches), Address(&BranchesPlusHundred), reinterpret_cast<LPVOID*>(&g_originalBranches)) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookBranches)) == MH_OK);
+
+	BOOST_TEST(MinHookBranches(0) == 103);
+	BOOST_TEST(MinHookBranches(1) == 102);
+}
+
+BOOST_FIXTURE_TEST_CASE(LargeTrampolinesGetLargerSlots, MinHookFixture)
+{
+	int (*original)() = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookManyBranches), Address(&ReturnsTen), reinterpret_cast<LPVOID*>(&original)) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookManyBranches)) == MH_OK);
+
+	BOOST_TEST(MinHookManyBranches() == 10);
+	BOOST_TEST(original() == 4);
+
+	BOOST_REQUIRE(MH_DisableHook(Address(&MinHookManyBranches)) == MH_OK);
+	BOOST_TEST(MinHookManyBranches() == 4);
+}
+
+BOOST_FIXTURE_TEST_CASE(TrampolineRelocatesLoopsThroughBranchIslands, MinHookFixture)
+{
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookLoops), Address(&LoopsPlusThousand), reinterpret_cast<LPVOID*>(&g_originalLoops)) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookLoops)) == MH_OK);
+
+	BOOST_TEST(MinHookLoops(0, 0, 0, 0) == 999);
+	BOOST_TEST(MinHookLoops(0, 0, 0, 1) == 1100);
+	BOOST_TEST(MinHookLoops(0, 0, 0, 5) == 1001);
+}
+
+BOOST_FIXTURE_TEST_CASE(TrampolineRelocatesVectorInstructions, MinHookFixture)
+{
+	if (!__builtin_cpu_supports("avx"))
+		return;
+
+	int (*original)() = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookVectorValue), Address(&ReturnsTen), reinterpret_cast<LPVOID*>(&original)) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookVectorValue)) == MH_OK);
+
+	BOOST_TEST(MinHookVectorValue() == 10);
+	BOOST_TEST(original() == MinHookValue);
+}
+
+BOOST_FIXTURE_TEST_CASE(ThreadsInADenselyPackedPrologueAreMoved, MinHookFixture)
+{
+	int (*original)() = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookOneByteInstructions), Address(&ReturnsTen), reinterpret_cast<LPVOID*>(&original)) == MH_OK);
+	BOOST_TEST(original() == 5);
+
+	// Threads stopped at any of the boundaries must resume at its
+	// counterpart in the target or trampoline function.
+	std::atomic<bool> stop { false };
+	std::atomic<bool> failed { false };
+	std::vector<std::thread> callers;
+	for (int i = 0; i < 4; ++i)
+	{
+		callers.emplace_back([&stop, &failed, original]()
+		{
+			while (!stop)
+			{
+				int result = MinHookOneByteInstructions();
+				if ((result != 5 && result != 10) || original() != 5)
+					failed = true;
+			}
+		});
+	}
+
+	for (int i = 0; i < 100; ++i)
+	{
+		BOOST_REQUIRE(MH_EnableHook(Address(&MinHookOneByteInstructions)) == MH_OK);
+		BOOST_REQUIRE(MH_DisableHook(Address(&MinHookOneByteInstructions)) == MH_OK);
+	}
+
+	stop = true;
+	for (std::thread& caller : callers)
+		caller.join();
+
+	BOOST_TEST(!failed);
+}
+
+BOOST_FIXTURE_TEST_CASE(DualMappedTrampolinesWork, MinHookFixture)
+{
+	BOOST_TEST(MH_SetDualMappedTrampolines(TRUE) == MH_OK);
+
+	int (*original)() = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsValue), Address(&ReturnsTen), reinterpret_cast<LPVOID*>(&original)) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookReturnsValue)) == MH_OK);
+
+	BOOST_TEST(MinHookReturnsValue() == 10);
+	BOOST_TEST(original() == 7);
+}
+
+BOOST_FIXTURE_TEST_CASE(NearDetoursAreJumpedToDirectly, MinHookFixture)
+{
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsOne), Address(&ReturnsTen), nullptr) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookReturnsOne)) == MH_OK);
+
+	BOOST_TEST(PatchDestination(Address(&MinHookReturnsOne)) == reinterpret_cast<uintptr_t>(&ReturnsTen));
+	BOOST_TEST(MinHookReturnsOne() == 10);
+}
+
+BOOST_FIXTURE_TEST_CASE(FarDetoursAreReachedThroughTheRelay, MinHookFixture)
+{
+	FarDetour detour;
+	uintptr_t target = reinterpret_cast<uintptr_t>(&MinHookReturnsOne);
+	uintptr_t far = reinterpret_cast<uintptr_t>(detour.Address());
+	BOOST_REQUIRE((far > target ? far - target : target - far) > 0x80000000u);
+
+	int (*original)() = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsOne), detour.Address(), reinterpret_cast<LPVOID*>(&original)) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(Address(&MinHookReturnsOne)) == MH_OK);
+
+	BOOST_TEST(PatchDestination(Address(&MinHookReturnsOne)) != far);
+	BOOST_TEST(MinHookReturnsOne() == 10);
+	BOOST_TEST(original() == 1);
+
+	BOOST_REQUIRE(MH_RemoveHook(Address(&MinHookReturnsOne)) == MH_OK);
+}
+
+BOOST_FIXTURE_TEST_CASE(QueuedChangesApplyTogether, MinHookFixture)
+{
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsOne), Address(&ReturnsTen), nullptr) == MH_OK);
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsValue), Address(&ReturnsTen), nullptr) == MH_OK);
+
+	BOOST_TEST(MH_QueueEnableHook(MH_ALL_HOOKS) == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 1);
+	BOOST_TEST(MH_ApplyQueued() == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 10);
+	BOOST_TEST(MinHookReturnsValue() == 10);
+
+	BOOST_TEST(MH_DisableHook(MH_ALL_HOOKS) == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 1);
+	BOOST_TEST(MinHookReturnsValue() == 7);
+}
+
+BOOST_FIXTURE_TEST_CASE(HooksAreCreatedAndEnabledInBatches, MinHookFixture)
+{
+	MH_HOOK_DESC hooks[] {
+		{ Address(&MinHookReturnsOne), Address(&ReturnsTen), nullptr, MH_UNKNOWN },
+		{ Address(&MinHookReturnsValue), Address(&ReturnsTen), nullptr, MH_UNKNOWN },
+	};
+	BOOST_REQUIRE(MH_CreateHooks(hooks, 2) == MH_OK);
+	BOOST_TEST(hooks[0].status == MH_OK);
+	BOOST_TEST(hooks[1].status == MH_OK);
+
+	LPVOID targets[] { Address(&MinHookReturnsOne), Address(&MinHookReturnsValue) };
+	BOOST_REQUIRE(MH_EnableHooks(targets, 2) == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 10);
+	BOOST_TEST(MinHookReturnsValue() == 10);
+
+	BOOST_REQUIRE(MH_DisableHooks(targets, 2) == MH_OK);
+	BOOST_TEST(MinHookReturnsOne() == 1);
+	BOOST_TEST(MinHookReturnsValue() == 7);
+}
+
+BOOST_FIXTURE_TEST_CASE(DataIsNotExecutable, MinHookFixture)
+{
+	BOOST_TEST(MH_CreateHook(&MinHookValue, Address(&ReturnsTen), nullptr) == MH_ERROR_NOT_EXECUTABLE);
+}
+
+BOOST_FIXTURE_TEST_CASE(HooksFunctionsOfLoadedModules, MinHookFixture)
+{
+	BOOST_TEST(MH_CreateHookApi(L"libNoSuchModule.so", "getpid", Address(&GetpidPlusOne), nullptr) == MH_ERROR_MODULE_NOT_FOUND);
+	BOOST_TEST(MH_CreateHookApi(L"libc.so.6", "NoSuchFunction", Address(&GetpidPlusOne), nullptr) == MH_ERROR_FUNCTION_NOT_FOUND);
+
+	pid_t pid = getpid();
+	LPVOID target = nullptr;
+	BOOST_REQUIRE(MH_CreateHookApiEx(L"libc.so.6", "getpid", Address(&GetpidPlusOne), reinterpret_cast<LPVOID*>(&g_originalGetpid), &target) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(target) == MH_OK);
+	BOOST_TEST(getpid() == pid + 1);
+	BOOST_REQUIRE(MH_DisableHook(target) == MH_OK);
+	BOOST_TEST(getpid() == pid);
+}
+
+BOOST_FIXTURE_TEST_CASE(ThreadsRunningTheTargetSeeEitherFunction, MinHookFixture)
+{
+	BOOST_REQUIRE(MH_CreateHook(Address(&MinHookReturnsOne), Address(&ReturnsTen), nullptr) == MH_OK);
+
+	std::atomic<bool> stop { false };
+	std::atomic<bool> failed { false };
+	std::vector<std::thread> callers;
+	for (int i = 0; i < 4; ++i)
+	{
+		callers.emplace_back([&stop, &failed]()
+		{
+			while (!stop)
+			{
+				int result = MinHookReturnsOne();
+				if (result != 1 && result != 10)
+					failed = true;
+			}
+		});
+	}
+
+	for (BOOL atomic : { FALSE, TRUE })
+	{
+		MH_SetAtomicPatching(atomic);
+		for (int i = 0; i < 50; ++i)
+		{
+			BOOST_REQUIRE(MH_EnableHook(Address(&MinHookReturnsOne)) == MH_OK);
+			BOOST_REQUIRE(MH_DisableHook(Address(&MinHookReturnsOne)) == MH_OK);
+		}
+	}
+
+	stop = true;
+	for (std::thread& caller : callers)
+		caller.join();
+
+	BOOST_TEST(!failed);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
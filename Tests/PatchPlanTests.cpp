@@ -0,0 +1,181 @@
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstring>
+#include "MinHook/src/patch.h"
+
+namespace
+{
+	// A code buffer whose first byte is 8-byte aligned. Filled with INT3 like
+	// the padding between functions.
+	struct CodeBuffer
+	{
+		alignas(8) uint8_t			m_bytes[64];
+
+		CodeBuffer()
+		{
+			std::memset(m_bytes, 0xCC, sizeof(m_bytes));
+		}
+
+		void Apply(const PATCH_PLAN& plan)
+		{
+			if (plan.above.size != 0)
+				std::memcpy(plan.above.pAddress, plan.above.bytes, plan.above.size);
+
+			uint64_t* word = GetPatchWord(&plan.atomic);
+			*word = MergePatchWord(&plan.atomic, *word);
+		}
+	};
+
+	int32_t JumpOperand(const uint8_t* jump)
+	{
+		int32_t operand;
+		std::memcpy(&operand, jump + 1, sizeof(operand));
+		return operand;
+	}
+
+	PATCH_TARGET MakeTarget(uint8_t* target, uint8_t* detour, const uint8_t* backup, const uint8_t* oldIPs, unsigned nIP, int patchAbove = 0)
+	{
+		PATCH_TARGET result;
+		result.pTarget = target;
+		result.pDetour = detour;
+		result.patchAbove = patchAbove;
+		result.pBackup = backup;
+		result.pOldIPs = oldIPs;
+		result.nIP = nIP;
+		return result;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(PatchPlan_)
+
+BOOST_AUTO_TEST_CASE(AlignedJumpIsOneAtomicWrite)
+{
+	CodeBuffer code;
+	uint8_t* target = code.m_bytes + 16;
+	const uint8_t prologue[] = { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3, 0x90, 0x90 };	// mov eax, 1; ret
+	std::memcpy(target, prologue, sizeof(prologue));
+	const uint8_t oldIPs[] = { 0, 5 };
+	PATCH_TARGET hook = MakeTarget(target, code.m_bytes + 48, prologue, oldIPs, 2);
+
+	PATCH_PLAN plan;
+	BOOST_REQUIRE(PlanAtomicPatch(&hook, 1, &plan));
+	BOOST_TEST(plan.above.size == 0);
+	BOOST_TEST(plan.atomic.pAddress == target);
+	BOOST_TEST(plan.atomic.size == 5);
+	BOOST_TEST(reinterpret_cast<uint8_t*>(GetPatchWord(&plan.atomic)) == target);
+
+	code.Apply(plan);
+	BOOST_TEST(target[0] == 0xE9);
+	BOOST_TEST(JumpOperand(target) == 48 - (16 + 5));
+	BOOST_TEST(target[5] == 0xC3);
+	BOOST_TEST(target[6] == 0x90);
+	BOOST_TEST(code.m_bytes[15] == 0xCC);
+
+	BOOST_REQUIRE(PlanAtomicPatch(&hook, 0, &plan));
+	code.Apply(plan);
+	BOOST_TEST(std::memcmp(target, prologue, sizeof(prologue)) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(JumpMayStartAnywhereInTheFirstHalfOfAWord)
+{
+	CodeBuffer code;
+	const uint8_t prologue[] = { 0xB8, 0x01, 0x00, 0x00, 0x00 };
+	const uint8_t oldIPs[] = { 0 };
+
+	for (int offset = 0; offset < 8; ++offset)
+	{
+		uint8_t* target = code.m_bytes + 16 + offset;
+		PATCH_TARGET hook = MakeTarget(target, code.m_bytes, prologue, oldIPs, 1);
+
+		PATCH_PLAN plan;
+		BOOST_TEST(PlanAtomicPatch(&hook, 1, &plan) == (offset <= 3 ? 1 : 0));
+		BOOST_TEST(PlanAtomicPatch(&hook, 0, &plan) == (offset <= 3 ? 1 : 0));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(InstructionBoundaryInsideTheJumpNeedsFreeze)
+{
+	CodeBuffer code;
+	uint8_t* target = code.m_bytes + 16;
+	const uint8_t prologue[] = { 0x55, 0x48, 0x89, 0xE5, 0x90 };	// push rbp; mov rbp, rsp; nop
+	std::memcpy(target, prologue, sizeof(prologue));
+	const uint8_t oldIPs[] = { 0, 1, 4 };
+	PATCH_TARGET hook = MakeTarget(target, code.m_bytes + 48, prologue, oldIPs, 3);
+
+	PATCH_PLAN plan;
+	BOOST_TEST(!PlanAtomicPatch(&hook, 1, &plan));
+
+	// No thread can stop inside the jump, so restoring needs no freeze.
+	target[0] = 0xE9;
+	BOOST_REQUIRE(PlanAtomicPatch(&hook, 0, &plan));
+	code.Apply(plan);
+	BOOST_TEST(std::memcmp(target, prologue, sizeof(prologue)) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(HotPatchWritesTheLongJumpBeforeTheShortOne)
+{
+	CodeBuffer code;
+	uint8_t* target = code.m_bytes + 24;
+	const uint8_t function[] = { 0x31, 0xC0, 0xC3 };	// xor eax, eax; ret
+	std::memcpy(target, function, sizeof(function));
+	uint8_t backup[7];
+	std::memcpy(backup, target - 5, sizeof(backup));
+	const uint8_t oldIPs[] = { 0, 2 };
+	PATCH_TARGET hook = MakeTarget(target, code.m_bytes + 56, backup, oldIPs, 2, 1);
+
+	PATCH_PLAN plan;
+	BOOST_REQUIRE(PlanAtomicPatch(&hook, 1, &plan));
+	BOOST_TEST(plan.above.pAddress == target - 5);
+	BOOST_TEST(plan.above.size == 5);
+	BOOST_TEST(plan.atomic.pAddress == target);
+	BOOST_TEST(plan.atomic.size == 2);
+
+	code.Apply(plan);
+	BOOST_TEST(target[-5] == 0xE9);
+	BOOST_TEST(JumpOperand(target - 5) == 56 - 24);
+	BOOST_TEST(target[0] == 0xEB);
+	BOOST_TEST(static_cast<int8_t>(target[1]) == -7);
+	BOOST_TEST(target[2] == 0xC3);
+
+	// A thread may be between the two jumps.
+	BOOST_TEST(!PlanAtomicPatch(&hook, 0, &plan));
+}
+
+BOOST_AUTO_TEST_CASE(HotPatchShortJumpMustNotStraddleAWord)
+{
+	CodeBuffer code;
+	const uint8_t backup[7] = { 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0x31, 0xC0 };
+	const uint8_t oldIPs[] = { 0, 2 };
+
+	PATCH_PLAN plan;
+	PATCH_TARGET hook = MakeTarget(code.m_bytes + 31, code.m_bytes, backup, oldIPs, 2, 1);
+	BOOST_TEST(!PlanAtomicPatch(&hook, 1, &plan));
+
+	hook = MakeTarget(code.m_bytes + 30, code.m_bytes, backup, oldIPs, 2, 1);
+	BOOST_TEST(PlanAtomicPatch(&hook, 1, &plan));
+
+	const uint8_t splitOldIPs[] = { 0, 1 };
+	hook = MakeTarget(code.m_bytes + 30, code.m_bytes, backup, splitOldIPs, 2, 1);
+	BOOST_TEST(!PlanAtomicPatch(&hook, 1, &plan));
+}
+
+BOOST_AUTO_TEST_CASE(MergeKeepsTheRestOfTheWord)
+{
+	CodeBuffer code;
+	PATCH_WRITE write {};
+	write.pAddress = code.m_bytes + 10;
+	write.size = 3;
+	write.bytes[0] = 1;
+	write.bytes[1] = 2;
+	write.bytes[2] = 3;
+
+	uint64_t* word = GetPatchWord(&write);
+	BOOST_TEST(reinterpret_cast<uint8_t*>(word) == code.m_bytes + 8);
+
+	*word = MergePatchWord(&write, *word);
+	const uint8_t expected[] = { 0xCC, 0xCC, 1, 2, 3, 0xCC, 0xCC, 0xCC };
+	BOOST_TEST(std::memcmp(code.m_bytes + 8, expected, sizeof(expected)) == 0);
+	BOOST_TEST(code.m_bytes[16] == 0xCC);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,2 @@
+#define BOOST_TEST_MODULE PortableTests
+#include <boost/test/unit_test.hpp>
@@ -10,3 +10,112 @@ BOOST_AUTO_TEST_CASE(CreateFile_)
 	HANDLE handle = CreateFileW(L"test", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, nullptr);
 	CloseHandle(handle);
 }
+
+BOOST_AUTO_TEST_CASE(VirtualFile_)
+{
+	MH_Initialize();
+	TestHooks::FileHook	fileHook;
+	fileHook.FileSystem().AddRoot(L"C:\\VirtualTestRoot");
+
+	const char contents[] = "recorded device data";
+	HANDLE handle = CreateFileW(L"C:\\VirtualTestRoot\\input.bin", GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, nullptr);
+	BOOST_REQUIRE(handle != INVALID_HANDLE_VALUE);
+	DWORD bytesWritten = 0;
+	BOOST_TEST(WriteFile(handle, contents, sizeof(contents), &bytesWritten, nullptr));
+	BOOST_TEST(bytesWritten == sizeof(contents));
+	BOOST_TEST(CloseHandle(handle));
+
+	handle = CreateFileW(L"c:/virtualtestroot/INPUT.bin", GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, nullptr);
+	BOOST_REQUIRE(handle != INVALID_HANDLE_VALUE);
+	char buffer[64] = {};
+	DWORD bytesRead = 0;
+	BOOST_TEST(ReadFile(handle, buffer, sizeof(buffer), &bytesRead, nullptr));
+	BOOST_TEST(bytesRead == sizeof(contents));
+	BOOST_TEST(std::string(buffer) == contents);
+	BOOST_TEST(CloseHandle(handle));
+
+	handle = CreateFileW(L"C:\\VirtualTestRoot\\missing.bin", GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, nullptr);
+	BOOST_TEST(handle == INVALID_HANDLE_VALUE);
+	BOOST_TEST(GetLastError() == static_cast<DWORD>(ERROR_FILE_NOT_FOUND));
+}
+
+BOOST_AUTO_TEST_CASE(VirtualFileOverlapped_)
+{
+	MH_Initialize();
+	TestHooks::FileHook	fileHook;
+	fileHook.FileSystem().AddRoot(L"C:\\VirtualTestRoot");
+
+	const char contents[] = "overlapped data";
+	HANDLE handle = CreateFileW(L"C:\\VirtualTestRoot\\overlapped.bin", GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_FLAG_OVERLAPPED, nullptr);
+	BOOST_REQUIRE(handle != INVALID_HANDLE_VALUE);
+
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	overlapped.Offset = 4;
+	BOOST_TEST(WriteFile(handle, contents, sizeof(contents), nullptr, &overlapped));
+	BOOST_TEST(WaitForSingleObject(overlapped.hEvent, 0) == WAIT_OBJECT_0);
+	DWORD byteCount = 0;
+	BOOST_TEST(GetOverlappedResult(handle, &overlapped, &byteCount, FALSE));
+	BOOST_TEST(byteCount == sizeof(contents));
+
+	char buffer[64] = {};
+	ResetEvent(overlapped.hEvent);
+	BOOST_TEST(ReadFile(handle, buffer, sizeof(buffer), nullptr, &overlapped));
+	BOOST_TEST(WaitForSingleObject(overlapped.hEvent, 0) == WAIT_OBJECT_0);
+	byteCount = 0;
+	BOOST_TEST(GetOverlappedResult(handle, &overlapped, &byteCount, TRUE));
+	BOOST_TEST(byteCount == sizeof(contents));
+	BOOST_TEST(std::string(buffer) == contents);
+
+	CloseHandle(overlapped.hEvent);
+	BOOST_TEST(CloseHandle(handle));
+}
+
+BOOST_AUTO_TEST_CASE(ApiWithoutArguments_)
+{
+	MH_Initialize();
+	TestHooks::ApiHook<&GetCurrentProcessId> hook;
+
+	DWORD processId = GetCurrentProcessId();
+	TestHooks::FilterCookie cookie = hook.AddFilter([](DWORD& result) { result = 42; return true; });
+	BOOST_TEST(GetCurrentProcessId() == 42u);
+	hook.RemoveFilter(cookie);
+	BOOST_TEST(GetCurrentProcessId() == processId);
+}
+
+BOOST_AUTO_TEST_CASE(ApiReturningVoid_)
+{
+	MH_Initialize();
+	TestHooks::ApiHook<&Sleep> hook;
+
+	DWORD filtered = 0;
+	DWORD monitored = 0;
+	TestHooks::FilterCookie filterCookie = hook.AddFilter([&filtered](DWORD milliseconds) { filtered = milliseconds; return milliseconds == 60000; });
+	TestHooks::FilterCookie monitorCookie = hook.AddMonitor([&monitored](DWORD milliseconds) { monitored = milliseconds; });
+
+	// The filter skips the one minute sleep, so the monitor does not see it.
+	Sleep(60000);
+	BOOST_TEST(filtered == 60000u);
+	BOOST_TEST(monitored == 0u);
+	Sleep(1);
+	BOOST_TEST(monitored == 1u);
+
+	hook.RemoveMonitor(monitorCookie);
+	hook.RemoveFilter(filterCookie);
+}
+
+BOOST_AUTO_TEST_CASE(ApiWithAStructArgument_)
+{
+	static_assert(!TestHooks::RoutesByHandle<POINT, DWORD>);
+
+	MH_Initialize();
+	TestHooks::ApiHook<&MonitorFromPoint> hook;
+
+	POINT seen {};
+	TestHooks::FilterCookie cookie = hook.AddFilter([&seen](POINT point, DWORD, HMONITOR& result) { seen = point; result = nullptr; return true; });
+	BOOST_TEST(MonitorFromPoint({ 12, 34 }, MONITOR_DEFAULTTOPRIMARY) == nullptr);
+	BOOST_TEST(seen.x == 12);
+	BOOST_TEST(seen.y == 34);
+	hook.RemoveFilter(cookie);
+	BOOST_TEST(MonitorFromPoint({ 12, 34 }, MONITOR_DEFAULTTOPRIMARY) != nullptr);
+}
@@ -0,0 +1,265 @@
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <ucontext.h>
+#include "MinHook/include/MinHook.h"
+#include "MinHook/src/platform/thread.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+// A loop that only leaves when a freeze moves the thread's IP out of it.
+asm(".text\n"
+	".globl TestSpinLoop\n"
+	"TestSpinLoop:\n"
+	"	jmp TestSpinLoop\n"
+	".globl TestSpinExit\n"
+	"TestSpinExit:\n"
+	"	ret\n");
+
+extern "C" void TestSpinLoop();
+extern "C" void TestSpinExit();
+#endif
+
+#if defined(__x86_64__)
+// loop 1f; nop; nop; nop; ret; 1: ret
+// The LOOP leaves the bytes the jump overwrites, so the trampoline sends it
+// through a branch island.
+asm(".text\n"
+	".p2align 4\n"
+	".globl TestIslandTarget\n"
+	"TestIslandTarget:\n"
+	"	loop 1f\n"
+	"	nop\n"
+	"	nop\n"
+	"	nop\n"
+	"	ret\n"
+	"1:\n"
+	"	ret\n");
+
+extern "C" void TestIslandTarget();
+#endif
+
+namespace
+{
+	// Threads that count for as long as they are not suspended.
+	class Counters
+	{
+	public:
+		explicit Counters(size_t count) :
+			m_counts(count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				m_threads.emplace_back([this, i]()
+				{
+					while (!m_stop)
+						++m_counts[i];
+				});
+			}
+
+			// Wait until every thread has started counting.
+			for (std::atomic<uint64_t>& count : m_counts)
+			{
+				while (count == 0)
+					std::this_thread::yield();
+			}
+		}
+
+		~Counters()
+		{
+			m_stop = true;
+			for (std::thread& thread : m_threads)
+				thread.join();
+		}
+
+		uint64_t Total() const
+		{
+			uint64_t total = 0;
+			for (const std::atomic<uint64_t>& count : m_counts)
+				total += count;
+			return total;
+		}
+
+	private:
+		std::vector<std::atomic<uint64_t>>	m_counts;
+		std::vector<std::thread>			m_threads;
+		std::atomic<bool>					m_stop { false };
+	};
+
+	uintptr_t CountThread(uintptr_t, void* context)
+	{
+		++*static_cast<unsigned*>(context);
+		return 0;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(ThreadFreeze_)
+
+BOOST_AUTO_TEST_CASE(FrozenThreadsDoNotRun)
+{
+	Counters counters(4);
+
+	unsigned visited = 0;
+	unsigned frozen = FreezeThreads(CountThread, &visited);
+	BOOST_TEST(frozen >= 4u);
+	BOOST_TEST(visited == frozen);
+
+	uint64_t total = counters.Total();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	BOOST_TEST(counters.Total() == total);
+
+	UnfreezeThreads();
+	while (counters.Total() == total)
+		std::this_thread::yield();
+}
+
+BOOST_AUTO_TEST_CASE(ThreadsMayComeAndGoBetweenFreezes)
+{
+	Counters counters(2);
+
+	for (int cycle = 0; cycle < 20; ++cycle)
+	{
+		std::vector<std::thread> passing;
+		for (int i = 0; i < 3; ++i)
+			passing.emplace_back([]() {});
+
+		unsigned frozen = FreezeThreads(nullptr, nullptr);
+		BOOST_TEST(frozen >= 2u);
+		UnfreezeThreads();
+
+		for (std::thread& thread : passing)
+			thread.join();
+	}
+
+	ReleaseFrozenThreads();
+	BOOST_TEST(FreezeThreads(nullptr, nullptr) >= 2u);
+	UnfreezeThreads();
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+BOOST_AUTO_TEST_CASE(MovesTheIPOfAFrozenThread)
+{
+	std::atomic<bool> started { false };
+	std::thread spinner([&started]()
+	{
+		started = true;
+		TestSpinLoop();
+	});
+	while (!started)
+		std::this_thread::yield();
+
+	// The thread may still be on its way into the loop.
+	bool moved = false;
+	for (int attempt = 0; attempt < 1000 && !moved; ++attempt)
+	{
+		FreezeThreads([](uintptr_t ip, void* context) -> uintptr_t
+		{
+			if (ip != reinterpret_cast<uintptr_t>(&TestSpinLoop))
+				return 0;
+
+			*static_cast<bool*>(context) = true;
+			return reinterpret_cast<uintptr_t>(&TestSpinExit);
+		}, &moved);
+		UnfreezeThreads();
+	}
+
+	BOOST_REQUIRE(moved);
+	spinner.join();
+}
+#endif
+
+#if defined(__x86_64__)
+namespace
+{
+	uintptr_t g_island;
+	std::atomic<bool> g_parked { false };
+
+	void IslandDetour()
+	{
+	}
+
+	bool IsAnySignalPending()
+	{
+		sigset_t pending;
+		sigemptyset(&pending);
+		sigpending(&pending);
+		for (int signal = 1; signal <= SIGRTMAX; ++signal)
+		{
+			if (sigismember(&pending, signal) == 1)
+				return true;
+		}
+		return false;
+	}
+
+	// Puts a thread spinning in TestSpinLoop() on the branch island, and keeps
+	// it there until the freeze signal is pending, so that the freeze finds it
+	// on the island. Every signal is blocked while this runs.
+	void ParkOnIsland(int, siginfo_t*, void* context)
+	{
+		greg_t& ip = static_cast<ucontext_t*>(context)->uc_mcontext.gregs[REG_RIP];
+		if (ip != reinterpret_cast<greg_t>(&TestSpinLoop))
+			return;
+
+		ip = static_cast<greg_t>(g_island);
+		g_parked = true;
+
+		while (!IsAnySignalPending())
+		{
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(RemovingAHookMovesAThreadOffABranchIsland)
+{
+	BOOST_REQUIRE(MH_Initialize() == MH_OK);
+
+	void* original = nullptr;
+	BOOST_REQUIRE(MH_CreateHook(reinterpret_cast<void*>(&TestIslandTarget), reinterpret_cast<void*>(&IslandDetour), &original) == MH_OK);
+	BOOST_REQUIRE(MH_EnableHook(reinterpret_cast<void*>(&TestIslandTarget)) == MH_OK);
+
+	// The relocated LOOP comes first in the trampoline and jumps to the island.
+	const uint8_t* loop = static_cast<const uint8_t*>(original);
+	BOOST_REQUIRE(loop[0] == 0xE2);
+	g_island = reinterpret_cast<uintptr_t>(loop) + 2 + static_cast<int8_t>(loop[1]);
+
+	struct sigaction action {};
+	struct sigaction oldAction {};
+	action.sa_sigaction = ParkOnIsland;
+	action.sa_flags = SA_SIGINFO;
+	sigfillset(&action.sa_mask);
+	BOOST_REQUIRE(sigaction(SIGUSR2, &action, &oldAction) == 0);
+
+	std::atomic<bool> started { false };
+	std::atomic<bool> returned { false };
+	std::thread spinner([&started, &returned]()
+	{
+		started = true;
+		TestSpinLoop();
+		returned = true;
+	});
+	while (!started)
+		std::this_thread::yield();
+
+	// The thread may still be on its way into the loop.
+	for (int attempt = 0; attempt < 1000 && !g_parked; ++attempt)
+	{
+		pthread_kill(spinner.native_handle(), SIGUSR2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	BOOST_REQUIRE(g_parked);
+
+	// The island goes away with the trampoline, so the thread has to be
+	// moved to where the LOOP jumps: the RET back out of TestSpinLoop().
+	BOOST_TEST(MH_RemoveHook(reinterpret_cast<void*>(&TestIslandTarget)) == MH_OK);
+	spinner.join();
+	BOOST_TEST(returned);
+
+	sigaction(SIGUSR2, &oldAction, nullptr);
+	BOOST_TEST(MH_Uninitialize() == MH_OK);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
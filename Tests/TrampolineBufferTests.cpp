@@ -0,0 +1,166 @@
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <vector>
+#include "MinHook/src/platform/compat.h"
+#include "MinHook/src/buffer.h"
+
+namespace
+{
+	struct BufferFixture
+	{
+		BufferFixture()
+		{
+			InitializeBuffer();
+		}
+
+		~BufferFixture()
+		{
+			UninitializeBuffer();
+		}
+	};
+
+	void Origin()
+	{
+	}
+
+#if defined(_M_X64) || defined(__x86_64__)
+	uintptr_t Distance(LPVOID buffer, LPVOID origin)
+	{
+		uintptr_t a = reinterpret_cast<uintptr_t>(buffer);
+		uintptr_t b = reinterpret_cast<uintptr_t>(origin);
+		return a > b ? a - b : b - a;
+	}
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE(TrampolineBuffer_)
+
+BOOST_FIXTURE_TEST_CASE(SlotsAreDistinctAndWithinReach, BufferFixture)
+{
+	LPVOID origin = reinterpret_cast<LPVOID>(&Origin);
+	std::set<LPVOID> buffers;
+	for (int i = 0; i < 500; ++i)
+	{
+		LPVOID buffer = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+		BOOST_REQUIRE(buffer != nullptr);
+		BOOST_TEST(reinterpret_cast<uintptr_t>(buffer) % MEMORY_SLOT_SIZE == 0u);
+#if defined(_M_X64) || defined(__x86_64__)
+		BOOST_TEST(Distance(buffer, origin) < 0x40000000u);
+#endif
+		BOOST_TEST(buffers.insert(buffer).second);
+	}
+
+	for (LPVOID buffer : buffers)
+		FreeBuffer(buffer);
+}
+
+BOOST_FIXTURE_TEST_CASE(FreedSlotIsReused, BufferFixture)
+{
+	LPVOID origin = reinterpret_cast<LPVOID>(&Origin);
+	LPVOID first = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+	LPVOID second = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+
+	FreeBuffer(first);
+	BOOST_TEST(AllocateBuffer(origin, MEMORY_SLOT_SIZE) == first);
+
+	FreeBuffer(first);
+	FreeBuffer(second);
+}
+
+BOOST_FIXTURE_TEST_CASE(LargerSlotsComeFromTheirOwnBlocks, BufferFixture)
+{
+	LPVOID origin = reinterpret_cast<LPVOID>(&Origin);
+	LPVOID small = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+	LPVOID medium = AllocateBuffer(origin, MEMORY_SLOT_SIZE + 1);
+	LPVOID large = AllocateBuffer(origin, MEMORY_SLOT_MAX_SIZE);
+	LPVOID nextSmall = AllocateBuffer(origin, 1);
+	BOOST_REQUIRE(small != nullptr);
+	BOOST_REQUIRE(medium != nullptr);
+	BOOST_REQUIRE(large != nullptr);
+	BOOST_TEST(AllocateBuffer(origin, MEMORY_SLOT_MAX_SIZE + 1) == nullptr);
+
+	auto block = [](LPVOID buffer) { return reinterpret_cast<uintptr_t>(buffer) / 0x1000; };
+	BOOST_TEST(reinterpret_cast<uintptr_t>(medium) % (2 * MEMORY_SLOT_SIZE) == 0u);
+	BOOST_TEST(reinterpret_cast<uintptr_t>(large) % MEMORY_SLOT_MAX_SIZE == 0u);
+	BOOST_TEST(block(small) != block(medium));
+	BOOST_TEST(block(small) != block(large));
+	BOOST_TEST(reinterpret_cast<uintptr_t>(nextSmall) == reinterpret_cast<uintptr_t>(small) + MEMORY_SLOT_SIZE);
+
+	FreeBuffer(large);
+	BOOST_TEST(AllocateBuffer(origin, MEMORY_SLOT_MAX_SIZE) == large);
+
+	FreeBuffer(small);
+	FreeBuffer(medium);
+	FreeBuffer(large);
+	FreeBuffer(nextSmall);
+}
+
+BOOST_FIXTURE_TEST_CASE(BlocksNearbyShareAReservation, BufferFixture)
+{
+	// Enough slots for four blocks, which fit in one 64 KB reservation.
+	LPVOID origin = reinterpret_cast<LPVOID>(&Origin);
+	std::vector<LPVOID> buffers;
+	for (size_t i = 0; i < 4 * (0x1000 / MEMORY_SLOT_SIZE - 1); ++i)
+	{
+		buffers.push_back(AllocateBuffer(origin, MEMORY_SLOT_SIZE));
+		BOOST_REQUIRE(buffers.back() != nullptr);
+	}
+
+	auto [lowest, highest] = std::minmax_element(buffers.begin(), buffers.end());
+	BOOST_TEST(reinterpret_cast<uintptr_t>(*highest) - reinterpret_cast<uintptr_t>(*lowest) < 0x10000u);
+
+	for (LPVOID buffer : buffers)
+		FreeBuffer(buffer);
+
+	// Decommitted blocks are committed again in the same place.
+	LPVOID buffer = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+	BOOST_TEST(buffer >= *lowest);
+	BOOST_TEST(buffer <= *highest);
+	FreeBuffer(buffer);
+}
+
+BOOST_FIXTURE_TEST_CASE(DualMappedBuffersAreWrittenThroughAnotherView, BufferFixture)
+{
+	LPVOID origin = reinterpret_cast<LPVOID>(&Origin);
+	LPVOID plain = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+	BOOST_REQUIRE(plain != nullptr);
+	BOOST_TEST(GetWritableBuffer(plain) == plain);
+
+	SetBufferDualMapping(TRUE);
+	LPVOID buffer = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+	BOOST_REQUIRE(buffer != nullptr);
+	BOOST_TEST(IsExecutableAddress(buffer));
+#if defined(_M_X64) || defined(__x86_64__)
+	BOOST_TEST(Distance(buffer, origin) < 0x40000000u);
+#endif
+
+	// Plain and dual-mapped slots never share a block.
+	BOOST_TEST(reinterpret_cast<uintptr_t>(buffer) / 0x1000 != reinterpret_cast<uintptr_t>(plain) / 0x1000);
+
+	auto writable = static_cast<unsigned char*>(GetWritableBuffer(buffer));
+	BOOST_REQUIRE(writable != buffer);
+	writable[0] = 0xC3;
+	BOOST_TEST(*static_cast<unsigned char*>(buffer) == 0xC3);
+
+	FreeBuffer(buffer);
+	SetBufferDualMapping(FALSE);
+	LPVOID next = AllocateBuffer(origin, MEMORY_SLOT_SIZE);
+	BOOST_TEST(GetWritableBuffer(next) == next);
+
+	FreeBuffer(next);
+	FreeBuffer(plain);
+}
+
+BOOST_AUTO_TEST_CASE(BufferFreedAfterUninitializeIsIgnored)
+{
+	InitializeBuffer();
+	LPVOID buffer = AllocateBuffer(reinterpret_cast<LPVOID>(&Origin), MEMORY_SLOT_SIZE);
+	BOOST_REQUIRE(buffer != nullptr);
+	UninitializeBuffer();
+
+	FreeBuffer(buffer);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,495 @@
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "MinHook/src/platform/compat.h"
+#include "MinHook/src/trampoline.h"
+
+#if defined(__x86_64__)
+namespace
+{
+	enum class Kind
+	{
+		Plain,
+		RipRelative,
+		IndirectJump,
+		Call,
+		Jump,
+		ConditionalJump,
+		Loop,
+		Return
+	};
+
+	// An instruction of a generated prologue. Branches keep their relative
+	// destination in the last relSize bytes, RIP relative operands keep their
+	// displacement at dispOffset.
+	struct Instruction
+	{
+		Kind kind;
+		std::vector<uint8_t> bytes;
+		size_t dispOffset;
+		size_t relSize;
+	};
+
+	struct Prologue
+	{
+		std::vector<Instruction> instructions;
+		std::vector<uint8_t> code;
+		uint64_t codeAddress;
+	};
+
+	// What BuildTrampoline() should do, worked out from the generated
+	// instructions rather than by disassembling them.
+	struct Expectation
+	{
+		bool built { false };
+		bool tooLarge { false };
+		bool needsPatchAbove { false };
+		size_t relayOffset { 0 };
+		std::vector<uint8_t> output;
+		std::vector<uint8_t> oldIPs;
+		std::vector<uint8_t> newIPs;
+		std::vector<uint8_t> islandPos;
+		std::vector<uint64_t> islandDests;
+	};
+
+	constexpr uint64_t JumpSize { 5 };
+	constexpr uint64_t ShortJumpSize { 2 };
+	constexpr size_t AbsoluteJumpSize { 14 };
+
+	class PrologueGenerator
+	{
+	public:
+		explicit PrologueGenerator(unsigned seed) : m_random(seed)
+		{
+		}
+
+		Prologue Generate()
+		{
+			Prologue prologue;
+			prologue.codeAddress = 0x7F0000000000 + (m_random() & 0xFFFFFFF);
+			while (prologue.code.size() < 16)
+			{
+				Instruction instruction = GenerateInstruction(prologue.code.size());
+				prologue.code.insert(prologue.code.end(), instruction.bytes.begin(), instruction.bytes.end());
+				prologue.instructions.push_back(std::move(instruction));
+			}
+			return prologue;
+		}
+
+		uint32_t Next()
+		{
+			return m_random();
+		}
+
+	private:
+		Instruction GenerateInstruction(size_t offset)
+		{
+			static const std::vector<std::vector<uint8_t>> plain
+			{
+				{ 0x90 },                               // nop
+				{ 0x55 },                               // push rbp
+				{ 0x41, 0x57 },                         // push r15
+				{ 0x48, 0x89, 0xE5 },                   // mov rbp, rsp
+				{ 0x48, 0x83, 0xEC, 0x20 },             // sub rsp, 0x20
+				{ 0x89, 0xC8 },                         // mov eax, ecx
+				{ 0x31, 0xC0 },                         // xor eax, eax
+				{ 0x66, 0x90 },                         // xchg ax, ax
+				{ 0x0F, 0x1F, 0x44, 0x00, 0x00 },       // nop dword [rax + rax]
+				{ 0xB8, 0x01, 0x02, 0x03, 0x04 },       // mov eax, imm32
+				{ 0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8 }, // mov rax, imm64
+				{ 0xCC }                                // int3
+			};
+
+			switch (m_random() % 10)
+			{
+			case 0:
+			case 1:
+			case 2:
+				return { Kind::Plain, plain[m_random() % plain.size()], 0, 0 };
+			case 3:
+				return GenerateRipRelative();
+			case 4:
+				return { Kind::Call, WithRel32({ 0xE8 }, GenerateRel32(offset, 5)), 0, 4 };
+			case 5:
+				return m_random() % 2
+					? Instruction { Kind::Jump, WithRel8({ 0xEB }, GenerateRel8(offset, 2)), 0, 1 }
+					: Instruction { Kind::Jump, WithRel32({ 0xE9 }, GenerateRel32(offset, 5)), 0, 4 };
+			case 6:
+				return { Kind::Loop, WithRel8({ static_cast<uint8_t>(0xE0 | m_random() % 4) }, GenerateRel8(offset, 2)), 0, 1 };
+			case 7:
+				return m_random() % 2
+					? Instruction { Kind::ConditionalJump, WithRel8({ static_cast<uint8_t>(0x70 | m_random() % 16) }, GenerateRel8(offset, 2)), 0, 1 }
+					: Instruction { Kind::ConditionalJump, WithRel32({ 0x0F, static_cast<uint8_t>(0x80 | m_random() % 16) }, GenerateRel32(offset, 6)), 0, 4 };
+			case 8:
+				return { Kind::Return, { 0xC3 }, 0, 0 };
+			default:
+				return m_random() % 4 ? GenerateRipRelative() : Instruction { Kind::IndirectJump, WithRel32({ 0xFF, 0x25 }, RandomDisplacement()), 2, 0 };
+			}
+		}
+
+		Instruction GenerateRipRelative()
+		{
+			switch (m_random() % 4)
+			{
+			case 0:
+				return { Kind::RipRelative, WithRel32({ 0x8B, 0x05 }, RandomDisplacement()), 2, 0 };        // mov eax, [rip + disp32]
+			case 1:
+				return { Kind::RipRelative, WithRel32({ 0x48, 0x8D, 0x05 }, RandomDisplacement()), 3, 0 };  // lea rax, [rip + disp32]
+			case 2:
+			{
+				Instruction instruction { Kind::RipRelative, WithRel32({ 0xC7, 0x05 }, RandomDisplacement()), 2, 0 };
+				for (int i = 0; i < 4; ++i)                                                                // mov dword [rip + disp32], imm32
+					instruction.bytes.push_back(static_cast<uint8_t>(m_random()));
+				return instruction;
+			}
+			default:
+			{
+				Instruction instruction { Kind::RipRelative, WithRel32({ 0x80, 0x3D }, RandomDisplacement()), 2, 0 };
+				instruction.bytes.push_back(static_cast<uint8_t>(m_random()));                              // cmp byte [rip + disp32], imm8
+				return instruction;
+			}
+			}
+		}
+
+		int32_t RandomDisplacement()
+		{
+			return static_cast<int32_t>(m_random() % 0x20000000) - 0x10000000;
+		}
+
+		// Most branches leave the prologue, some go back into the bytes the
+		// jump to the detour replaces.
+		int8_t GenerateRel8(size_t offset, size_t length)
+		{
+			if (m_random() % 3 == 0)
+				return static_cast<int8_t>(static_cast<int>(m_random() % JumpSize) - static_cast<int>(offset + length));
+			return static_cast<int8_t>(m_random());
+		}
+
+		int32_t GenerateRel32(size_t offset, size_t length)
+		{
+			if (m_random() % 4 == 0)
+				return static_cast<int32_t>(m_random() % JumpSize) - static_cast<int32_t>(offset + length);
+			return RandomDisplacement();
+		}
+
+		static std::vector<uint8_t> WithRel8(std::vector<uint8_t> bytes, int8_t rel)
+		{
+			bytes.push_back(static_cast<uint8_t>(rel));
+			return bytes;
+		}
+
+		static std::vector<uint8_t> WithRel32(std::vector<uint8_t> bytes, int32_t rel)
+		{
+			uint8_t encoded[4];
+			std::memcpy(encoded, &rel, sizeof(rel));
+			bytes.insert(bytes.end(), encoded, encoded + sizeof(encoded));
+			return bytes;
+		}
+
+		std::mt19937 m_random;
+	};
+
+	void Append(std::vector<uint8_t>& output, const void* data, size_t size)
+	{
+		auto bytes = static_cast<const uint8_t*>(data);
+		output.insert(output.end(), bytes, bytes + size);
+	}
+
+	void AppendAbsoluteJump(std::vector<uint8_t>& output, uint64_t destination)
+	{
+		static const uint8_t jump[] { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+		Append(output, jump, sizeof(jump));
+		Append(output, &destination, sizeof(destination));
+	}
+
+	int64_t Relative(const Instruction& instruction)
+	{
+		const uint8_t* rel = instruction.bytes.data() + instruction.bytes.size() - instruction.relSize;
+		if (instruction.relSize == 1)
+			return static_cast<int8_t>(*rel);
+
+		int32_t rel32;
+		std::memcpy(&rel32, rel, sizeof(rel32));
+		return rel32;
+	}
+
+	// A branch the builder has to point at its relocated destination, or at
+	// a branch island after the relay function.
+	struct Branch
+	{
+		const Instruction* instruction;
+		size_t position;
+		uint64_t destination;
+		bool internal;
+	};
+
+	bool IsPadding(const std::vector<uint8_t>& code, size_t begin, size_t end)
+	{
+		if (code[begin] != 0x00 && code[begin] != 0x90 && code[begin] != 0xCC)
+			return false;
+		return std::all_of(code.begin() + begin, code.begin() + end, [&](uint8_t byte) { return byte == code[begin]; });
+	}
+
+	Expectation Expect(const Prologue& prologue, size_t codeSize, uint64_t trampolineAddress, uint64_t detourAddress, size_t outputSize, size_t maxIP)
+	{
+		Expectation expected;
+		size_t oldPos = 0;
+		uint64_t jumpDestination = 0;
+		std::vector<Branch> branches;
+		std::vector<size_t> copySizes;
+		size_t islandsSize = 0;
+		auto instruction = prologue.instructions.begin();
+		for (bool finished = false; !finished; ++instruction)
+		{
+			uint64_t oldAddress = prologue.codeAddress + oldPos;
+			uint64_t newAddress = trampolineAddress + expected.output.size();
+			std::vector<uint8_t> copy;
+			size_t length = 0;
+
+			if (oldPos >= JumpSize)
+			{
+				AppendAbsoluteJump(copy, oldAddress);
+				finished = true;
+			}
+			else
+			{
+				length = instruction->bytes.size();
+				if (oldPos + length > codeSize)
+					return expected;
+
+				copy = instruction->bytes;
+				uint64_t destination = oldAddress + length + (instruction->relSize ? Relative(*instruction) : 0);
+				bool internal = prologue.codeAddress <= destination && destination < prologue.codeAddress + JumpSize;
+				switch (instruction->kind)
+				{
+				case Kind::RipRelative:
+				case Kind::IndirectJump:
+				{
+					int32_t disp;
+					std::memcpy(&disp, copy.data() + instruction->dispOffset, sizeof(disp));
+					int32_t newDisp = static_cast<int32_t>(oldAddress + disp - newAddress);
+					std::memcpy(copy.data() + instruction->dispOffset, &newDisp, sizeof(newDisp));
+					finished = instruction->kind == Kind::IndirectJump;
+					break;
+				}
+				case Kind::Call:
+				{
+					static const uint8_t call[] { 0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08 };
+					copy.clear();
+					Append(copy, call, sizeof(call));
+					Append(copy, &destination, sizeof(destination));
+					break;
+				}
+				case Kind::Jump:
+					if (internal)
+					{
+						jumpDestination = std::max(jumpDestination, destination);
+						branches.push_back({ &*instruction, expected.output.size(), destination, true });
+					}
+					else
+					{
+						copy.clear();
+						AppendAbsoluteJump(copy, destination);
+						finished = oldAddress >= jumpDestination;
+					}
+					break;
+				case Kind::ConditionalJump:
+					if (internal)
+					{
+						jumpDestination = std::max(jumpDestination, destination);
+						branches.push_back({ &*instruction, expected.output.size(), destination, true });
+					}
+					else
+					{
+						uint8_t condition = instruction->bytes[0] == 0x0F ? instruction->bytes[1] & 0x0F : instruction->bytes[0] & 0x0F;
+						copy = { static_cast<uint8_t>(0x71 ^ condition), 0x0E };
+						AppendAbsoluteJump(copy, destination);
+					}
+					break;
+				case Kind::Loop:
+					if (internal)
+						jumpDestination = std::max(jumpDestination, destination);
+					else
+						islandsSize += AbsoluteJumpSize;
+					branches.push_back({ &*instruction, expected.output.size(), destination, internal });
+					break;
+				case Kind::Return:
+					finished = oldAddress >= jumpDestination;
+					break;
+				case Kind::Plain:
+					break;
+				}
+			}
+
+			if (expected.output.size() + copy.size() + islandsSize > outputSize - AbsoluteJumpSize)
+			{
+				expected.tooLarge = true;
+				return expected;
+			}
+
+			if (expected.oldIPs.size() >= maxIP)
+				return expected;
+
+			expected.oldIPs.push_back(static_cast<uint8_t>(oldPos));
+			expected.newIPs.push_back(static_cast<uint8_t>(expected.output.size()));
+			expected.output.insert(expected.output.end(), copy.begin(), copy.end());
+			copySizes.push_back(copy.size());
+			oldPos += length;
+		}
+
+		if (oldPos < JumpSize && (codeSize < JumpSize || !IsPadding(prologue.code, oldPos, JumpSize)))
+		{
+			if (oldPos < ShortJumpSize && (codeSize < ShortJumpSize || !IsPadding(prologue.code, oldPos, ShortJumpSize)))
+				return expected;
+
+			expected.needsPatchAbove = true;
+		}
+
+		expected.relayOffset = expected.output.size();
+		AppendAbsoluteJump(expected.output, detourAddress);
+
+		for (const Branch& branch : branches)
+		{
+			int64_t target = -1;
+			if (branch.internal)
+			{
+				// The relocated instruction it jumps to, or a place in one
+				// that kept its size.
+				uint64_t offset = branch.destination - prologue.codeAddress;
+				for (size_t i = 0; i < expected.oldIPs.size(); ++i)
+				{
+					size_t length = i + 1 < expected.oldIPs.size() ? expected.oldIPs[i + 1] - expected.oldIPs[i] : 0;
+					if (offset == expected.oldIPs[i])
+						target = expected.newIPs[i];
+					else if (offset > expected.oldIPs[i] && offset < expected.oldIPs[i] + length && copySizes[i] == length)
+						target = expected.newIPs[i] + (offset - expected.oldIPs[i]);
+				}
+				if (target < 0)
+					return expected;
+			}
+			else
+			{
+				target = expected.output.size();
+				expected.islandPos.push_back(static_cast<uint8_t>(target));
+				expected.islandDests.push_back(branch.destination);
+				AppendAbsoluteJump(expected.output, branch.destination);
+			}
+
+			const Instruction& instruction = *branch.instruction;
+			int64_t rel = target - static_cast<int64_t>(branch.position + instruction.bytes.size());
+			uint8_t* relField = expected.output.data() + branch.position + instruction.bytes.size() - instruction.relSize;
+			if (instruction.relSize == 1)
+			{
+				if (rel < INT8_MIN || rel > INT8_MAX)
+					return expected;
+				*relField = static_cast<uint8_t>(rel);
+			}
+			else
+			{
+				int32_t rel32 = static_cast<int32_t>(rel);
+				std::memcpy(relField, &rel32, sizeof(rel32));
+			}
+		}
+
+		expected.built = true;
+		return expected;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(TrampolineBuilder_)
+
+BOOST_AUTO_TEST_CASE(RandomProloguesAreRelocatedAsExpected)
+{
+	PrologueGenerator generator(1);
+	size_t built = 0;
+	for (int i = 0; i < 20000; ++i)
+	{
+		Prologue prologue = generator.Generate();
+
+		// Some copies end inside the instructions that have to be relocated.
+		size_t codeSize = prologue.code.size();
+		if (generator.Next() % 4 == 0)
+			codeSize = generator.Next() % codeSize;
+
+		size_t outputSize = size_t(32) << (generator.Next() % 3);
+		size_t maxIP = generator.Next() % 8 ? TRAMPOLINE_MAX_IPS : 1 + generator.Next() % TRAMPOLINE_MAX_IPS;
+		uint64_t trampolineAddress = prologue.codeAddress - 0x10000000 + (generator.Next() % 0x20000000 & ~0x1Full);
+		uint64_t detourAddress = 0x500000000000 + generator.Next();
+		Expectation expected = Expect(prologue, codeSize, trampolineAddress, detourAddress, outputSize, maxIP);
+
+		std::vector<uint8_t> output(outputSize, 0xAB);
+		std::vector<uint8_t> oldIPs(maxIP);
+		std::vector<uint8_t> newIPs(maxIP);
+		TRAMPOLINE_BUILD build {};
+		build.pCode = prologue.code.data();
+		build.codeSize = static_cast<UINT>(codeSize);
+		build.codeAddress = prologue.codeAddress;
+		build.trampolineAddress = trampolineAddress;
+		build.detourAddress = detourAddress;
+		build.pOutput = output.data();
+		build.outputSize = static_cast<UINT>(outputSize);
+		build.pOldIPs = oldIPs.data();
+		build.pNewIPs = newIPs.data();
+		build.maxIP = static_cast<UINT>(maxIP);
+
+		bool result = BuildTrampoline(&build) != FALSE;
+		BOOST_TEST_INFO("prologue " << i);
+		BOOST_REQUIRE_EQUAL(result, expected.built);
+		BOOST_REQUIRE_EQUAL(build.tooLarge != FALSE, expected.tooLarge);
+		if (!result)
+			continue;
+
+		++built;
+		BOOST_TEST_INFO("prologue " << i);
+		BOOST_REQUIRE_EQUAL(build.needsPatchAbove != FALSE, expected.needsPatchAbove);
+		BOOST_REQUIRE_EQUAL(build.nIP, expected.oldIPs.size());
+		BOOST_TEST(std::vector<uint8_t>(oldIPs.begin(), oldIPs.begin() + build.nIP) == expected.oldIPs, boost::test_tools::per_element());
+		BOOST_TEST(std::vector<uint8_t>(newIPs.begin(), newIPs.begin() + build.nIP) == expected.newIPs, boost::test_tools::per_element());
+		BOOST_REQUIRE_EQUAL(build.size, expected.output.size());
+		BOOST_TEST(build.relayOffset == expected.relayOffset);
+		BOOST_REQUIRE_EQUAL(build.nIsland, expected.islandPos.size());
+		BOOST_TEST(std::vector<uint8_t>(build.islandPos, build.islandPos + build.nIsland) == expected.islandPos, boost::test_tools::per_element());
+		BOOST_TEST(std::vector<uint64_t>(build.islandDests, build.islandDests + build.nIsland) == expected.islandDests, boost::test_tools::per_element());
+		BOOST_TEST(std::vector<uint8_t>(output.begin(), output.begin() + build.size) == expected.output, boost::test_tools::per_element());
+	}
+
+	// Enough prologues get through for the comparison to mean something.
+	BOOST_TEST(built > 2000u);
+}
+
+BOOST_AUTO_TEST_CASE(CodeEndingAfterTheRelocatedInstructionsIsEnough)
+{
+	// push rbp; mov rbp, rsp; sub rsp, 0x20
+	const uint8_t code[] { 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20 };
+	uint8_t output[64];
+	uint8_t oldIPs[TRAMPOLINE_MAX_IPS];
+	uint8_t newIPs[TRAMPOLINE_MAX_IPS];
+	TRAMPOLINE_BUILD build {};
+	build.pCode = code;
+	build.codeSize = sizeof(code);
+	build.codeAddress = 0x7F0000001000;
+	build.trampolineAddress = 0x7F0000200000;
+	build.detourAddress = 0x7F0000300000;
+	build.pOutput = output;
+	build.outputSize = sizeof(output);
+	build.pOldIPs = oldIPs;
+	build.pNewIPs = newIPs;
+	build.maxIP = TRAMPOLINE_MAX_IPS;
+
+	BOOST_REQUIRE(BuildTrampoline(&build));
+	BOOST_TEST(build.nIP == 4u);
+	BOOST_TEST(oldIPs[3] == sizeof(code));
+
+	uint64_t resume;
+	std::memcpy(&resume, output + sizeof(code) + 6, sizeof(resume));
+	BOOST_TEST(resume == build.codeAddress + sizeof(code));
+
+	build.codeSize = sizeof(code) - 1;
+	BOOST_TEST(!BuildTrampoline(&build));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
@@ -0,0 +1,285 @@
+#include <boost/test/unit_test.hpp>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include "VirtualFileSystem.h"
+
+using TestHooks::FileDisposition;
+using TestHooks::FileStatus;
+using TestHooks::HandleKey;
+using TestHooks::VirtualFileSystem;
+
+BOOST_TEST_DONT_PRINT_LOG_VALUE(TestHooks::FileStatus)
+
+namespace
+{
+	constexpr unsigned int ReadWrite { TestHooks::FileAccessRead | TestHooks::FileAccessWrite };
+
+	std::string ReadAll(HandleKey handle)
+	{
+		std::string result;
+		char buffer[7];
+		size_t bytesRead;
+		while (VirtualFileSystem::Read(handle, buffer, sizeof(buffer), bytesRead) == FileStatus::Success && bytesRead != 0)
+			result.append(buffer, bytesRead);
+		return result;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(VirtualFileSystem_)
+
+BOOST_AUTO_TEST_CASE(OnlyRootsAndAddedFilesAreVirtual)
+{
+	VirtualFileSystem fileSystem;
+	fileSystem.AddRoot(L"C:\\Fixtures");
+	fileSystem.AddFile(L"D:\\config.ini", "x", 1);
+
+	BOOST_TEST(fileSystem.IsVirtual(L"C:\\Fixtures\\a.bin"));
+	BOOST_TEST(fileSystem.IsVirtual(L"c:/fixtures//sub/b.bin"));
+	BOOST_TEST(fileSystem.IsVirtual(L"\\\\?\\C:\\Fixtures\\a.bin"));
+	BOOST_TEST(fileSystem.IsVirtual(L"d:\\CONFIG.ini"));
+	BOOST_TEST(!fileSystem.IsVirtual(L"C:\\Fixtures"));
+	BOOST_TEST(!fileSystem.IsVirtual(L"C:\\FixturesOther\\a.bin"));
+	BOOST_TEST(!fileSystem.IsVirtual(L"D:\\other.ini"));
+}
+
+BOOST_AUTO_TEST_CASE(WriteThenReadBack)
+{
+	VirtualFileSystem fileSystem;
+	fileSystem.AddRoot(L"C:\\Fixtures");
+
+	HandleKey handle;
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\log.txt", ReadWrite, FileDisposition::CreateNew, handle) == FileStatus::Success);
+
+	size_t bytesWritten;
+	BOOST_TEST(VirtualFileSystem::Write(handle, "hello ", 6, bytesWritten) == FileStatus::Success);
+	BOOST_TEST(VirtualFileSystem::Write(handle, "world", 5, bytesWritten) == FileStatus::Success);
+	BOOST_TEST(bytesWritten == 5u);
+	BOOST_TEST(VirtualFileSystem::Close(handle) == FileStatus::Success);
+
+	BOOST_REQUIRE(fileSystem.Open(L"C:/FIXTURES/log.txt", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle) == FileStatus::Success);
+	BOOST_TEST(ReadAll(handle) == "hello world");
+
+	size_t bytesRead;
+	char buffer[5];
+	BOOST_TEST(VirtualFileSystem::ReadAt(handle, 6, buffer, sizeof(buffer), bytesRead) == FileStatus::Success);
+	BOOST_TEST(std::string(buffer, bytesRead) == "world");
+	BOOST_TEST(VirtualFileSystem::Write(handle, "!", 1, bytesWritten) == FileStatus::AccessDenied);
+	BOOST_TEST(VirtualFileSystem::Close(handle) == FileStatus::Success);
+	BOOST_TEST(VirtualFileSystem::Close(handle) == FileStatus::InvalidHandle);
+}
+
+BOOST_AUTO_TEST_CASE(Dispositions)
+{
+	VirtualFileSystem fileSystem;
+	fileSystem.AddRoot(L"C:\\Fixtures");
+	fileSystem.AddFile(L"C:\\Fixtures\\existing.bin", "abc", 3);
+
+	HandleKey handle;
+	BOOST_TEST(fileSystem.Open(L"C:\\Fixtures\\existing.bin", ReadWrite, FileDisposition::CreateNew, handle) == FileStatus::FileExists);
+	BOOST_TEST(handle == 0u);
+	BOOST_TEST(fileSystem.Open(L"C:\\Fixtures\\missing.bin", ReadWrite, FileDisposition::OpenExisting, handle) == FileStatus::FileNotFound);
+	BOOST_TEST(fileSystem.Open(L"C:\\Fixtures\\missing.bin", ReadWrite, FileDisposition::TruncateExisting, handle) == FileStatus::FileNotFound);
+	BOOST_TEST(fileSystem.Open(L"C:\\Elsewhere\\new.bin", ReadWrite, FileDisposition::CreateAlways, handle) == FileStatus::FileNotFound);
+
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\existing.bin", ReadWrite, FileDisposition::OpenAlways, handle) == FileStatus::AlreadyExists);
+	BOOST_TEST(ReadAll(handle) == "abc");
+	VirtualFileSystem::Close(handle);
+
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\existing.bin", ReadWrite, FileDisposition::CreateAlways, handle) == FileStatus::AlreadyExists);
+	BOOST_TEST(ReadAll(handle) == "");
+	VirtualFileSystem::Close(handle);
+
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\created.bin", ReadWrite, FileDisposition::OpenAlways, handle) == FileStatus::Success);
+	VirtualFileSystem::Close(handle);
+	BOOST_TEST(fileSystem.Exists(L"C:\\Fixtures\\created.bin"));
+}
+
+BOOST_AUTO_TEST_CASE(WritesSpanExtentsAndLeaveHolesZeroed)
+{
+	VirtualFileSystem fileSystem;
+	fileSystem.AddRoot(L"C:\\Fixtures");
+
+	HandleKey handle;
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\sparse.bin", ReadWrite, FileDisposition::CreateNew, handle) == FileStatus::Success);
+
+	std::vector<unsigned char> block(TestHooks::VirtualFile::ExtentSize + 100, 0xab);
+	size_t bytesWritten;
+	uint64_t offset = 3 * TestHooks::VirtualFile::ExtentSize - 50;
+	BOOST_TEST(VirtualFileSystem::WriteAt(handle, offset, block.data(), block.size(), bytesWritten) == FileStatus::Success);
+	VirtualFileSystem::Close(handle);
+
+	std::vector<unsigned char> contents = fileSystem.ReadContents(L"C:\\Fixtures\\sparse.bin");
+	BOOST_REQUIRE(contents.size() == offset + block.size());
+	BOOST_TEST(std::all_of(contents.begin(), contents.begin() + offset, [](unsigned char value) { return value == 0; }));
+	BOOST_TEST(std::all_of(contents.begin() + offset, contents.end(), [](unsigned char value) { return value == 0xab; }));
+}
+
+BOOST_AUTO_TEST_CASE(WritesFarPastTheEndOnlyAllocateWhatTheyTouch)
+{
+	VirtualFileSystem fileSystem;
+	fileSystem.AddRoot(L"C:\\Fixtures");
+
+	HandleKey handle;
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\far.bin", ReadWrite, FileDisposition::CreateNew, handle) == FileStatus::Success);
+
+	size_t bytesWritten;
+	uint64_t offset = TestHooks::VirtualFile::MaxSize - 4;
+	BOOST_TEST(VirtualFileSystem::WriteAt(handle, offset, "tail", 4, bytesWritten) == FileStatus::Success);
+	BOOST_TEST(bytesWritten == 4u);
+
+	char buffer[8] = {};
+	size_t bytesRead;
+	BOOST_TEST(VirtualFileSystem::ReadAt(handle, offset - 4, buffer, sizeof(buffer), bytesRead) == FileStatus::Success);
+	BOOST_TEST(bytesRead == 8u);
+	BOOST_TEST(std::string(buffer, 8) == std::string("\0\0\0\0tail", 8));
+	BOOST_TEST(VirtualFileSystem::ReadAt(handle, 0, buffer, sizeof(buffer), bytesRead) == FileStatus::Success);
+	BOOST_TEST(std::string(buffer, 8) == std::string(8, '\0'));
+	VirtualFileSystem::Close(handle);
+}
+
+BOOST_AUTO_TEST_CASE(WritesEndingPastMaxSizeOrWrappingFail)
+{
+	VirtualFileSystem fileSystem;
+	fileSystem.AddRoot(L"C:\\Fixtures");
+
+	HandleKey handle;
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\huge.bin", ReadWrite, FileDisposition::CreateNew, handle) == FileStatus::Success);
+
+	size_t bytesWritten = 1;
+	BOOST_TEST(VirtualFileSystem::WriteAt(handle, TestHooks::VirtualFile::MaxSize - 2, "data", 4, bytesWritten) == FileStatus::DiskFull);
+	BOOST_TEST(bytesWritten == 0u);
+	BOOST_TEST(VirtualFileSystem::WriteAt(handle, std::numeric_limits<uint64_t>::max() - 1, "data", 4, bytesWritten) == FileStatus::InvalidParameter);
+	BOOST_TEST(bytesWritten == 0u);
+
+	// A failed write does not move the file position.
+	BOOST_TEST(VirtualFileSystem::Write(handle, "data", 4, bytesWritten) == FileStatus::Success);
+	VirtualFileSystem::Close(handle);
+	BOOST_TEST(fileSystem.ReadContents(L"C:\\Fixtures\\huge.bin").size() == 4u);
+}
+
+BOOST_AUTO_TEST_CASE(OpenHandlesOutliveRemovedFiles)
+{
+	VirtualFileSystem fileSystem;
+	fileSystem.AddFile(L"C:\\data.bin", "payload", 7);
+
+	HandleKey handle;
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\data.bin", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle) == FileStatus::Success);
+	BOOST_TEST(fileSystem.RemoveFile(L"C:\\data.bin"));
+	BOOST_TEST(!fileSystem.Exists(L"C:\\data.bin"));
+	BOOST_TEST(ReadAll(handle) == "payload");
+	VirtualFileSystem::Close(handle);
+}
+
+BOOST_AUTO_TEST_CASE(ForeignHandlesAreNotFiles)
+{
+	size_t bytesRead;
+	char buffer[4];
+	BOOST_TEST(VirtualFileSystem::Read(HandleKey { 0x1234 }, buffer, sizeof(buffer), bytesRead) == FileStatus::InvalidHandle);
+
+	HandleKey other = TestHooks::FakeHandleTable::Instance().Allocate(std::make_unique<int>(0));
+	BOOST_TEST(VirtualFileSystem::Read(other, buffer, sizeof(buffer), bytesRead) == FileStatus::InvalidHandle);
+	BOOST_TEST(VirtualFileSystem::Close(other) == FileStatus::InvalidHandle);
+	TestHooks::FakeHandleTable::Instance().Release(other);
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentWritersToSeparateFiles)
+{
+	constexpr int ThreadCount { 4 };
+	VirtualFileSystem fileSystem;
+	fileSystem.AddRoot(L"C:\\Fixtures");
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < ThreadCount; ++t)
+	{
+		threads.emplace_back([&, t] {
+			std::wstring path = L"C:\\Fixtures\\thread" + std::to_wstring(t) + L".bin";
+			HandleKey handle;
+			fileSystem.Open(path, ReadWrite, FileDisposition::CreateNew, handle);
+			for (int i = 0; i < 1000; ++i)
+			{
+				size_t bytesWritten;
+				VirtualFileSystem::Write(handle, &i, sizeof(i), bytesWritten);
+			}
+			VirtualFileSystem::Close(handle);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	for (int t = 0; t < ThreadCount; ++t)
+	{
+		std::vector<unsigned char> contents = fileSystem.ReadContents(L"C:\\Fixtures\\thread" + std::to_wstring(t) + L".bin");
+		BOOST_REQUIRE(contents.size() == 1000 * sizeof(int));
+		int last;
+		std::memcpy(&last, contents.data() + contents.size() - sizeof(int), sizeof(int));
+		BOOST_TEST(last == 999);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(MountedFixturesAreReadOnlyAndMappedOnRead)
+{
+	std::filesystem::path hostDirectory = std::filesystem::temp_directory_path() / "TestHooksMountedFixtures";
+	std::filesystem::remove_all(hostDirectory);
+	std::filesystem::create_directories(hostDirectory / "device");
+	std::ofstream(hostDirectory / "small.bin", std::ios::binary) << "fixture";
+	std::ofstream(hostDirectory / "empty.bin", std::ios::binary);
+	{
+		std::ofstream large(hostDirectory / "device" / "capture.bin", std::ios::binary);
+		for (int i = 0; i < 100000; ++i)
+			large.write(reinterpret_cast<const char*>(&i), sizeof(i));
+	}
+
+	VirtualFileSystem fileSystem;
+	BOOST_TEST(fileSystem.MountDirectory(L"C:\\Fixtures", hostDirectory) == 3u);
+	BOOST_TEST(fileSystem.IsVirtual(L"C:\\Fixtures\\missing.bin"));
+
+	HandleKey handle;
+	BOOST_REQUIRE(fileSystem.Open(L"c:/fixtures/SMALL.bin", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle) == FileStatus::Success);
+	BOOST_TEST(ReadAll(handle) == "fixture");
+	VirtualFileSystem::Close(handle);
+
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\empty.bin", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle) == FileStatus::Success);
+	BOOST_TEST(ReadAll(handle) == "");
+	VirtualFileSystem::Close(handle);
+
+	BOOST_REQUIRE(fileSystem.Open(L"C:\\Fixtures\\device\\capture.bin", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle) == FileStatus::Success);
+	int value = 0;
+	size_t bytesRead;
+	BOOST_TEST(VirtualFileSystem::ReadAt(handle, 4 * 76543, &value, sizeof(value), bytesRead) == FileStatus::Success);
+	BOOST_TEST(bytesRead == sizeof(value));
+	BOOST_TEST(value == 76543);
+	BOOST_TEST(VirtualFileSystem::ReadAt(handle, 4 * 100000 - 2, &value, sizeof(value), bytesRead) == FileStatus::Success);
+	BOOST_TEST(bytesRead == 2u);
+	size_t bytesWritten;
+	BOOST_TEST(VirtualFileSystem::Write(handle, &value, sizeof(value), bytesWritten) == FileStatus::AccessDenied);
+	VirtualFileSystem::Close(handle);
+
+	BOOST_TEST(fileSystem.Open(L"C:\\Fixtures\\small.bin", ReadWrite, FileDisposition::OpenExisting, handle) == FileStatus::AccessDenied);
+	BOOST_TEST(fileSystem.Open(L"C:\\Fixtures\\small.bin", ReadWrite, FileDisposition::CreateAlways, handle) == FileStatus::AccessDenied);
+	BOOST_TEST(fileSystem.Open(L"C:\\Fixtures\\new.bin", ReadWrite, FileDisposition::CreateNew, handle) == FileStatus::AccessDenied);
+	BOOST_TEST(fileSystem.Open(L"C:\\Fixtures\\missing.bin", TestHooks::FileAccessRead, FileDisposition::OpenExisting, handle) == FileStatus::FileNotFound);
+
+	std::filesystem::remove_all(hostDirectory);
+}
+
+BOOST_AUTO_TEST_CASE(MountedSizeHoldsUntilTheFileIsMapped)
+{
+	std::filesystem::path hostPath = std::filesystem::temp_directory_path() / "TestHooksMountedSize.bin";
+	std::ofstream(hostPath, std::ios::binary) << "fixture";
+
+	TestHooks::VirtualFile file(hostPath, 7);
+	std::ofstream(hostPath, std::ios::binary | std::ios::app) << " grown";
+	BOOST_TEST(file.Size() == 7u);
+
+	char buffer[32];
+	BOOST_TEST(file.ReadAt(0, buffer, sizeof(buffer)) == 13u);
+	BOOST_TEST(file.Size() == 13u);
+
+	std::filesystem::remove(hostPath);
+}
+
+BOOST_AUTO_TEST_SUITE_END()